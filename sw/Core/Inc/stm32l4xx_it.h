@@ -63,6 +63,7 @@ void DMA1_Channel3_IRQHandler(void);
 void DMA1_Channel4_IRQHandler(void);
 void DMA1_Channel5_IRQHandler(void);
 void I2C2_EV_IRQHandler(void);
+void I2C2_ER_IRQHandler(void);
 void USART3_IRQHandler(void);
 void DMA2_Channel1_IRQHandler(void);
 void DMA2_Channel2_IRQHandler(void);
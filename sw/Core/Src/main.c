@@ -817,7 +817,12 @@ static void MX_TIM5_Init(void) {
 		Error_Handler();
 	}
 	/* USER CODE BEGIN TIM5_Init 2 */
-
+	// micros() counts 1us ticks: apb1 timers run at twice the bus clock when the bus is divided down
+	uint32_t tim_clock = HAL_RCC_GetPCLK1Freq();
+	if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
+		tim_clock *= 2;
+	htim5.Instance->PSC = tim_clock / 1000000 - 1; // 1MHz
+	htim5.Instance->EGR = TIM_EGR_UG;              // load the prescaler now, it is buffered
 	/* USER CODE END TIM5_Init 2 */
 }
 
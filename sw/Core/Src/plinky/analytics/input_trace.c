@@ -0,0 +1,489 @@
+#include "input_trace.h"
+#include "hardware/ram.h"
+#include "hardware/touchstrips.h"
+#include "synth/arp.h"
+#include "synth/audio.h"
+#include "synth/sequencer.h"
+#include "synth/strings.h"
+#include "synth/synth.h"
+#include "synth/time.h"
+
+#define RING_SIZE 2048 // power of 2
+#define US_PER_TICK (SAMPLES_PER_TICK * 1000000 / SAMPLE_RATE)
+#define MAX_RECORD_SIZE                                                                                                \
+	(1 + 2 + 1 + NUM_TOUCH_READINGS * 2 + 1 + TRACE_MAX_ADC * 2 + 1 + TRACE_MAX_MIDI * 5 + 6 + 6 + 2 + 4)
+
+typedef struct TraceMidi {
+	u8 status;
+	u8 d1;
+	u8 d2;
+	u16 age;
+} TraceMidi;
+
+// the inputs of one tick. The adc, accel and encoder values carry over between ticks, a record only holds changes
+typedef struct TraceTick {
+	u8 flags;
+	s16 time_dev;
+	u8 num_touch;
+	u16 touch[NUM_TOUCH_READINGS];
+	u8 adc_mask;
+	u16 adc[TRACE_MAX_ADC];
+	u8 num_midi;
+	TraceMidi midi[TRACE_MAX_MIDI];
+	s8 detents;
+	bool pressed;
+	float acc;
+	s16 accel[3];
+	u16 cv_age;
+	u32 hash;
+} TraceTick;
+
+static_assert(RING_SIZE >= 2 * MAX_RECORD_SIZE, "a replay has to be able to buffer two records");
+
+volatile TraceMode trace_mode = TRACE_OFF;
+
+static u8 ring[RING_SIZE];
+static volatile u16 write_pos;
+static volatile u16 read_pos;
+static volatile bool replay_eof;
+
+static TraceHeader header;
+static TraceStatus status;
+
+// audio interrupt
+static volatile TraceMode tick_mode = TRACE_OFF;
+static bool tick_open;
+static bool starting;
+static TraceTick tick;
+static u32 tick_time;
+static u32 prev_tick_time;
+static u8 touch_pos;
+static u8 midi_pos;
+static u8 adc_read;  // channels read this tick
+static u8 adc_known; // channels recorded since the start
+static bool accel_known;
+static u32 hash;
+
+static u16 ring_used(void) {
+	return (u16)(write_pos - read_pos);
+}
+
+static void stop(TraceError error) {
+	if (!status.error)
+		status.error = error;
+	tick_mode = TRACE_OFF;
+	trace_mode = TRACE_OFF;
+}
+
+// == MAIN LOOP == //
+
+// a recording writes its own header, a replay starts once the host has sent enough of the trace. Stopping keeps the
+// recorded bytes around until they have been read
+bool trace_start(TraceMode mode, const TraceHeader* replay_header) {
+	if (mode == TRACE_OFF) {
+		trace_mode = TRACE_OFF;
+		return true;
+	}
+	if (mode == TRACE_REPLAY && (replay_header->magic != TRACE_MAGIC || replay_header->version != TRACE_VERSION
+	                             || !replay_header->hash_ticks))
+		return false;
+	trace_mode = TRACE_OFF;
+	// the audio interrupt is done with the previous trace once its tick sees the mode change
+	while (tick_mode != TRACE_OFF)
+		;
+	// the reset loads the preset from flash on the replaying unit, edits that only live in ram would be missing there
+	save_ram_edits();
+	memset(&status, 0, sizeof(status));
+	status.mode = mode;
+	read_pos = write_pos = 0;
+	replay_eof = false;
+	if (mode == TRACE_RECORD) {
+		header.magic = TRACE_MAGIC;
+		header.version = TRACE_VERSION;
+		header.preset_id = sys_params.preset_id;
+		header.hash_ticks = TRACE_HASH_TICKS;
+		header.seed = micros();
+		touch_noise_floor(header.sensor_floor);
+		memcpy(ring, &header, sizeof(header));
+		write_pos = sizeof(header);
+	}
+	else
+		header = *replay_header;
+	starting = true;
+	// make sure everything is set up before the audio interrupt can see the new mode
+	memory_barrier();
+	trace_mode = mode;
+	return true;
+}
+
+// recorded bytes, in order
+u16 trace_read(u8* dst, u16 max_len) {
+	u16 pos = read_pos;
+	u16 len = mini((u16)(write_pos - pos), max_len);
+	for (u16 i = 0; i < len; ++i)
+		dst[i] = ring[(pos + i) & (RING_SIZE - 1)];
+	// make sure the bytes are read before the producer can overwrite them
+	memory_barrier();
+	read_pos = pos + len;
+	status.bytes += len;
+	return len;
+}
+
+// bytes to replay, false if they don't fit yet
+bool trace_write(const u8* src, u16 len) {
+	if (trace_mode != TRACE_REPLAY || replay_eof)
+		return false;
+	if (!len) {
+		replay_eof = true;
+		return true;
+	}
+	u16 pos = write_pos;
+	if ((u16)(pos - read_pos) + len > RING_SIZE)
+		return false;
+	for (u16 i = 0; i < len; ++i)
+		ring[(pos + i) & (RING_SIZE - 1)] = src[i];
+	// make sure the bytes are written before the consumer can see them
+	memory_barrier();
+	write_pos = pos + len;
+	status.bytes += len;
+	return true;
+}
+
+void trace_get_status(TraceStatus* dst) {
+	*dst = status;
+	dst->mode = trace_mode;
+	dst->hash = hash;
+}
+
+// == RECORDS == //
+
+static u8* put(u8* dst, const void* src, u8 size) {
+	memcpy(dst, src, size);
+	return dst + size;
+}
+
+static u8* encode_tick(u8* dst) {
+	*dst++ = tick.flags;
+	if (tick.flags & TR_TIME)
+		dst = put(dst, &tick.time_dev, 2);
+	if (tick.flags & TR_TOUCH) {
+		*dst++ = tick.num_touch;
+		dst = put(dst, tick.touch, tick.num_touch * 2);
+	}
+	if (tick.flags & TR_ADC) {
+		*dst++ = tick.adc_mask;
+		for (u8 channel = 0; channel < TRACE_MAX_ADC; ++channel)
+			if (tick.adc_mask & (1 << channel))
+				dst = put(dst, &tick.adc[channel], 2);
+	}
+	if (tick.flags & TR_MIDI) {
+		*dst++ = tick.num_midi;
+		for (u8 i = 0; i < tick.num_midi; ++i) {
+			TraceMidi* event = &tick.midi[i];
+			*dst++ = event->status;
+			*dst++ = event->d1;
+			*dst++ = event->d2;
+			dst = put(dst, &event->age, 2);
+		}
+	}
+	if (tick.flags & TR_ENCODER) {
+		*dst++ = tick.detents;
+		*dst++ = tick.pressed;
+		dst = put(dst, &tick.acc, 4);
+	}
+	if (tick.flags & TR_ACCEL)
+		dst = put(dst, tick.accel, 6);
+	if (tick.flags & TR_CV_CLOCK)
+		dst = put(dst, &tick.cv_age, 2);
+	if (tick.flags & TR_HASH)
+		dst = put(dst, &tick.hash, 4);
+	return dst;
+}
+
+static bool get(const u8** src, const u8* end, void* dst, u8 size) {
+	if (*src + size > end)
+		return false;
+	memcpy(dst, *src, size);
+	*src += size;
+	return true;
+}
+
+static u16 decode_tick(const u8* src, u16 len) {
+	const u8* start = src;
+	const u8* end = src + len;
+	if (!get(&src, end, &tick.flags, 1))
+		return 0;
+	tick.time_dev = 0;
+	tick.num_touch = 0;
+	tick.num_midi = 0;
+	if ((tick.flags & TR_TIME) && !get(&src, end, &tick.time_dev, 2))
+		return 0;
+	if (tick.flags & TR_TOUCH) {
+		if (!get(&src, end, &tick.num_touch, 1) || tick.num_touch > NUM_TOUCH_READINGS
+		    || !get(&src, end, tick.touch, tick.num_touch * 2))
+			return 0;
+	}
+	if (tick.flags & TR_ADC) {
+		if (!get(&src, end, &tick.adc_mask, 1))
+			return 0;
+		for (u8 channel = 0; channel < TRACE_MAX_ADC; ++channel)
+			if ((tick.adc_mask & (1 << channel)) && !get(&src, end, &tick.adc[channel], 2))
+				return 0;
+	}
+	if (tick.flags & TR_MIDI) {
+		if (!get(&src, end, &tick.num_midi, 1) || tick.num_midi > TRACE_MAX_MIDI)
+			return 0;
+		for (u8 i = 0; i < tick.num_midi; ++i) {
+			TraceMidi* event = &tick.midi[i];
+			if (!(get(&src, end, &event->status, 1) && get(&src, end, &event->d1, 1) && get(&src, end, &event->d2, 1)
+			      && get(&src, end, &event->age, 2)))
+				return 0;
+		}
+	}
+	if ((tick.flags & TR_ENCODER)
+	    && !(get(&src, end, &tick.detents, 1) && get(&src, end, &tick.pressed, 1) && get(&src, end, &tick.acc, 4)))
+		return 0;
+	if ((tick.flags & TR_ACCEL) && !get(&src, end, tick.accel, 6))
+		return 0;
+	if ((tick.flags & TR_CV_CLOCK) && !get(&src, end, &tick.cv_age, 2))
+		return 0;
+	if ((tick.flags & TR_HASH) && !get(&src, end, &tick.hash, 4))
+		return 0;
+	return src - start;
+}
+
+static void push_record(void) {
+	u8 record[MAX_RECORD_SIZE];
+	u16 size = encode_tick(record) - record;
+	u16 pos = write_pos;
+	// a trace with a gap is useless => stop
+	if ((u16)(pos - read_pos) + size > RING_SIZE) {
+		stop(TRACE_ERR_OVERFLOW);
+		return;
+	}
+	for (u16 i = 0; i < size; ++i)
+		ring[(pos + i) & (RING_SIZE - 1)] = record[i];
+	memory_barrier();
+	write_pos = pos + size;
+}
+
+// the next record gets copied out of the ring first, that keeps the decoding simple
+static bool pull_record(void) {
+	u8 record[MAX_RECORD_SIZE];
+	u16 pos = read_pos;
+	u16 avail = mini(ring_used(), MAX_RECORD_SIZE);
+	for (u16 i = 0; i < avail; ++i)
+		record[i] = ring[(pos + i) & (RING_SIZE - 1)];
+	u16 size = decode_tick(record, avail);
+	if (!size) {
+		// the host either didn't keep up or the trace is over
+		if (!replay_eof)
+			stop(TRACE_ERR_UNDERRUN);
+		else
+			stop(avail ? TRACE_ERR_CORRUPT : TRACE_OK);
+		return false;
+	}
+	memory_barrier();
+	read_pos = pos + size;
+	return true;
+}
+
+// == AUDIO INTERRUPT == //
+
+static u32 hash_words(u32 h, const void* src, u16 num_words) {
+	const u32* word = (const u32*)src;
+	while (num_words--)
+		h = (h ^ *word++) * 16777619; // fnv-1a, a word at a time
+	return h;
+}
+
+// both modes start from the same state, as far as it can be reset
+static void reset_synth(void) {
+	if (tick_mode == TRACE_REPLAY)
+		load_preset(header.preset_id, false);
+	srand(header.seed);
+	seq_stop();
+	clock_reset();
+	arp_reset();
+	strings_clear_midi();
+	delay_clear();
+	reverb_clear();
+	touchstrips_restart(header.sensor_floor);
+	prev_tick_time = tick_time;
+	adc_known = 0;
+	accel_known = false;
+	tick.pressed = false;
+	tick.detents = 0;
+	tick.acc = 0.f;
+	hash = 2166136261;
+}
+
+void trace_tick_start(void) {
+	u32 now = micros();
+	tick_time = now;
+	// every path through the tick closes it, this catches one that doesn't
+	if (tick_open) {
+		tick_open = false;
+		stop(TRACE_ERR_BROKEN);
+	}
+	tick_mode = trace_mode;
+	if (tick_mode == TRACE_OFF)
+		return;
+	// a replay waits until the ring is half full or the whole trace is in
+	if (starting && tick_mode == TRACE_REPLAY && ring_used() < RING_SIZE / 2 && !replay_eof) {
+		tick_mode = TRACE_OFF;
+		return;
+	}
+	if (starting) {
+		starting = false;
+		reset_synth();
+	}
+	if (tick_mode == TRACE_REPLAY && !pull_record())
+		return;
+	tick_open = true;
+	touch_pos = 0;
+	midi_pos = 0;
+	adc_read = 0;
+	if (tick_mode == TRACE_RECORD) {
+		s32 time_dev = (s32)(now - prev_tick_time) - US_PER_TICK;
+		tick.flags = time_dev && status.ticks ? TR_TIME : 0;
+		tick.time_dev = clampi(time_dev, -32768, 32767);
+		tick.num_touch = 0;
+		tick.adc_mask = 0;
+		tick.num_midi = 0;
+	}
+	else
+		tick_time = status.ticks ? prev_tick_time + US_PER_TICK + tick.time_dev : now;
+	prev_tick_time = tick_time;
+}
+
+void trace_tick_end(const u32* audio_out) {
+	if (!tick_open)
+		return;
+	tick_open = false;
+	hash = hash_words(hash, audio_out, SAMPLES_PER_TICK);
+	hash = hash_words(hash, &clock_32nds_q21, 1);
+	hash = hash_words(hash, envs.env1_lvl, NUM_VOICES);
+	hash = hash_words(hash, oscs.pitch, sizeof(oscs.pitch) / 4);
+	status.ticks++;
+	if (tick_mode == TRACE_RECORD) {
+		if (status.ticks % header.hash_ticks == 0) {
+			tick.flags |= TR_HASH;
+			tick.hash = hash;
+		}
+		push_record();
+		return;
+	}
+	if (tick.flags & TR_HASH) {
+		status.hashes_checked++;
+		if (tick.hash != hash && status.error != TRACE_ERR_DIVERGED) {
+			status.error = TRACE_ERR_DIVERGED;
+			status.first_diverged_tick = status.ticks - 1;
+		}
+	}
+}
+
+u32 trace_now(void) {
+	return tick_time;
+}
+
+// == INPUTS == //
+
+static u16 age(u32 time) {
+	return clampi((s32)(tick_time - time), 0, 65535);
+}
+
+bool trace_touch(bool ready, u16* value) {
+	if (tick_mode == TRACE_RECORD && ready && tick.num_touch < NUM_TOUCH_READINGS) {
+		tick.flags |= TR_TOUCH;
+		tick.touch[tick.num_touch++] = *value;
+	}
+	else if (tick_mode == TRACE_REPLAY) {
+		if (touch_pos >= tick.num_touch)
+			return false;
+		*value = tick.touch[touch_pos++];
+		return true;
+	}
+	return ready;
+}
+
+// recorded adc values hold for the whole tick, so that every reader sees the same value. Reads outside of the tick
+// (calibration and init in the main loop) get the live value and don't touch the record of the tick
+u16 trace_adc(u8 channel, u16 raw) {
+	if (!tick_open)
+		return raw;
+	u8 bit = 1 << channel;
+	if (tick_mode == TRACE_RECORD && !(adc_read & bit)) {
+		adc_read |= bit;
+		if (!(adc_known & bit) || raw != tick.adc[channel]) {
+			adc_known |= bit;
+			tick.adc[channel] = raw;
+			tick.adc_mask |= bit;
+			tick.flags |= TR_ADC;
+		}
+	}
+	return tick.adc[channel];
+}
+
+void trace_midi(u8 midi_status, u8 d1, u8 d2, u32 time) {
+	if (tick_mode != TRACE_RECORD)
+		return;
+	if (tick.num_midi == TRACE_MAX_MIDI) {
+		stop(TRACE_ERR_OVERFLOW);
+		return;
+	}
+	tick.flags |= TR_MIDI;
+	tick.midi[tick.num_midi++] = (TraceMidi){midi_status, d1, d2, age(time)};
+}
+
+bool trace_replay_midi(u8* midi_status, u8* d1, u8* d2, u32* time) {
+	if (tick_mode != TRACE_REPLAY || midi_pos >= tick.num_midi)
+		return false;
+	TraceMidi* event = &tick.midi[midi_pos++];
+	*midi_status = event->status;
+	*d1 = event->d1;
+	*d2 = event->d2;
+	*time = tick_time - event->age;
+	return true;
+}
+
+// the acceleration only matters on ticks with detents
+void trace_encoder(s8* detents, bool* pressed, float* acc) {
+	if (tick_mode == TRACE_RECORD) {
+		if (*detents || *pressed != tick.pressed) {
+			tick.flags |= TR_ENCODER;
+			tick.detents = *detents;
+			tick.pressed = *pressed;
+			tick.acc = *acc;
+		}
+	}
+	else if (tick_mode == TRACE_REPLAY) {
+		*detents = (tick.flags & TR_ENCODER) ? tick.detents : 0;
+		*pressed = tick.pressed;
+		*acc = tick.acc;
+	}
+}
+
+void trace_accel(s16* raw) {
+	if (tick_mode == TRACE_RECORD && (!accel_known || memcmp(raw, tick.accel, 6))) {
+		accel_known = true;
+		tick.flags |= TR_ACCEL;
+		memcpy(tick.accel, raw, 6);
+	}
+	else if (tick_mode == TRACE_REPLAY)
+		memcpy(raw, tick.accel, 6);
+}
+
+bool trace_cv_clock(bool pulse, u32* time) {
+	if (tick_mode == TRACE_RECORD && pulse) {
+		tick.flags |= TR_CV_CLOCK;
+		tick.cv_age = age(*time);
+	}
+	else if (tick_mode == TRACE_REPLAY) {
+		if (!(tick.flags & TR_CV_CLOCK))
+			return false;
+		*time = tick_time - tick.cv_age;
+		return true;
+	}
+	return pulse;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "utils.h"
+
+// records every external input of the audio tick into a compact trace, or plays a trace back in place of the live
+// inputs. The audio interrupt logs or consumes one record per tick through a lock-free ring, the main loop moves the
+// bytes over the bulk protocol (see bulk_protocol.c). Recording and replay start from the same reset (preset, rand
+// seed, clock, sequencer, effects, touch scan), so a trace that starts from silence replays to the same hashes on the
+// unit it was recorded on. Another unit gets the same inputs, but its calibration and settings may change the sound
+
+// trace = TraceHeader, then one record per tick. A record is a u8 TraceFlags mask, followed by the sections it names
+typedef enum TraceFlags {
+	TR_TIME = 1 << 0,     // s16 deviation of the tick start from US_PER_TICK after the previous one
+	TR_TOUCH = 1 << 1,    // u8 n, u16 raw tsc values[n] in the order they were read
+	TR_ADC = 1 << 2,      // u8 channel mask, u16 raw value of every channel in the mask
+	TR_MIDI = 1 << 3,     // u8 n, n * (u8 status, u8 d1, u8 d2, u16 age in micros)
+	TR_ENCODER = 1 << 4,  // s8 detents, u8 pressed, float acceleration
+	TR_ACCEL = 1 << 5,    // s16 raw[3]
+	TR_CV_CLOCK = 1 << 6, // u16 age of the clock pulse in micros
+	TR_HASH = 1 << 7,     // u32 hash of the audio and synth state of all ticks so far
+} TraceFlags;
+
+typedef enum TraceMode {
+	TRACE_OFF,
+	TRACE_RECORD,
+	TRACE_REPLAY,
+} TraceMode;
+
+typedef enum TraceError {
+	TRACE_OK,
+	TRACE_ERR_OVERFLOW, // recording: the host didn't keep up
+	TRACE_ERR_UNDERRUN, // replay: the host didn't keep up
+	TRACE_ERR_CORRUPT,  // replay: the trace ends in the middle of a record
+	TRACE_ERR_BROKEN,   // a tick didn't reach trace_tick_end()
+	TRACE_ERR_DIVERGED, // replay: a hash didn't match
+} TraceError;
+
+#define TRACE_MAGIC 0x52544c50 // "PLTR"
+#define TRACE_VERSION 1
+#define TRACE_HASH_TICKS 64
+#define TRACE_MAX_MIDI 64
+#define TRACE_MAX_ADC 8 // the channel mask is a u8
+
+typedef struct TraceHeader {
+	u32 magic;
+	u8 version;
+	u8 preset_id;
+	u16 hash_ticks;
+	u32 seed;
+	u16 sensor_floor[2 * NUM_TOUCH_READINGS]; // lifetime minimum of every touch sensor, sets the noise floor
+} TraceHeader;
+
+typedef struct TraceStatus {
+	u8 mode;
+	u8 error;
+	u16 hashes_checked;
+	u32 ticks;
+	u32 bytes;
+	u32 first_diverged_tick;
+	u32 hash;
+} TraceStatus;
+
+extern volatile TraceMode trace_mode;
+
+// main loop
+bool trace_start(TraceMode mode, const TraceHeader* header);
+u16 trace_read(u8* dst, u16 max_len);
+bool trace_write(const u8* src, u16 len); // replay data, len 0 marks the end of the trace
+void trace_get_status(TraceStatus* status);
+
+// audio interrupt
+void trace_tick_start(void);
+void trace_tick_end(const u32* audio_out);
+u32 trace_now(void); // micros() at the start of the tick, replayed along with the inputs
+
+// every input is read live first, then recorded or replaced by the replayed value
+bool trace_touch(bool ready, u16* value);
+u16 trace_adc(u8 channel, u16 raw);
+void trace_midi(u8 status, u8 d1, u8 d2, u32 time);
+bool trace_replay_midi(u8* status, u8* d1, u8* d2, u32* time);
+void trace_encoder(s8* detents, bool* pressed, float* acc);
+void trace_accel(s16* raw);
+bool trace_cv_clock(bool pulse, u32* time);
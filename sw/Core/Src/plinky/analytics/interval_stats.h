@@ -0,0 +1,37 @@
+#pragma once
+#include "utils.h"
+
+// collects the intervals between recurring events, to measure their rate and jitter
+
+typedef struct IntervalStats {
+	u32 n;
+	u32 total;
+	u64 total_sq;
+	u32 max;
+} IntervalStats;
+
+static inline void is_reset(IntervalStats* s) {
+	s->n = 0;
+	s->total = 0;
+	s->total_sq = 0;
+	s->max = 0;
+}
+
+static inline void is_add(IntervalStats* s, u32 interval) {
+	s->n++;
+	s->total += interval;
+	s->total_sq += (u64)interval * interval;
+	s->max = maxi(s->max, interval);
+}
+
+static inline float is_mean(IntervalStats* s) {
+	return s->n ? (float)s->total / s->n : 0.f;
+}
+
+// standard deviation of the intervals
+static inline float is_jitter(IntervalStats* s) {
+	if (!s->n)
+		return 0.f;
+	float mean = is_mean(s);
+	return sqrtf(maxf((float)s->total_sq / s->n - mean * mean, 0.f));
+}
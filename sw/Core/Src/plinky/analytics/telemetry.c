@@ -0,0 +1,169 @@
+#include "telemetry.h"
+#include "analytics/tick_counter.h"
+#include "hardware/ram.h"
+#include "synth/lfos.h"
+#include "synth/params.h"
+#include "synth/sampler.h"
+#include "synth/sequencer.h"
+#include "synth/synth.h"
+#include "synth/time.h"
+
+#define RING_SIZE 2048 // power of 2
+#define RECORD_HEADER_SIZE 3
+#define VOICE_SIZE (4 + 2 + 4)
+
+static u8 ring[RING_SIZE];
+static volatile u16 write_pos;
+static volatile u16 read_pos;
+static volatile u16 records_dropped; // only written by the producer
+static u16 drops_reported;
+
+static volatile u8 subscribed;
+static u8 tick_interval;
+static u8 ticks_left;
+static u8 next_param;
+static TickCounter tick_counter;
+
+static u16 section_size(TelemetrySection section) {
+	switch (section) {
+	case TELEM_VOICES:
+		return NUM_VOICES * VOICE_SIZE;
+	case TELEM_LFOS:
+		return NUM_LFOS * 4;
+	case TELEM_PARAMS:
+		return 1 + TELEM_PARAMS_PER_TICK * 4;
+	case TELEM_CLOCK:
+		return 4 + 1;
+	case TELEM_GRAINS:
+		return NUM_GRAINS * 2;
+	case TELEM_TICKS:
+		return 4 + 4;
+	case TELEM_PRESET:
+		return 1 + 2 + 2;
+	default:
+		return 0;
+	}
+}
+
+static u16 record_size(u8 section_mask) {
+	u16 size = RECORD_HEADER_SIZE;
+	for (u8 section = 1; section & TELEM_ALL; section <<= 1)
+		if (section_mask & section)
+			size += section_size(section);
+	return size;
+}
+
+static_assert(NUM_VOICES * VOICE_SIZE + NUM_LFOS * 4 + 1 + TELEM_PARAMS_PER_TICK * 4 + 5 + NUM_GRAINS * 2 + 8 + 5
+                  <= TELEM_MAX_RECORD_SIZE - RECORD_HEADER_SIZE,
+              "telemetry record too large");
+static_assert(NUM_PARAMS % TELEM_PARAMS_PER_TICK == 0, "param windows have to line up");
+
+// mask 0 stops the stream
+void telemetry_subscribe(u8 section_mask, u8 interval) {
+	if (section_mask & TELEM_TICKS)
+		tc_init();
+	tc_reset(&tick_counter);
+	tick_interval = maxi(interval, 1);
+	ticks_left = 0;
+	subscribed = section_mask & TELEM_ALL;
+}
+
+// == AUDIO INTERRUPT == //
+
+void telemetry_tick_start(void) {
+	if (subscribed & TELEM_TICKS)
+		tc_start(&tick_counter);
+}
+
+static u8* put(u8* dst, const void* src, u8 size) {
+	memcpy(dst, src, size);
+	return dst + size;
+}
+
+void telemetry_tick(void) {
+	u8 mask = subscribed;
+	if (!mask)
+		return;
+	if (mask & TELEM_TICKS)
+		tc_stop(&tick_counter);
+	if (ticks_left) {
+		ticks_left--;
+		return;
+	}
+	ticks_left = tick_interval - 1;
+
+	u8 record[TELEM_MAX_RECORD_SIZE];
+	u8* dst = record;
+	u16 tick = synth_tick;
+	dst = put(dst, &tick, 2);
+	*dst++ = mask;
+	if (mask & TELEM_VOICES)
+		for (u8 voice_id = 0; voice_id < NUM_VOICES; ++voice_id) {
+			dst = put(dst, &envs.env1_lvl[voice_id], 4);
+			dst = put(dst, &envs.env2_lvl16[voice_id], 2);
+			dst = put(dst, &oscs.pitch[voice_id][0], 4);
+		}
+	if (mask & TELEM_LFOS)
+		dst = put(dst, lfo_cur, sizeof(lfo_cur));
+	// the params take turns, all of them come around every NUM_PARAMS / TELEM_PARAMS_PER_TICK records
+	if (mask & TELEM_PARAMS) {
+		*dst++ = next_param;
+		for (u8 i = 0; i < TELEM_PARAMS_PER_TICK; ++i) {
+			s32 val = param_val(next_param + i);
+			dst = put(dst, &val, 4);
+		}
+		next_param = (next_param + TELEM_PARAMS_PER_TICK) % NUM_PARAMS;
+	}
+	if (mask & TELEM_CLOCK) {
+		dst = put(dst, &clock_32nds_q21, 4);
+		*dst++ = seq_cur_step();
+	}
+	if (mask & TELEM_GRAINS)
+		dst = put(dst, grain_buf_end, sizeof(grain_buf_end));
+	if (mask & TELEM_TICKS) {
+		u32 avg = tick_counter.n ? tick_counter.total / tick_counter.n : 0;
+		dst = put(dst, &avg, 4);
+		dst = put(dst, &tick_counter.max, 4);
+		tc_reset(&tick_counter);
+	}
+	if (mask & TELEM_PRESET) {
+		*dst++ = sys_params.preset_id;
+		dst = put(dst, &preset_switch_ticks, 2);
+		dst = put(dst, &preset_switch_max_ticks, 2);
+	}
+
+	// no room => drop the whole record, the host sees the gap in the ticks
+	u16 size = dst - record;
+	u16 pos = write_pos;
+	if ((u16)(pos - read_pos) + size > RING_SIZE) {
+		records_dropped++;
+		return;
+	}
+	for (u16 i = 0; i < size; ++i)
+		ring[(pos + i) & (RING_SIZE - 1)] = record[i];
+	// make sure the record is written before the consumer can see it
+	memory_barrier();
+	write_pos = pos + size;
+}
+
+// == MAIN LOOP == //
+
+u16 telemetry_read(u8* dst, u16 max_len, u16* dropped) {
+	u16 pos = read_pos;
+	u16 len = 0;
+	while ((u16)(write_pos - pos) >= RECORD_HEADER_SIZE) {
+		u16 size = record_size(ring[(pos + 2) & (RING_SIZE - 1)]);
+		if (len + size > max_len)
+			break;
+		for (u16 i = 0; i < size; ++i)
+			dst[len++] = ring[(pos + i) & (RING_SIZE - 1)];
+		pos += size;
+	}
+	// make sure the records are read before the producer can overwrite them
+	memory_barrier();
+	read_pos = pos;
+	u16 total_dropped = records_dropped;
+	*dropped = total_dropped - drops_reported;
+	drops_reported = total_dropped;
+	return len;
+}
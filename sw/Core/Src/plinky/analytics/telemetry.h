@@ -0,0 +1,29 @@
+#pragma once
+#include "utils.h"
+
+// streams internal synth state to the host at tick rate. The audio interrupt serializes the subscribed sections into
+// a lock-free ring, the main loop drains it into frames of the bulk protocol (see bulk_protocol.c)
+
+// sections of a record, in the order they appear. Every record starts with u16 synth_tick and u8 section mask
+typedef enum TelemetrySection {
+	TELEM_VOICES = 1 << 0, // per voice: float env1_lvl, u16 env2_lvl16, s32 pitch
+	TELEM_LFOS = 1 << 1,   // s32 lfo_cur[NUM_LFOS]
+	TELEM_PARAMS = 1 << 2, // u8 first param, s32 param_val() of TELEM_PARAMS_PER_TICK consecutive params
+	TELEM_CLOCK = 1 << 3,  // u32 clock_32nds_q21, u8 sequencer step
+	TELEM_GRAINS = 1 << 4, // s16 grain_buf_end[NUM_GRAINS]
+	TELEM_TICKS = 1 << 5,  // u32 average and u32 max cycles of the audio tick since the previous record
+	TELEM_PRESET = 1 << 6, // u8 preset id, u16 ticks the latest preset switch took, u16 slowest switch since boot
+	TELEM_ALL = (1 << 7) - 1,
+} TelemetrySection;
+
+#define TELEM_PARAMS_PER_TICK 8
+#define TELEM_MAX_RECORD_SIZE 256 // a record with all sections fits in one frame
+
+void telemetry_subscribe(u8 section_mask, u8 tick_interval);
+
+// audio interrupt
+void telemetry_tick_start(void);
+void telemetry_tick(void);
+
+// main loop: copies whole records into dst, returns the number of bytes
+u16 telemetry_read(u8* dst, u16 max_len, u16* dropped);
@@ -9,6 +9,7 @@ typedef struct TickCounter {
 } TickCounter;
 
 static inline void tc_init(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // the cycle counter only runs with tracing enabled
 	DWT->CTRL |= 1;
 	DWT->CYCCNT = 0; // reset the counter
 }
@@ -3,9 +3,13 @@
 
 
 __STATIC_FORCEINLINE u16 SATURATEU16(s32 a) {
+#ifdef __arm__
 	int tmp;
 	asm("usat %0, %1, %2" : "=r"(tmp) : "I"(16), "r"(a));
 	return tmp;
+#else
+	return a < 0 ? 0 : a > 65535 ? 65535 : a;
+#endif
 }
 
 // 16 bit unsigned input, looked up in a 1024 entry table and linearly interpolated
@@ -88,7 +92,7 @@ float lpf_k(int x) {
 	return table_interp(lpf_ks, x);
 }
     
-const float pitches[1025] = { // 10 octaves, 8th of a semitone steps
+FAST_DATA const float pitches[1025] = { // 10 octaves, 8th of a semitone steps
     0.02480314f,0.02498288f,0.02516391f,0.02534626f,0.02552993f,0.02571493f,0.02590127f,0.02608896f,0.02627801f,0.02646843f,0.02666024f,0.02685343f,0.02704802f,0.02724402f,0.02744144f,0.02764029f, 
     0.02784058f,0.02804233f,0.02824554f,0.02845021f,0.02865638f,0.02886403f,0.02907319f,0.02928387f,0.02949607f,0.02970981f,0.02992510f,0.03014195f,0.03036037f,0.03058038f,0.03080197f,0.03102518f, 
     0.03125000f,0.03147645f,0.03170454f,0.03193429f,0.03216569f,0.03239878f,0.03263356f,0.03287003f,0.03310822f,0.03334814f,0.03358979f,0.03383320f,0.03407837f,0.03432531f,0.03457405f,0.03482459f, 
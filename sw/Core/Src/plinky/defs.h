@@ -34,8 +34,9 @@
 #define NUM_PATTERNS 24
 #define NUM_SAMPLES 8
 
-#define MAX_PTN_STEPS 64
-#define PTN_STEPS_PER_QTR (MAX_PTN_STEPS / 4)
+#define MAX_PTN_STEPS 64 // a pattern's four flash quarters, a longer one would overwrite the next pattern
+#define PTN_STEPS_PER_QTR 16
+#define MAX_PTN_QUARTERS (MAX_PTN_STEPS / PTN_STEPS_PER_QTR)
 #define PTN_SUBSTEPS 8
 
 #define NUM_VOICES 8
@@ -122,14 +123,6 @@ typedef struct ConditionalStep {
 	bool advance_step;
 } ConditionalStep;
 
-typedef struct Osc {
-	u32 phase;
-	u32 prev_sample;
-	s32 phase_diff;
-	s32 goal_phase_diff;
-	s32 pitch;
-} Osc;
-
 typedef struct GrainPair {
 	int fpos24;
 	int pos[2];
@@ -142,29 +135,37 @@ typedef struct GrainPair {
 	int outflags;
 } GrainPair;
 
-typedef struct Voice {
-	// oscillator (sampler only uses the pitch value)
-	Osc osc[OSCS_PER_VOICE];
+// voice state is split into blocks per engine, each field is an array over the voices. The state a kernel works on
+// is contiguous across voices and the other engine's state stays out of the cache
+
+typedef struct OscBlock {
+	u32 phase[NUM_VOICES][OSCS_PER_VOICE];
+	s32 phase_diff[NUM_VOICES][OSCS_PER_VOICE];
+	s32 goal_phase_diff[NUM_VOICES][OSCS_PER_VOICE];
+	u32 prev_sample[NUM_VOICES][OSCS_PER_VOICE];
+	s32 pitch[NUM_VOICES][OSCS_PER_VOICE]; // the sampler only uses the pitch
+} OscBlock;
+
+typedef struct EnvBlock {
 	// env 1
-	float env1_lvl;
-	bool env1_decaying;
-	ValueSmoother lpg_smoother[2];
-	// env 1 visuals
-	float env1_peak;
-	float env1_norm;
-	// env 2
-	float env2_lvl;
-	u16 env2_lvl16;
-	bool env2_decaying;
+	float env1_lvl[NUM_VOICES];
+	ValueSmoother lpg_smoother[NUM_VOICES][2];
 	// noise
-	float noise_lvl;
-	// sampler state
-	GrainPair grain_pair[2];
-	int playhead8;
-	u8 slice_id;
-	u16 touch_pos_start;
-	ValueSmoother touch_pos;
-} Voice;
+	float noise_lvl[NUM_VOICES];
+	// env 2
+	float env2_lvl[NUM_VOICES];
+	u16 env2_lvl16[NUM_VOICES];
+	bool env1_decaying[NUM_VOICES];
+	bool env2_decaying[NUM_VOICES];
+} EnvBlock;
+
+typedef struct SamplerBlock {
+	GrainPair grain_pair[NUM_VOICES][2];
+	int playhead8[NUM_VOICES];
+	ValueSmoother touch_pos[NUM_VOICES];
+	u16 touch_pos_start[NUM_VOICES];
+	u8 slice_id[NUM_VOICES];
+} SamplerBlock;
 
 typedef struct SysParams {
 	u8 preset_id;
@@ -175,8 +176,10 @@ typedef struct SysParams {
 	u8 volume_msb : 3; // add 3 bits to make editing in 0-1024 range possible
 	u8 cv_quant : 2;
 	u8 reverse_encoder : 1;
-	u8 paddy : 2;
-	u8 pad[16 - 6];
+	u8 touch_scan : 2;
+	u8 clock_smoothing : 2;
+	u8 preset_glide : 2;
+	u8 pad[16 - 7];
 	u8 version;
 } SysParams;
 
@@ -184,7 +187,7 @@ typedef struct Preset {
 	s16 params[96][8];
 	u8 pad;
 	u8 seq_start;
-	u8 seq_len;
+	u8 seq_len; // 0 => MAX_PTN_STEPS
 	u8 paddy[3];
 	u8 version;
 	u8 category;
@@ -336,6 +339,30 @@ typedef enum CVQuantType {
 	NUM_CV_QUANT_TYPES,
 } CVQuantType;
 
+typedef enum TouchScanStrategy {
+	SCAN_TWO_PASS,   // quick check of all strips in parallel, touched strips get read again individually
+	SCAN_SEQUENTIAL, // every strip gets read individually
+	SCAN_ADAPTIVE,   // touched strips get read every frame, untouched strips every few frames (slower first touch)
+	NUM_SCAN_STRATEGIES,
+} TouchScanStrategy;
+
+// bandwidth of the loop that follows an external clock
+typedef enum ClockSmoothing {
+	CLK_SMOOTH_NORMAL,
+	CLK_SMOOTH_FAST, // follows tempo changes quickly, lets more jitter through
+	CLK_SMOOTH_SLOW, // for very jittery clocks, takes a few beats to follow tempo changes
+	NUM_CLOCK_SMOOTHINGS,
+} ClockSmoothing;
+
+// time the continuous params take to move to the values of a newly loaded preset
+typedef enum PresetGlide {
+	GLIDE_OFF,
+	GLIDE_SHORT,
+	GLIDE_MEDIUM,
+	GLIDE_LONG,
+	NUM_PRESET_GLIDES,
+} PresetGlide;
+
 // PITCH
 
 typedef enum Scale {
@@ -555,6 +582,15 @@ typedef enum Param {
 
 // clang-format on
 
+// HARDWARE
+
+typedef enum I2cClient {
+	I2C_NONE,
+	I2C_OLED,
+	I2C_ACCEL,
+	I2C_CODEC,
+} I2cClient;
+
 // MEMORY
 
 typedef enum FlashCalibType {
@@ -566,7 +602,7 @@ typedef enum FlashCalibType {
 
 typedef enum RamSegment {
 	SEG_PRESET,
-	SEG_PAT0,
+	SEG_PAT0, // pattern quarters, see ram.c
 	SEG_PAT1,
 	SEG_PAT2,
 	SEG_PAT3,
@@ -802,6 +838,25 @@ static const char* const cv_quant_name[NUM_CV_QUANT_TYPES] = {
     [CVQ_SCALE] = "Scale",
 };
 
+static const char* const touch_scan_name[NUM_SCAN_STRATEGIES] = {
+    [SCAN_TWO_PASS] = "2-Pass",
+    [SCAN_SEQUENTIAL] = "Seq",
+    [SCAN_ADAPTIVE] = "Adapt",
+};
+
+static const char* const clock_smoothing_name[NUM_CLOCK_SMOOTHINGS] = {
+    [CLK_SMOOTH_NORMAL] = "Normal",
+    [CLK_SMOOTH_FAST] = "Fast",
+    [CLK_SMOOTH_SLOW] = "Slow",
+};
+
+static const char* const preset_glide_name[NUM_PRESET_GLIDES] = {
+    [GLIDE_OFF] = "Off",
+    [GLIDE_SHORT] = "50ms",
+    [GLIDE_MEDIUM] = "250ms",
+    [GLIDE_LONG] = "1s",
+};
+
 static const char* const lfo_shape_name[NUM_LFO_SHAPES] = {
     [LFO_TRI] = "Triangle",
     [LFO_SIN] = "Sine",
@@ -1,5 +1,6 @@
 #pragma once
 #include "utils.h"
+#include "hardware/i2c_bus.h"
 
 extern I2C_HandleTypeDef hi2c2;
 
@@ -36,20 +37,16 @@ extern I2C_HandleTypeDef hi2c2;
 
 #define I2C_ADDRESS (0x3c << 1)
 
-static inline void ssd130x_wait(void) {
-	while (HAL_I2C_GetState(&hi2c2) == HAL_I2C_STATE_BUSY_TX)
-		;
-}
-
 static inline void ssd130x_command(unsigned char c) {
 	u8 buf[2] = {0, c};
+	i2c_bus_acquire(I2C_OLED);
 	HAL_I2C_Master_Transmit(&hi2c2, I2C_ADDRESS, buf, 2, 20);
+	i2c_bus_release();
 	HAL_Delay(1);
 }
 
-static inline void ssd130x_flip(u8* buffer) {
-	ssd130x_wait();
-	HAL_I2C_Master_Transmit(&hi2c2, I2C_ADDRESS, buffer, OLED_BUFFER_SIZE, 500);
+static inline u8 ssd130x_col_offset(void) {
+	return hw_version == HW_PLINKY ? 0 : 4;
 }
 
 static void ssd130x_init() {
@@ -86,7 +83,7 @@ static void ssd130x_init() {
 	ssd130x_command(SSD130X_DEACTIVATE_SCROLL);
 
 	// prepare flip
-	u8 col_offset = hw_version == HW_PLINKY ? 0 : 4;
+	u8 col_offset = ssd130x_col_offset();
 	ssd130x_command(SSD130X_COLUMNADDR);
 	ssd130x_command(col_offset);                  // Column start address (0 = reset)
 	ssd130x_command(OLED_WIDTH - 1 + col_offset); // Column end address (127 = reset)
@@ -7,9 +7,24 @@ static u32 debug_start_time = 0;
 static bool debug_view_active = false;
 static bool debug_buffer_active = false;
 
+#define OLED_PAGES (OLED_HEIGHT / 8)
+
+// one page of the display, as it gets transmitted
+typedef struct OledPage {
+	u8 control; // always 0x40
+	u8 data[OLED_WIDTH];
+} OledPage;
+
 static u8 oled[OLED_BUFFER_SIZE];
 static u8 oled_debug[OLED_BUFFER_SIZE];
 
+// transmission
+static OledPage sent_pages[OLED_PAGES]; // last transmitted frame, pages are sent straight from here
+static u8 page_cmd[7];
+static volatile u8 dirty_pages = 0; // pages still to be sent
+static bool sending_cmd = false;
+static bool resend_all = true;
+
 u8* oled_buffer(void) {
 	return (debug_buffer_active ? oled_debug : oled) + 1;
 }
@@ -24,21 +39,95 @@ void oled_init(void) {
 	memset(&oled[1], 0, OLED_BUFFER_SIZE - 1);
 	oled_debug[0] = 0x40;
 	memset(&oled_debug[1], 0, OLED_BUFFER_SIZE - 1);
+	for (u8 page = 0; page < OLED_PAGES; ++page)
+		sent_pages[page].control = 0x40;
 }
 
 void oled_clear(void) {
 	memset(&oled[1], 0, OLED_BUFFER_SIZE - 1);
 }
 
+// == TRANSMISSION == //
+
+// a dirty page gets sent in two transfers: a command that sets the address window to the page, followed by the
+// page data. The next transfer gets started from the completion callback of the previous one, the bus is released
+// after the last page has been sent
+
+static void send_next_transfer(void);
+
+static void transfer_done(bool success) {
+	// something went wrong, make sure the next flip sends the full display
+	if (!success) {
+		resend_all = true;
+		dirty_pages = 0;
+		i2c_bus_release();
+		return;
+	}
+	if (sending_cmd)
+		sending_cmd = false;
+	else {
+		dirty_pages &= dirty_pages - 1; // page done
+		sending_cmd = true;
+	}
+	send_next_transfer();
+}
+
+static void send_next_transfer(void) {
+	if (!dirty_pages) {
+		i2c_bus_release();
+		return;
+	}
+	u8 page = __builtin_ctz(dirty_pages);
+	bool started;
+	if (sending_cmd) {
+		u8 col_offset = ssd130x_col_offset();
+		page_cmd[0] = 0x00; // command stream
+		page_cmd[1] = SSD130X_COLUMNADDR;
+		page_cmd[2] = col_offset;
+		page_cmd[3] = OLED_WIDTH - 1 + col_offset;
+		page_cmd[4] = SSD130X_PAGEADDR;
+		page_cmd[5] = page;
+		page_cmd[6] = page;
+		started = i2c_bus_transmit_async(I2C_ADDRESS, page_cmd, sizeof(page_cmd), transfer_done);
+	}
+	else
+		started = i2c_bus_transmit_async(I2C_ADDRESS, (u8*)&sent_pages[page], sizeof(OledPage), transfer_done);
+	if (!started)
+		transfer_done(false);
+}
+
+// compare the buffer to what was sent last and start sending the pages that changed, this only blocks while the
+// previous flip is still being sent
+static void flip(const u8* buffer) {
+	i2c_bus_acquire(I2C_OLED);
+	u8 pages = 0;
+	for (u8 page = 0; page < OLED_PAGES; ++page) {
+		const u8* src = buffer + 1 + page * OLED_WIDTH;
+		if (resend_all || memcmp(sent_pages[page].data, src, OLED_WIDTH)) {
+			memcpy(sent_pages[page].data, src, OLED_WIDTH);
+			pages |= 1 << page;
+		}
+	}
+	resend_all = false;
+	// nothing changed
+	if (!pages) {
+		i2c_bus_release();
+		return;
+	}
+	dirty_pages = pages;
+	sending_cmd = true;
+	send_next_transfer();
+}
+
 void oled_flip() {
 	// debug timeout
 	if (debug_view_active && (millis() - debug_start_time >= DEBUG_DISPLAY_TIME))
 		debug_view_active = false;
-	ssd130x_flip(debug_view_active ? oled_debug : oled);
+	flip(debug_view_active ? oled_debug : oled);
 }
 
 void oled_flip_with_buffer(u8* buffer) {
-	ssd130x_flip(buffer);
+	flip(buffer);
 }
 
 // DEBUG
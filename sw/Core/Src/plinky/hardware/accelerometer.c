@@ -1,5 +1,7 @@
 #include "accelerometer.h"
 #include "../../lis2dh12_reg.h"
+#include "analytics/input_trace.h"
+#include "i2c_bus.h"
 #include "ram.h"
 #include "synth/params.h"
 
@@ -34,6 +36,7 @@ float accel_get_axis(bool y_axis) {
 
 void init_accel(void) {
 	HAL_Delay(8);
+	i2c_bus_acquire(I2C_ACCEL);
 	u8 whoamI = 0;
 	lis2dh12_device_id_get(&accelerometer, &whoamI);
 	if (whoamI != LIS2DH12_ID) {
@@ -46,30 +49,37 @@ void init_accel(void) {
 		lis2dh12_temperature_meas_set(&accelerometer, LIS2DH12_TEMP_DISABLE);
 		lis2dh12_operating_mode_set(&accelerometer, LIS2DH12_HR_12bit);
 	}
+	i2c_bus_release();
 }
 
 void accel_read(void) {
 	if (!accelerometer.handle)
 		return;
+	// the oled is sending, try again next loop
+	if (!i2c_bus_try_acquire(I2C_ACCEL))
+		return;
 	lis2dh12_reg_t reg;
 	lis2dh12_xl_data_ready_get(&accelerometer, &reg.byte);
-	if (!reg.byte)
-		return;
-	s16 tmp[3] = {0, 0, 0};
-	lis2dh12_acceleration_raw_get(&accelerometer, tmp);
-	accel_raw[0] = tmp[0];
-	accel_raw[1] = tmp[1];
-	accel_raw[2] = tmp[2];
+	if (reg.byte) {
+		s16 tmp[3] = {0, 0, 0};
+		lis2dh12_acceleration_raw_get(&accelerometer, tmp);
+		accel_raw[0] = tmp[0];
+		accel_raw[1] = tmp[1];
+		accel_raw[2] = tmp[2];
+	}
+	i2c_bus_release();
 }
 
 void accel_tick(void) {
 	static u16 accel_counter;
 	// full sensitivity equals 200% scaling
 	float accel_sens_f = 2 * (sys_params.accel_sens - 100) / 100.f;
+	s16 raw[3] = {accel_raw[0], accel_raw[1], accel_raw[2]};
+	trace_accel(raw);
 	// detect inverted sensor
-	bool axis_swap = accel_raw[2] > 4000;
+	bool axis_swap = raw[2] > 4000;
 	for (u8 axis_id = 0; axis_id < 2; ++axis_id) {
-		float f = accel_raw[axis_id ^ axis_swap] / (float)(1 << 14) * accel_sens_f;
+		float f = raw[axis_id ^ axis_swap] / (float)(1 << 14) * accel_sens_f;
 		if (!axis_id) {
 			if (!axis_swap)
 				f = -f; // reverse x
@@ -1,4 +1,5 @@
 #include "adc_dac.h"
+#include "analytics/input_trace.h"
 #include "encoder.h"
 #include "flash.h"
 #include "gfx/gfx.h"
@@ -21,6 +22,8 @@ extern TIM_HandleTypeDef htim3;
 
 #define NUM_CV_INS 6
 
+static_assert(ADC_CHANS <= TRACE_MAX_ADC, "?");
+
 ADC_DAC_Calib adc_dac_calib[NUM_ADC_DAC_ITEMS] = {
     // cv inputs
     {52100.f, 1.f / -9334.833333f}, // pitch
@@ -73,14 +76,14 @@ u16 adc_get_raw(ADC_DAC_Index index) {
 			raw_value = maxi(raw_value, *src);
 			src += ADC_CHANS;
 		}
-		return raw_value;
+		return trace_adc(index, raw_value);
 	}
 	// all other inputs: get average
 	for (u8 i = 0; i < ADC_SAMPLES; ++i) {
 		raw_value += *src;
 		src += ADC_CHANS;
 	}
-	return raw_value / ADC_SAMPLES;
+	return trace_adc(index, raw_value / ADC_SAMPLES);
 }
 
 float adc_get_calib(ADC_DAC_Index index) { // only one use in arp.h
@@ -144,6 +147,7 @@ static void adc_dac_monitor(void) {
 	for (u8 strip = 0; strip < 9; ++strip)
 		for (u8 pad = 0; pad < 8; ++pad)
 			leds[strip][pad] = 255;
+	leds_swap();
 	u16 saw = 128;
 	s16 enc_press_count = -1;
 	do {
@@ -310,6 +314,7 @@ void cv_calib(void) {
 				leds[column][y] = led_add_gamma(((column == last_touched_column) ? 255 : 128) - k);
 			}
 		}
+		leds_swap();
 
 		// pitch cable detection
 		pitch_present_2back = pitch_present_1back;
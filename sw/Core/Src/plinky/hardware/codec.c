@@ -1,5 +1,7 @@
 #include "codec.h"
+#include "i2c_bus.h"
 #include "ram.h"
+#include "usb/usb_audio.h"
 
 extern I2C_HandleTypeDef hi2c2;
 extern SAI_HandleTypeDef hsai_BlockB1;
@@ -288,10 +290,12 @@ static short rx_buf[SAMPLES_PER_TICK * 4];
 
 void HAL_SAI_RxCpltCallback(SAI_HandleTypeDef* hi2s) {
 	plinky_codec_tick(((u32*)tx_buf) + SAMPLES_PER_TICK, ((u32*)rx_buf) + SAMPLES_PER_TICK);
+	usb_audio_capture(((u32*)tx_buf) + SAMPLES_PER_TICK);
 }
 
 void HAL_SAI_RxHalfCpltCallback(SAI_HandleTypeDef* hi2s) {
 	plinky_codec_tick((u32*)tx_buf, ((u32*)rx_buf));
+	usb_audio_capture((u32*)tx_buf);
 }
 
 static u8 wmcodec_write(u8 reg, u16 data) {
@@ -300,12 +304,14 @@ static u8 wmcodec_write(u8 reg, u16 data) {
 	d[1] = (u8)data;
 	u8 attempt;
 	HAL_Delay(1);
+	i2c_bus_acquire(I2C_CODEC);
 	for (attempt = 0; attempt < 10; ++attempt) {
 		HAL_StatusTypeDef r = HAL_I2C_Master_Transmit(&hi2c2, 0x34, d, 2, I2C_TIMEOUT);
 		if (r == HAL_OK)
 			break;
 		HAL_Delay(10);
 	}
+	i2c_bus_release();
 	if (attempt == 100) {
 		DebugLog("error in wmcodec_write reg %d data %d\r\n", reg, data);
 	}
@@ -1,4 +1,5 @@
 #include "encoder.h"
+#include "analytics/input_trace.h"
 #include "hardware/ram.h"
 #include "synth/params.h"
 #include "synth/sampler.h"
@@ -53,25 +54,27 @@ void encoder_tick(void) {
 	static bool prev_encoder_pressed;
 
 	s8 enc_diff = encoder_value >> 2;
+	encoder_value -= enc_diff << 2;
+	bool pressed = encoder_pressed;
+	float acc = encoder_acc;
+	trace_encoder(&enc_diff, &pressed, &acc);
 
 	// hold time
-	if (encoder_pressed)
+	if (pressed)
 		encoder_press_duration++;
 
-	if ((enc_diff || encoder_pressed || prev_encoder_pressed)) {
-		// log time
+	// log time
+	if (enc_diff || pressed || prev_encoder_pressed)
 		last_encoder_use = millis();
-		encoder_value -= enc_diff << 2;
-	}
 
 	switch (ui_mode) {
 	case UI_DEFAULT:
 	case UI_EDITING_A:
 	case UI_EDITING_B:
 		if (enc_diff)
-			edit_param_from_encoder(enc_diff, encoder_acc);
+			edit_param_from_encoder(enc_diff, acc);
 		// release of a short encoder press
-		else if (!encoder_pressed && prev_encoder_pressed && encoder_press_duration <= 50)
+		else if (!pressed && prev_encoder_pressed && encoder_press_duration <= 50)
 			params_toggle_default_value();
 		hold_encoder_for_params(encoder_press_duration);
 		break;
@@ -84,7 +87,7 @@ void encoder_tick(void) {
 		}
 		break;
 	case UI_SETTINGS_MENU:
-		settings_encoder_press(encoder_pressed, encoder_press_duration);
+		settings_encoder_press(pressed, encoder_press_duration);
 		if (enc_diff)
 			edit_settings_from_encoder(enc_diff);
 		break;
@@ -92,7 +95,7 @@ void encoder_tick(void) {
 		break;
 	}
 
-	if (!encoder_pressed)
+	if (!pressed)
 		encoder_press_duration = 0;
-	prev_encoder_pressed = encoder_pressed;
+	prev_encoder_pressed = pressed;
 }
\ No newline at end of file
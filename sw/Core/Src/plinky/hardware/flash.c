@@ -246,6 +246,7 @@ void flash_toggle_preset(u8 preset_id) {
 // writing flash
 
 void flash_erase_page(u8 page) {
+#ifdef __arm__
 	FLASH_WaitForLastOperation((u32)FLASH_TIMEOUT_VALUE);
 	SET_BIT(FLASH->CR, FLASH_CR_BKER); // bank 2
 	MODIFY_REG(FLASH->CR, FLASH_CR_PNB, ((page & 0xFFU) << FLASH_CR_PNB_Pos));
@@ -253,6 +254,12 @@ void flash_erase_page(u8 page) {
 	SET_BIT(FLASH->CR, FLASH_CR_STRT);
 	FLASH_WaitForLastOperation((u32)FLASH_TIMEOUT_VALUE);
 	CLEAR_BIT(FLASH->CR, (FLASH_CR_PER | FLASH_CR_PNB));
+#else
+	// host builds erase through the hal, see tools/flash_sim.c
+	FLASH_EraseInitTypeDef erase = {.TypeErase = FLASH_TYPEERASE_PAGES, .Banks = FLASH_BANK_2, .Page = page, .NbPages = 1};
+	u32 page_error;
+	HAL_FLASHEx_Erase(&erase, &page_error);
+#endif
 }
 
 void flash_write_block(void* dst, const void* src, int size) {
@@ -264,7 +271,11 @@ void flash_write_block(void* dst, const void* src, int size) {
 	}
 }
 
-void flash_write_page(const void* src, u32 size, u8 page_id) {
+// streamed page writes: reserve and erase a page, fill it in chunks, then make it the latest version of its item by
+// writing the footer. A stream that never gets committed leaves a page without footer, which gets reused later. Every
+// stream has its own page, so several can be open at once
+
+void flash_stream_begin(FlashStream* stream, u8 item_id) {
 	flash_busy = true;
 	HAL_FLASH_Unlock();
 	bool in_use;
@@ -277,21 +288,44 @@ void flash_write_page(const void* src, u32 size, u8 page_id) {
 			++next_free_page;
 	} while (in_use);
 	flash_erase_page(next_free_page);
-	u8 flash_page = next_free_page++;
-	u8* dst = (u8*)(FLASH_ADDR_256 + flash_page * FLASH_PAGE_SIZE);
-	flash_write_block(dst, src, size);
+	stream->page = next_free_page++;
+	stream->item_id = item_id;
+	HAL_FLASH_Lock();
+	flash_busy = false;
+}
+
+// offset and size need to be multiples of 8
+void flash_stream_write(FlashStream* stream, u32 offset, const void* src, u32 size) {
+	flash_busy = true;
+	HAL_FLASH_Unlock();
+	flash_write_block((u8*)flash_page_ptr(stream->page) + offset, src, size);
+	HAL_FLASH_Lock();
+	flash_busy = false;
+}
+
+void flash_stream_commit(FlashStream* stream) {
+	flash_busy = true;
+	HAL_FLASH_Unlock();
+	u8* dst = (u8*)flash_page_ptr(stream->page);
 	flash_write_block(dst + FLASH_PAGE_SIZE - sizeof(SysParams) - sizeof(PageFooter), &sys_params, sizeof(SysParams));
 	PageFooter footer;
-	footer.idx = page_id;
+	footer.idx = stream->item_id;
 	footer.seq = next_seq++;
 	footer.version = FOOTER_VERSION;
 	footer.crc = compute_hash(dst, 2040);
 	flash_write_block(dst + 2040, &footer, 8);
 	HAL_FLASH_Lock();
-	latest_page_id[page_id] = flash_page;
+	latest_page_id[stream->item_id] = stream->page;
 	flash_busy = false;
 }
 
+void flash_write_page(const void* src, u32 size, u8 page_id) {
+	FlashStream stream;
+	flash_stream_begin(&stream, page_id);
+	flash_stream_write(&stream, 0, src, size);
+	flash_stream_commit(&stream);
+}
+
 // calib
 
 FlashCalibType flash_read_calib(void) {
@@ -304,6 +338,7 @@ FlashCalibType flash_read_calib(void) {
 	if (*src != ~(u64)(0)) {
 		flash_calib_type |= FLASH_CALIB_TOUCH;
 		memcpy(touch_calib_ptr(), (u64*)src, sizeof(TouchCalibData) * NUM_TOUCH_READINGS);
+		update_touch_calib_lut();
 	}
 	// read adc/dac calibration data
 	src += sizeof(TouchCalibData) * NUM_TOUCH_READINGS / 8;
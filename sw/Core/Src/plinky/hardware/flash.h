@@ -28,6 +28,16 @@ void flash_erase_page(u8 page);
 void flash_write_block(void* dst, const void* src, int size);
 void flash_write_page(const void* src, u32 size, u8 page_id);
 
+// streamed writing, for items that arrive in chunks
+typedef struct FlashStream {
+	u8 page;
+	u8 item_id;
+} FlashStream;
+
+void flash_stream_begin(FlashStream* stream, u8 item_id);
+void flash_stream_write(FlashStream* stream, u32 offset, const void* src, u32 size);
+void flash_stream_commit(FlashStream* stream);
+
 // calib
 
 FlashCalibType flash_read_calib(void);
@@ -0,0 +1,41 @@
+#include "i2c_bus.h"
+
+extern I2C_HandleTypeDef hi2c2;
+
+// the bus only gets acquired from the main loop and released from either the main loop or an i2c callback, so a
+// plain volatile is enough to keep track of the owner
+static volatile I2cClient bus_owner = I2C_NONE;
+static void (*tx_callback)(bool success) = 0;
+
+bool i2c_bus_try_acquire(I2cClient client) {
+	if (bus_owner != I2C_NONE)
+		return false;
+	bus_owner = client;
+	return true;
+}
+
+void i2c_bus_acquire(I2cClient client) {
+	while (!i2c_bus_try_acquire(client))
+		__asm__ volatile("" ::: "memory");
+}
+
+void i2c_bus_release(void) {
+	bus_owner = I2C_NONE;
+}
+
+bool i2c_bus_transmit_async(u16 address, u8* data, u16 size, void (*callback)(bool success)) {
+	tx_callback = callback;
+	return HAL_I2C_Master_Transmit_IT(&hi2c2, address, data, size) == HAL_OK;
+}
+
+// hal callbacks
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef* hi2c) {
+	if (hi2c == &hi2c2 && tx_callback)
+		tx_callback(true);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c) {
+	if (hi2c == &hi2c2 && tx_callback)
+		tx_callback(false);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "utils.h"
+
+// this module arbitrates the i2c bus that is shared by the oled, the accelerometer and the codec
+// - blocking transfers are wrapped in i2c_bus_acquire() / i2c_bus_release()
+// - asynchronous transfers run on interrupts, their owner keeps the bus until its last callback releases it
+
+bool i2c_bus_try_acquire(I2cClient client);
+void i2c_bus_acquire(I2cClient client);
+void i2c_bus_release(void);
+
+// only call while owning the bus, the callback runs in interrupt context
+bool i2c_bus_transmit_async(u16 address, u8* data, u16 size, void (*callback)(bool success));
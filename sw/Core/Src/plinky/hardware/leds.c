@@ -31,7 +31,23 @@ const static u32 OutputEnableBits[5] = {(1 << (N4 * 2)), (1 << (N3 * 2)), (1 <<
 #define SET_ALL_PINS_BITS ((1 << N1) | (1 << N2) | (1 << N3) | (1 << N4) | (1 << N5))
 #define RESET_ALL_PINS_BITS (((1 << N1) | (1 << N2) | (1 << N3) | (1 << N4) | (1 << N5)) << 16)
 
+#define NUM_LED_COLUMNS 10   // two per GPIO output, the last one is not connected to any leds
+#define LED_COLUMN_RATE 2000 // columns per second, a full refresh of the matrix takes NUM_LED_COLUMNS columns
+
+// everything that gets written to the registers to light up one column
+typedef struct LedColumn {
+	u32 bsrr;          // GPIO polarity of this column
+	u32 output_enable; // GPIO mode bits that activate this column
+	u16 compare[PADS_PER_STRIP];
+} LedColumn;
+
 u8 leds[NUM_TOUCHSTRIPS][PADS_PER_STRIP];
+
+// double-buffered register images, the timer interrupt streams out one column at a time
+static LedColumn led_frames[2][NUM_LED_COLUMNS];
+static volatile u8 display_frame = 0;       // frame being scanned by the timer interrupt
+static volatile u8 next_frame = 0;          // frame to be picked up at the start of the next scan
+static volatile bool filling_frame = false; // leds_swap() is writing the frame that is not displayed
 static u8 active_column = 0;
 
 void init_leds(void) {
@@ -62,42 +78,66 @@ void init_leds(void) {
 
 	// clear all leds
 	memset(leds, 0, sizeof(leds));
-}
-
-void leds_update(void) {
-	GPIOD->MODER &= OUTPUT_DISABLE_BITS; // disable all outputs
+	leds_swap();
 
-	const u8* col = leds[active_column];
-	// odd frames
-	if (active_column & 1) {
-		GPIOD->BSRR = RESET_ALL_PINS_BITS;
+	// scan the columns from a timer interrupt, at a lower priority than audio
+	__HAL_RCC_TIM7_CLK_ENABLE();
+	TIM7->CR1 = 0;
+	// apb1 timers run at twice the bus clock when the bus is divided down
+	u32 tim_clock = HAL_RCC_GetPCLK1Freq();
+	if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
+		tim_clock *= 2;
+	TIM7->PSC = tim_clock / 1000000 - 1; // 1MHz
+	TIM7->ARR = 1000000 / LED_COLUMN_RATE - 1;
+	TIM7->DIER = TIM_DIER_UIE;
+	HAL_NVIC_SetPriority(TIM7_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(TIM7_IRQn);
+	TIM7->CR1 |= TIM_CR1_CEN;
+}
 
-		P1 = col[0];
-		P2 = col[1] ^ 0x1FF;
-		P3 = col[2];
-		P4 = col[3] ^ 0x1FF;
-		P5 = col[4];
-		P6 = col[5] ^ 0x1FF;
-		P7 = col[6];
-		P8 = col[7] ^ 0x1FF;
+// convert leds[] to register images and hand them over to the timer interrupt
+void leds_swap(void) {
+	// keep the timer interrupt from switching frames while we write, it switches at the next scan instead
+	filling_frame = true;
+	memory_barrier();
+	u8 frame_id = !display_frame;
+	for (u8 column = 0; column < NUM_LED_COLUMNS; ++column) {
+		LedColumn* img = &led_frames[frame_id][column];
+		static const u8 dark[PADS_PER_STRIP] = {0};
+		const u8* col = column < NUM_TOUCHSTRIPS ? leds[column] : dark;
+		// pins alternate polarity between columns, the compare values follow
+		bool odd = column & 1;
+		img->bsrr = odd ? RESET_ALL_PINS_BITS : SET_ALL_PINS_BITS;
+		img->output_enable = OutputEnableBits[column >> 1];
+		for (u8 pad = 0; pad < PADS_PER_STRIP; ++pad)
+			img->compare[pad] = ((pad & 1) == odd) ? col[pad] ^ 0x1FF : col[pad];
 	}
-	// even frames
-	else {
-		GPIOD->BSRR = SET_ALL_PINS_BITS;
+	next_frame = frame_id;
+	memory_barrier();
+	filling_frame = false;
+}
 
-		P1 = col[0] ^ 0x1FF;
-		P2 = col[1];
-		P3 = col[2] ^ 0x1FF;
-		P4 = col[3];
-		P5 = col[4] ^ 0x1FF;
-		P6 = col[5];
-		P7 = col[6] ^ 0x1FF;
-		P8 = col[7];
-	}
+// drive one column of the led matrix
+void TIM7_IRQHandler(void) {
+	TIM7->SR = 0; // clear update flag
+	// only switch frames between scans, and not into a frame that is half written
+	if (!active_column && !filling_frame)
+		display_frame = next_frame;
+	const LedColumn* img = &led_frames[display_frame][active_column];
 
-	GPIOD->MODER |= OutputEnableBits[active_column >> 1]; // activate column
+	GPIOD->MODER &= OUTPUT_DISABLE_BITS; // disable all outputs
+	GPIOD->BSRR = img->bsrr;
+	P1 = img->compare[0];
+	P2 = img->compare[1];
+	P3 = img->compare[2];
+	P4 = img->compare[3];
+	P5 = img->compare[4];
+	P6 = img->compare[5];
+	P7 = img->compare[6];
+	P8 = img->compare[7];
+	GPIOD->MODER |= img->output_enable; // activate column
 
-	active_column = (active_column + 1) % 10; // next column
+	active_column = (active_column + 1) % NUM_LED_COLUMNS; // next column
 }
 
 void leds_bootswish(void) {
@@ -121,5 +161,6 @@ void leds_bootswish(void) {
 				leds[y][x] = ((k * k) >> 8);
 			}
 		}
+		leds_swap();
 	}
 }
\ No newline at end of file
@@ -10,7 +10,7 @@
 extern u8 leds[NUM_TOUCHSTRIPS][PADS_PER_STRIP];
 
 void init_leds(void);
-void leds_update(void);
+void leds_swap(void);
 void leds_bootswish(void);
 
 static inline u8 led_add_gamma(s16 i) {
@@ -1,4 +1,5 @@
 #include "midi.h"
+#include "analytics/input_trace.h"
 #include "ram.h"
 #include "synth/params.h"
 #include "synth/strings.h"
@@ -9,7 +10,16 @@
 extern UART_HandleTypeDef huart3;
 
 #define NUM_14BIT_CCS 32
-#define MIDI_BUFFER_SIZE 16
+#define SERIAL_BATCH_SIZE 6    // bytes per uart dma, 1.92ms at 3125 bytes/s keeps it under a tick
+#define NOTE_QUEUE_SIZE 16     // power of 2
+#define MIDI_RX_BUFFER_SIZE 64 // circular dma, power of 2
+#define MIDI_QUEUE_SIZE 32     // power of 2
+#define US_PER_SERIAL_BYTE 320 // 10 bits at 31250 baud
+#define US_PER_SAMPLE 32       // 1000000 / SAMPLE_RATE
+#define USB_MIDI_EP_OUT 0x01   // EPNUM_MIDI in usb_descriptors.c
+
+// tinyusb only starts the next usb midi transfer once its fifo is empty, so the fifo holds one transfer at a time
+static_assert(CFG_TUD_MIDI_RX_BUFSIZE < 2 * CFG_TUD_MIDI_EP_BUFSIZE, "usb midi fifo holds more than one transfer");
 
 u8 midi_chan_pressure[NUM_MIDI_CHANNELS];
 s16 midi_chan_pitchbend[NUM_MIDI_CHANNELS];
@@ -19,107 +29,224 @@ void set_midi_goal_note(u8 string_id, u8 midi_note) {
 	midi_goal_note[string_id] = midi_note;
 }
 
-static u8 clocks_to_send;
-static MidiMessageType send_transport;
+// incoming messages with their arrival time in micros()
+typedef struct MidiEvent {
+	u32 time;
+	u8 status;
+	u8 d1;
+	u8 d2;
+} MidiEvent;
+
+// single producer, single consumer: filled from an interrupt or the main loop, emptied by the codec tick
+typedef struct MidiQueue {
+	MidiEvent events[MIDI_QUEUE_SIZE];
+	volatile u8 head;
+	volatile u8 tail;
+	volatile u16 dropped; // events that found the queue full, only written by the producer
+	u16 drops_reported;   // only written by the consumer
+} MidiQueue;
+
+// outgoing messages are split by priority: realtime first, then notes in order, then expression. Expression messages
+// have a fixed slot per string and kind, a newer value replaces one that hasn't been sent yet
+typedef enum ExprKind {
+	EXPR_AFTERTOUCH, // poly key pressure
+	EXPR_POSITION,   // CC32 - CC39
+	EXPR_PRESSURE,   // CC40 - CC47
+	NUM_EXPR_KINDS,
+} ExprKind;
+
+typedef enum OutClass {
+	OUT_NONE,
+	OUT_CLOCK,
+	OUT_TRANSPORT,
+	OUT_NOTE,
+	OUT_EXPR,
+} OutClass;
+
+#define NUM_EXPR_SLOTS (NUM_EXPR_KINDS * NUM_STRINGS)
+static_assert(NUM_EXPR_SLOTS <= 32, "expr_dirty is a u32");
+
+// usb and serial get their own queue, usb isn't held back by the serial baud rate
+typedef struct MidiOutPort {
+	u8 clocks;
+	MidiMessageType transport;
+	u8 notes[NOTE_QUEUE_SIZE][3];
+	u8 note_head;
+	u8 note_tail;
+	u8 expr[NUM_EXPR_SLOTS][2]; // d1, d2
+	u32 expr_dirty;
+	u8 next_expr;   // expression slots take turns
+	u8 peeked_expr; // slot returned by the last peek_msg()
+} MidiOutPort;
+
+// buffers
+static u8 midi_receive_buffer[MIDI_RX_BUFFER_SIZE];
+static u8 midi_receive_pos;
+static u8 midi_send_buffer[SERIAL_BATCH_SIZE];
+static MidiQueue serial_queue;   // filled by the uart interrupts
+static MidiQueue usb_queue;      // filled by the usb task
+static volatile u32 usb_rx_time; // when the latest usb midi transfer arrived
+static MidiOutPort serial_out;
+static MidiOutPort usb_out;
 
 void midi_send_clock(void) {
-	clocks_to_send++;
+	serial_out.clocks++;
+	usb_out.clocks++;
 }
 
 void midi_send_transport(MidiMessageType transport_type) {
 	if (transport_type < MIDI_TIMING_CLOCK)
 		return;
-	send_transport = transport_type;
+	serial_out.transport = transport_type;
+	usb_out.transport = transport_type;
 }
 
-// buffers
-static u8 midi_receive_buffer[MIDI_BUFFER_SIZE];
-static u8 midi_send_buffer[2 * MIDI_BUFFER_SIZE];
-static u8 midi_send_head;
-static u8 midi_send_tail;
-
 void init_midi(void) {
 	HAL_UART_Receive_DMA(&huart3, midi_receive_buffer, sizeof(midi_receive_buffer));
+	// the dma half/full interrupts only fire every 32 bytes, the idle line marks the end of shorter bursts
+	__HAL_UART_ENABLE_IT(&huart3, UART_IT_IDLE);
 }
 
 // === OUTPUT LOOP === //
 
-// throw send buffer to the uart
-static void midi_buffer_to_uart(void) {
-	if (huart3.TxXferCount == 0 && midi_send_head != midi_send_tail) {
-		u8 from = midi_send_tail & 15;
-		u8 to = midi_send_head & 15;
-		if (to > from) {
-			midi_send_tail += (to - from);
-			HAL_UART_Transmit_DMA(&huart3, midi_send_buffer + from, to - from);
-		}
-		else if (to < from) {
-			// wrapped! send from->16, and 0->to
-			u8 send_len = (MIDI_BUFFER_SIZE - from) + to;
-			// copy looped part to end so we can send it all in one go! good on us.
-			memcpy(midi_send_buffer + MIDI_BUFFER_SIZE, midi_send_buffer, to);
-			midi_send_tail += send_len;
-			HAL_UART_Transmit_DMA(&huart3, midi_send_buffer + from, send_len);
-		}
+static bool note_queue_full(MidiOutPort* port) {
+	return (u8)(port->note_head - port->note_tail) >= NOTE_QUEUE_SIZE;
+}
+
+static void queue_note(MidiOutPort* port, u8 string_id, u8 status, u8 d1, u8 d2) {
+	u8* msg = port->notes[port->note_head++ & (NOTE_QUEUE_SIZE - 1)];
+	msg[0] = status;
+	msg[1] = d1;
+	msg[2] = d2;
+	// aftertouch that was meant for the previous note of the string is stale now
+	if (status == MIDI_NOTE_OFF)
+		port->expr_dirty &= ~(1 << (EXPR_AFTERTOUCH * NUM_STRINGS + string_id));
+}
+
+static void queue_expr(MidiOutPort* port, ExprKind kind, u8 string_id, u8 d1, u8 d2) {
+	u8 slot = kind * NUM_STRINGS + string_id;
+	port->expr[slot][0] = d1;
+	port->expr[slot][1] = d2;
+	port->expr_dirty |= 1 << slot;
+}
+
+// notes are never dropped, the caller checks for room first
+static bool out_notes_full(void) {
+	return note_queue_full(&serial_out) || note_queue_full(&usb_out);
+}
+
+static void out_note(u8 string_id, u8 status, u8 d1, u8 d2) {
+	queue_note(&serial_out, string_id, status, d1, d2);
+	queue_note(&usb_out, string_id, status, d1, d2);
+}
+
+static void out_expr(ExprKind kind, u8 string_id, u8 d1, u8 d2) {
+	queue_expr(&serial_out, kind, string_id, d1, d2);
+	queue_expr(&usb_out, kind, string_id, d1, d2);
+}
+
+// find the most urgent message on a port without taking it off
+static OutClass peek_msg(MidiOutPort* port, u8* msg) {
+	// realtime messages have no data bytes, usb packets send them as zeros
+	msg[1] = 0;
+	msg[2] = 0;
+	if (port->clocks) {
+		msg[0] = MIDI_TIMING_CLOCK;
+		return OUT_CLOCK;
+	}
+	if (port->transport != MIDI_NONE) {
+		msg[0] = port->transport;
+		return OUT_TRANSPORT;
+	}
+	if (port->note_head != port->note_tail) {
+		memcpy(msg, port->notes[port->note_tail & (NOTE_QUEUE_SIZE - 1)], 3);
+		return OUT_NOTE;
 	}
+	if (port->expr_dirty) {
+		u8 slot = port->next_expr;
+		while (!(port->expr_dirty & (1 << slot)))
+			slot = (slot + 1) % NUM_EXPR_SLOTS;
+		msg[0] = slot < NUM_STRINGS ? MIDI_POLY_KEY_PRESSURE : MIDI_CONTROL_CHANGE;
+		msg[1] = port->expr[slot][0];
+		msg[2] = port->expr[slot][1];
+		port->peeked_expr = slot;
+		return OUT_EXPR;
+	}
+	return OUT_NONE;
 }
 
-// add midi bytes to the send buffer
-static bool send_midi_serial(const u8* data, int len) {
-	if (len <= 0)
-		return true;
-	if (midi_send_head - midi_send_tail + len > MIDI_BUFFER_SIZE)
-		return false; // full
-	while (len--)
-		midi_send_buffer[(midi_send_head++) & 15] = *data++;
-	return true;
+static void pop_msg(MidiOutPort* port, OutClass out_class) {
+	switch (out_class) {
+	case OUT_CLOCK:
+		port->clocks--;
+		break;
+	case OUT_TRANSPORT:
+		port->transport = MIDI_NONE;
+		break;
+	case OUT_NOTE:
+		port->note_tail++;
+		break;
+	case OUT_EXPR:
+		port->expr_dirty &= ~(1 << port->peeked_expr);
+		port->next_expr = (port->peeked_expr + 1) % NUM_EXPR_SLOTS;
+		break;
+	default:
+		break;
+	}
 }
 
-// send midi msg to uart and usb, returns false if serial too full
-static bool send_midi_msg(u8 status, u8 data1, u8 data2) {
-	// prepare message
-	u8 num_bytes = 3;
-	if (status == MIDI_PROGRAM_CHANGE || status == MIDI_CHANNEL_PRESSURE)
-		num_bytes = 2;
-	if (status < MIDI_SYSTEM_EXCLUSIVE)
-		status += sys_params.midi_out_chan;
-	u8 buf[4] = {status >> 4, status, data1, data2};
-	// send to serial
-	if (!send_midi_serial(buf + 1, num_bytes)) {
-		return false;
+// add the output channel and return the number of bytes in the message
+static u8 finish_msg(u8* msg) {
+	if (msg[0] >= MIDI_SYSTEM_EXCLUSIVE)
+		return 1;
+	msg[0] += sys_params.midi_out_chan;
+	return (msg[0] & 0xF0) == MIDI_PROGRAM_CHANGE || (msg[0] & 0xF0) == MIDI_CHANNEL_PRESSURE ? 2 : 3;
+}
+
+// the uart gets a small batch at a time, so that urgent messages never wait behind a long backlog
+static void serial_out_flush(void) {
+	if (huart3.TxXferCount)
+		return;
+	u8 len = 0;
+	u8 msg[3];
+	OutClass out_class;
+	while (len + 3 <= SERIAL_BATCH_SIZE && (out_class = peek_msg(&serial_out, msg)) != OUT_NONE) {
+		pop_msg(&serial_out, out_class);
+		u8 num_bytes = finish_msg(msg);
+		memcpy(midi_send_buffer + len, msg, num_bytes);
+		len += num_bytes;
 	}
-	// if serial was successful, send to usb
-	// we assume this succeeds as it's so much faster than serial midi
-	tud_midi_packet_write(buf);
-	return true;
+	if (len)
+		HAL_UART_Transmit_DMA(&huart3, midi_send_buffer, len);
 }
 
-// outgoing midi gets processed once and sent out identically to serial and usb
+// usb takes whatever fits its fifo
+static void usb_out_flush(void) {
+	// nobody listening, don't let the queue fill up with stale messages
+	if (!tud_midi_mounted()) {
+		memset(&usb_out, 0, sizeof(usb_out));
+		return;
+	}
+	u8 msg[3];
+	OutClass out_class;
+	while ((out_class = peek_msg(&usb_out, msg)) != OUT_NONE) {
+		finish_msg(msg);
+		u8 packet[4] = {msg[0] >> 4, msg[0], msg[1], msg[2]};
+		if (!tud_midi_packet_write(packet))
+			return;
+		pop_msg(&usb_out, out_class);
+	}
+}
+
+// outgoing midi gets generated once and queued identically for serial and usb
 void process_all_midi_out(void) {
-	static u8 string_id = 0;
 	static u8 note[NUM_STRINGS];             // last sent midi note
 	static u8 note_on_pressure[NUM_STRINGS]; // pressure/velocity sent on note on
 	static u8 aftertouch[NUM_STRINGS];       // last sent poly aftertouch
 	static u8 position[NUM_STRINGS];         // last sent position CC
 	static u8 pressure[NUM_STRINGS];         // last sent pressure CC
 
-	// exit if the uart is not ready
-	if (huart3.TxXferCount)
-		return;
-	if (send_transport != MIDI_NONE) {
-		if (!send_midi_msg(send_transport, 0, 0))
-			return;
-		send_transport = MIDI_NONE;
-	}
-	while (clocks_to_send) {
-		if (!send_midi_msg(MIDI_TIMING_CLOCK, 0, 0))
-			return;
-		clocks_to_send--;
-	}
-	// we check for a maximum of eight times (once for each voice)
-	u8 num_loops = 0;
-	while (num_loops < 8) {
-		num_loops++;
+	for (u8 string_id = 0; string_id < NUM_STRINGS; string_id++) {
 		//  get a bunch of parameters from the synth
 		Touch* synthf = get_string_touch(string_id);
 		Touch* prevsynthf = get_string_touch_prev(string_id, 2);
@@ -136,71 +263,58 @@ void process_all_midi_out(void) {
 		if (!target_pressure)
 			target_note = 0;
 
-		// one loop checks all needed outgoing midi messages for one voice
-		bool sent = false;
 		u8 cur_note = note[string_id];
 		// note has changed
 		if (target_note != cur_note) {
+			// a queue is full => try again next time
+			if (out_notes_full())
+				continue;
 			// we were playing a note => send note off
 			if (cur_note) {
-				if (!send_midi_msg(MIDI_NOTE_OFF, cur_note, 0))
-					return; // if the buffer is full, we exit the function and try again next time
+				out_note(string_id, MIDI_NOTE_OFF, cur_note, 0);
 				note[string_id] = 0;
 				aftertouch[string_id] = 0;
-				sent = true;
 			}
 			// we start playing a new note => send note on
 			if (target_note != 0 && pos_stable && pres_stable) {
+				if (out_notes_full())
+					continue;
 				// we use the current pressure as the note velocity
-				if (!send_midi_msg(MIDI_NOTE_ON, target_note, target_pressure))
-					return;
+				out_note(string_id, MIDI_NOTE_ON, target_note, target_pressure);
 				note[string_id] = target_note;
 				note_on_pressure[string_id] = target_pressure;
 				aftertouch[string_id] = 0;
-				sent = true;
 			}
+			cur_note = note[string_id];
 		}
 		// we define aftertouch as any pressure on top of the pressure when the note started
 		u8 goal_aftertouch = maxi(target_pressure - note_on_pressure[string_id], 0);
-		if (abs(goal_aftertouch - aftertouch[string_id]) > 4) {
+		if (cur_note && abs(goal_aftertouch - aftertouch[string_id]) > 4) {
 			// poly aftertouch (only when pressure difference is larger than 4)
-			if (!send_midi_msg(MIDI_POLY_KEY_PRESSURE, cur_note, goal_aftertouch))
-				return;
+			out_expr(EXPR_AFTERTOUCH, string_id, cur_note, goal_aftertouch);
 			aftertouch[string_id] = goal_aftertouch;
-			sent = true;
 		}
 		// voice position, CC32 - CC39
 		u8 goal_position = clampi(127 - (synthf->pos / 13 - 16), 0, 127);
 		if (abs(goal_position - position[string_id]) > 1 && pres_significant && pres_stable) {
-			if (!send_midi_msg(MIDI_CONTROL_CHANGE, 32 + string_id, goal_position))
-				return;
+			out_expr(EXPR_POSITION, string_id, 32 + string_id, goal_position);
 			position[string_id] = goal_position;
-			sent = true;
 		}
 		// voice pressure, CC40 - CC47
 		if (abs(target_pressure - pressure[string_id]) > 1) {
-			if (!send_midi_msg(MIDI_CONTROL_CHANGE, 40 + string_id, target_pressure))
-				return;
+			out_expr(EXPR_PRESSURE, string_id, 40 + string_id, target_pressure);
 			pressure[string_id] = target_pressure;
-			sent = true;
-		}
-
-		// jump to next voice
-		string_id = (string_id + 1) & 7;
-
-		// if we sent any midi message for this voice, send the midi buffer to the uart and exit the function
-		// the next time we enter the function again, string_id will be set to the next voice
-		if (sent) {
-			midi_buffer_to_uart();
-			return;
 		}
 	}
+
+	serial_out_flush();
+	usb_out_flush();
 }
 
 // === INPUT LOOP === //
 
-// apply midi messages to plinky
-static void process_midi_msg(u8 status, u8 d1, u8 d2) {
+// apply midi messages to plinky, time is when it arrived and sample where its note on/off lands, see event_sample
+static void process_midi_msg(u8 status, u8 d1, u8 d2, u32 time, u32 sample) {
 	u8 chan = status & 0x0F;              // save the channel
 	MidiMessageType type = status & 0xF0; // take the channel out
 
@@ -223,7 +337,7 @@ static void process_midi_msg(u8 status, u8 d1, u8 d2) {
 	case MIDI_NOTE_OFF:
 	case MIDI_NOTE_ON:
 	case MIDI_POLY_KEY_PRESSURE:
-		strings_rcv_midi(status, d1, d2);
+		strings_rcv_midi(status, d1, d2, sample);
 		break;
 	case MIDI_PITCH_BEND:
 		midi_chan_pitchbend[chan] = (d1 + (d2 << 7)) - 0x2000;
@@ -234,7 +348,7 @@ static void process_midi_msg(u8 status, u8 d1, u8 d2) {
 	case MIDI_CONTROL_CHANGE:
 		// sustain is sent to the strings
 		if (d1 == 64) {
-			strings_rcv_midi(status, d1, d2);
+			strings_rcv_midi(status, d1, d2, sample);
 			break;
 		}
 
@@ -278,25 +392,72 @@ static void process_midi_msg(u8 status, u8 d1, u8 d2) {
 		break;
 	// out of the system messages we only implement the time-related ones => forward to clock
 	case MIDI_SYSTEM_COMMON_MSG:
-		clock_rcv_midi(status);
+		clock_rcv_midi(status, time);
 		break;
 	default:
 		break;
 	}
 }
 
-// read bytes from *buf and put them into midi messages
-static void midi_bytes_to_msg(const u8* buf, u8 len) {
+// == QUEUES == //
+
+static bool queue_push(MidiQueue* queue, u32 time, u8 status, u8 d1, u8 d2) {
+	u8 head = queue->head;
+	if ((u8)(head - queue->tail) >= MIDI_QUEUE_SIZE) {
+		queue->dropped++;
+		return false;
+	}
+	MidiEvent* event = &queue->events[head & (MIDI_QUEUE_SIZE - 1)];
+	event->time = time;
+	event->status = status;
+	event->d1 = d1;
+	event->d2 = d2;
+	// make sure the event is written before the consumer can see it
+	memory_barrier();
+	queue->head = head + 1;
+	return true;
+}
+
+// notes play two ticks after they arrived, at the same position within the tick: one tick to arrive in full and one
+// for the strings, which only get generated every other tick. This trades the jitter of applying everything at the
+// start of a tick for a constant latency. We run before clock_tick(), synth_tick is still the tick that just finished
+static u32 event_sample(u32 now, u32 time) {
+	u32 age = now - time;
+	u32 offset = (age >= SAMPLES_PER_TICK * US_PER_SAMPLE) ? 0 : SAMPLES_PER_TICK - 1 - age / US_PER_SAMPLE;
+	return (synth_tick + 2) * SAMPLES_PER_TICK + offset;
+}
+
+// apply all events that arrived before now
+static void process_queue(MidiQueue* queue, u32 now) {
+	u8 tail = queue->tail;
+	while (tail != queue->head) {
+		MidiEvent* event = &queue->events[tail & (MIDI_QUEUE_SIZE - 1)];
+		// arrived after the tick started, keep it for the next one
+		if ((s32)(event->time - now) > 0)
+			break;
+		trace_midi(event->status, event->d1, event->d2, event->time);
+		process_midi_msg(event->status, event->d1, event->d2, event->time, event_sample(now, event->time));
+		tail++;
+	}
+	queue->tail = tail;
+}
+
+// == SERIAL INPUT == //
+
+// read bytes from *buf and put them into midi messages, time is when the last byte arrived
+static void midi_bytes_to_msg(const u8* buf, u8 len, u32 time) {
 	static u8 state = 0;
 	static u8 msg[3] = {0};
 	for (; len--;) {
 		u8 data = *buf++;
+		// the bytes of a burst arrived back to back
+		u32 data_time = time - len * US_PER_SERIAL_BYTE;
 		// status byte
 		if (data & 0x80) {
 			// real-time msg
 			if ((data & 0xF8) == 0xF8) {
-				// handle immediately
-				process_midi_msg(data, 0, 0);
+				// pass on immediately, can interrupt other msgs
+				queue_push(&serial_queue, data_time, data, 0, 0);
 			}
 			// channel mode msg
 			else if ((data & 0xF0) == 0xF0) {
@@ -323,52 +484,93 @@ static void midi_bytes_to_msg(const u8* buf, u8 len) {
 			msg[state++] = data;
 			// program change and channel pressure only have one data byte
 			if (state == 2 && ((msg[0] & 0xF0) == MIDI_PROGRAM_CHANGE || (msg[0] & 0xF0) == MIDI_CHANNEL_PRESSURE)) {
-				process_midi_msg(msg[0], msg[1], 0);
+				queue_push(&serial_queue, data_time, msg[0], msg[1], 0);
 			}
-			// we received a full midi msg, process
+			// we received a full midi msg, queue it
 			else if (state == 3) {
-				process_midi_msg(msg[0], msg[1], msg[2]);
+				queue_push(&serial_queue, data_time, msg[0], msg[1], msg[2]);
 			}
 		}
 	}
 }
 
-// handles up to one buffer (16 bytes) of incoming serial midi data
-static void process_serial_midi_in(void) {
-	// pass the midi out buffer to the uart
-	// rj: why is this in the midi in function?
-	midi_buffer_to_uart();
-	// get midi bytes from buffer and pass them to midi_bytes_to_msg()
-	static u8 last_read_pos = 0;
-	u8 read_pos = MIDI_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart3.hdmarx);
-	if (read_pos != last_read_pos) {
-		if (read_pos > last_read_pos) {
-			midi_bytes_to_msg(&midi_receive_buffer[last_read_pos], read_pos - last_read_pos);
-		}
-		else {
-			midi_bytes_to_msg(&midi_receive_buffer[last_read_pos], MIDI_BUFFER_SIZE - last_read_pos);
-			midi_bytes_to_msg(&midi_receive_buffer[0], read_pos);
-		}
+// parse everything the dma has received since the last call, time is when the last byte arrived
+static void serial_midi_rx(u32 time) {
+	u8 read_pos = (MIDI_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart3.hdmarx)) & (MIDI_RX_BUFFER_SIZE - 1);
+	u8 last_read_pos = midi_receive_pos;
+	if (read_pos > last_read_pos)
+		midi_bytes_to_msg(&midi_receive_buffer[last_read_pos], read_pos - last_read_pos, time);
+	else if (read_pos < last_read_pos) {
+		midi_bytes_to_msg(&midi_receive_buffer[last_read_pos], MIDI_RX_BUFFER_SIZE - last_read_pos,
+		                  time - read_pos * US_PER_SERIAL_BYTE);
+		midi_bytes_to_msg(&midi_receive_buffer[0], read_pos, time);
 	}
-	last_read_pos = read_pos;
+	midi_receive_pos = read_pos;
+}
+
+// dma half and full interrupts
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef* huart) {
+	if (huart == &huart3)
+		serial_midi_rx(micros());
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart) {
+	if (huart == &huart3)
+		serial_midi_rx(micros());
+}
+
+// called from the uart interrupt, the line goes idle one byte after the last byte of a burst
+void midi_uart_irq(void) {
+	if (!__HAL_UART_GET_FLAG(&huart3, UART_FLAG_IDLE))
+		return;
+	__HAL_UART_CLEAR_IDLEFLAG(&huart3);
+	serial_midi_rx(micros() - US_PER_SERIAL_BYTE);
+}
+
+// == USB INPUT == //
+
+// usb interrupt: a transfer completed
+void midi_usb_xfer_isr(u8 ep_addr) {
+	if (ep_addr == USB_MIDI_EP_OUT)
+		usb_rx_time = micros();
 }
 
-static void process_usb_midi_in(void) {
-	const static u8 max_packets_per_call = 2;
+// usb midi packets carry the arrival time of their transfer, packets that don't fit the queue wait in the usb fifo
+void midi_usb_rx(void) {
 	u8 midi_packet[4];
-	u8 packets_handled = 0;
-	do {
-		if (!tud_midi_available() || !tud_midi_packet_read(midi_packet))
-			return;
-		process_midi_msg(midi_packet[1], midi_packet[2], midi_packet[3]);
-		packets_handled++;
-	} while (packets_handled < max_packets_per_call);
+	u32 time = usb_rx_time;
+	while ((u8)(usb_queue.head - usb_queue.tail) < MIDI_QUEUE_SIZE && tud_midi_available()
+	       && tud_midi_packet_read(midi_packet))
+		queue_push(&usb_queue, time, midi_packet[1], midi_packet[2], midi_packet[3]);
+}
+
+// called by tinyusb when it moved a transfer into its fifo
+void tud_midi_rx_cb(uint8_t itf) {
+	midi_usb_rx();
 }
 
 void process_midi(void) {
 	process_all_midi_out();
-	process_serial_midi_in();
-	process_usb_midi_in();
+	u32 now = trace_now();
+	// a replayed trace brings its own midi, live input is dropped
+	if (trace_mode == TRACE_REPLAY) {
+		serial_queue.tail = serial_queue.head;
+		usb_queue.tail = usb_queue.head;
+		u8 status, d1, d2;
+		u32 time;
+		while (trace_replay_midi(&status, &d1, &d2, &time))
+			process_midi_msg(status, d1, d2, time, event_sample(now, time));
+		return;
+	}
+	process_queue(&serial_queue, now);
+	process_queue(&usb_queue, now);
+	// the serial queue only overflows when ticks stall for longer than it lasts, those messages are lost
+	u16 total_dropped = serial_queue.dropped;
+	u16 dropped = total_dropped - serial_queue.drops_reported;
+	if (dropped) {
+		serial_queue.drops_reported = total_dropped;
+		DebugLog("midi: %d serial messages dropped\r\n", dropped);
+	}
 }
 
 // == AUX == //
@@ -391,5 +593,6 @@ void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart) {
 	__HAL_UART_DISABLE_IT(huart, UART_IT_ERR);
 	// The most important thing when UART framing error occur/any error is restart the RX process
 	midi_panic();
+	midi_receive_pos = 0;
 	HAL_UART_Receive_DMA(&huart3, midi_receive_buffer, sizeof(midi_receive_buffer));
 }
\ No newline at end of file
@@ -6,6 +6,9 @@ extern s16 midi_chan_pitchbend[NUM_MIDI_CHANNELS];
 
 void init_midi(void);
 void process_midi(void);
+void midi_uart_irq(void);
+void midi_usb_rx(void);
+void midi_usb_xfer_isr(u8 ep_addr);
 void set_midi_goal_note(u8 string_id, u8 midi_note);
 
 void midi_send_clock(void);
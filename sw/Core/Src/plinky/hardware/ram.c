@@ -7,10 +7,12 @@
 #include "hardware/codec.h"
 #include "synth/sequencer.h"
 #include "synth/strings.h"
+#include "synth/time.h"
 // -- cleanup
 
 #define SYS_PARAMS_VERSION 2
 #define NUM_RAM_ITEMS (NUM_PRESETS + NUM_PATTERNS + NUM_SAMPLES)
+#define NO_PRESET 255
 
 typedef enum RamItemType {
 	RAM_PRESET,
@@ -33,9 +35,30 @@ static u8 ram_sample_id = 255;
 
 // ram item contents
 Preset cur_preset;
-static PatternQuarter cur_ptn_quarter[4];
 SampleInfo cur_sample_info;
 
+// preset switches: the main loop stages the preset to switch to in next_preset, the audio tick exchanges it with
+// cur_preset at the start of a tick. An outgoing preset with unsaved edits stays behind in next_preset until the main
+// loop has written it back, a clean one stays staged for switching back
+static Preset next_preset;
+static volatile u8 staged_preset_id = NO_PRESET;  // preset in next_preset, ready to be swapped in
+static volatile u8 retired_preset_id = NO_PRESET; // edited preset in next_preset, waiting to be written back
+static volatile bool saving_preset = false;       // the main loop is writing cur_preset to flash
+static u32 switch_start_tick;
+
+u16 preset_switch_ticks = 0;
+u16 preset_switch_max_ticks = 0;
+
+// the audio tick copies a selected pattern in whole, once the main loop has written back the edited quarters of the
+// outgoing one
+static PatternQuarter cur_ptn_quarter[MAX_PTN_QUARTERS];
+static volatile bool saving_pattern = false; // the main loop is writing a quarter of cur_ptn_quarter to flash
+
+// occupancy of the quarters, rebuilt on load and edit so that nobody has to scan pressure bytes: per step and string a
+// bitmask of the substeps holding pressure, per step a bitmask of the strings holding any
+static u8 qtr_substeps[MAX_PTN_QUARTERS][PTN_STEPS_PER_QTR][NUM_STRINGS];
+static u8 qtr_strings[MAX_PTN_QUARTERS][PTN_STEPS_PER_QTR];
+
 // item to change to
 static u8 cued_preset_id = 255;
 static u8 cued_pattern_id = 255;
@@ -70,37 +93,177 @@ static RamItemType get_item_type(u8 item_id) {
 static bool preset_outdated(void) {
 	return sys_params.preset_id != ram_preset_id;
 }
-bool pattern_outdated(void) {
+static bool pattern_outdated(void) {
 	return cur_pattern_id != ram_pattern_id;
 }
 static bool sample_outdated(void) {
 	return cur_sample_id != ram_sample_id;
 }
 
+static bool segment_outdated(RamSegment seg) {
+	return last_ram_write[seg] != last_flash_write[seg];
+}
+
+// a pattern's quarters sit in consecutive flash quarters
+static u8 ptn_quarter_id(u8 pattern_id, u8 qtr) {
+	return pattern_id * MAX_PTN_QUARTERS + qtr;
+}
+
+static u8 step_quarter(u8 seq_step) {
+	return (seq_step / PTN_STEPS_PER_QTR) % MAX_PTN_QUARTERS;
+}
+
+// == PATTERN QUARTERS == //
+
+static void index_step(u8 qtr, u8 step) {
+	u8 strings = 0;
+	for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id) {
+		const u8* pres = cur_ptn_quarter[qtr].steps[step][string_id].pres;
+		u8 substeps = 0;
+		for (u8 substep_id = 0; substep_id < PTN_SUBSTEPS; ++substep_id)
+			if (pres[substep_id])
+				substeps |= 1 << substep_id;
+		qtr_substeps[qtr][step][string_id] = substeps;
+		if (substeps)
+			strings |= 1 << string_id;
+	}
+	qtr_strings[qtr][step] = strings;
+}
+
+static void index_quarter(u8 qtr) {
+	for (u8 step = 0; step < PTN_STEPS_PER_QTR; ++step)
+		index_step(qtr, step);
+}
+
+static bool pattern_edited(void) {
+	for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr)
+		if (segment_outdated(SEG_PAT0 + qtr))
+			return true;
+	return false;
+}
+
+// writes a quarter back to flash, the audio tick doesn't copy in another pattern meanwhile
+static void save_pattern_quarter(u8 qtr) {
+	saving_pattern = true;
+	memory_barrier();
+	last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
+	last_flash_write[SEG_PAT0 + qtr] = last_ram_write[SEG_PAT0 + qtr];
+	flash_write_page(&cur_ptn_quarter[qtr], sizeof(PatternQuarter),
+	                 PATTERNS_START + ptn_quarter_id(ram_pattern_id, qtr));
+	saving_pattern = false;
+}
+
+// forget the pattern in ram and its unsaved edits, the audio tick copies it in again
+static void drop_pattern(void) {
+	ram_pattern_id = 255;
+	for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr)
+		last_flash_write[SEG_PAT0 + qtr] = last_ram_write[SEG_PAT0 + qtr];
+}
+
+// == PRESET SWITCH == //
+
+// writes cur_preset back to flash, the audio tick doesn't swap it out meanwhile
+static void save_cur_preset(void) {
+	saving_preset = true;
+	memory_barrier();
+	last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
+	last_flash_write[SEG_PRESET] = last_ram_write[SEG_PRESET];
+	flash_write_page(&cur_preset, sizeof(Preset), ram_preset_id);
+	saving_preset = false;
+}
+
+static void save_cur_sample(void) {
+	last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
+	last_flash_write[SEG_SAMPLE] = last_ram_write[SEG_SAMPLE];
+	if (ram_sample_id < NUM_SAMPLES)
+		flash_write_page(&cur_sample_info, sizeof(SampleInfo), F_SAMPLES_START + ram_sample_id);
+}
+
+static void save_retired_preset(void) {
+	if (retired_preset_id == NO_PRESET)
+		return;
+	flash_write_page(&next_preset, sizeof(Preset), retired_preset_id);
+	retired_preset_id = NO_PRESET;
+}
+
+// main loop: keep the preset that is being switched to, or else the cued one, in next_preset
+static void stage_preset(void) {
+	save_retired_preset();
+	u8 preset_id = preset_outdated() ? sys_params.preset_id : cued_preset_id;
+	if (preset_id >= NUM_PRESETS || preset_id == staged_preset_id || preset_id == ram_preset_id)
+		return;
+	// hide next_preset from the audio tick while it is being filled
+	staged_preset_id = NO_PRESET;
+	memory_barrier();
+	// a switch got in before that, its outgoing preset gets written back first
+	if (retired_preset_id != NO_PRESET)
+		return;
+	memcpy(&next_preset, preset_flash_ptr(preset_id), sizeof(Preset));
+	memory_barrier();
+	staged_preset_id = preset_id;
+}
+
+static void swap_staged_preset(void) {
+	u32* cur = (u32*)&cur_preset;
+	u32* next = (u32*)&next_preset;
+	for (u16 i = 0; i < sizeof(Preset) / 4; ++i) {
+		u32 word = cur[i];
+		cur[i] = next[i];
+		next[i] = word;
+	}
+	u8 prev_preset_id = ram_preset_id;
+	ram_preset_id = staged_preset_id;
+	if (segment_outdated(SEG_PRESET)) {
+		staged_preset_id = NO_PRESET;
+		retired_preset_id = prev_preset_id;
+		last_flash_write[SEG_PRESET] = last_ram_write[SEG_PRESET];
+	}
+	else
+		staged_preset_id = prev_preset_id;
+}
+
 // == MAIN == //
 
-// only_filled returns 0 if the step doesn't hold any pressure data
+// only_filled returns 0 if the step doesn't hold any pressure
 PatternStringStep* string_step_ptr(u8 string_id, bool only_filled, u8 seq_step) {
 	if (preset_outdated() && only_filled)
 		return 0;
-	PatternStringStep* step = &cur_ptn_quarter[(seq_step >> 4) & 3].steps[seq_step & 15][string_id];
-	if (!only_filled)
-		return step;
-	// return pointer if any of its substeps hold pressure
-	for (u8 substep_id = 0; substep_id < 8; substep_id++)
-		if (step->pres[substep_id])
-			return step;
-	// otherwise return 0
-	return 0;
+	u8 qtr = step_quarter(seq_step);
+	u8 step = seq_step % PTN_STEPS_PER_QTR;
+	if (only_filled && !qtr_substeps[qtr][step][string_id])
+		return 0;
+	return &cur_ptn_quarter[qtr].steps[step][string_id];
+}
+
+// bitmask of the substeps holding pressure, 0 under the same conditions as string_step_ptr with only_filled
+u8 step_substeps(u8 string_id, u8 seq_step) {
+	if (preset_outdated())
+		return 0;
+	return qtr_substeps[step_quarter(seq_step)][seq_step % PTN_STEPS_PER_QTR][string_id];
+}
+
+// bitmask of the strings holding pressure in the step
+u8 step_strings(u8 seq_step) {
+	return qtr_strings[step_quarter(seq_step)][seq_step % PTN_STEPS_PER_QTR];
+}
+
+// the two bit fields have room for one value more than they use, old flash or a restore from the host can hold it
+void clamp_sys_params(void) {
+	if (sys_params.cv_quant >= NUM_CV_QUANT_TYPES)
+		sys_params.cv_quant = CVQ_OFF;
+	if (sys_params.touch_scan >= NUM_SCAN_STRATEGIES)
+		sys_params.touch_scan = SCAN_TWO_PASS;
+	if (sys_params.clock_smoothing >= NUM_CLOCK_SMOOTHINGS)
+		sys_params.clock_smoothing = CLK_SMOOTH_NORMAL;
 }
 
 void init_ram(void) {
 	cued_preset_id = -1;
 	cued_pattern_id = -1;
 	cued_sample_id = -1;
-	ram_pattern_id = -1;
 	ram_sample_id = -1;
 	ram_preset_id = -1;
+	ram_pattern_id = -1;
 	// relocate the first preset and pattern into ram
 	edit_item_id = 255;
 	for (u8 i = 0; i < NUM_RAM_SEGMENTS; ++i) {
@@ -120,7 +283,8 @@ void init_ram(void) {
 		sys_params.accel_sens = 150; // 100%
 		sys_params.cv_quant = CVQ_OFF;
 		sys_params.reverse_encoder = false;
-		sys_params.paddy = 0;
+		sys_params.touch_scan = SCAN_TWO_PASS;
+		sys_params.clock_smoothing = CLK_SMOOTH_NORMAL;
 		memset(sys_params.pad, 0, sizeof(sys_params.pad));
 		sys_params.version = REV_SYS_PARAMS_VERSION;
 		// fall through for further updating
@@ -140,6 +304,7 @@ void init_ram(void) {
 		oled_flip();
 		HAL_Delay(2000);
 	}
+	clamp_sys_params();
 	codec_update_volume();
 	recent_load_item = sys_params.preset_id;
 }
@@ -149,28 +314,13 @@ static bool need_flash_write(RamSegment seg, u32 now) {
 	if (last_ram_write[seg] == last_flash_write[seg])
 		return false;
 
-	// a ram item (preset, pattern, sample) being outdated means the user has requested to load a different one, but
-	// that load has not happened yet because the current item hasn't finished writing to flash - we need to write it to
-	// flash immediately so the new item can be loaded
-	switch (seg) {
-	case SEG_PRESET:
-		if (preset_outdated())
-			return true;
-		break;
-	case SEG_PAT0:
-	case SEG_PAT1:
-	case SEG_PAT2:
-	case SEG_PAT3:
-		if (pattern_outdated())
-			return true;
-		break;
-	case SEG_SAMPLE:
-		if (sample_outdated())
-			return true;
-		break;
-	default:
-		break;
-	}
+	// a pattern or sample being outdated means the user has requested to load a different one, but that load has not
+	// happened yet because the current one hasn't finished writing to flash - we need to write it to flash immediately
+	// so the new one can be loaded. Presets don't wait for this, the switch takes their edits along (see stage_preset)
+	if (seg >= SEG_PAT0 && seg <= SEG_PAT3 && pattern_outdated())
+		return true;
+	if (seg == SEG_SAMPLE && sample_outdated())
+		return true;
 
 	// if our ram item was not outdated, that means we changed something small (a parameter, the contents of a step,
 	// etc) we try to wait for at least 5 seconds after the most recent edit before we write them to flash
@@ -192,15 +342,16 @@ void ram_frame(void) {
 			edit_item_id &= 63;
 			switch (item_type) {
 			case RAM_PRESET:
+				cancel_preset_glide();
 				memcpy(&cur_preset, init_params_ptr(), sizeof(cur_preset));
 				last_ram_write[SEG_PRESET] = now;
 				break;
 			case RAM_PATTERN:
 				memset(&cur_ptn_quarter, 0, sizeof(cur_ptn_quarter));
-				last_ram_write[SEG_PAT0] = now;
-				last_ram_write[SEG_PAT1] = now;
-				last_ram_write[SEG_PAT2] = now;
-				last_ram_write[SEG_PAT3] = now;
+				for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr) {
+					index_quarter(qtr);
+					last_ram_write[SEG_PAT0 + qtr] = now;
+				}
 				break;
 			case RAM_SAMPLE:
 				memset(&cur_sample_info, 0, sizeof(SampleInfo));
@@ -213,11 +364,10 @@ void ram_frame(void) {
 		// msb not set, preset tries to copy to itself => toggle
 		else if (edit_item_id == copy_preset_id) {
 			// flush any writes
-			last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
-			last_flash_write[SEG_PRESET] = last_ram_write[SEG_PRESET];
-			flash_write_page(&cur_preset, sizeof(Preset), ram_preset_id);
+			save_cur_preset();
 			// -- flush any writes
 			flash_toggle_preset(copy_preset_id);
+			cancel_preset_glide();
 			memcpy(&cur_preset, preset_flash_ptr(sys_params.preset_id), sizeof(cur_preset));
 			load_preset(edit_item_id, true);
 		}
@@ -225,15 +375,25 @@ void ram_frame(void) {
 		else {
 			switch (item_type) {
 			case RAM_PRESET:
+				// copy with the unsaved edits, and write back a retired preset before the copy can land on it
+				save_retired_preset();
+				if (copy_preset_id == ram_preset_id && segment_outdated(SEG_PRESET))
+					save_cur_preset();
 				flash_write_page(preset_flash_ptr(copy_preset_id), sizeof(Preset), edit_item_id);
 				load_preset(edit_item_id, true);
 				break;
 			case RAM_PATTERN: {
-				u8 src_page = 4 * copy_pattern_id;
-				u8 dst_page = 4 * (edit_item_id - PATTERNS_START) + PATTERNS_START;
-				for (u8 qtr = 0; qtr < 4; ++qtr)
-					flash_write_page(ptn_quarter_flash_ptr(src_page + qtr), sizeof(PatternQuarter), dst_page + qtr);
-				save_param_index(P_PATTERN, edit_item_id - PATTERNS_START);
+				u8 dst_pattern_id = edit_item_id - PATTERNS_START;
+				// copy with the unsaved edits, the copy replaces what ram holds of the destination
+				for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr)
+					if (copy_pattern_id == ram_pattern_id && segment_outdated(SEG_PAT0 + qtr))
+						save_pattern_quarter(qtr);
+				if (dst_pattern_id == ram_pattern_id)
+					drop_pattern();
+				for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr)
+					flash_write_page(ptn_quarter_flash_ptr(ptn_quarter_id(copy_pattern_id, qtr)),
+					                 sizeof(PatternQuarter), PATTERNS_START + ptn_quarter_id(dst_pattern_id, qtr));
+				save_param_index(P_PATTERN, dst_pattern_id);
 			} break;
 			default:
 				// samples don't copy
@@ -246,64 +406,82 @@ void ram_frame(void) {
 
 	// write ram items to flash (auto-save)
 
-	for (u8 qtr = 0; qtr < 4; ++qtr) {
-		if (need_flash_write(SEG_PAT0 + qtr, now)) {
-			last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
-			last_flash_write[SEG_PAT0 + qtr] = last_ram_write[SEG_PAT0 + qtr];
-			flash_write_page(&cur_ptn_quarter[qtr], sizeof(PatternQuarter), PATTERNS_START + 4 * ram_pattern_id + qtr);
-		}
-	}
-	if (need_flash_write(SEG_SAMPLE, now)) {
-		last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
-		last_flash_write[SEG_SAMPLE] = last_ram_write[SEG_SAMPLE];
-		if (ram_sample_id < NUM_SAMPLES)
-			flash_write_page(&cur_sample_info, sizeof(SampleInfo), F_SAMPLES_START + ram_sample_id);
-	}
-	if (need_flash_write(SEG_PRESET, now) || need_flash_write(SEG_SYS, now)) {
-		last_flash_write[SEG_SYS] = last_ram_write[SEG_SYS];
-		last_flash_write[SEG_PRESET] = last_ram_write[SEG_PRESET];
-		flash_write_page(&cur_preset, sizeof(Preset), ram_preset_id);
-	}
+	for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr)
+		if (need_flash_write(SEG_PAT0 + qtr, now))
+			save_pattern_quarter(qtr);
+	if (need_flash_write(SEG_SAMPLE, now))
+		save_cur_sample();
+	stage_preset();
+	if (need_flash_write(SEG_PRESET, now) || need_flash_write(SEG_SYS, now))
+		save_cur_preset();
 }
 
-// == UPDATE RAM == //
-
-static bool segment_outdated(RamSegment seg) {
-	return last_ram_write[seg] != last_flash_write[seg];
+// main loop: write all unsaved edits to flash right away, without waiting for the auto-save
+void save_ram_edits(void) {
+	for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr)
+		if (segment_outdated(SEG_PAT0 + qtr))
+			save_pattern_quarter(qtr);
+	if (segment_outdated(SEG_SAMPLE))
+		save_cur_sample();
+	if (segment_outdated(SEG_PRESET) || segment_outdated(SEG_SYS))
+		save_cur_preset();
 }
 
+// == UPDATE RAM == //
+
 void log_ram_edit(RamSegment segment) {
 	last_ram_write[segment] = millis();
 }
 
-bool update_preset_ram(bool force) {
-	// already up to date
-	if (!preset_outdated() && !force)
-		return true;
-	// flash is not ready
-	if (flash_busy || segment_outdated(SEG_PRESET))
-		return false;
-	// retrieve preset from flash
-	memcpy(&cur_preset, preset_flash_ptr(sys_params.preset_id), sizeof(cur_preset));
-	ram_preset_id = sys_params.preset_id;
-	return true;
+bool preset_ram_ready(void) {
+	return !preset_outdated();
 }
 
-void update_pattern_ram(bool force) {
+// audio tick, at its start: switch to the selected preset, from next_preset if it is staged there, otherwise straight
+// from flash as long as the outgoing preset has nothing to write back
+void update_preset_ram(void) {
+	if (!preset_outdated() || saving_preset)
+		return;
+	bool staged = staged_preset_id == sys_params.preset_id;
+	if (!staged && (flash_busy || segment_outdated(SEG_PRESET) || sys_params.preset_id == retired_preset_id))
+		return;
+	begin_preset_glide();
+	if (staged)
+		swap_staged_preset();
+	else {
+		memcpy(&cur_preset, preset_flash_ptr(sys_params.preset_id), sizeof(cur_preset));
+		ram_preset_id = sys_params.preset_id;
+	}
+	end_preset_glide();
+	preset_switch_ticks = mini(synth_tick - switch_start_tick, 65535);
+	preset_switch_max_ticks = maxi(preset_switch_max_ticks, preset_switch_ticks);
+}
+
+// audio tick: copy in the selected pattern as soon as the edits of the outgoing one are in flash
+void update_pattern_ram(void) {
 	cur_pattern_id = param_index(P_PATTERN);
 	// already up to date
-	if (!pattern_outdated() && !force)
+	if (!pattern_outdated())
 		return;
 	// flash is not ready
-	if (flash_busy || segment_outdated(SEG_PAT0) || segment_outdated(SEG_PAT1) || segment_outdated(SEG_PAT2)
-	    || segment_outdated(SEG_PAT3))
+	if (flash_busy || saving_pattern || pattern_edited())
 		return;
-	// retrieve pattern from flash
-	for (u8 qtr = 0; qtr < 4; ++qtr)
-		memcpy(&cur_ptn_quarter[qtr], ptn_quarter_flash_ptr(4 * cur_pattern_id + qtr), sizeof(cur_ptn_quarter[0]));
+	// retrieve the pattern from flash
+	for (u8 qtr = 0; qtr < MAX_PTN_QUARTERS; ++qtr) {
+		memcpy(&cur_ptn_quarter[qtr], ptn_quarter_flash_ptr(ptn_quarter_id(cur_pattern_id, qtr)),
+		       sizeof(PatternQuarter));
+		index_quarter(qtr);
+	}
 	ram_pattern_id = cur_pattern_id;
 }
 
+// an edit of the given step, its quarter gets reindexed now and written back to flash later
+void log_pattern_edit(u8 seq_step) {
+	u8 qtr = step_quarter(seq_step);
+	index_step(qtr, seq_step % PTN_STEPS_PER_QTR);
+	log_ram_edit(SEG_PAT0 + qtr);
+}
+
 void update_sample_ram(bool force) {
 	cur_sample_id = param_index(P_SAMPLE);
 	// already up to date
@@ -322,12 +500,25 @@ void update_sample_ram(bool force) {
 
 // == SAVE / LOAD == //
 
+// the audio tick switches at the start of its next run, force loads the preset from flash right away and is for the
+// main loop only
 void load_preset(u8 preset_id, bool force) {
 	if (preset_id == sys_params.preset_id && !force)
 		return;
+	if (!preset_outdated())
+		switch_start_tick = synth_tick;
 	sys_params.preset_id = preset_id;
 	log_ram_edit(SEG_SYS);
-	update_preset_ram(force);
+	if (force) {
+		save_retired_preset();
+		staged_preset_id = NO_PRESET;
+		if (preset_outdated() && segment_outdated(SEG_PRESET))
+			save_cur_preset();
+		cancel_preset_glide();
+		memcpy(&cur_preset, preset_flash_ptr(preset_id), sizeof(cur_preset));
+		ram_preset_id = preset_id;
+		last_flash_write[SEG_PRESET] = last_ram_write[SEG_PRESET];
+	}
 	clear_latch();
 }
 
@@ -340,6 +531,53 @@ void load_sample(u8 sample_id) {
 	cued_sample_id = 255;
 }
 
+// the most recent version of a flash item: the ram copy if the item is loaded, otherwise its flash page
+const void* latest_flash_item(u8 flash_item_id) {
+	if (flash_item_id < PATTERNS_START) {
+		if (flash_item_id == ram_preset_id)
+			return &cur_preset;
+		return flash_item_id == retired_preset_id ? &next_preset : (const void*)preset_flash_ptr(flash_item_id);
+	}
+	if (flash_item_id < F_SAMPLES_START) {
+		u8 quarter_id = flash_item_id - PATTERNS_START;
+		if (quarter_id / MAX_PTN_QUARTERS == ram_pattern_id)
+			return &cur_ptn_quarter[quarter_id % MAX_PTN_QUARTERS];
+		return ptn_quarter_flash_ptr(quarter_id);
+	}
+	u8 sample_id = flash_item_id - F_SAMPLES_START;
+	return sample_id == ram_sample_id ? &cur_sample_info : sample_info_flash_ptr(sample_id);
+}
+
+// a flash item was overwritten from outside of the ui, reload it if it is loaded and drop its unsaved edits
+void reload_flash_item(u8 flash_item_id) {
+	if (flash_item_id < PATTERNS_START) {
+		if (flash_item_id == staged_preset_id)
+			staged_preset_id = NO_PRESET;
+		if (flash_item_id == retired_preset_id)
+			retired_preset_id = NO_PRESET;
+		if (flash_item_id != ram_preset_id)
+			return;
+		cancel_preset_glide();
+		memcpy(&cur_preset, preset_flash_ptr(flash_item_id), sizeof(Preset));
+		last_flash_write[SEG_PRESET] = last_ram_write[SEG_PRESET];
+		return;
+	}
+	if (flash_item_id < F_SAMPLES_START) {
+		u8 quarter_id = flash_item_id - PATTERNS_START;
+		if (quarter_id / MAX_PTN_QUARTERS != ram_pattern_id)
+			return;
+		u8 qtr = quarter_id % MAX_PTN_QUARTERS;
+		memcpy(&cur_ptn_quarter[qtr], ptn_quarter_flash_ptr(quarter_id), sizeof(PatternQuarter));
+		index_quarter(qtr);
+		last_flash_write[SEG_PAT0 + qtr] = last_ram_write[SEG_PAT0 + qtr];
+		return;
+	}
+	if (flash_item_id - F_SAMPLES_START != ram_sample_id)
+		return;
+	memcpy(&cur_sample_info, sample_info_flash_ptr(ram_sample_id), sizeof(SampleInfo));
+	last_flash_write[SEG_SAMPLE] = last_ram_write[SEG_SAMPLE];
+}
+
 // register the most recently touched ram item
 void touch_load_item(u8 item_id) {
 	recent_load_item = item_id;
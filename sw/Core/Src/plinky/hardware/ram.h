@@ -10,24 +10,33 @@ extern u8 cur_sample_id;           // possibly remove after SPI cleanup
 extern Preset cur_preset;          // could be made local by optimizing sequencer & modulation
 extern SampleInfo cur_sample_info; // possibly give sampler its own copy
 
-// get ram state
-bool pattern_outdated(void);
+// audio ticks from requesting a preset to playing it, of the latest switch and the slowest one since boot
+extern u16 preset_switch_ticks;
+extern u16 preset_switch_max_ticks;
 
 // main
 PatternStringStep* string_step_ptr(u8 string_id, bool only_filled, u8 seq_step);
+u8 step_substeps(u8 string_id, u8 seq_step);
+u8 step_strings(u8 seq_step);
 
 void init_ram(void);
 void ram_frame(void);
+void save_ram_edits(void);
+void clamp_sys_params(void);
 
 // update ram
 void log_ram_edit(RamSegment segment);
-bool update_preset_ram(bool force);
-void update_pattern_ram(bool force);
+bool preset_ram_ready(void);
+void update_preset_ram(void);
+void update_pattern_ram(void);
+void log_pattern_edit(u8 seq_step);
 void update_sample_ram(bool force);
 
 // save / load
 void load_preset(u8 preset_id, bool force);
 void load_sample(u8 sample_id);
+const void* latest_flash_item(u8 flash_item_id);
+void reload_flash_item(u8 flash_item_id);
 
 void touch_load_item(u8 item_id);
 void clear_load_item(void);
@@ -24,22 +24,53 @@ u8 spi_bit_tx[256 + 4];
 
 // toolies
 
+// host builds have no registers, they select the simulated flash chips through the hal (see tools/flash_sim.c)
+
 static void spi_assert_cs(void) {
+#ifdef __arm__
 	SPI_PORT->BSRR = SPI_CS1_PIN_ | SPI_CS0_PIN_;
 	hspi2.Instance->CR1 &= ~(64);
 	hspi2.Instance->CR1 |= 1 | 64;
 
 	SPI_PORT->BRR = cur_spi_pin;
+#else
+	HAL_GPIO_WritePin(SPI_PORT, SPI_CS1_PIN_ | SPI_CS0_PIN_, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(SPI_PORT, cur_spi_pin, GPIO_PIN_RESET);
+#endif
 }
 
 static void spi_release_cs(void) {
+#ifdef __arm__
+	SPI_PORT->BSRR = SPI_CS1_PIN_ | SPI_CS0_PIN_;
+#else
+	HAL_GPIO_WritePin(SPI_PORT, SPI_CS1_PIN_ | SPI_CS0_PIN_, GPIO_PIN_SET);
+#endif
+}
+
+static void spi_assert_dac_cs(void) {
+#ifdef __arm__
+	hspi2.Instance->CR1 &= ~(1 | 64);
+	hspi2.Instance->CR1 |= 64;
 	SPI_PORT->BSRR = SPI_CS1_PIN_ | SPI_CS0_PIN_;
+	GPIOA->BRR = 1 << 8; // dac cs low
+#else
+	spi_release_cs();
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_8, GPIO_PIN_RESET);
+#endif
+}
+
+static void spi_release_dac_cs(void) {
+#ifdef __arm__
+	GPIOA->BSRR = 1 << 8; // DAC cs high
+#else
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_8, GPIO_PIN_SET);
+#endif
 }
 
 static void reset_spi_state(void) {
 	spi_state = 0;
 	alex_dma_mode = false;
-	GPIOA->BSRR = 1 << 8; // DAC cs high
+	spi_release_dac_cs();
 }
 
 // init
@@ -72,6 +103,7 @@ void init_spi(void) {
 
 // main
 
+#ifdef __arm__
 static void dma_set_config(DMA_HandleTypeDef* hdma, u32 src_address, u32 dst_address, u32 data_length) {
 	hdma->DmaBaseAddress->IFCR = (DMA_ISR_GIF1 << (hdma->ChannelIndex & 0x1CU)); /* Clear all flags */
 	hdma->Instance->CNDTR = data_length;
@@ -84,16 +116,18 @@ static void dma_set_config(DMA_HandleTypeDef* hdma, u32 src_address, u32 dst_add
 		hdma->Instance->CMAR = dst_address;
 	}
 }
+#endif
 
-static void setup_spi_alex_dma(u32 tx_addr, u32 rx_addr, int len) { // len is in 8 bit words
+static void setup_spi_alex_dma(const void* tx, void* rx, int len) { // len is in 8 bit words
 	// ALEX DMA MODE! fewer interrupts; simpler code.
 	alex_dma_mode = true;
+#ifdef __arm__
 	CLEAR_BIT(hspi2.Instance->CR2, SPI_CR2_LDMATX | SPI_CR2_LDMARX); // Reset the threshold bit
 	SET_BIT(hspi2.Instance->CR2,
 	        SPI_RXFIFO_THRESHOLD); // Set RX Fifo threshold according the reception data length: 8bit
 	// config rx dma - transfer complete callback
 	__HAL_DMA_DISABLE(hspi2.hdmarx);
-	dma_set_config(hspi2.hdmarx, (u32)&hspi2.Instance->DR, rx_addr, len);
+	dma_set_config(hspi2.hdmarx, (u32)&hspi2.Instance->DR, (u32)rx, len);
 	__HAL_DMA_DISABLE_IT(hspi2.hdmarx, (DMA_IT_HT | DMA_IT_TE));
 	__HAL_DMA_ENABLE_IT(hspi2.hdmarx, (DMA_IT_TC));
 	__HAL_DMA_ENABLE(hspi2.hdmarx);
@@ -101,12 +135,16 @@ static void setup_spi_alex_dma(u32 tx_addr, u32 rx_addr, int len) { // len is in
 
 	// config tx dma - no interrupts
 	__HAL_DMA_DISABLE(hspi2.hdmatx);
-	dma_set_config(hspi2.hdmatx, tx_addr, (u32)&hspi2.Instance->DR, len);
+	dma_set_config(hspi2.hdmatx, (u32)tx, (u32)&hspi2.Instance->DR, len);
 	__HAL_DMA_DISABLE_IT(hspi2.hdmatx, (DMA_IT_HT | DMA_IT_TE | DMA_IT_TC));
 	__HAL_DMA_ENABLE(hspi2.hdmatx);
 	if ((hspi2.Instance->CR1 & SPI_CR1_SPE) != SPI_CR1_SPE)
 		__HAL_SPI_ENABLE(&hspi2); // Enable SPI peripheral
 	SET_BIT(hspi2.Instance->CR2, SPI_CR2_TXDMAEN);
+#else
+	// host builds: the simulated flash answers at once, calling alex_dma_done() stands in for the irq
+	HAL_SPI_TransmitReceive(&hspi2, (u8*)tx, rx, len, -1);
+#endif
 }
 
 static void spi_update_dac(int dac_chan) {
@@ -118,11 +156,8 @@ static void spi_update_dac(int dac_chan) {
 	dac_cmd = (dac_cmd >> 8) | (dac_cmd << 8);
 	// set expander dac
 	cur_spi_pin = 0;
-	hspi2.Instance->CR1 &= ~(1 | 64);
-	hspi2.Instance->CR1 |= 64;
-	SPI_PORT->BSRR = SPI_CS1_PIN_ | SPI_CS0_PIN_;
-	GPIOA->BRR = 1 << 8; // dac cs low
-	setup_spi_alex_dma((u32)&dac_cmd, (u32)&dac_dummy, 2);
+	spi_assert_dac_cs();
+	setup_spi_alex_dma(&dac_cmd, &dac_dummy, 2);
 }
 
 static int spi_readgrain_dma(int grain_id) {
@@ -153,7 +188,7 @@ again:
 	spi_set_chip(addr);
 	spi_assert_cs();
 
-	setup_spi_alex_dma((u32)spi_bit_tx, (u32)(grain_buf_ptr() + start), len * 2);
+	setup_spi_alex_dma(spi_bit_tx, grain_buf_ptr() + start, len * 2);
 
 	return 0;
 }
@@ -174,7 +209,26 @@ void spi_ready_for_sampler(u8 grain_id) {
 
 // end of dma irq handler
 
+// starts the next transfer of the chain: grain reads, then the four expander dac channels
+static void spi_dma_next(void) {
+	if (spi_state >= MAX_SPI_STATE) {
+		spi_release_dac_cs();
+		if (spi_state == MAX_SPI_STATE + 4) {
+			reset_spi_state();
+		}
+		else {
+			int dac_chan = spi_state - MAX_SPI_STATE;
+			if (dac_chan < 4 && dac_chan >= 0)
+				spi_update_dac(dac_chan);
+		}
+	}
+	else {
+		spi_readgrain_dma(spi_state);
+	}
+}
+
 void alex_dma_done(void) {
+#ifdef __arm__
 	// replacement irq handler for the HAL guff.
 	DMA_HandleTypeDef* hdma = hspi2.hdmarx; /*!< SPI Rx DMA Handle parameters             */
 	u32 flag_it = hdma->DmaBaseAddress->ISR;
@@ -183,21 +237,11 @@ void alex_dma_done(void) {
 		__HAL_DMA_DISABLE_IT(hdma, DMA_IT_TE | DMA_IT_TC | DMA_IT_HT);
 		hdma->DmaBaseAddress->IFCR =
 		    (DMA_ISR_TCIF1 << (hdma->ChannelIndex & 0x1CU)); /* Clear the transfer complete flag */
-		if (spi_state >= MAX_SPI_STATE) {
-			GPIOA->BSRR = 1 << 8; // DAC cs high
-			if (spi_state == MAX_SPI_STATE + 4) {
-				reset_spi_state();
-			}
-			else {
-				int dac_chan = spi_state - MAX_SPI_STATE;
-				if (dac_chan < 4 && dac_chan >= 0)
-					spi_update_dac(dac_chan);
-			}
-		}
-		else {
-			spi_readgrain_dma(spi_state);
-		}
+		spi_dma_next();
 	}
+#else
+	spi_dma_next();
+#endif
 }
 
 // actual writing
@@ -283,3 +327,33 @@ int spi_write256(u32 addr) {
 		spi_rv = spi_wait_not_busy("write", 0, 0);
 	return spi_rv;
 }
+
+// bus ownership for the main loop, spi_tick() only starts the grain reads while spi_state is 0
+
+void spi_claim(void) {
+	while (spi_state)
+		;
+	spi_state = 255;
+}
+
+void spi_release(void) {
+	spi_state = 0;
+}
+
+// blocking reads, the caller must own the spi bus
+
+int spi_read(u32 addr, void* dst, u32 len) {
+	spi_set_chip(addr);
+	u8 spi_tx_buf[4] = {3, addr >> 16, addr >> 8, addr};
+	u8 spi_rx_buf[4];
+	spi_assert_cs();
+	spi_delay();
+	int spi_rv = HAL_SPI_TransmitReceive(&hspi2, (u8*)spi_tx_buf, (u8*)spi_rx_buf, 4, -1);
+	// the flash ignores what gets clocked out while it is sending, so dst doubles as the tx buffer
+	if (spi_rv == 0)
+		spi_rv = HAL_SPI_TransmitReceive(&hspi2, (u8*)dst, (u8*)dst, len, -1);
+	CHECK_RV(spi_rv, "spi_read");
+	spi_release_cs();
+	spi_delay();
+	return spi_rv;
+}
@@ -18,6 +18,11 @@ extern volatile u8 spi_state;
 extern u8 spi_bit_tx[256 + 4];
 int spi_erase64k(u32 addr, void (*callback)(u8), u8 param);
 int spi_write256(u32 addr);
+int spi_read(u32 addr, void* dst, u32 len);
+
+// main loop access to the flash: waits until the grain reads of the audio tick are done and keeps them off the bus
+void spi_claim(void);
+void spi_release(void);
 
 static inline void spi_delay(void) {
 	volatile static u8 dummy;
@@ -1,7 +1,11 @@
 #include "touchstrips.h"
+#include "analytics/input_trace.h"
+#include "analytics/interval_stats.h"
+#include "encoder.h"
 #include "flash.h"
 #include "gfx/gfx.h"
 #include "leds.h"
+#include "ram.h"
 #include "sensor_defs.h"
 #include "synth/audio.h"
 #include "ui/pad_actions.h"
@@ -11,7 +15,27 @@ extern TSC_HandleTypeDef htsc;
 
 #define TOUCH_THRESHOLD 1000
 
+#define FIRST_PASS_PHASES 0b111
+#define ALL_PHASES ((1 << READ_PHASES) - 1)
+// untouched strips get read once every this many frames in the adaptive strategy, so the first touch of an idle strip
+// can take up to ADAPTIVE_IDLE_FRAMES - 1 extra frames to register
+#define ADAPTIVE_IDLE_FRAMES 4
+
+#define CALIB_SECTIONS (PADS_PER_STRIP + 1) // the pads' calibrated positions split a strip into nine sections
+#define POS_SCALE_BITS 12
+#define INV_PRES_BITS 24
+
+// calibration data, compiled into a form that needs no searching or dividing while processing readings
+typedef struct TouchCalibLut {
+	s16 bound[CALIB_SECTIONS + 1];     // raw position of the section boundaries, including extrapolated outer edges
+	u16 pos_scale[CALIB_SECTIONS];     // (256 << POS_SCALE_BITS) / section size
+	u16 inv_pres[PADS_PER_STRIP];      // (1 << INV_PRES_BITS) / expected pressure at each pad
+	bool calibrated;
+	bool reversed;
+} TouchCalibLut;
+
 static TouchCalibData touch_calib_data[NUM_TOUCH_READINGS];
+static TouchCalibLut touch_calib_lut[NUM_TOUCH_READINGS];
 
 TouchCalibData* touch_calib_ptr(void) {
 	return touch_calib_data;
@@ -25,7 +49,25 @@ static u16 sensor_min[2 * NUM_TOUCH_READINGS];           // lifetime low
 static u16 sensor_max[2 * NUM_TOUCH_READINGS];           // lifetime high
 
 static bool tsc_started = false;
-static u8 read_this_frame = 0; // has touch (0 - 7) been read this touch_frame? bitmask
+static u16 read_this_frame = 0; // has touch (0 - 8) been read this touch_frame? bitmask
+
+// read loop
+static u8 read_phase = 0;
+static u8 reading_id = 0;
+static u8 group_id = 0;
+static u8 sensor_id = 0;
+static u16 phase_read_mask = ALL_PHASES; // fill min_value array on first loop
+static TouchScanStrategy frame_strategy = SCAN_TWO_PASS;
+static s8 strategy_override = -1;
+static u16 strips_active = 0; // strips that were touched at their last reading
+static u8 idle_frame = 0;     // adaptive strategy: the untouched strips whose turn it is
+
+// scan benchmark
+static volatile bool bench_active = false;
+static u32 last_update_us[NUM_TOUCHSTRIPS];
+static IntervalStats touched_stats[NUM_TOUCHSTRIPS];
+static IntervalStats idle_stats[NUM_TOUCHSTRIPS];
+static bool bench_enc_held;
 
 // sensor macros
 
@@ -39,21 +81,31 @@ static u8 read_this_frame = 0; // has touch (0 - 7) been read this touch_frame?
 #define B_DIFF(reading_id) (B_VAL(reading_id) - B_MIN(reading_id))
 #define IS_TOUCH(reading_id) (A_DIFF(reading_id) + B_DIFF(reading_id) > TOUCH_THRESHOLD)
 
-static void setup_tsc(u8 read_phase) {
+static void setup_tsc(u8 phase) {
 	TSC_IOConfigTypeDef config = {0};
-	config.ChannelIOs = channels_io[read_phase];
-	config.SamplingIOs = sample_io[read_phase];
+	config.ChannelIOs = channels_io[phase];
+	config.SamplingIOs = sample_io[phase];
 	HAL_TSC_IOConfig(&htsc, &config);
 	HAL_TSC_IODischarge(&htsc, ENABLE);
 	tsc_started = false;
 }
 
+// point the read loop at the first reading of a phase and set up the TSC for it
+static void start_read_phase(u8 phase) {
+	read_phase = phase;
+	reading_id = phase ? max_readings_in_phase[phase - 1] : 0;
+	group_id = reading_group[reading_id];
+	sensor_id = reading_sensor[reading_id];
+	setup_tsc(phase);
+}
+
 void init_touchstrips(void) {
 	memset(sensor_val, 0, sizeof(sensor_val));
 	memset(sensor_min, -1, sizeof(sensor_min));
 	memset(sensor_max, 0, sizeof(sensor_max));
 	memset(touch_calib_data, 0, sizeof(touch_calib_data));
-	setup_tsc(0);
+	memset(touch_calib_lut, 0, sizeof(touch_calib_lut));
+	start_read_phase(0);
 }
 
 // == GET TOUCH INFO == //
@@ -119,6 +171,36 @@ static bool validate_shift_state_change(ShiftState new_state) {
 	return true;
 }
 
+// the touch of this strip is final for this frame, handle it in the context of shift states, parameters and other
+// actions
+static void handle_touch(u8 touch_id) {
+	Touch* cur_touch = get_touch(touch_id);
+
+	// don't further process the touches during cv-calib
+	if (calib_mode == CALIB_CV)
+		return;
+
+	// shift buttons
+	if (touch_id == 8) {
+		ShiftState new_state = cur_touch->pos >> 8;
+		// valid new state? => set
+		if (validate_shift_state_change(new_state))
+			shift_set_state(new_state);
+		// no pressure on strip but we were in a state => release
+		else if (cur_touch->pres <= 0 && shift_state != SS_NONE)
+			shift_release_state();
+		// in any shift state => hold
+		if (shift_state != SS_NONE)
+			shift_hold_state();
+	}
+	// main grid
+	else {
+		// at this point the touchstrip has fully been processed to be used by the synth, which runs on its own time
+		// next, the touchstrip gets handled in the context of parameters and other actions
+		handle_pad_actions(touch_id, cur_touch);
+	}
+}
+
 static void process_reading(u8 reading_id) {
 	// raw values
 	s16 raw_pos = sensor_reading_position(reading_id);
@@ -132,50 +214,63 @@ static void process_reading(u8 reading_id) {
 	// calibration
 	u16 calib_pos;
 	s16 calib_pres;
-	const TouchCalibData* c = &touch_calib_data[reading_id];
+	const TouchCalibLut* lut = &touch_calib_lut[reading_id];
 
 	// we have calibration data, let's apply it
-	if (c->pres[0] != 0) {
-		s16 avg_pres;
-
-		// handle reversed calibration values
-		bool reversed = c->pos[7] < c->pos[0];
+	if (lut->calibrated) {
+		u16 inv_pres;
+		// on reversed strips we compare ~raw_pos against -bound, which is equivalent to comparing raw_pos against
+		// bound with the comparison inverted
+		s16 flip = lut->reversed ? -1 : 0;
+		s16 norm_pos = raw_pos ^ flip;
+#define NORM_BOUND(id) ((lut->bound[id] ^ flip) - flip)
 
 		// position out of range, negative extreme
-		if ((raw_pos < c->pos[0] - (c->pos[1] - c->pos[0])) ^ reversed) {
+		if (norm_pos < NORM_BOUND(0)) {
 			calib_pos = TOUCH_MIN_POS;
-			avg_pres = c->pres[0];
+			inv_pres = lut->inv_pres[0];
 		}
 		// position out of range, positive extreme
-		else if ((raw_pos >= c->pos[7] + (c->pos[7] - c->pos[6])) ^ reversed) {
+		else if (norm_pos >= NORM_BOUND(CALIB_SECTIONS)) {
 			calib_pos = TOUCH_MAX_POS;
-			avg_pres = c->pres[7];
+			inv_pres = lut->inv_pres[PADS_PER_STRIP - 1];
 		}
 		// position in range
 		else {
-			// find the correct section
+			// find the correct section: binary search over the calibrated pad positions (bound 1 through 8)
 			u8 section = 0;
-			s16 upper_pos = c->pos[0];
-			while (section < 8 && ((raw_pos >= upper_pos) ^ reversed)) {
-				section++;
-				if (section == 8)
-					upper_pos = c->pos[7] + (c->pos[7] - c->pos[6]); // extrapolated
-				else
-					upper_pos = c->pos[section];
-			}
-			s16 lower_pos = (section == 0) ? c->pos[0] - (c->pos[1] - c->pos[0]) : c->pos[section - 1];
+			if (norm_pos >= NORM_BOUND(4))
+				section = 4;
+			if (norm_pos >= NORM_BOUND(section + 2))
+				section += 2;
+			if (norm_pos >= NORM_BOUND(section + 1))
+				section += 1;
+			if (section == PADS_PER_STRIP - 1 && norm_pos >= NORM_BOUND(PADS_PER_STRIP))
+				section = PADS_PER_STRIP;
+#undef NORM_BOUND
 			// scale the position between the upper and lower calibrations
-			s16 section_size = upper_pos - lower_pos;
-			s16 section_pos = (section_size ^ reversed) ? ((raw_pos - lower_pos) * 256) / section_size : 0;
+			s16 section_pos = (abs(raw_pos - lut->bound[section]) * lut->pos_scale[section]) >> POS_SCALE_BITS;
 			calib_pos = clampi(section * 256 - 128 + section_pos, TOUCH_MIN_POS, TOUCH_MAX_POS);
-			// scale the pressure between the upper and lower calibrations
-			s16 lower_pres = c->pres[maxi(0, section - 1)];
-			s16 upper_pres = c->pres[mini(7, section)];
-			avg_pres = (upper_pres - lower_pres) * section_pos / 256 + lower_pres;
+			// scale the expected pressure between the upper and lower calibrations
+			u8 lower_pad = maxi(0, section - 1);
+			u8 upper_pad = mini(PADS_PER_STRIP - 1, section);
+			const TouchCalibData* c = &touch_calib_data[reading_id];
+			s32 avg_pres = maxi((c->pres[upper_pad] - c->pres[lower_pad]) * section_pos / 256 + c->pres[lower_pad], 1000);
+			// interpolating the reciprocals overestimates the reciprocal of the interpolated pressure, one newton
+			// step brings it back in line
+			s32 lower_inv = lut->inv_pres[lower_pad];
+			s32 upper_inv = lut->inv_pres[upper_pad];
+			s32 est_inv = lower_inv + (((upper_inv - lower_inv) * section_pos) >> 8);
+			s32 correction = (2 << INV_PRES_BITS) - avg_pres * est_inv;
+			// estimate is too far off for newton to converge, only happens with wildly uneven calibration pressures
+			if (correction <= 0)
+				inv_pres = (1 << INV_PRES_BITS) / avg_pres;
+			else
+				inv_pres = ((s64)est_inv * correction) >> INV_PRES_BITS;
 		}
 		// scale the pressure around the expected pressure at this point - a raw_pres less than half the expected
 		// pressure from calibration results in a negative calib_pres
-		calib_pres = (raw_pres << 12) / maxi(avg_pres, 1000) + TOUCH_MIN_PRES;
+		calib_pres = ((raw_pres * inv_pres) >> (INV_PRES_BITS - 12)) + TOUCH_MIN_PRES;
 	}
 	// we have no calibration data - it's unlikely that we get any usable result without calibration data, but we
 	// can at least map the raw data to acceptable ranges
@@ -195,112 +290,74 @@ static void process_reading(u8 reading_id) {
 	else
 		cur_touch->pos = prev_touch->pos;
 
-	// don't further process the touches during cv-calib
-	if (calib_mode == CALIB_CV)
-		return;
+	// sensor values have been read
+	read_this_frame |= 1 << touch_id;
 
-	// shift buttons
-	if (touch_id == 8) {
-		ShiftState new_state = cur_touch->pos >> 8;
-		// valid new state? => set
-		if (validate_shift_state_change(new_state))
-			shift_set_state(new_state);
-		// no pressure on strip but we were in a state => release
-		else if (cur_touch->pres <= 0 && shift_state != SS_NONE)
-			shift_release_state();
-		// in any shift state => hold
-		if (shift_state != SS_NONE)
-			shift_hold_state();
+	// benchmark: time since the previous update of this strip
+	if (bench_active) {
+		u32 now = micros();
+		if (last_update_us[touch_id])
+			is_add(IS_TOUCH(reading_id) ? &touched_stats[touch_id] : &idle_stats[touch_id],
+			       now - last_update_us[touch_id]);
+		last_update_us[touch_id] = now;
 	}
-	// main grid
-	else {
-		// sensor values have been read
-		read_this_frame |= 1 << touch_id;
 
-		// at this point the touchstrip has fully been processed to be used by the synth, which runs on its own time
-		// next, the touchstrip gets handled in the context of parameters and other actions
-		handle_pad_actions(touch_id, get_touch(touch_id));
-	}
+	handle_touch(touch_id);
 }
 
-// 1. Make sure TSC is set up to read the current phase
-// 2. For each TSC group we are reading, exit if TSC is not done reading yet
-// 3. Read and store the value, keep track of lifetime min/max values
-// 4. Reading and updating is done by read phase, see below
+// strip was skipped this frame => carry its previous touch forward
+static void carry_touch(u8 strip_id) {
+	*get_touch(strip_id) = *get_touch_prev(strip_id, 1);
+	handle_touch(strip_id);
+}
 
-// returns the current read phase
-u8 read_touchstrips(void) {
-	static u8 reading_id = 0;
-	static u8 group_id = 0;
-	static u8 sensor_id = 0;
-	static u8 read_phase = 0;
-	static u16 phase_read_mask = 0xffff; // fill min_value array on first loop
+// == SCAN STRATEGIES == //
+
+// read phases
+//
+// phase 0 through 2 constitute the first pass, they read multiple strips in parallel:
+// - phase 0 reads strips 0, 1, 2, and the first sensor of 8
+// - phase 1 reads strips 3, 4, 5, and the second sensor of 8
+// - phase 2 reads strips 6 and 7
+//
+// phase 3 through 12 constitute the second pass, each of them reads one strip individually:
+// - phase 3 through 10 read strips 0 through 7
+// - strip 8 is read over two phases (11 & 12) because of a wiring issue
+//
+// a scan strategy decides which of these phases get executed in a touch frame. start_frame() returns the phases to
+// execute at the start of a frame, phase_done() processes the readings of a finished phase and returns any phases
+// that should be added to the current frame. Strips that did not get processed in a frame keep their previous touch
+
+// second pass phase(s) that read a single strip
+static u16 strip_phases(u8 strip_id) {
+	return strip_id == 8 ? (1 << 11) + (1 << 12) : 1 << (3 + strip_id);
+}
 
-	if (!tsc_started) {
-		HAL_TSC_Start(&htsc);
-		tsc_started = true;
-		return 255; // give TSC a tick to catch up
+static void process_second_pass_phase(u8 phase) {
+	switch (phase) {
+	case 11: // first sensor of strip 8
+		break;
+	case 12: // second sensor of strip 8
+		process_reading(NUM_TOUCHSTRIPS + 8);
+		break;
+	default: // phase 3 through 10: strips 0 through 7
+		process_reading(NUM_TOUCHSTRIPS + phase - 3);
+		break;
 	}
+}
 
-	// loop to read all sensor values for this phase
-	do {
-		// check whether current group is ready for reading
-		if (HAL_TSC_GroupGetStatus(&htsc, group_id) != TSC_GROUP_COMPLETED)
-			return 255; // give TSC a tick to catch up
-		// if so, save sensor value (resulting range 0 - 65027)
-		u16 value = sensor_val[sensor_id] = (1 << 23) / maxi(129, HAL_TSC_GroupGetValue(&htsc, group_id));
-		// keep track of lifetime min/max values
-		if (calib_mode && value > sensor_max[sensor_id])
-			sensor_max[sensor_id] = value;
-		if (value < sensor_min[sensor_id])
-			sensor_min[sensor_id] = value;
-		// move to next reading
-		reading_id++;
-		group_id = reading_group[reading_id];
-		sensor_id = reading_sensor[reading_id];
-	} while (reading_id < max_readings_in_phase[read_phase]);
-
-	// we have done all readings for this phase
-	HAL_TSC_Stop(&htsc);
+// two-pass: the first pass quickly checks all strips for touches
+// - in a phase, if there are 0 or 1 touches detected, all checked strips are immediately updated
+// - if there are 2 or more touches detected, untouched strips are immediately updated and touched strips are queued
+//   to be updated in the second pass
 
-	// touch-calibration loop is a simplified version of the regular loop
-	if (calib_mode == CALIB_TOUCH) {
-		read_phase++;
-		if (read_phase == READ_PHASES) {
-			touch_frame = (touch_frame + 1) & 7;
-			read_phase = 0;
-			reading_id = 0;
-			group_id = reading_group[reading_id];
-			sensor_id = reading_sensor[reading_id];
-		}
-		setup_tsc(read_phase);
-		return read_phase; // skip the regular loop
-	}
+static u16 two_pass_start_frame(void) {
+	return FIRST_PASS_PHASES;
+}
 
-	// read phases
-	//
-	// the strategy is to first quickly check all strips for touches:
-	// - phase 0 checks strips 0, 1, 2, and the first sensor of 8
-	// - phase 1 checks strips 3, 4, 5, and the second sensor of 8
-	// - plase 2 checks strips 6 and 7
-	//
-	// in a phase, if there are 0 or 1 touches detected, all checked strips are immediately updated
-	// if there are 2 or more touches detected:
-	//	- untouched strips are immediately updated
-	//	- touched strips are queued to be updated in the second pass
-	//
-	// phase 3 through 12 constitute the second pass
-	// - each phase checks their assigned strip (phase_id - 3) if it was queued during the first pass
-	// - strip 8 is checked over two phases (11 & 12) because of a wiring issue
-
-	// rj: while this does some effective checking in the first three frames, the second pass effectively ignores
-	// the values read in the first three frames, which means two read phases (including setting up the TSC) are
-	// spent for one touch update - does this outperform a simple sequential read of the fingers?
-	//
-	// additionally, the sensor readings are saved in 36-sized arrays for 18 sensors, but it looks like the double
-	// sensor readings are not used anywhere - it might be easier to just store them in 18-sized arrays?
-
-	switch (read_phase) {
+static u16 two_pass_phase_done(u8 phase) {
+	u16 queue = 0;
+	switch (phase) {
 	case 0: { // strip 0, 1, 2 and first half of 8
 		bool t0 = IS_TOUCH(0);
 		bool t1 = IS_TOUCH(1);
@@ -315,15 +372,15 @@ u8 read_touchstrips(void) {
 		}
 		else {
 			if (t0)
-				phase_read_mask |= 1 << (3 + 0);
+				queue |= strip_phases(0);
 			else
 				process_reading(0);
 			if (t1)
-				phase_read_mask |= 1 << (3 + 1);
+				queue |= strip_phases(1);
 			else
 				process_reading(1);
 			if (t2)
-				phase_read_mask |= 1 << (3 + 2);
+				queue |= strip_phases(2);
 			else
 				process_reading(2);
 		}
@@ -342,19 +399,19 @@ u8 read_touchstrips(void) {
 		}
 		else {
 			if (t3)
-				phase_read_mask |= 1 << (3 + 3);
+				queue |= strip_phases(3);
 			else
 				process_reading(3);
 			if (t4)
-				phase_read_mask |= 1 << (3 + 4);
+				queue |= strip_phases(4);
 			else
 				process_reading(4);
 			if (t5)
-				phase_read_mask |= 1 << (3 + 5);
+				queue |= strip_phases(5);
 			else
 				process_reading(5);
 			if (t8)
-				phase_read_mask |= (1 << (3 + 8)) + (1 << (3 + 9));
+				queue |= strip_phases(8);
 			else
 				process_reading(8);
 		}
@@ -369,50 +426,271 @@ u8 read_touchstrips(void) {
 		}
 		else {
 			// the only option here is that both strips need to be queued
-			phase_read_mask |= (1 << (3 + 6)) + (1 << (3 + 7));
+			queue |= strip_phases(6) + strip_phases(7);
 		}
 	} break;
-	case 11: // second pass of first sensor of strip 8
-		break;
-	case 12: // second pass of second sensor of strip 8
-		process_reading(NUM_TOUCHSTRIPS + 8);
-		break;
-	default: // phase 3 through 10: second pass of individual fingers 0 through 7
-		process_reading(NUM_TOUCHSTRIPS + read_phase - 3);
+	default:
+		process_second_pass_phase(phase);
 		break;
 	}
+	return queue;
+}
 
-	// look for another phase in this loop that needs to be executed
-	do {
-		read_phase++;
-	} while (read_phase < READ_PHASES && !(phase_read_mask & (1 << read_phase)));
+// sequential: every strip gets its own phase, one update costs one TSC setup
 
-	// if we have completed all read phases
-	if (read_phase == READ_PHASES) {
-		touch_frame = (touch_frame + 1) & 7; // move to next frame,
-		read_this_frame = 0;                 // where no touches have been read
-		read_phase = 0;                      // start back from the top
-		reading_id = 0;
-		group_id = reading_group[reading_id];
-		sensor_id = reading_sensor[reading_id];
-		phase_read_mask = 0b111; // the first three phases are always executed
+static u16 sequential_start_frame(void) {
+	return ALL_PHASES & ~FIRST_PASS_PHASES;
+}
+
+static u16 sequential_phase_done(u8 phase) {
+	process_second_pass_phase(phase);
+	return 0;
+}
+
+// adaptive: like sequential, but only touched strips get read every frame - untouched strips take turns being read
+// every ADAPTIVE_IDLE_FRAMES frames, which makes frames shorter and the touched strips update more often. The price is
+// the latency of a first touch, which waits for its strip's turn
+
+static u16 adaptive_start_frame(void) {
+	idle_frame = (idle_frame + 1) % ADAPTIVE_IDLE_FRAMES;
+	u16 mask = 0;
+	for (u8 strip_id = 0; strip_id < NUM_TOUCHSTRIPS; ++strip_id)
+		if ((strips_active & (1 << strip_id)) || (strip_id % ADAPTIVE_IDLE_FRAMES == idle_frame))
+			mask |= strip_phases(strip_id);
+	return mask;
+}
+
+static u16 adaptive_phase_done(u8 phase) {
+	process_second_pass_phase(phase);
+	if (phase != 11) {
+		u8 strip_id = (phase == 12) ? 8 : phase - 3;
+		if (IS_TOUCH(NUM_TOUCHSTRIPS + strip_id))
+			strips_active |= 1 << strip_id;
+		else
+			strips_active &= ~(1 << strip_id);
 	}
+	return 0;
+}
+
+typedef struct ScanStrategy {
+	u16 (*start_frame)(void);
+	u16 (*phase_done)(u8 phase);
+} ScanStrategy;
 
-	// catch up with any phases we might have missed
-	if (read_phase > 0 && reading_id < max_readings_in_phase[read_phase - 1]) {
-		// set reading id to the start-id of this phase
-		reading_id = max_readings_in_phase[read_phase - 1];
+static const ScanStrategy scan_strategies[NUM_SCAN_STRATEGIES] = {
+    [SCAN_TWO_PASS] = {two_pass_start_frame, two_pass_phase_done},
+    [SCAN_SEQUENTIAL] = {sequential_start_frame, sequential_phase_done},
+    [SCAN_ADAPTIVE] = {adaptive_start_frame, adaptive_phase_done},
+};
+
+// == MAIN == //
+
+// the next phase that is queued for this frame, READ_PHASES if there are none left
+static u8 next_read_phase(u8 phase) {
+	while (phase < READ_PHASES && !(phase_read_mask & (1 << phase)))
+		phase++;
+	return phase;
+}
+
+// 1. Make sure TSC is set up to read the current phase
+// 2. For each TSC group we are reading, exit if TSC is not done reading yet
+// 3. Read and store the value, keep track of lifetime min/max values
+// 4. Process the values according to the active scan strategy, see above
+
+// returns whether a new touch frame has started
+bool read_touchstrips(void) {
+	if (!tsc_started) {
+		HAL_TSC_Start(&htsc);
+		tsc_started = true;
+		return false; // give TSC a tick to catch up
+	}
+
+	// loop to read all sensor values for this phase
+	do {
+		// check whether current group is ready for reading
+		bool ready = HAL_TSC_GroupGetStatus(&htsc, group_id) == TSC_GROUP_COMPLETED;
+		u16 raw = ready ? HAL_TSC_GroupGetValue(&htsc, group_id) : 0;
+		if (!trace_touch(ready, &raw))
+			return false; // give TSC a tick to catch up
+		// if so, save sensor value (resulting range 0 - 65027)
+		u16 value = sensor_val[sensor_id] = (1 << 23) / maxi(129, raw);
+		// keep track of lifetime min/max values
+		if (calib_mode && value > sensor_max[sensor_id])
+			sensor_max[sensor_id] = value;
+		if (value < sensor_min[sensor_id])
+			sensor_min[sensor_id] = value;
+		// move to next reading
+		reading_id++;
 		group_id = reading_group[reading_id];
 		sensor_id = reading_sensor[reading_id];
+	} while (reading_id < max_readings_in_phase[read_phase]);
+
+	// we have done all readings for this phase
+	HAL_TSC_Stop(&htsc);
+
+	// touch-calibration loop simply reads all phases in order
+	if (calib_mode == CALIB_TOUCH) {
+		u8 phase = read_phase + 1;
+		if (phase == READ_PHASES) {
+			touch_frame = (touch_frame + 1) & 7;
+			phase = 0;
+		}
+		start_read_phase(phase);
+		return phase == 0; // skip the regular loop
+	}
+
+	// process the readings and queue any extra phases
+	phase_read_mask |= scan_strategies[frame_strategy].phase_done(read_phase);
+
+	// look for another phase in this frame that needs to be executed
+	u8 phase = next_read_phase(read_phase + 1);
+	bool new_frame = phase == READ_PHASES;
+
+	// if we have completed all read phases
+	if (new_frame) {
+		// strips that were not read keep their previous touch
+		for (u8 strip_id = 0; strip_id < NUM_TOUCHSTRIPS; ++strip_id)
+			if (!(read_this_frame & (1 << strip_id)))
+				carry_touch(strip_id);
+		touch_frame = (touch_frame + 1) & 7; // move to next frame,
+		read_this_frame = 0;                 // where no touches have been read
+		// strategy changes take effect at the start of a frame
+		frame_strategy = (strategy_override >= 0) ? strategy_override : sys_params.touch_scan;
+		if (frame_strategy >= NUM_SCAN_STRATEGIES)
+			frame_strategy = SCAN_TWO_PASS;
+		phase_read_mask = scan_strategies[frame_strategy].start_frame();
+		phase = next_read_phase(0);
 	}
 
 	// prepare for next phase
-	setup_tsc(read_phase);
-	return read_phase;
+	start_read_phase(phase);
+	return new_frame;
+}
+
+// == INPUT TRACE == //
+
+void touch_noise_floor(u16* dst) {
+	memcpy(dst, sensor_min, sizeof(sensor_min));
+}
+
+// start over with the first phase of a fresh frame, from the given noise floor. A replayed trace then feeds its
+// readings to the same sensors as the recording did
+void touchstrips_restart(const u16* noise_floor) {
+	HAL_TSC_Stop(&htsc);
+	memcpy(sensor_min, noise_floor, sizeof(sensor_min));
+	memset(sensor_val, 0, sizeof(sensor_val));
+	memset(touches, 0, sizeof(touches));
+	touch_frame = 0;
+	read_this_frame = 0;
+	strips_active = 0;
+	idle_frame = 0;
+	phase_read_mask = ALL_PHASES;
+	start_read_phase(0);
+}
+
+// == SCAN BENCHMARK == //
+
+static u16 stats_hz(IntervalStats* stats) {
+	float mean = is_mean(stats);
+	return mean > 0.f ? 1000000.f / mean : 0.f;
+}
+
+// a new press of the encoder stops the benchmark, the one that started it has to be released first
+static bool bench_stopped(void) {
+	bool pressed = encoder_pressed;
+	bool stop = pressed && !bench_enc_held;
+	bench_enc_held = pressed;
+	return stop;
+}
+
+// measures how often each strip gets updated with each scan strategy, while the user plays
+void touch_scan_benchmark(void) {
+	static const u16 BENCH_TIME_MS = 4000;
+	static const u16 RESULT_TIME_MS = 5000;
+	u16 touched_hz[NUM_SCAN_STRATEGIES][NUM_TOUCHSTRIPS];
+	u16 idle_hz[NUM_SCAN_STRATEGIES][NUM_TOUCHSTRIPS];
+	float max_jitter[NUM_SCAN_STRATEGIES];
+	bool stopped = false;
+	bench_enc_held = true;
+
+	for (TouchScanStrategy strategy = 0; strategy < NUM_SCAN_STRATEGIES && !stopped; ++strategy) {
+		// run strategy
+		strategy_override = strategy;
+		bench_active = false;
+		for (u8 strip_id = 0; strip_id < NUM_TOUCHSTRIPS; ++strip_id) {
+			is_reset(&touched_stats[strip_id]);
+			is_reset(&idle_stats[strip_id]);
+		}
+		memset(last_update_us, 0, sizeof(last_update_us));
+		bench_active = true;
+		u32 start = millis();
+		while (millis() - start < BENCH_TIME_MS && !(stopped = bench_stopped())) {
+			oled_clear();
+			fdraw_str(0, 0, F_16, "Bench %s", touch_scan_name[strategy]);
+			draw_str(0, 16, F_8, "play with several fingers\nencoder press stops");
+			inverted_rectangle(0, 0, ((millis() - start) * OLED_WIDTH) / BENCH_TIME_MS, OLED_HEIGHT);
+			oled_flip();
+		}
+		bench_active = false;
+		// collect results
+		max_jitter[strategy] = 0.f;
+		for (u8 strip_id = 0; strip_id < NUM_TOUCHSTRIPS; ++strip_id) {
+			touched_hz[strategy][strip_id] = stats_hz(&touched_stats[strip_id]);
+			idle_hz[strategy][strip_id] = stats_hz(&idle_stats[strip_id]);
+			max_jitter[strategy] = maxf(max_jitter[strategy], is_jitter(&touched_stats[strip_id]) * (1.f / 1000.f));
+		}
+	}
+	strategy_override = -1;
+
+	// show results, a page per strategy: update rate of every strip while touched / untouched, and the jitter of the
+	// touched strip that had the most
+	for (TouchScanStrategy strategy = 0; strategy < NUM_SCAN_STRATEGIES && !stopped; ++strategy) {
+		oled_clear();
+		fdraw_str(0, 0, F_8_BOLD, "%s Hz t/i jit %d.%dms", touch_scan_name[strategy], (int)max_jitter[strategy],
+		          (int)(max_jitter[strategy] * 10.f) % 10);
+		for (u8 strip_id = 0; strip_id < NUM_TOUCHSTRIPS; ++strip_id)
+			fdraw_str((strip_id % 3) * 43, 8 + (strip_id / 3) * 8, F_8, "%d:%d/%d", strip_id + 1,
+			          touched_hz[strategy][strip_id], idle_hz[strategy][strip_id]);
+		oled_flip();
+		u32 start = millis();
+		while (millis() - start < RESULT_TIME_MS && !(stopped = bench_stopped()))
+			;
+	}
 }
 
 // == CALIB == //
 
+// compile the calibration data of all readings into lookup tables for process_reading()
+void update_touch_calib_lut(void) {
+	for (u8 reading_id = 0; reading_id < NUM_TOUCH_READINGS; ++reading_id) {
+		const TouchCalibData* c = &touch_calib_data[reading_id];
+		TouchCalibLut* lut = &touch_calib_lut[reading_id];
+		lut->calibrated = false;
+		if (c->pres[0] == 0)
+			continue;
+		lut->reversed = c->pos[PADS_PER_STRIP - 1] < c->pos[0];
+		// section boundaries, the outer edges are extrapolated from the neighbouring sections
+		lut->bound[0] = c->pos[0] - (c->pos[1] - c->pos[0]);
+		for (u8 pad = 0; pad < PADS_PER_STRIP; ++pad)
+			lut->bound[pad + 1] = c->pos[pad];
+		lut->bound[CALIB_SECTIONS] =
+		    c->pos[PADS_PER_STRIP - 1] + (c->pos[PADS_PER_STRIP - 1] - c->pos[PADS_PER_STRIP - 2]);
+		// the binary search in process_reading() expects the pads to be in order, discard pads that aren't
+		for (u8 id = 2; id <= CALIB_SECTIONS; ++id)
+			if ((lut->bound[id] < lut->bound[id - 1]) ^ lut->reversed)
+				lut->bound[id] = lut->bound[id - 1];
+		// position scales
+		for (u8 section = 0; section < CALIB_SECTIONS; ++section) {
+			u16 section_size = abs(lut->bound[section + 1] - lut->bound[section]);
+			lut->pos_scale[section] = section_size ? mini((256 << POS_SCALE_BITS) / section_size, 65535) : 0;
+		}
+		// reciprocals of the expected pressures
+		for (u8 pad = 0; pad < PADS_PER_STRIP; ++pad)
+			lut->inv_pres[pad] = (1 << INV_PRES_BITS) / maxi(c->pres[pad], 1000);
+		lut->calibrated = true;
+	}
+}
+
 void touch_calib(FlashCalibType flash_calib_type) {
 	calib_mode = CALIB_TOUCH;
 
@@ -544,9 +822,11 @@ void touch_calib(FlashCalibType flash_calib_type) {
 				leds[strip][pad] = led_add_gamma(k);
 			}
 		}
+		leds_swap();
 	} while (readings_done < NUM_TOUCH_READINGS);
 
 	// save results
+	update_touch_calib_lut();
 	flash_write_calib(flash_calib_type);
 	HAL_Delay(500);
 	calib_mode = CALIB_NONE;
@@ -18,8 +18,18 @@ Touch* get_touch_prev(u8 touch_id, u8 frames_back);
 // main
 
 void init_touchstrips(void);
-u8 read_touchstrips(void);
+bool read_touchstrips(void);
+
+// input trace
+
+void touch_noise_floor(u16* dst);
+void touchstrips_restart(const u16* noise_floor);
+
+// benchmark
+
+void touch_scan_benchmark(void);
 
 // calib
 
+void update_touch_calib_lut(void);
 void touch_calib(FlashCalibType flash_calib_type);
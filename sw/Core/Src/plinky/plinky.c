@@ -1,4 +1,6 @@
 #include "plinky.h"
+#include "analytics/input_trace.h"
+#include "analytics/telemetry.h"
 #include "gfx/gfx.h"
 #include "hardware/accelerometer.h"
 #include "hardware/adc_dac.h"
@@ -10,6 +12,7 @@
 #include "hardware/ram.h"
 #include "hardware/spi.h"
 #include "hardware/touchstrips.h"
+#include "scheduler.h"
 #include "synth/arp.h"
 #include "synth/audio.h"
 #include "synth/params.h"
@@ -130,32 +133,35 @@ void plinky_init(void) {
 
 // this runs with precise audio timing
 void plinky_codec_tick(u32* audio_out, u32* audio_in) {
+	telemetry_tick_start();
+	// record or replay the inputs of this tick
+	trace_tick_start();
 	// read physical touches
-	u8 read_phase = read_touchstrips();
+	bool new_touch_frame = read_touchstrips();
 	// once per touchstrip read cycle:
-	if (!read_phase) {
+	if (new_touch_frame) {
 		handle_pad_action_long_presses();
 		encoder_tick();
 	}
-	// update all leds
-	leds_update();
-
 	// pre-process audio
 	audio_pre(audio_out, audio_in);
 
 	// don't do anything else while calibrating
-	if (calib_mode)
+	if (calib_mode) {
+		trace_tick_end(audio_out);
 		return;
+	}
 
 	// in the process of recording a new sample
 	if (sampler_mode > SM_PREVIEW) {
 		// handle recording audio and exit
 		sampler_recording_tick(audio_out, audio_in);
+		trace_tick_end(audio_out);
 		return;
 	}
 
-	// make sure preset ram is up to date
-	update_preset_ram(false);
+	// switch to a newly selected preset at the start of the tick
+	update_preset_ram();
 	// midi
 	process_midi();
 	// clock
@@ -168,49 +174,67 @@ void plinky_codec_tick(u32* audio_out, u32* audio_in) {
 	params_tick();
 	// make sure sample and pattern ram is up to date
 	update_sample_ram(false);
-	update_pattern_ram(false);
+	update_pattern_ram();
 	// generate the voices, based on touches and parameters
 	handle_synth_voices(audio_out);
 	// restart spi loop if necessary
 	spi_tick();
 	// apply audio effects and send result to output buffer
 	audio_post(audio_out, audio_in);
+	// close the traced tick with a hash of its output
+	trace_tick_end(audio_out);
+	// stream internal state to the host
+	telemetry_tick();
 }
 
-// this is the main loop, only code that is blocking in some way lives here
-void plinky_loop(void) {
-	while (1) {
-		// set output volume
-		codec_update_volume();
-		// handle spi flash writes for the sampler
-		if (ui_mode == UI_SAMPLE_EDIT) {
-			switch (sampler_mode) {
-			case SM_ERASING:
-				// this fully blocks the loop until the sample is erased, also draws its own visuals
-				clear_flash_sample();
-				break;
-			case SM_RECORDING:
-			case SM_STOPPING1:
-			case SM_STOPPING2:
-			case SM_STOPPING3:
-			case SM_STOPPING4:
-				// pump blocks of the ram delay buffer to spi flash
-				write_flash_sample_blocks();
-			default:
-				break;
-			}
-		}
-		// visuals
-		take_param_snapshots();
-		draw_oled_visuals();
-		draw_led_visuals();
-		// read accelerometer values
-		accel_read();
-		// ram updates and writing ram to flash
-		ram_frame();
-		// web editor and usd midi data
-		usb_frame();
-		// execute actions triggered by setting menu
-		settings_menu_actions();
+// == MAIN LOOP == //
+
+// everything that is blocking in some way lives in the main loop
+
+static void sampler_flash_task(void) {
+	// handle spi flash writes for the sampler
+	if (ui_mode != UI_SAMPLE_EDIT)
+		return;
+	switch (sampler_mode) {
+	case SM_ERASING:
+		// this fully blocks the loop until the sample is erased, also draws its own visuals
+		clear_flash_sample();
+		break;
+	case SM_RECORDING:
+	case SM_STOPPING1:
+	case SM_STOPPING2:
+	case SM_STOPPING3:
+	case SM_STOPPING4:
+		// pump blocks of the ram delay buffer to spi flash
+		write_flash_sample_blocks();
+	default:
+		break;
 	}
-}
\ No newline at end of file
+}
+
+// rates and time slices in microseconds, as counted by micros()
+static Task tasks[] = {
+    // set output volume
+    {"volume", codec_update_volume, 10000, 1000},
+    // pump sampler data to spi flash, as fast as possible
+    {"sampler", sampler_flash_task, 0, 1000},
+    // visuals, both draw from one param snapshot per led frame
+    {"snapshot", take_param_snapshots, 10000, 100},
+    {"oled", draw_oled_visuals, 33333, 5000},
+    {"leds", draw_led_visuals, 10000, 1000},
+    // read accelerometer values at its output data rate
+    {"accel", accel_read, 10000, 1000},
+    // ram updates and writing ram to flash
+    {"ram", ram_frame, 1000, 2000},
+    // web editor and usb midi data, as fast as possible
+    {"usb", usb_frame, 0, 1000},
+    // execute actions triggered by setting menu
+    {"settings", settings_menu_actions, 10000, 1000},
+};
+
+#define NUM_TASKS (sizeof(tasks) / sizeof(Task))
+
+void plinky_loop(void) {
+	while (1)
+		sched_run(tasks, NUM_TASKS);
+}
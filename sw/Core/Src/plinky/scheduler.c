@@ -0,0 +1,67 @@
+#include "scheduler.h"
+#include "gfx/gfx.h"
+
+static Task* sched_tasks = 0;
+static u8 sched_num_tasks = 0;
+
+static const Task* cur_task = 0;
+static u32 cur_task_start = 0;
+
+// one pass over all tasks, running the ones that are due
+void sched_run(Task* tasks, u8 num_tasks) {
+	sched_tasks = tasks;
+	sched_num_tasks = num_tasks;
+	for (Task* task = tasks; task < tasks + num_tasks; ++task) {
+		u32 now = micros();
+		if (task->interval_us && now - task->last_run < task->interval_us)
+			continue;
+		// keep the rate steady, unless we have fallen behind by more than one interval
+		task->last_run = (now - task->last_run < 2 * task->interval_us) ? task->last_run + task->interval_us : now;
+		// run
+		cur_task = task;
+		cur_task_start = now;
+		task->run();
+		cur_task = 0;
+		// stats
+		u32 duration = micros() - now;
+		task->stats.runs++;
+		task->stats.total_us += duration;
+		task->stats.max_us = maxi(task->stats.max_us, duration);
+		if (duration > task->slice_us)
+			task->stats.overruns++;
+	}
+}
+
+// time left in the slice of the running task
+u32 sched_time_left(void) {
+	if (!cur_task)
+		return 0;
+	u32 elapsed = micros() - cur_task_start;
+	return elapsed < cur_task->slice_us ? cur_task->slice_us - elapsed : 0;
+}
+
+// == STATS == //
+
+#define TASKS_PER_PAGE 3
+
+void sched_reset_stats(void) {
+	for (u8 i = 0; i < sched_num_tasks; ++i)
+		memset(&sched_tasks[i].stats, 0, sizeof(TaskStats));
+}
+
+// blocking, shows the stats of all tasks a page at a time and starts a new measurement
+void sched_show_stats(void) {
+	static const u16 PAGE_TIME_MS = 3000;
+	for (u8 first = 0; first < sched_num_tasks; first += TASKS_PER_PAGE) {
+		oled_clear();
+		draw_str(0, 0, F_8_BOLD, "task avg/max us over");
+		for (u8 i = first; i < mini(first + TASKS_PER_PAGE, sched_num_tasks); ++i) {
+			const TaskStats* s = &sched_tasks[i].stats;
+			fdraw_str(0, 8 + (i - first) * 8, F_8, "%s %d/%d %d", sched_tasks[i].name,
+			          s->runs ? s->total_us / s->runs : 0, s->max_us, s->overruns);
+		}
+		oled_flip();
+		HAL_Delay(PAGE_TIME_MS);
+	}
+	sched_reset_stats();
+}
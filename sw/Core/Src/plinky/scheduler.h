@@ -0,0 +1,32 @@
+#pragma once
+#include "utils.h"
+
+// cooperative scheduler for the main loop
+// - every task runs at its own rate and gets a time slice
+// - tasks that loop internally use sched_time_left() to stay within their slice
+// - runtime statistics are kept per task
+// all times are in micros(), which counts 1us
+
+typedef struct TaskStats {
+	u32 runs;
+	u32 total_us;
+	u32 max_us;
+	u32 overruns; // runs that took longer than their time slice
+} TaskStats;
+
+typedef struct Task {
+	const char* name;
+	void (*run)(void);
+	u32 interval_us; // 0 => run on every pass
+	u32 slice_us;
+	u32 last_run;
+	TaskStats stats;
+} Task;
+
+void sched_run(Task* tasks, u8 num_tasks);
+u32 sched_time_left(void);
+
+// stats
+
+void sched_reset_stats(void);
+void sched_show_stats(void);
@@ -60,6 +60,7 @@ static bool step_up(u8 avail_touch_mask, s8 bottom_oct_offset, u8 top_oct_offset
 			case ARP_UPDOWN:
 			case ARP_PEDAL_UPDOWN:
 				dec_cur_string(avail_touch_mask);
+				// fall through
 			case ARP_UPDOWN_REP:
 			case ARP_UPDOWN8:
 				moving_down = true;
@@ -86,6 +87,7 @@ static bool step_down(u8 avail_touch_mask, s8 bottom_oct_offset, u8 top_oct_offs
 			case ARP_UPDOWN:
 			case ARP_PEDAL_UPDOWN:
 				inc_cur_string(avail_touch_mask);
+				// fall through
 			case ARP_UPDOWN_REP:
 			case ARP_UPDOWN8:
 				moving_down = false;
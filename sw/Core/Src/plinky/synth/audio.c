@@ -17,7 +17,6 @@ ValueSmoother ext_gain_smoother;
 static s16 audioin_is_stereo = 0;
 static s16 noise_gate = 0;
 static u16 audio_in_hold_time = 0;
-static s16 scopex = 0;
 static int k_reverb_fade = 240;
 static int k_reverb_shim = 240;
 static float k_reverb_wob = 0.5f;
@@ -62,51 +61,13 @@ void init_audio(void) {
 	delay_clear();
 }
 
-s32 Reverb2(s32 input, s16* buf) {
+RAM_FUNC s32 Reverb2(s32 input, s16* buf) {
 	int i = reverbpos;
 	int outl = 0, outr = 0;
 	float wob = lfo_next(&aplfo) * k_reverb_wob;
 	int apwobpos = FLOAT2FIXED((wob + 1.f), 12 + 6);
 	wob = lfo_next(&aplfo2) * k_reverb_wob;
 	int delaywobpos = FLOAT2FIXED((wob + 1.f), 12 + 6);
-#define RVDIV / 2
-#define CHECKACC // assert(acc>=-32768 && acc<32767);
-#define AP(len)                                                                                                        \
-	{                                                                                                                  \
-		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
-		s16 d = buf[j];                                                                                                \
-		acc -= d >> 1;                                                                                                 \
-		buf[i] = SATURATE16(acc);                                                                                      \
-		acc = (acc >> 1) + d;                                                                                          \
-		i = j;                                                                                                         \
-		CHECKACC                                                                                                       \
-	}
-#define AP_WOBBLE(len, wobpos)                                                                                         \
-	{                                                                                                                  \
-		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
-		s16 d = LINEARINTERPRV(buf, j, wobpos);                                                                        \
-		acc -= d >> 1;                                                                                                 \
-		buf[i] = SATURATE16(acc);                                                                                      \
-		acc = (acc >> 1) + d;                                                                                          \
-		i = j;                                                                                                         \
-		CHECKACC                                                                                                       \
-	}
-#define DELAY(len)                                                                                                     \
-	{                                                                                                                  \
-		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
-		buf[i] = SATURATE16(acc);                                                                                      \
-		acc = buf[j];                                                                                                  \
-		i = j;                                                                                                         \
-		CHECKACC                                                                                                       \
-	}
-#define DELAY_WOBBLE(len, wobpos)                                                                                      \
-	{                                                                                                                  \
-		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
-		buf[i] = SATURATE16(acc);                                                                                      \
-		acc = LINEARINTERPRV(buf, j, wobpos);                                                                          \
-		i = j;                                                                                                         \
-		CHECKACC                                                                                                       \
-	}
 
 	// Griesinger according to datorro does 142, 379, 107, 277 on the way in - totoal 905 (20ms)
 	// then the loop does 672+excursion, delay 4453, (damp), 1800, delay 3720 - total 10,645 (241ms)
@@ -172,7 +133,7 @@ s32 Reverb2(s32 input, s16* buf) {
 		// Fixed point crossfade:
 		u32 a = STEREOPACK((SHIMMER_FADE_LEN - 1) - shimmerfade, shimmerfade);
 		s32 shimo;
-		asm("smuad %0, %1, %2" : "=r"(shimo) : "r"(a), "r"(shim));
+		SMUAD(shimo, a, shim);
 		shimo >>= 15; // Divide by SHIMMER_FADE_LEN
 
 		// Apply user-selected shimmer amount.
@@ -276,7 +237,7 @@ u32 delay_samples_from_param(u32 param_val) {
 	return clampi(samples, SAMPLES_PER_TICK, DL_SIZE_MASK - 64); // clamp & return
 }
 
-void audio_post(u32* audio_out, u32* audio_in) {
+RAM_FUNC void audio_post(u32* audio_out, u32* audio_in) {
 
 	// delay params
 
@@ -466,36 +427,16 @@ void audio_post(u32* audio_out, u32* audio_in) {
 		delaypos++;
 		s16 li = dry2wetlr;
 		s16 ri = dry2wetlr >> 16;
-		static s16 prevli = 0;
-		static s16 prevprevli = 0;
-		static u16 bestedge = 0;
-		static s16 antiturningpointli = 0;
-		bool turningpoint = (prevli > prevprevli && prevli > li);
-		bool antiturningpoint = (prevli < prevprevli && prevli < li);
-		if (antiturningpoint)
-			antiturningpointli = prevli; // remember the last turning point at the bottom
-		if (turningpoint) {              // we are at a peak!
-			int edgesize = prevli - antiturningpointli;
-			if (scopex >= 256 || (scopex < 0 && edgesize > bestedge)) {
-				scopex = -256;
-				bestedge = edgesize;
-			}
-		}
-		prevprevli = prevli;
-		prevli = li;
 
-		// scope generation
+		// scope
 
-		if (scopex < 256 && scopex >= 0) {
-			int x = scopex / 2;
-			if (!(scopex & 1))
-				clear_scope_pixel(x);
-			put_scope_pixel(x, (li * scopescale >> 16) + 16);
-			put_scope_pixel(x, (ri * scopescale >> 16) + 16);
+		// trigger search and drawing happen in the main loop, we only pass on the raw left sample (for the trigger)
+		// and both channels scaled to scope pixels, in blocks of consecutive samples
+		if (!viz_tap_full(&scope_tap)) {
+			u8 scope_l = (li * scopescale >> 16) + 16;
+			u8 scope_r = (ri * scopescale >> 16) + 16;
+			viz_tap_push(&scope_tap, (u16)li | ((u32)scope_l << 16) | ((u32)scope_r << 24));
 		}
-		scopex++;
-		if (scopex > 1024)
-			scopex = -256;
 
 		u32 newwetlr = STEREOPACK(delayreturnl, delayreturnr);
 
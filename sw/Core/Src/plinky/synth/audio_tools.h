@@ -10,18 +10,28 @@
 #define FLOAT2FIXED(x, bits) ((int)((x) * (1 << (bits))))
 #define STEREOUNPACK(lr) int lr##l = (s16)lr, lr##r = (s16)(lr >> 16);
 
+// the inline asm has portable equivalents for host builds (dsp bench), they give the same bits
+
 __STATIC_FORCEINLINE
 u32 STEREOPACK(s16 l, s16 r) {
+#ifdef __arm__
 	s32 out;
 	asm("pkhbt %0, %1, %2, lsl #16" : "=r"(out) : "r"(l), "r"(r));
 	return out;
+#else
+	return (u16)l | ((u32)(u16)r << 16);
+#endif
 }
 
 __STATIC_FORCEINLINE
 s16 SATURATE16(s32 a) {
+#ifdef __arm__
 	s32 tmp;
 	asm("ssat %0, %1, %2" : "=r"(tmp) : "I"(16), "r"(a));
 	return tmp;
+#else
+	return a < -32768 ? -32768 : a > 32767 ? 32767 : a;
+#endif
 }
 
 __STATIC_FORCEINLINE
@@ -33,7 +43,7 @@ s16 LINEARINTERPDL(const s16* buf, int basei, int wobpos) { // read buf[basei-wo
 	s32 out;
 	u32 a = STEREOPACK(a1, a0);
 	u32 b = STEREOPACK(wobpos, 0x1000 - wobpos);
-	asm("smuad %0, %1, %2" : "=r"(out) : "r"(a), "r"(b));
+	SMUAD(out, a, b);
 	return out >> 12;
 }
 
@@ -57,16 +67,24 @@ u32 STEREOSCALE(u32 in, int scale) {
 
 __STATIC_FORCEINLINE
 u32 STEREOADDSAT(u32 a, u32 b) {
+#ifdef __arm__
 	s32 out;
 	asm("qadd16 %0, %1, %2" : "=r"(out) : "r"(a), "r"(b));
 	return out;
+#else
+	return STEREOPACK(SATURATE16((s16)a + (s16)b), SATURATE16((s16)(a >> 16) + (s16)(b >> 16)));
+#endif
 }
 
 __STATIC_FORCEINLINE
 u32 STEREOADDAVERAGE(u32 a, u32 b) {
+#ifdef __arm__
 	s32 out;
 	asm("shadd16 %0, %1, %2" : "=r"(out) : "r"(a), "r"(b));
 	return out;
+#else
+	return STEREOPACK(((s16)a + (s16)b) >> 1, ((s16)(a >> 16) + (s16)(b >> 16)) >> 1);
+#endif
 }
 
 __STATIC_FORCEINLINE
@@ -78,7 +96,7 @@ s16 LINEARINTERPRV(const s16* buf, int basei, int wobpos) { // read buf[basei-wo
 	s32 out;
 	u32 a = STEREOPACK(a1, a0);
 	u32 b = STEREOPACK(wobpos, 0x1000 - wobpos);
-	asm("smuad %0, %1, %2" : "=r"(out) : "r"(a), "r"(b));
+	SMUAD(out, a, b);
 	return out >> 12;
 }
 
@@ -93,4 +111,63 @@ u32 STEREOSIGMOID(u32 in) {
 	u16 l = sigmoid[(u16)in];
 	u16 r = sigmoid[in >> 16];
 	return STEREOPACK(l, r);
-}
\ No newline at end of file
+}
+
+// one sample of a polyblep sawtooth, returns the sample before the one it generates: the edge gets rounded off on both
+// sides when the phase wraps
+__STATIC_FORCEINLINE
+u32 POLYBLEPSAW(u32* phase, s32* phase_diff, s32 dd_phase, u32* prev_sample) {
+	*phase_diff += dd_phase;
+	*phase += *phase_diff;
+	u32 new_sample = *phase;
+	if (unlikely(*phase < (u32)*phase_diff)) {
+		// edge! polyblep it.
+		u32 fractime = mini(65535, *phase / (*phase_diff >> 16));
+		*prev_sample -= (fractime * fractime) >> 1;
+		fractime = 65535 - fractime;
+		new_sample += (fractime * fractime) >> 1;
+	}
+	u32 out = *prev_sample;
+	*prev_sample = new_sample;
+	return out;
+}
+
+// reverb building blocks, they run on the i, buf and acc of the caller (Reverb2)
+#define RVDIV / 2
+#define CHECKACC // assert(acc>=-32768 && acc<32767);
+#define AP(len)                                                                                                        \
+	{                                                                                                                  \
+		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
+		s16 d = buf[j];                                                                                                \
+		acc -= d >> 1;                                                                                                 \
+		buf[i] = SATURATE16(acc);                                                                                      \
+		acc = (acc >> 1) + d;                                                                                          \
+		i = j;                                                                                                         \
+		CHECKACC                                                                                                       \
+	}
+#define AP_WOBBLE(len, wobpos)                                                                                         \
+	{                                                                                                                  \
+		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
+		s16 d = LINEARINTERPRV(buf, j, wobpos);                                                                        \
+		acc -= d >> 1;                                                                                                 \
+		buf[i] = SATURATE16(acc);                                                                                      \
+		acc = (acc >> 1) + d;                                                                                          \
+		i = j;                                                                                                         \
+		CHECKACC                                                                                                       \
+	}
+#define DELAY(len)                                                                                                     \
+	{                                                                                                                  \
+		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
+		buf[i] = SATURATE16(acc);                                                                                      \
+		acc = buf[j];                                                                                                  \
+		i = j;                                                                                                         \
+		CHECKACC                                                                                                       \
+	}
+#define DELAY_WOBBLE(len, wobpos)                                                                                      \
+	{                                                                                                                  \
+		int j = (i + len RVDIV) & RV_SIZE_MASK;                                                                        \
+		buf[i] = SATURATE16(acc);                                                                                      \
+		acc = LINEARINTERPRV(buf, j, wobpos);                                                                          \
+		i = j;                                                                                                         \
+		CHECKACC                                                                                                       \
+	}
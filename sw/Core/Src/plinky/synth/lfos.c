@@ -7,13 +7,16 @@
 #include "hardware/ram.h"
 #include "params.h"
 #include "time.h"
+#include "ui/viz_tap.h"
 
 #define LFO_SCOPE_FRAMES 16
+#define LFO_SCOPE_TAP_SIZE 64
 
 s32 lfo_cur[NUM_LFOS];
 static u8 lfo_scope_frame = 0;
 static u8 lfo_scope_data[LFO_SCOPE_FRAMES][NUM_LFOS];
-static bool new_scope_frame;
+static u8 lfo_scope_pos[NUM_LFOS];
+VIZ_TAP(lfo_scope_tap, LFO_SCOPE_TAP_SIZE);
 
 // random float value normalized to [-1, 1)
 static float rnd_norm(u16 half_cycle) {
@@ -93,21 +96,68 @@ static float (*lfo_funcs[NUM_LFO_SHAPES])(float pos, u32 half_cycle) = {
     [LFO_SAW] = eval_saw,
 };
 
+// pass this tick's scope positions of all lfos on to the main loop
+void push_lfo_scope(void) {
+	viz_tap_push(&lfo_scope_tap,
+	             lfo_scope_pos[0] | (lfo_scope_pos[1] << 8) | (lfo_scope_pos[2] << 16) | ((u32)lfo_scope_pos[3] << 24));
+}
+
+// draw the scope positions collected by the audio interrupt
 void update_lfo_scope(void) {
-	// every 16 frames, lfo_scope_frame increments and data for that frame is cleared
-	new_scope_frame = (synth_tick & 15) == 0;
-	if (new_scope_frame) {
-		lfo_scope_frame = (synth_tick >> 4) & 15;
-		lfo_scope_data[lfo_scope_frame][0] = 0;
-		lfo_scope_data[lfo_scope_frame][1] = 0;
-		lfo_scope_data[lfo_scope_frame][2] = 0;
-		lfo_scope_data[lfo_scope_frame][3] = 0;
+	static u32 scope_tick = 0;
+	static s8 prev_scope_pos[NUM_LFOS] = {0};
+	static bool restart = false;
+
+	u16 num_ticks = viz_tap_available(&lfo_scope_tap);
+	while (num_ticks--) {
+		u32 scope_val = viz_tap_pop(&lfo_scope_tap);
+		if (restart) {
+			for (u8 lfo_id = 0; lfo_id < NUM_LFOS; lfo_id++)
+				prev_scope_pos[lfo_id] = (scope_val >> (lfo_id * 8)) & 7;
+			restart = false;
+		}
+		// every 16 ticks, lfo_scope_frame increments and data for that frame is cleared
+		bool new_scope_frame = (scope_tick & 15) == 0;
+		if (new_scope_frame) {
+			lfo_scope_frame = (scope_tick >> 4) & 15;
+			lfo_scope_data[lfo_scope_frame][0] = 0;
+			lfo_scope_data[lfo_scope_frame][1] = 0;
+			lfo_scope_data[lfo_scope_frame][2] = 0;
+			lfo_scope_data[lfo_scope_frame][3] = 0;
+		}
+		scope_tick++;
+		for (u8 lfo_id = 0; lfo_id < NUM_LFOS; lfo_id++) {
+			s8 old_scope_pos = prev_scope_pos[lfo_id];
+			s8 scope_pos = (scope_val >> (lfo_id * 8)) & 7;
+			bool moving_up = scope_pos > old_scope_pos;
+			// a new scope frame always needs to write at least one pixel
+			if (new_scope_frame && old_scope_pos == scope_pos)
+				lfo_scope_data[lfo_scope_frame][lfo_id] |= 1 << scope_pos;
+			// draw line towards the new position
+			while (old_scope_pos != scope_pos) {
+				old_scope_pos += moving_up ? 1 : -1;
+				lfo_scope_data[lfo_scope_frame][lfo_id] |= 1 << old_scope_pos;
+			}
+			// save position
+			prev_scope_pos[lfo_id] = scope_pos;
+		}
+	}
+
+	// values are only dropped while the tap is full, so the gap follows what we just read. Those ticks stay empty and
+	// the trace picks up again at the next position
+	u16 dropped = viz_tap_dropped(&lfo_scope_tap);
+	restart |= dropped > 0;
+	while (dropped--) {
+		if ((scope_tick & 15) == 0) {
+			lfo_scope_frame = (scope_tick >> 4) & 15;
+			memset(lfo_scope_data[lfo_scope_frame], 0, NUM_LFOS);
+		}
+		scope_tick++;
 	}
 }
 
 void update_lfo(u8 lfo_id) {
 	static u64 lfo_clock_q32[NUM_LFOS] = {0}; // lfo phase acculumator clock, counts half(!) lfo cycles in q32
-	static s8 prev_scope_pos[NUM_LFOS] = {0};
 
 	u8 lfo_page_offset = lfo_id * 6;
 	s32 lfo_rate = param_val(P_A_RATE + lfo_page_offset);
@@ -181,20 +231,8 @@ void update_lfo(u8 lfo_id) {
 	// offset from offset param
 	lfo_val += param_val(P_A_OFFSET + lfo_page_offset);
 
-	// save lfo positions for oled scope
-	s8 old_scope_pos = prev_scope_pos[lfo_id];
-	s8 scope_pos = clampi((-(lfo_val * 7 + (1 << 16)) >> 17) + 4, 0, 7);
-	bool moving_up = scope_pos > old_scope_pos;
-	// a new scope frame always needs to write at least one pixel
-	if (new_scope_frame && old_scope_pos == scope_pos)
-		lfo_scope_data[lfo_scope_frame][lfo_id] |= 1 << scope_pos;
-	// draw line towards the new position
-	while (old_scope_pos != scope_pos) {
-		old_scope_pos += moving_up ? 1 : -1;
-		lfo_scope_data[lfo_scope_frame][lfo_id] |= 1 << old_scope_pos;
-	}
-	// save position
-	prev_scope_pos[lfo_id] = scope_pos;
+	// save lfo position for oled scope
+	lfo_scope_pos[lfo_id] = clampi((-(lfo_val * 7 + (1 << 16)) >> 17) + 4, 0, 7);
 
 	// send to expander
 	set_expander_lfo_data(lfo_id, lfo_val);
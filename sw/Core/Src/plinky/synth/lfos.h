@@ -5,6 +5,9 @@
 
 extern s32 lfo_cur[NUM_LFOS];
 
-void update_lfo_scope(void);
 void update_lfo(u8 lfo_id);
+void push_lfo_scope(void);
+
+// main loop
+void update_lfo_scope(void);
 void draw_lfos(void);
\ No newline at end of file
@@ -52,6 +52,19 @@ static u32 max_pres_global = 0;
 static u16 sample_hold_global = {8 << 12};
 static u16 sample_hold_poly[NUM_STRINGS] = {0, 1 << 12, 2 << 12, 3 << 12, 4 << 12, 5 << 12, 6 << 12, 7 << 12};
 
+// preset glide: after a preset switch the base values of the continuous params move from the outgoing preset's values
+// to the new ones, index params switch right away
+static const u16 glide_ticks[NUM_PRESET_GLIDES] = {
+    [GLIDE_OFF] = 0,
+    [GLIDE_SHORT] = 50 / TICK_LENGTH_MS,
+    [GLIDE_MEDIUM] = 250 / TICK_LENGTH_MS,
+    [GLIDE_LONG] = 1000 / TICK_LENGTH_MS,
+};
+static s16 glide_delta[NUM_PARAMS]; // outgoing minus new base value
+static u16 glide_len;
+static u16 glide_ticks_left;
+static s32 glide_amount; // share of glide_delta still applied, 65536 => all of it
+
 // editing params
 static Param mem_param = 255; // remembers previous selected_param, used by encoder and A/B shift-presses
 static bool open_edit_mode = false;
@@ -64,9 +77,13 @@ static Touch* touch_pointer[NUM_STRINGS];
 // == INLINES == //
 
 static s32 SATURATE17(s32 a) {
+#ifdef __arm__
 	int tmp;
 	asm("ssat %0, %1, %2" : "=r"(tmp) : "I"(17), "r"(a));
 	return tmp;
+#else
+	return a < -65536 ? -65536 : a > 65535 ? 65535 : a;
+#endif
 }
 
 static s8 value_to_index(s32 value, u8 range) {
@@ -366,13 +383,43 @@ void revert_presets(void) {
 
 static void apply_lfo_mods(Param param_id) {
 	s16* param = cur_preset.params[param_id];
-	s32 new_val = param[SRC_BASE] << 16;
+	s32 new_val = (param[SRC_BASE] << 16) + glide_delta[param_id] * glide_amount;
 	for (u8 lfo_id = 0; lfo_id < NUM_LFOS; lfo_id++)
 		new_val += lfo_cur[lfo_id] * param[SRC_LFO_A + lfo_id];
 	param_with_lfo[param_id] = new_val;
 }
 
-void params_tick(void) {
+// audio tick, right before and after the preset in ram gets replaced by another one. A glide that is still going
+// starts over from where it got to
+void begin_preset_glide(void) {
+	for (Param param_id = 0; param_id < NUM_PARAMS; ++param_id)
+		glide_delta[param_id] = cur_preset.params[param_id][SRC_BASE] + ((glide_delta[param_id] * glide_amount) >> 16);
+}
+
+void end_preset_glide(void) {
+	glide_len = glide_ticks[sys_params.preset_glide];
+	glide_ticks_left = glide_len;
+	glide_amount = glide_len ? 65536 : 0;
+	for (Param param_id = 0; param_id < NUM_PARAMS; ++param_id) {
+		s16 from = glide_delta[param_id];
+		s16 to = cur_preset.params[param_id][SRC_BASE];
+		glide_delta[param_id] = param_is_index(param_id, SRC_BASE, from) || param_is_index(param_id, SRC_BASE, to)
+		                            ? 0
+		                            : from - to;
+	}
+}
+
+// main loop, when cur_preset gets replaced outside of a switch: the glide deltas belong to the outgoing preset
+void cancel_preset_glide(void) {
+	glide_ticks_left = 0;
+	glide_amount = 0;
+}
+
+RAM_FUNC void params_tick(void) {
+	if (glide_ticks_left) {
+		glide_ticks_left--;
+		glide_amount = ((u32)glide_ticks_left << 16) / glide_len;
+	}
 	// envelope 2
 	for (Param param_id = P_ENV_LVL2; param_id <= P_RELEASE2; param_id++)
 		apply_lfo_mods(param_id);
@@ -381,46 +428,45 @@ void params_tick(void) {
 	for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id) {
 		// update envelope 2
 		u8 mask = 1 << string_id;
-		Voice* v = &voices[string_id];
 		// reset envelope on new touch
 		if (env_trig_mask & mask) {
-			v->env2_lvl = 0.f;
-			v->env2_decaying = false;
+			envs.env2_lvl[string_id] = 0.f;
+			envs.env2_decaying[string_id] = false;
 		}
 		bool touching = string_touched & mask;
 		// set lvl_goal
 		float lvl_goal = touching
 		                     // touching the string
-		                     ? (v->env2_decaying)
+		                     ? (envs.env2_decaying[string_id])
 		                           // decay stage: 2 times sustain parameter
 		                           ? 2.f * (param_val_poly(P_SUSTAIN2, string_id) * (1.f / 65536.f))
 		                           // attack stage: we aim for 2.2, the actual peak is at 2.0
 		                           : 2.2f
 		                     // not touching, release stage: 0
 		                     : 0.f;
-		float lvl_diff = lvl_goal - v->env2_lvl;
+		float lvl_diff = lvl_goal - envs.env2_lvl[string_id];
 		// get multiplier size (scaled exponentially)
 		float k = lpf_k(param_val_poly((lvl_diff > 0.f)
 		                                   // positive difference => moving up => attack param
 		                                   ? P_ATTACK2
-		                                   : (v->env2_decaying && touching)
+		                                   : (envs.env2_decaying[string_id] && touching)
 		                                         // negative difference and decaying => decay param
 		                                         ? P_DECAY2
 		                                         // negative difference and not decaying => release param
 		                                         : P_RELEASE2,
 		                               string_id));
 		// change env level by fraction of difference
-		v->env2_lvl += lvl_diff * k;
+		envs.env2_lvl[string_id] += lvl_diff * k;
 		// if we went past the peak during the attack stage, start the decay stage
-		if (v->env2_lvl >= 2.f && touching)
-			v->env2_decaying = true;
+		if (envs.env2_lvl[string_id] >= 2.f && touching)
+			envs.env2_decaying[string_id] = true;
 		// scale the envelope from a roughly [0, 2] float, to a u16 range scaled by the envelope level parameter
-		v->env2_lvl16 = SATURATE17(v->env2_lvl * param_val_poly(P_ENV_LVL2, string_id));
+		envs.env2_lvl16[string_id] = SATURATE17(envs.env2_lvl[string_id] * param_val_poly(P_ENV_LVL2, string_id));
 
 		// collect range pressure
 		max_pres_global = maxi(max_pres_global, touch_pointer[string_id]->pres);
 		// collect range envelope
-		max_env_global = maxf(max_env_global, voices[string_id].env2_lvl16);
+		max_env_global = maxf(max_env_global, envs.env2_lvl16[string_id]);
 		// generate polyphonic sample & hold random value on new touch
 		if (env_trig_mask & mask)
 			sample_hold_poly[string_id] += 4813;
@@ -436,7 +482,6 @@ void params_tick(void) {
 	adc_update_inputs();
 
 	// lfos
-	update_lfo_scope();
 	for (u8 lfo_id = 0; lfo_id < NUM_LFOS; lfo_id++) {
 		u8 lfo_row_offset = lfo_id * 6;
 		// apply lfo modulation to the parameters of the lfo itself
@@ -444,6 +489,7 @@ void params_tick(void) {
 			apply_lfo_mods(param_id + lfo_row_offset);
 		update_lfo(lfo_id);
 	}
+	push_lfo_scope();
 
 	// apply lfo modulation to al other params
 	for (Param param_id = 0; param_id < NUM_PARAMS; ++param_id) {
@@ -507,7 +553,7 @@ s32 param_val(Param param_id) {
 }
 
 s32 param_val_poly(Param param_id, u8 string_id) {
-	return param_val_mod(param_id, sample_hold_poly[string_id], voices[string_id].env2_lvl16,
+	return param_val_mod(param_id, sample_hold_poly[string_id], envs.env2_lvl16[string_id],
 	                     clampi(touch_pointer[string_id]->pres << 5, 0, 65535));
 }
 
@@ -551,7 +597,7 @@ void save_param_raw(Param param_id, ModSource mod_src, s16 data) {
 	if (data == cur_preset.params[param_id][mod_src])
 		return;
 	// don't save if ram not ready
-	if (!update_preset_ram(false))
+	if (!preset_ram_ready())
 		return;
 	// save
 	cur_preset.params[param_id][mod_src] = data;
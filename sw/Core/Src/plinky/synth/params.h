@@ -14,6 +14,9 @@ bool arp_active(void);
 void init_presets(void);
 void revert_presets(void);
 void params_tick(void);
+void begin_preset_glide(void);
+void end_preset_glide(void);
+void cancel_preset_glide(void);
 
 // param retrieval calls
 s32 param_val(Param param_id);
@@ -0,0 +1,23 @@
+#include "pitch_grid.h"
+#include "pitch_tools.h"
+
+typedef struct PitchGridRow {
+	s32 pitch[PITCH_GRID_STEPS];
+	Scale scale;
+	u8 first_step;
+	bool valid;
+} PitchGridRow;
+
+static PitchGridRow rows[NUM_STRINGS];
+
+const s32* pitch_grid_row(u8 string_id, Scale scale, u8 first_step) {
+	PitchGridRow* row = &rows[string_id];
+	if (!row->valid || row->scale != scale || row->first_step != first_step) {
+		for (u8 i = 0; i < PITCH_GRID_STEPS; ++i)
+			row->pitch[i] = pitch_at_step(scale, first_step + i - 1);
+		row->scale = scale;
+		row->first_step = first_step;
+		row->valid = true;
+	}
+	return row->pitch + 1;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "utils.h"
+
+// caches the pitches of the pads of each string, so that the oscillators don't walk the scale every tick. A string's
+// row is rebuilt when its scale or its first step (degree, column and quantized cv) changes. Audio interrupt only
+
+#define PITCH_GRID_STEPS (PADS_PER_STRIP + 2) // one extra step past both ends, for the microtone distance
+
+// returns the pitch of pad 0 of the string, the row is valid from [-1] to [PADS_PER_STRIP]
+const s32* pitch_grid_row(u8 string_id, Scale scale, u8 first_step);
@@ -11,12 +11,13 @@
 #include "synth.h"
 
 #define MAX_SAMPLE_VOICES 6
-#define MAX_SAMPLE_LEN (1024 * 1024 * 2)  // max sample length in samples
 #define AVG_GRAINBUF_SAMPLE_SIZE (64 + 4) // 2 extra for interpolation, 2 extra for SPI address at the start
 #define GRAINBUF_BUDGET (AVG_GRAINBUF_SAMPLE_SIZE * NUM_GRAINS)
 
 SamplerMode sampler_mode = SM_PREVIEW;
 
+static SamplerBlock smp_voices;
+
 int grain_pos[NUM_GRAINS];
 static s16 grain_buf[GRAINBUF_BUDGET];
 s16 grain_buf_end[NUM_GRAINS]; // for each of the 32 grain fetches, where does it end in the grain_buf?
@@ -96,7 +97,8 @@ void sampler_recording_tick(u32* dst, u32* audioin) {
 	}
 }
 
-void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noise_diff, float drive, u32* dst) {
+RAM_FUNC void apply_sample_lpg_noise(u8 voice_id, float goal_lpg, float noise_diff, float drive, u8 ramp_start,
+                                     u32* dst) {
 	// sampler parameters
 	float timestretch = 1.f;
 	float posjit = 0.f;
@@ -116,7 +118,7 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 	}
 	int trig = env_trig_mask & (1 << voice_id);
 
-	int prevsliceidx = voice->slice_id;
+	int prevsliceidx = smp_voices.slice_id[voice_id];
 	bool gp = ui_mode == UI_SAMPLE_EDIT;
 	u16 touch_pos = get_string_touch(voice_id)->pos;
 
@@ -130,7 +132,7 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 			/// / / / ////////////////////// multisample choice
 			int best = voice_id;
 			int bestdist = 0x7fffffff;
-			int mypitch = (voice->osc[1].pitch + voice->osc[2].pitch) / 2;
+			int mypitch = (oscs.pitch[voice_id][1] + oscs.pitch[voice_id][2]) / 2;
 			int mysemi = (mypitch) >> 9;
 			static u8 multisampletime[8];
 			static u8 trig_count = 0;
@@ -143,43 +145,43 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 				}
 			}
 			multisampletime[best] = trig_count; // for round robin
-			voice->slice_id = best;
+			smp_voices.slice_id[voice_id] = best;
 			if (grate < 0.f)
 				ypos = 8;
 		}
 		else {
-			voice->slice_id = voice_id;
+			smp_voices.slice_id[voice_id] = voice_id;
 			ypos = (touch_pos / 256);
 			if (gp)
 				ypos = 0;
 			if (grate < 0.f)
 				ypos++;
 		}
-		voice->touch_pos_start = gp ? 128 : touch_pos;
+		smp_voices.touch_pos_start[voice_id] = gp ? 128 : touch_pos;
 		// calculate playhead position
-		int pos16 = clampi(((voice->slice_id * 8) + ypos) << 10, 0, 65535);
+		int pos16 = clampi(((smp_voices.slice_id[voice_id] * 8) + ypos) << 10, 0, 65535);
 		int i = pos16 >> 13;
 		int p0 = cur_sample_info.splitpoints[i];
 		int p1 = cur_sample_info.splitpoints[i + 1];
-		voice->playhead8 = (p0 << 8) + (((p1 - p0) * (pos16 & 0x1fff)) >> 5);
+		smp_voices.playhead8[voice_id] = (p0 << 8) + (((p1 - p0) * (pos16 & 0x1fff)) >> 5);
 		if (grate < 0.f) {
-			voice->playhead8 -= 192 << 8;
-			if (voice->playhead8 < 0)
-				voice->playhead8 = 0;
+			smp_voices.playhead8[voice_id] -= 192 << 8;
+			if (smp_voices.playhead8[voice_id] < 0)
+				smp_voices.playhead8[voice_id] = 0;
 		}
-		set_smoother(&voice->touch_pos, 0);
+		set_smoother(&smp_voices.touch_pos[voice_id], 0);
 	}
 	else { // not trigger - just advance playhead
-		float ms2 = (voice->grain_pair[0].multisample_grate
-		             + voice->grain_pair[1].multisample_grate); // double multisample rate
+		float ms2 = (smp_voices.grain_pair[voice_id][0].multisample_grate
+		             + smp_voices.grain_pair[voice_id][1].multisample_grate); // double multisample rate
 		int delta_playhead8 = (int)(grate * ms2 * timestretch * (SAMPLES_PER_TICK * 0.5f * 256.f) + 0.5f);
 
-		int new_playhead = voice->playhead8 + delta_playhead8;
+		int new_playhead = smp_voices.playhead8[voice_id] + delta_playhead8;
 
 		// if the sample loops and the new playhead has crossed the loop boundary, recalculate new playhead position
 		if (cur_sample_info.loop & 1) {
-			int loopstart = calcloopstart(voice->slice_id) << 8;
-			int loopend = calcloopend(voice->slice_id) << 8;
+			int loopstart = calcloopstart(smp_voices.slice_id[voice_id]) << 8;
+			int loopend = calcloopend(smp_voices.slice_id[voice_id]) << 8;
 			int looplen = loopend - loopstart;
 			if (looplen > 0 && (new_playhead < loopstart || new_playhead >= loopstart + looplen)) {
 				new_playhead = (new_playhead - loopstart) % looplen;
@@ -189,25 +191,25 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 			}
 		}
 
-		voice->playhead8 = new_playhead;
+		smp_voices.playhead8[voice_id] = new_playhead;
 
 		float gdeadzone = clampf(minf(1.f - posjit, timestretch * 2.f), 0.f,
 		                         1.f); // if playing back normally and not jittering, add a deadzone
-		float fpos = deadzone(touch_pos - voice->touch_pos_start, gdeadzone * 32.f);
+		float fpos = deadzone(touch_pos - smp_voices.touch_pos_start[voice_id], gdeadzone * 32.f);
 		if (gp)
 			fpos = 0.f;
-		smooth_value(&voice->touch_pos, fpos, 2048.f);
+		smooth_value(&smp_voices.touch_pos[voice_id], fpos, 2048.f);
 	}
 
 	float noise;
 	for (int osc_id = 0; osc_id < OSCS_PER_VOICE / 2; osc_id++) {
 		s16* osc_dst = ((s16*)dst) + (osc_id & 1);
-		noise = voice->noise_lvl;
-		float y1 = voice->lpg_smoother[osc_id].y1;
-		float y2 = voice->lpg_smoother[osc_id].y2;
+		noise = envs.noise_lvl[voice_id];
+		float y1 = envs.lpg_smoother[voice_id][osc_id].y1;
+		float y2 = envs.lpg_smoother[voice_id][osc_id].y2;
 		int randtabpos = rand() & 16383;
 		// mix grains
-		GrainPair* g = &voice->grain_pair[osc_id];
+		GrainPair* g = &smp_voices.grain_pair[voice_id][osc_id];
 		int grainidx = voice_id * 4 + osc_id * 2;
 		int g0start = 0;
 		if (grainidx)
@@ -225,14 +227,14 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 		int dgvol24 = g->dvol24;
 		int dpos24 = g->dpos24;
 		int fpos24 = g->fpos24;
-		float vol = voice->env1_lvl;
-		float dvol = (goal_lpg - vol) * (1.f / SAMPLES_PER_TICK);
+		float vol = envs.env1_lvl[voice_id];
+		float dvol = (goal_lpg - vol) / (SAMPLES_PER_TICK - ramp_start);
 		outofrange0 |= g1start - g0start <= 2;
 		outofrange1 |= g2start - g1start <= 2;
 		g->outflags = (outofrange0 ? 1 : 0) + (outofrange1 ? 2 : 0);
 		if ((g1start - g0start <= 2 && g2start - g1start <= 2)) {
 			// fast mode :) emulate side effects without doing any work
-			vol += dvol * SAMPLES_PER_TICK;
+			vol += dvol * (SAMPLES_PER_TICK - ramp_start);
 			noise += noise_diff * SAMPLES_PER_TICK;
 			gvol24 -= dgvol24 * SAMPLES_PER_TICK;
 			fpos24 += dpos24 * SAMPLES_PER_TICK;
@@ -278,7 +280,8 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 				s16 n = ((s16*)rndtab)[randtabpos++]; // mix in a white noise source
 				noise += noise_diff;                  // volume ramp for noise
 
-				vol += dvol;                                               // volume ramp for grain signal
+				if (i >= ramp_start)
+					vol += dvol;                                           // volume ramp for grain signal
 				float input = (ofinal * drive + n * noise);                // input to filter
 				float cutoff = 1.f - squaref(maxf(0.f, 1.f - vol * 1.1f)); // filter cutoff for low pass gate
 				y1 += (input - y1) * cutoff;                               // do the lowpass
@@ -295,11 +298,11 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 		g->vol24 = gvol24;
 
 		if (gvol24 <= dgvol24 || trig) { // new grain trigger! this is for the *next* frame
-			int ph = voice->playhead8 >> 8;
-			int slicelen =
-			    cur_sample_info.splitpoints[voice->slice_id + 1] - cur_sample_info.splitpoints[voice->slice_id];
+			int ph = smp_voices.playhead8[voice_id] >> 8;
+			u8 slice_id = smp_voices.slice_id[voice_id];
+			int slicelen = cur_sample_info.splitpoints[slice_id + 1] - cur_sample_info.splitpoints[slice_id];
 			if (ui_mode != UI_SAMPLE_EDIT) {
-				ph += ((int)(voice->touch_pos.y2 * slicelen)) >> (10);
+				ph += ((int)(smp_voices.touch_pos[voice_id].y2 * slicelen)) >> (10);
 				ph += smppos; // scrub input
 			}
 			g->vol24 = ((1 << 24) - 1);
@@ -316,18 +319,18 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 			g->pos[0] = trig ? ph : g->pos[1];
 			g->pos[1] = ph;
 		}
-		voice->lpg_smoother[osc_id].y1 = y1;
-		voice->lpg_smoother[osc_id].y2 = y2;
+		envs.lpg_smoother[voice_id][osc_id].y1 = y1;
+		envs.lpg_smoother[voice_id][osc_id].y2 = y2;
 	} // osc loop
 
-	voice->env1_lvl = goal_lpg;
-	voice->noise_lvl = noise;
+	envs.env1_lvl[voice_id] = goal_lpg;
+	envs.noise_lvl[voice_id] = noise;
 
 	// update pitch (aka dpos24) for next time!
 	for (int gi = 0; gi < 2; ++gi) {
 		float multisample_grate;
 		if (cur_sample_info.pitched && (ui_mode != UI_SAMPLE_EDIT)) {
-			int relpitch = voice->osc[1 + gi].pitch - cur_sample_info.notes[voice->slice_id] * 512;
+			int relpitch = oscs.pitch[voice_id][1 + gi] - cur_sample_info.notes[smp_voices.slice_id[voice_id]] * 512;
 			if (relpitch < -512 * 12 * 5) {
 				multisample_grate = 0.f;
 			}
@@ -339,11 +342,11 @@ void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noi
 		else {
 			multisample_grate = 1.f;
 		}
-		voice->grain_pair[gi].multisample_grate = multisample_grate;
-		int dpos24 = (1 << 24) * (grate * voice->grain_pair[gi].grate_ratio * multisample_grate);
+		smp_voices.grain_pair[voice_id][gi].multisample_grate = multisample_grate;
+		int dpos24 = (1 << 24) * (grate * smp_voices.grain_pair[voice_id][gi].grate_ratio * multisample_grate);
 		while (dpos24 > (2 << 24))
 			dpos24 >>= 1;
-		voice->grain_pair[gi].dpos24 = dpos24;
+		smp_voices.grain_pair[voice_id][gi].dpos24 = dpos24;
 	}
 }
 
@@ -353,7 +356,7 @@ void sampler_playing_tick(void) {
 	u32 sampleaddr = cur_sample_id * MAX_SAMPLE_LEN;
 
 	for (int i = 0; i < 8; ++i) {
-		GrainPair* g = voices[i].grain_pair;
+		GrainPair* g = smp_voices.grain_pair[i];
 		int glen0 =
 		    ((abs(g[0].dpos24) * (SAMPLES_PER_TICK / 2) + g[0].fpos24 / 2 + 1) >> 23) + 2; // +2 for interpolation
 		int glen1 =
@@ -370,7 +373,7 @@ void sampler_playing_tick(void) {
 		grain_pos[i * 4 + 2] = (int)(g[1].pos[0]) - g[1].bufadjust + sampleaddr;
 		grain_pos[i * 4 + 3] = (int)(g[1].pos[1]) - g[1].bufadjust + sampleaddr;
 		glen += 2; // 2 extra 'samples' for the SPI header
-		gprio[i] = ((int)(voices[i].env1_lvl * 65535.f) << 12) + i + (glen << 3);
+		gprio[i] = ((int)(envs.env1_lvl[i] * 65535.f) << 12) + i + (glen << 3);
 	}
 	sort8(gprio, gprio);
 	u8 lengths[8];
@@ -382,7 +385,7 @@ void sampler_playing_tick(void) {
 		// we only budget for MAX_SPI_STATE transfers. so after that, len goes to 0. also helps CPU load
 		if (i < 8 - MAX_SAMPLE_VOICES)
 			len = 0;
-		else if (voices[fi].env1_lvl <= 0.01f && !(string_touched & (1 << fi)))
+		else if (envs.env1_lvl[fi] <= 0.01f && !(string_touched & (1 << fi)))
 			len = 0; // if your finger is up and the volume is 0, we can just skip this one.
 		lengths[fi] = (pos + len * 4 > GRAINBUF_BUDGET) ? 0 : len;
 		pos += len * 4;
@@ -771,8 +774,8 @@ void draw_sample_playback(SampleInfo* s) {
 	max_pos = clampi(max_pos, 0, s->samplelen);
 
 	for (int i = 0; i < 8; ++i) {
-		GrainPair* gr = voices[i].grain_pair;
-		int vvol = (int)(256.f * voices[i].env1_lvl);
+		GrainPair* gr = smp_voices.grain_pair[i];
+		int vvol = (int)(256.f * envs.env1_lvl[i]);
 		if (vvol > 8)
 			for (int g = 0; g < 4; ++g) {
 				if (!(gr->outflags & (1 << (g & 1)))) {
@@ -1,6 +1,8 @@
 #pragma once
 #include "utils.h"
 
+#define MAX_SAMPLE_LEN (1024 * 1024 * 2) // in samples, every sample slot has 2 * MAX_SAMPLE_LEN bytes of spi flash
+
 extern SamplerMode sampler_mode;
 
 // spi
@@ -15,7 +17,7 @@ void open_sampler(u8 with_sample_id);
 // play sampler audio
 
 void sampler_recording_tick(u32* dst, u32* audioin);
-void apply_sample_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noise_diff, float drive, u32* dst);
+void apply_sample_lpg_noise(u8 voice_id, float goal_lpg, float noise_diff, float drive, u8 ramp_start, u32* dst);
 void sampler_playing_tick(void);
 
 // recording samples
@@ -4,6 +4,7 @@
 #include "hardware/midi.h"
 #include "hardware/ram.h"
 #include "params.h"
+#include "strings.h"
 #include "time.h"
 #include "ui/shift_states.h"
 
@@ -13,21 +14,23 @@
 
 #define GATE_LEN_SUBSTEPS 256
 #define SEQ_CLOCK_SYNCED (step_32nds >= 0)
-#define CUR_QUARTER ((cur_seq_step >> 4) & 3)
+#define NO_CUED_START 0xffff
 
 SeqFlags seq_flags = {0};
 static ConditionalStep c_step;
 
 // timing
 static s16 step_32nds = 0;       // 32nds in a step
-static u32 last_step_ticks = 0;  // duration
-static u32 ticks_since_step = 0; // current duration
+static u32 last_step_ticks = 0;   // duration
+static u32 ticks_since_step = 0;  // current duration
+static u32 last_step_samples = 0; // duration at sample resolution, for playback
+static u8 step_offset = 0;        // sample within its tick where the current step started
 
 // pattern
-static s8 cur_seq_step = 0;  // current step, modulated by step offset
+static u8 cur_seq_step = 0;  // current step, modulated by step offset
 static u8 cur_seq_start = 0; // where we start playing, modulated by step offset
-static u8 cued_ptn_start = 255;
-static u64 random_steps_avail = 0; // bitmask of unplayed steps in random modes
+static u16 cued_ptn_start = NO_CUED_START;
+static u32 random_steps_avail[MAX_PTN_STEPS / 32]; // bitmask of unplayed steps in random modes
 
 // recording
 static u8 last_edited_step_global = 255;
@@ -43,6 +46,15 @@ bool seq_recording(void) {
 	return seq_flags.recording;
 }
 
+u8 seq_cur_step(void) {
+	return cur_seq_step;
+}
+
+// lengths past MAX_PTN_STEPS play as a full pattern, they would reach into the flash quarters of the next pattern
+u16 seq_length(void) {
+	return cur_preset.seq_len && cur_preset.seq_len < MAX_PTN_STEPS ? cur_preset.seq_len : MAX_PTN_STEPS;
+}
+
 SeqState seq_state(void) {
 	if (seq_flags.recording)
 		return seq_flags.playing ? SEQ_LIVE_RECORDING : SEQ_STEP_RECORDING;
@@ -63,16 +75,57 @@ u32 seq_substep(u32 resolution) {
 	return (ticks_since_step * resolution) / last_step_ticks;
 }
 
+// == SAMPLE TIMING == //
+
+// playback runs at sample resolution: substeps and gate ends that fall inside a tick land on their sample
+
+// position of this tick's block in the current step, negative while the step starts inside the block
+static s32 block_start_sample(void) {
+	return ticks_since_step * SAMPLES_PER_TICK - step_offset;
+}
+
+// first sample of a subdivision of the current step
+static s32 step_sample(u32 pos, u32 resolution) {
+	return ((u64)pos * last_step_samples + resolution - 1) / resolution;
+}
+
+// subdivision playing at the end of this tick's block, seq_substep() at sample resolution
+static u32 play_substep(u32 resolution) {
+	if (ticks_since_step == 0)
+		return 0;
+	if (ticks_since_step > last_step_ticks)
+		return resolution - 1;
+	s32 end = block_start_sample() + SAMPLES_PER_TICK - 1;
+	if (end >= (s32)last_step_samples)
+		return resolution - 1;
+	return (u64)end * resolution / last_step_samples;
+}
+
+// pass the sample of a note on/off to the string. Strings only get generated every other tick so the event can also lie
+// in the previous block, it plays one tick after its sample either way
+static void land_event(u8 string_id, s32 sample) {
+	string_event(string_id, (synth_tick + 1) * SAMPLES_PER_TICK + sample - block_start_sample());
+}
+
 // == SEQ TOOLIES == //
 
-// keep cur_seq_step within bounds of both the local sequence length and the global max of 64
+static u8 wrap_step(s32 step) {
+	return modi(step, MAX_PTN_STEPS);
+}
+
+// step relative to the start of the pattern
+static u8 rel_step(u8 step) {
+	return wrap_step(step - cur_seq_start);
+}
+
+// keep cur_seq_step within the sequence length
 static void align_cur_step(void) {
-	cur_seq_step = (modi(cur_seq_step - cur_seq_start, cur_preset.seq_len) + cur_seq_start) & 63;
+	cur_seq_step = wrap_step(rel_step(cur_seq_step) % seq_length() + cur_seq_start);
 }
 
 // calculate start step from preset and step offset modulation
 static void recalc_start_step(void) {
-	cur_seq_start = (cur_preset.seq_start + param_index(P_STEP_OFFSET) + 64) & 63;
+	cur_seq_start = wrap_step(cur_preset.seq_start + param_index(P_STEP_OFFSET));
 	// this always needs an align of cur step as well
 	align_cur_step();
 }
@@ -85,22 +138,22 @@ static void jump_to_step(u8 step) {
 
 static void seq_set_start(u8 new_step) {
 	// save the relative step position
-	u8 relative_step = cur_seq_step - cur_seq_start + 64;
+	u8 relative_step = rel_step(cur_seq_step);
 	// set the new pattern start
 	cur_preset.seq_start = new_step;
 	log_ram_edit(SEG_PRESET);
 	recalc_start_step();
 	// set the new absolute step position
-	jump_to_step((cur_seq_start + relative_step) & 63);
+	jump_to_step(wrap_step(cur_seq_start + relative_step));
 }
 
 static void apply_cued_changes(void) {
 	bool needs_start_recalc = false;
 	// apply new start step
-	if (cued_ptn_start != 255) {
+	if (cued_ptn_start != NO_CUED_START) {
 		seq_set_start(cued_ptn_start);
 		needs_start_recalc = true;
-		cued_ptn_start = 255;
+		cued_ptn_start = NO_CUED_START;
 	}
 	if (apply_cued_load_items() || needs_start_recalc)
 		recalc_start_step();
@@ -108,11 +161,14 @@ static void apply_cued_changes(void) {
 
 // == MAIN SEQ FUNCTIONS == //
 
-// perform a sequencer step
-static void seq_step(void) {
-	if (!seq_flags.first_pulse)
+// perform a sequencer step, offset is the sample within the tick where it starts
+static void seq_step(u8 offset) {
+	if (!seq_flags.first_pulse) {
 		last_step_ticks = ticks_since_step;
+		last_step_samples = ticks_since_step * SAMPLES_PER_TICK + offset - step_offset;
+	}
 	ticks_since_step = 0;
+	step_offset = offset;
 
 	if (!seq_flags.playing && !seq_flags.force_next_step) {
 		c_step.play_step = false;
@@ -144,13 +200,10 @@ static void seq_step(void) {
 		wrapped = seq_dec_step();
 		break;
 	case SEQ_ORD_PINGPONG: {
-		u8 end_step = cur_seq_start + cur_preset.seq_len - 1;
+		u8 rel_end = seq_length() - 1;
 		// current step is at either extreme => switch directions
-
-		// == this should just be equal signs?? test! == //
-
-		if ((!seq_flags.playing_backwards && cur_seq_step >= end_step)
-		    || (seq_flags.playing_backwards && cur_seq_step <= cur_seq_start)) {
+		if ((!seq_flags.playing_backwards && rel_step(cur_seq_step) >= rel_end)
+		    || (seq_flags.playing_backwards && rel_step(cur_seq_step) == 0)) {
 			seq_flags.playing_backwards = !seq_flags.playing_backwards;
 			wrapped = true;
 		}
@@ -158,15 +211,12 @@ static void seq_step(void) {
 		break;
 	}
 	case SEQ_ORD_PINGPONG_REP: {
-		u8 end_step = cur_preset.seq_len + cur_seq_start - 1;
+		u8 rel_end = seq_length() - 1;
 		// current step is at either extreme => switch directions but trigger the *same* step again
-		if ((!seq_flags.playing_backwards && cur_seq_step >= end_step)
-		    || (seq_flags.playing_backwards && cur_seq_step <= cur_seq_start)) {
+		if ((!seq_flags.playing_backwards && rel_step(cur_seq_step) >= rel_end)
+		    || (seq_flags.playing_backwards && rel_step(cur_seq_step) == 0)) {
 			seq_flags.playing_backwards = !seq_flags.playing_backwards;
-
-			// == this should just be able to be cur step? test! == //
-
-			jump_to_step(seq_flags.playing_backwards ? end_step : cur_seq_start);
+			jump_to_step(wrap_step(cur_seq_start + (seq_flags.playing_backwards ? rel_end : 0)));
 			wrapped = true;
 		}
 		// otherwise => regular step
@@ -175,27 +225,33 @@ static void seq_step(void) {
 		break;
 	}
 	case SEQ_ORD_SHUFFLE: {
+		u16 num_avail = 0;
+		for (u8 i = 0; i < MAX_PTN_STEPS / 32; ++i)
+			num_avail += __builtin_popcount(random_steps_avail[i]);
 		// no steps left: end of a "loop"
-		if (!random_steps_avail) {
+		if (!num_avail) {
 			// all steps are available again
-			random_steps_avail = ((u64)1 << cur_preset.seq_len) - 1;
+			u16 len = seq_length();
+			for (u8 i = 0; i < MAX_PTN_STEPS / 32; ++i)
+				random_steps_avail[i] = len >= (i + 1) * 32 ? ~0u : len > i * 32 ? (1u << (len - i * 32)) - 1 : 0;
+			num_avail = len;
 			wrapped = true;
 		}
-
-		// == replace this with get random bit? == //
-
-		u64 step_mask = random_steps_avail;
 		// pick a value from the number of available steps
-		u8 step_val = rand() % __builtin_popcountll(step_mask);
-		// clear that many least significant positive bits from step mask
+		u16 step_val = rand() % num_avail;
+		// skip whole words, then clear that many least significant positive bits from the word
+		u8 word = 0;
+		while (step_val >= __builtin_popcount(random_steps_avail[word]))
+			step_val -= __builtin_popcount(random_steps_avail[word++]);
+		u32 step_mask = random_steps_avail[word];
 		while (step_val-- > 0)
 			step_mask &= step_mask - 1;
 		// position of next least significant bit is the next step (relative)
-		step_val = step_mask ? __builtin_ctzll(step_mask) : 0;
+		u8 rel = word * 32 + __builtin_ctz(step_mask);
 		// jump to and sound that step (absolute)
-		jump_to_step(cur_seq_start + step_val);
+		jump_to_step(wrap_step(cur_seq_start + rel));
 		// chosen step is no longer available
-		random_steps_avail &= ~((u64)1 << cur_seq_step);
+		random_steps_avail[rel / 32] &= ~(1u << (rel & 31));
 		break;
 	}
 	default:
@@ -219,7 +275,7 @@ void seq_tick(void) {
 	// synced
 	if (SEQ_CLOCK_SYNCED) {
 		if (pulse_32nd && (counter_32nds % step_32nds == 0))
-			seq_step();
+			seq_step(pulse_32nd_offset);
 	}
 	// following cv gate - should this move to CV?
 	else if (seq_flags.playing && cv_gate_present()) {
@@ -229,7 +285,7 @@ void seq_tick(void) {
 		bool new_gate = adc_get_calib(ADC_GATE) > thresh;
 		// trigger a step on rising edge
 		if (new_gate && !prev_gate)
-			seq_step();
+			seq_step(0);
 		prev_gate = new_gate;
 	}
 }
@@ -253,7 +309,7 @@ static void rec_substep(PatternStringStep* string_step, u8 substep, u8 seq_pres,
 			string_step->pos[3] = seq_pos;
 		}
 	}
-	log_ram_edit(SEG_PAT0 + CUR_QUARTER);
+	log_pattern_edit(cur_seq_step);
 }
 
 // try recording string touch to sequencer
@@ -265,10 +321,13 @@ void seq_try_rec_touch(u8 string_id, s16 pressure, s16 position, bool pres_incre
 	static u8 record_to_substep[NUM_STRINGS]; // remembers for each string where they were writing
 
 	// not recording => exit
-	if (!seq_flags.recording || pattern_outdated())
+	if (!seq_flags.recording)
 		return;
 
+	// the step's quarter is not in ram yet => exit
 	PatternStringStep* string_step = string_step_ptr(string_id, false, cur_seq_step);
+	if (!string_step)
+		return;
 	u8 mask = 1 << string_id;
 	u8 substep = seq_substep(8);
 
@@ -325,6 +384,7 @@ void seq_try_rec_touch(u8 string_id, s16 pressure, s16 position, bool pres_incre
 				// align clock
 				clock_reset();
 				ticks_since_step = 0;
+				step_offset = 0;
 			}
 			// we are recording and we havent written this substep yet => record
 			else if ((substep_recorded & mask) == 0) {
@@ -337,23 +397,36 @@ void seq_try_rec_touch(u8 string_id, s16 pressure, s16 position, bool pres_incre
 
 // try receiving touch data from sequencer
 void seq_try_get_touch(u8 string_id, s16* pressure, s16* position) {
-	// exit if we're not playing a sequencer note
-	if (!c_step.play_step || shift_state == SS_CLEAR)
-		return;
-	PatternStringStep* string_step = string_step_ptr(string_id, true, cur_seq_step);
-	// exit if there is no data in the step
-	if (!string_step)
-		return;
-	// exit if there's no pressure in the substep
-	u8 substep = seq_substep(PTN_SUBSTEPS);
-	if (!string_step->pres[substep])
-		return;
-	// exit if we're beyond the gate length
-	if (seq_substep(GATE_LEN_SUBSTEPS) > (param_val_poly(P_GATE_LENGTH, string_id) >> 8)) {
+	static u8 sounding = 0;               // strings playing a substep, bitmask
+	static u16 sounding_pos[NUM_STRINGS]; // step and substep they are playing
+	u8 mask = 1 << string_id;
+	u8 substep = play_substep(PTN_SUBSTEPS);
+	u16 pos = cur_seq_step * PTN_SUBSTEPS + substep;
+	u32 gate_len = (param_val_poly(P_GATE_LENGTH, string_id) >> 8) + 1;
+	bool filled = step_substeps(string_id, cur_seq_step) & (1 << substep);
+	bool gate_open = play_substep(GATE_LEN_SUBSTEPS) < gate_len;
+
+	// not playing a sequencer note => a note that was playing ends where the step, its substep or its gate did
+	if (!c_step.play_step || shift_state == SS_CLEAR || !filled || !gate_open) {
+		if (sounding & mask) {
+			sounding &= ~mask;
+			s32 end = step_sample(gate_len, GATE_LEN_SUBSTEPS);
+			if (!c_step.play_step || shift_state == SS_CLEAR)
+				end = maxi(block_start_sample(), 0);
+			else if (!filled)
+				end = mini(end, step_sample(substep, PTN_SUBSTEPS));
+			land_event(string_id, end);
+		}
 		return;
 	}
+	// a new substep starts the note on its sample
+	if (!(sounding & mask) || sounding_pos[string_id] != pos)
+		land_event(string_id, step_sample(substep, PTN_SUBSTEPS));
+	sounding |= mask;
+	sounding_pos[string_id] = pos;
 
 	// we're playing from the sequencer => create touch from pattern
+	PatternStringStep* string_step = string_step_ptr(string_id, false, cur_seq_step);
 	*pressure = pres_decompress(string_step->pres[substep]);
 	*position = pos_decompress(string_step->pos[substep / 2]);
 }
@@ -373,7 +446,7 @@ void seq_continue(void) {
 // equivalent to midi start: reset and start playing from beginning
 void seq_play(void) {
 	seq_flags.playing_backwards = false;
-	random_steps_avail = 0;
+	memset(random_steps_avail, 0, sizeof(random_steps_avail));
 	c_step.euclid_trigs = 0;
 	seq_flags.playing_backwards = false;
 	jump_to_step(cur_seq_start);
@@ -424,28 +497,28 @@ void seq_force_play_step(void) {
 
 // returns whether this wrapped
 bool seq_inc_step(void) {
-	u8 prev_step = cur_seq_step;
-	jump_to_step((cur_seq_step + 1) & 63);
-	return cur_seq_step <= prev_step;
+	u8 prev_step = rel_step(cur_seq_step);
+	jump_to_step(wrap_step(cur_seq_start + prev_step + 1));
+	return rel_step(cur_seq_step) <= prev_step;
 }
 
 // returns whether this wrapped
 bool seq_dec_step(void) {
-	u8 prev_step = cur_seq_step;
-	jump_to_step((cur_seq_step + 64 - 1) & 63);
-	return cur_seq_step >= prev_step;
+	u8 prev_step = rel_step(cur_seq_step);
+	jump_to_step(wrap_step(cur_seq_start + (prev_step ? prev_step : seq_length()) - 1));
+	return rel_step(cur_seq_step) >= prev_step;
 }
 
 void seq_try_set_start(u8 new_step) {
 	// get the unmodulated new start step
-	u8 new_start = (new_step - param_index(P_STEP_OFFSET) + 64) & 63;
+	u8 new_start = wrap_step(new_step - param_index(P_STEP_OFFSET));
 	// 1. not playing => change immediately
 	// 2. goal identical to cued means double press on the same step => change immediately
 	if (!seq_flags.playing || cued_ptn_start == new_start) {
 		// ignore if we already have this start step
 		if (cur_seq_start != new_step)
 			seq_set_start(new_start);
-		cued_ptn_start = 255;
+		cued_ptn_start = NO_CUED_START;
 	}
 	// 3. otherwise => cue change for later change
 	else
@@ -453,8 +526,9 @@ void seq_try_set_start(u8 new_step) {
 }
 
 void seq_set_end(u8 new_step) {
-	u8 new_len = (new_step - cur_seq_start + 1 + 64) & 63;
-	if (new_len != cur_preset.seq_len) {
+	u16 new_len = rel_step(new_step) + 1;
+	// a full length pattern is stored as 0
+	if ((u8)new_len != cur_preset.seq_len) {
 		cur_preset.seq_len = new_len;
 		log_ram_edit(SEG_PRESET);
 	}
@@ -463,18 +537,14 @@ void seq_set_end(u8 new_step) {
 
 void seq_clear_step(void) {
 	// clear pressures from all substeps, from all strings, for the current step
-	bool data_saved = false;
+	u8 strings = step_strings(cur_seq_step);
+	if (!strings)
+		return;
 	PatternStringStep* string_step = string_step_ptr(0, false, cur_seq_step);
-	for (u8 string_id = 0; string_id < 8; ++string_id, ++string_step) {
-		for (u8 substep_id = 0; substep_id < 8; ++substep_id) {
-			if (string_step->pres[substep_id] > 0) {
-				data_saved = true;
-				string_step->pres[substep_id] = 0;
-			}
-		}
-	}
-	if (data_saved)
-		log_ram_edit(SEG_PAT0 + CUR_QUARTER);
+	for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id)
+		if (strings & (1 << string_id))
+			memset(string_step[string_id].pres, 0, sizeof(string_step->pres));
+	log_pattern_edit(cur_seq_step);
 }
 
 // == SEQ VISUALS == //
@@ -485,8 +555,8 @@ void seq_ptn_start_visuals(void) {
 }
 
 void seq_ptn_end_visuals(void) {
-	fdraw_str(0, 0, F_20_BOLD, I_NEXT "End %d", ((cur_seq_start + cur_preset.seq_len) & 63) + 1);
-	fdraw_str(0, 16, F_20_BOLD, I_INTERVAL "Length %d", cur_preset.seq_len);
+	fdraw_str(0, 0, F_20_BOLD, I_NEXT "End %d", wrap_step(cur_seq_start + seq_length() - 1) + 1);
+	fdraw_str(0, 16, F_20_BOLD, I_INTERVAL "Length %d", seq_length());
 }
 
 static void draw_pres_substep(u8 id, u8 y, u8 draw_style) {
@@ -549,7 +619,7 @@ u8 seq_led(u8 x, u8 y, u8 sync_pulse) {
 	u8 k = 0;
 	u8 step = x + y * 8;
 	// all active steps
-	if (((step - cur_seq_start) & 63) < cur_preset.seq_len)
+	if (rel_step(step) < seq_length())
 		k = maxi(k, ui_mode == UI_DEFAULT ? 48 : 96);
 	// start/end steps
 	switch (ui_mode) {
@@ -558,7 +628,7 @@ u8 seq_led(u8 x, u8 y, u8 sync_pulse) {
 			k = 255;
 		break;
 	case UI_PTN_END:
-		if (((step + 1) & 63) == ((cur_seq_start + cur_preset.seq_len) & 63))
+		if (rel_step(step) == seq_length() - 1)
 			k = 255;
 		break;
 	default:
@@ -574,8 +644,12 @@ u8 seq_led(u8 x, u8 y, u8 sync_pulse) {
 }
 
 u8 seq_press_led(u8 x, u8 y) {
-	PatternStringStep* string_step = string_step_ptr(x, true, cur_seq_step);
+	// runs in the main loop, the audio tick can move the playhead between the lookups
+	u8 step = cur_seq_step;
 	u8 substep = seq_substep(8);
+	if (!(step_substeps(x, step) & (1 << substep)))
+		return 0;
+	PatternStringStep* string_step = string_step_ptr(x, false, step);
 	if (string_step && string_step->pos[substep / 2] / 32 == y)
 		return string_step->pres[substep];
 	return 0;
@@ -7,6 +7,8 @@ extern SeqFlags seq_flags;
 
 bool seq_playing(void);
 bool seq_recording(void);
+u8 seq_cur_step(void);
+u16 seq_length(void); // in steps
 SeqState seq_state(void);
 u32 seq_substep(u32 resolution); // ui & params_tick
 
@@ -32,6 +32,15 @@ static u8 string_touched_no_arp_1back = 0;
 // physical touch mask during the write_frame, used by latch
 static u8 strings_phys_touched = 0;
 
+// midi and sequencer notes start and stop on a sample: their events carry the absolute sample they are due on
+// (synth_tick * SAMPLES_PER_TICK + offset). The touch generated with an event is kept out of the read frame until the
+// tick of that sample and published into it then, frame swap or not, so these notes play with a constant latency
+u8 note_offset[NUM_STRINGS];           // for the synth: sample within this tick where a published note on/off lands
+static u32 event_due[NUM_STRINGS];     // absolute sample of the latest event of the string
+static Touch event_touch[NUM_STRINGS]; // touch generated with that event
+static u8 events_pending = 0;          // bitmask, events that are not in a generated touch yet
+static u8 touches_pending = 0;         // bitmask, touches waiting for their due tick
+
 // midi
 u8 midi_note[NUM_STRINGS];
 static u8 midi_velocity[NUM_STRINGS];
@@ -219,11 +228,55 @@ static void generate_string_touch(u8 string_id) {
 	// save resulting touch to main array
 	s_touch->pres = pressure;
 	s_touch->pos = position;
+	if ((events_pending | touches_pending) & mask) {
+		event_touch[string_id] = *s_touch;
+		touches_pending |= mask;
+		events_pending &= ~mask;
+	}
 
 	// sort string's frames by position
 	sort8((int*)string_touch_sorted[string_id], (int*)string_touch[string_id]);
 }
 
+// strings touched on the read frame, with hysteresis
+static u8 touched_strings(u8 prev_touched) {
+	u8 touched = 0;
+	for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id) {
+		s8 thresh = (prev_touched & (1 << string_id)) ? -50 : 1;
+		if (get_string_touch(string_id)->pres > thresh)
+			touched |= 1 << string_id;
+	}
+	return touched;
+}
+
+// new (physical or virtual) touch: restart arp
+static void restart_arp(u8 prev_touched, u8 touched) {
+	if (arp_active() && touched && !prev_touched) {
+		arp_reset();
+		// if the sequencer is not playing, reset the clock so the arp gets a trigger
+		if (!seq_playing())
+			clock_reset();
+	}
+}
+
+// move the pending touches that are due in this tick into the read frame, returns a bitmask of them
+static u8 publish_due_touches(void) {
+	u32 block_start = synth_tick * SAMPLES_PER_TICK;
+	u8 published = 0;
+	for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id) {
+		s32 due = event_due[string_id] - block_start;
+		if (!(touches_pending & (1 << string_id)) || due >= SAMPLES_PER_TICK)
+			continue;
+		*get_string_touch(string_id) = event_touch[string_id];
+		sort8((int*)string_touch_sorted[string_id], (int*)string_touch[string_id]);
+		// a late event starts right away
+		note_offset[string_id] = maxi(due, 0);
+		published |= 1 << string_id;
+	}
+	touches_pending &= ~published;
+	return published;
+}
+
 // manage generating the string_touch array
 void generate_string_touches(void) {
 	static bool do_second_half = false;
@@ -249,31 +302,35 @@ void generate_string_touches(void) {
 		// make use of the new touch-data
 		if (strings_write_frame != touch_frame) {
 			// we read from the frame that was written just before
+			u8 prev_read_frame = strings_read_frame;
 			strings_read_frame = strings_write_frame;
 			// we write to the frame that is currently being processed by the touchstrips
 			strings_write_frame = touch_frame;
+			// touches that aren't due yet don't show up early, the string keeps its previous touch
+			for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id)
+				if (touches_pending & (1 << string_id))
+					string_touch[string_id][strings_read_frame] = string_touch[string_id][prev_read_frame];
 			// we update the touch pointers for he new strings_read_frame
 			params_update_touch_pointers();
 			arp_next_strings_frame_trig();
 		}
 
+		publish_due_touches();
+
 		// calculate string touches
 		string_touched_no_arp_1back = string_touched_no_arp;
-		string_touched_no_arp = 0;
-		for (u8 string_id = 0; string_id < NUM_STRINGS; ++string_id) {
-			Touch* s_touch = get_string_touch(string_id);
-			s8 thresh = (string_touched_no_arp_1back & (1 << string_id)) ? -50 : 1; // hysteresis
-			if (s_touch->pres > thresh)
-				string_touched_no_arp |= 1 << string_id;
-		}
+		string_touched_no_arp = touched_strings(string_touched_no_arp_1back);
 		env_trig_mask = (string_touched_no_arp & ~string_touched_no_arp_1back);
-
-		// new (physical or virtual) touch: restart arp
-		if (arp_active() && string_touched_no_arp && !string_touched_no_arp_1back) {
-			arp_reset();
-			// if the sequencer is not playing, reset the clock so the arp gets a trigger
-			if (!seq_playing())
-				clock_reset();
+		restart_arp(string_touched_no_arp_1back, string_touched_no_arp);
+	}
+	// in between, only the strings that just got published change
+	else {
+		u8 published = publish_due_touches();
+		if (published) {
+			u8 prev_touched = string_touched_no_arp;
+			string_touched_no_arp = (prev_touched & ~published) | (touched_strings(prev_touched) & published);
+			env_trig_mask |= string_touched_no_arp & ~prev_touched;
+			restart_arp(prev_touched, string_touched_no_arp);
 		}
 	}
 
@@ -359,7 +416,7 @@ static u8 find_free_midi_string(u8 midi_note_number, u16* midi_note_position, u8
 	// collect non-pressed, non-sounding strings
 	for (u8 string_id = 0; string_id < 8; string_id++) {
 		if (!(midi_pressure_override & (1 << string_id)) && !(string_touched_no_arp & (1 << string_id))
-		    && voices[string_id].env1_lvl < 0.001f) {
+		    && envs.env1_lvl[string_id] < 0.001f) {
 			string_option[num_string_options] = string_id;
 			num_string_options++;
 		}
@@ -387,8 +444,8 @@ static u8 find_free_midi_string(u8 midi_note_number, u16* midi_note_position, u8
 	}
 	// find quietest
 	for (u8 option_id = 0; option_id < num_string_options; option_id++) {
-		if (voices[string_option[option_id]].env1_lvl < min_vol) {
-			min_vol = voices[string_option[option_id]].env1_lvl;
+		if (envs.env1_lvl[string_option[option_id]] < min_vol) {
+			min_vol = envs.env1_lvl[string_option[option_id]];
 			min_string_id = string_option[option_id];
 		}
 	}
@@ -400,7 +457,13 @@ static u8 find_free_midi_string(u8 midi_note_number, u16* midi_note_position, u8
 	return min_string_id;
 }
 
-void strings_rcv_midi(u8 status, u8 d1, u8 d2) {
+// a midi or sequencer note on/off of the string is due on this absolute sample, see event_due
+void string_event(u8 string_id, u32 sample) {
+	event_due[string_id] = sample;
+	events_pending |= 1 << string_id;
+}
+
+void strings_rcv_midi(u8 status, u8 d1, u8 d2, u32 sample) {
 	u8 chan = status & 0x0F; // save the channel
 	u8 type = status & 0xF0; // take the channel out
 
@@ -411,8 +474,10 @@ void strings_rcv_midi(u8 status, u8 d1, u8 d2) {
 		if (string_id < NUM_STRINGS) {
 			if (midi_sustain_pressed)
 				midi_held_by_sustain |= 1 << string_id;
-			else
+			else {
 				midi_pressure_override &= ~(1 << string_id);
+				string_event(string_id, sample);
+			}
 		}
 	} break;
 	case MIDI_NOTE_ON: {
@@ -431,6 +496,7 @@ void strings_rcv_midi(u8 status, u8 d1, u8 d2) {
 			midi_channel[string_id] = chan;
 			midi_velocity[string_id] = d2;
 			midi_poly_pressure[string_id] = 0;
+			string_event(string_id, sample);
 			// activate midi for string
 			midi_pressure_override |= 1 << string_id;
 			midi_pitch_override |= 1 << string_id;
@@ -471,5 +537,8 @@ void strings_clear_midi(void) {
 	memset(midi_note, 0, sizeof(midi_note));
 	memset(midi_velocity, 0, sizeof(midi_velocity));
 	memset(midi_poly_pressure, 0, sizeof(midi_poly_pressure));
+	memset(note_offset, 0, sizeof(note_offset));
+	events_pending = 0;
+	touches_pending = 0;
 	memset(midi_channel, 255, sizeof(midi_channel));
 }
\ No newline at end of file
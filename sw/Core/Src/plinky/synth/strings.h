@@ -14,6 +14,7 @@ extern u8 midi_channel[NUM_STRINGS];
 extern u8 midi_pressure_override;
 extern u8 midi_pitch_override;
 extern u8 midi_suppress;
+extern u8 note_offset[NUM_STRINGS];
 
 Touch* get_string_touch(u8 string_id);
 Touch* sorted_string_touch_ptr(u8 string_id);
@@ -22,7 +23,8 @@ void clean_string(u8 string_id);
 void clear_latch(void);
 
 void generate_string_touches(void);
-void strings_rcv_midi(u8 status, u8 d1, u8 d2);
+void string_event(u8 string_id, u32 sample);
+void strings_rcv_midi(u8 status, u8 d1, u8 d2, u32 sample);
 void strings_clear_midi(void);
 // this only exists for midi output - remove after midi cleanup
 Touch* get_string_touch_prev(u8 string_id, u8 frames_back);
\ No newline at end of file
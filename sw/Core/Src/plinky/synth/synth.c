@@ -5,11 +5,17 @@
 #include "gfx/gfx.h"
 #include "hardware/adc_dac.h"
 #include "hardware/ram.h"
+#include "pitch_grid.h"
 #include "pitch_tools.h"
 #include "sampler.h"
 #include "strings.h"
 
-Voice voices[NUM_VOICES];
+OscBlock oscs;
+EnvBlock envs;
+
+// ui only, the audio interrupt updates these after each envelope step
+static float env1_peak[NUM_VOICES];
+static float env1_norm[NUM_VOICES];
 
 static bool cv_trig_high = false;   // should cv trigger be high?
 static s32 cv_gate_value;           // cv gate value
@@ -27,8 +33,8 @@ static void osc_generation_init(void) {
 	synth_max_pres = 0;
 }
 
-// take string values, calculate osc pitches and write them to voice
-void generate_oscs(u8 string_id, Voice* voice) {
+// take string values, calculate osc pitches and write them to the voice's oscillators
+void generate_oscs(u8 string_id) {
 	float pres_scaled = get_string_touch(string_id)->pres * 1.f / TOUCH_MAX_POS;
 
 	// rj: cv_gate_value is in practice another expression of the maximum pressure over all strings, which goes against
@@ -50,6 +56,7 @@ void generate_oscs(u8 string_id, Voice* voice) {
 	Scale scale = NUM_SCALES;
 	s32 cv_pitch_offset = 0;
 	s8 cv_step_offset = 0;
+	const s32* pad_pitch = 0;
 
 	// saving string values that are the same for all oscillators
 
@@ -82,6 +89,9 @@ void generate_oscs(u8 string_id, Voice* voice) {
 			cv_step_offset = pitch_to_scale_steps(cv_pitch, scale); // quantized cv
 		else
 			cv_pitch_offset = cv_pitch; // unquantized cv
+
+		// pitches of the pads on this string
+		pad_pitch = pitch_grid_row(string_id, scale, string_step_offset + cv_step_offset);
 	}
 
 	// we discard the two highest and lowest positions and use elements 2 through 5 to generate our oscillator pitches
@@ -99,13 +109,11 @@ void generate_oscs(u8 string_id, Voice* voice) {
 			u16 position = s_touch_sort->pos; // touch position
 			u8 pad_y = 7 - (position >> 8);   // pad on string
 			// pitch at step + cv
-			note_pitch = pitch_at_step(scale, string_step_offset + pad_y + cv_step_offset) + cv_pitch_offset;
+			note_pitch = pad_pitch[pad_y] + cv_pitch_offset;
 
 			// detuning scaled by microtune param
 			s16 fine_pos = 127 - (position & 255); // offset from pad center
-			u16 pitch_to_next_pad =
-			    abs(pitch_at_step(scale, string_step_offset + pad_y + cv_step_offset + (fine_pos > 0 ? 1 : -1))
-			        - note_pitch);
+			u16 pitch_to_next_pad = abs(pad_pitch[pad_y + (fine_pos > 0 ? 1 : -1)] - note_pitch);
 			s32 micro_tune = ((64 + param_val_poly(P_MICROTONE, string_id)) * pitch_to_next_pad) >> 10;
 			fine_pitch = (fine_pos * micro_tune) >> 14;
 		}
@@ -123,8 +131,8 @@ void generate_oscs(u8 string_id, Voice* voice) {
 
 		// save values
 		summed_pitch += osc_pitch;
-		voice->osc[osc_id].pitch = osc_pitch;
-		voice->osc[osc_id].goal_phase_diff =
+		oscs.pitch[string_id][osc_id] = osc_pitch;
+		oscs.goal_phase_diff[string_id][osc_id] =
 		    maxi(65536, (s32)(table_interp(pitches, osc_pitch + PITCH_BASE) * (65536.f * 128.f)));
 		++s_touch_sort;
 	}
@@ -140,7 +148,7 @@ void generate_oscs(u8 string_id, Voice* voice) {
 	set_midi_goal_note(string_id, quad_pitch_to_midi_note(summed_pitch));
 }
 
-static float update_envelope(u8 voice_id, Voice* voice) {
+static float update_envelope(u8 voice_id) {
 	u8 mask = 1 << voice_id;
 	float goal_lpg = 0.f;
 
@@ -150,7 +158,7 @@ static float update_envelope(u8 voice_id, Voice* voice) {
 		goal_lpg = get_string_touch(voice_id)->pres * 1.f / TOUCH_MAX_POS * sens * sens;
 		if (goal_lpg < 0.f)
 			goal_lpg = 0.f;
-		goal_lpg *= 1.f + ((voice->osc[2].pitch - 43000) * (1.f / 65536.f)); // pitch compensation
+		goal_lpg *= 1.f + ((oscs.pitch[voice_id][2] - 43000) * (1.f / 65536.f)); // pitch compensation
 	}
 
 	// retrieve envelope
@@ -160,19 +168,22 @@ static float update_envelope(u8 voice_id, Voice* voice) {
 	const float sustain = is_sample_preview ? 1.f : squaref(param_val_poly(P_SUSTAIN1, voice_id) * (1.f / 65536.f));
 	const float release = is_sample_preview ? 0.5f : lpf_k((param_val_poly(P_RELEASE1, voice_id)));
 
-	float env_lvl = voice->env1_lvl;
+	float env_lvl = envs.env1_lvl[voice_id];
+	bool decaying = envs.env1_decaying[voice_id];
+	float peak = env1_peak[voice_id];
+	float norm;
 
 	// new touch: start new envelope
 	if (env_trig_mask & mask) {
 		env_lvl *= sustain;
-		voice->env1_decaying = false;
-		voice->env1_peak = goal_lpg;
+		decaying = false;
+		peak = goal_lpg;
 		cv_trig_high = true; // send cv trigger
 	}
 
 	if (goal_lpg <= 0.f) // no pressure => release phase (aka not decaying)
-		voice->env1_decaying = false;
-	else if (voice->env1_decaying) // in decay phase => aim for sustain level
+		decaying = false;
+	else if (decaying) // in decay phase => aim for sustain level
 		goal_lpg *= sustain;
 
 	// apply envelope
@@ -182,31 +193,34 @@ static float update_envelope(u8 voice_id, Voice* voice) {
 
 	// release phase
 	if (goal_lpg <= 0.f)
-		voice->env1_norm = voice->env1_peak == 0 ? 0 : env_lvl / voice->env1_peak;
+		norm = peak == 0 ? 0 : env_lvl / peak;
 	// decay/sustain phase
-	else if (voice->env1_decaying) {
-		voice->env1_norm = 1;
-		voice->env1_peak = env_lvl;
+	else if (decaying) {
+		norm = 1;
+		peak = env_lvl;
 	}
 	// attack phase
 	else {
-		voice->env1_norm = env_lvl / goal_lpg;
-		if (goal_lpg > voice->env1_peak)
-			voice->env1_peak = goal_lpg;
+		norm = env_lvl / goal_lpg;
+		if (goal_lpg > peak)
+			peak = goal_lpg;
 	}
 	// we hit the peak! time to decay
 	if (env_lvl > goal_lpg * 0.95f)
-		voice->env1_decaying = true;
+		decaying = true;
 	// constrain to max 1.0
 	if (env_lvl > 1.f) {
 		env_lvl = 1.f;
-		voice->env1_decaying = true;
+		decaying = true;
 	}
+	envs.env1_decaying[voice_id] = decaying;
+	env1_peak[voice_id] = peak;
+	env1_norm[voice_id] = norm;
 	return env_lvl;
 }
 
-static void apply_subtractive_lpg_noise(u8 voice_id, Voice* voice, float goal_lpg, float noise_diff, float drive,
-                                        float resonance, u32* dst) {
+RAM_FUNC static void apply_subtractive_lpg_noise(u8 voice_id, float goal_lpg, float noise_diff, float drive,
+                                                 float resonance, u8 ramp_start, u32* dst) {
 	float glide = lpf_k(param_val_poly(P_GLIDE, voice_id) >> 2) * (0.5f / SAMPLES_PER_TICK);
 
 	// oscillator shape
@@ -222,48 +236,53 @@ static void apply_subtractive_lpg_noise(u8 voice_id, Voice* voice, float goal_lp
 	else
 		osc_shape = clampi(osc_shape, -65535, -1);
 
+	u32* phase = oscs.phase[voice_id];
+	s32* phase_diff = oscs.phase_diff[voice_id];
+	s32* goal_phase_diff = oscs.goal_phase_diff[voice_id];
+	u32* prev_sample = oscs.prev_sample[voice_id];
+	ValueSmoother* lpg_smoother = envs.lpg_smoother[voice_id];
+
 	// two loops handling two oscillators each
 	float noise;
 	for (u8 osc_id = 0; osc_id < OSCS_PER_VOICE / 2; osc_id++) {
 		s16* osc_dst = ((s16*)dst) + (osc_id & 1);
-		noise = voice->noise_lvl;
+		noise = envs.noise_lvl[voice_id];
 		int rand_table_pos = rand() & 16383;
-		float osc_lpg = voice->env1_lvl;
-		float osc_lpg_diff = (goal_lpg - osc_lpg) * (1.f / SAMPLES_PER_TICK);
+		float osc_lpg = envs.env1_lvl[voice_id];
+		float osc_lpg_diff = (goal_lpg - osc_lpg) / (SAMPLES_PER_TICK - ramp_start);
 
-		Osc* osc = &voice->osc[osc_id];
+		u8 osc1 = osc_id;
+		u8 osc2 = osc_id + 2;
 
 		u32 flippity = 0;
 		if (osc_shape != 0) {
 			flippity = ~0;
 			{
-				u32 avg_phase_diff = (osc[0].phase_diff + osc[2].phase_diff) / 2;
-				osc[0].phase_diff = avg_phase_diff;
-				osc[2].phase_diff = avg_phase_diff;
-				avg_phase_diff = (osc[0].goal_phase_diff + osc[2].goal_phase_diff) / 2;
-				osc[0].goal_phase_diff = avg_phase_diff;
-				osc[2].goal_phase_diff = avg_phase_diff;
+				u32 avg_phase_diff = (phase_diff[osc1] + phase_diff[osc2]) / 2;
+				phase_diff[osc1] = avg_phase_diff;
+				phase_diff[osc2] = avg_phase_diff;
+				avg_phase_diff = (goal_phase_diff[osc1] + goal_phase_diff[osc2]) / 2;
+				goal_phase_diff[osc1] = avg_phase_diff;
+				goal_phase_diff[osc2] = avg_phase_diff;
 				if (osc_shape < 0) {
 					s32 phase0_fix =
-					    (s32)(osc[2].phase - osc[0].phase - (osc_shape << 16) + (1 << 31)) / (SAMPLES_PER_TICK);
-					osc[0].phase_diff += phase0_fix;
-					osc[0].goal_phase_diff += phase0_fix;
+					    (s32)(phase[osc2] - phase[osc1] - (osc_shape << 16) + (1 << 31)) / (SAMPLES_PER_TICK);
+					phase_diff[osc1] += phase0_fix;
+					goal_phase_diff[osc1] += phase0_fix;
 				}
 			}
 		}
-		int dd_phase1 = (int)((osc->goal_phase_diff - osc->phase_diff) * glide);
-		u32 phase1 = osc->phase;
-		s32 phase1_diff = osc->phase_diff;
-		u32 prev_sample1 = osc->prev_sample;
-		osc += 2;
-		int dd_phase2 = (int)((osc->goal_phase_diff - osc->phase_diff) * glide);
-		u32 phase2 = osc->phase;
-		s32 phase2_diff = osc->phase_diff;
-		u32 prev_sample2 = osc->prev_sample;
-		osc -= 2;
-
-		float y1 = voice->lpg_smoother[osc_id].y1;
-		float y2 = voice->lpg_smoother[osc_id].y2;
+		int dd_phase1 = (int)((goal_phase_diff[osc1] - phase_diff[osc1]) * glide);
+		u32 phase1 = phase[osc1];
+		s32 phase1_diff = phase_diff[osc1];
+		u32 prev_sample1 = prev_sample[osc1];
+		int dd_phase2 = (int)((goal_phase_diff[osc2] - phase_diff[osc2]) * glide);
+		u32 phase2 = phase[osc2];
+		s32 phase2_diff = phase_diff[osc2];
+		u32 prev_sample2 = prev_sample[osc2];
+
+		float y1 = lpg_smoother[osc_id].y1;
+		float y2 = lpg_smoother[osc_id].y2;
 
 		// == WAVETABLE == //
 		if (osc_shape > 0) {
@@ -295,7 +314,8 @@ static void apply_subtractive_lpg_noise(u8 voice_id, Voice* voice, float goal_lp
 				s16 n = ((s16*)rndtab)[rand_table_pos++];
 				noise += noise_diff;
 
-				osc_lpg += osc_lpg_diff;
+				if (i >= ramp_start)
+					osc_lpg += osc_lpg_diff;
 				y1 += (out * drive + n * noise - (y2 - y1) * resonance - y1) * osc_lpg; // drive
 				y1 *= 0.999f;
 				y2 += (y1 - y2) * osc_lpg;
@@ -311,35 +331,15 @@ static void apply_subtractive_lpg_noise(u8 voice_id, Voice* voice, float goal_lp
 
 		else {
 			for (u8 i = 0; i < SAMPLES_PER_TICK; ++i) {
-				phase1_diff += dd_phase1;
-				phase1 += phase1_diff;
-				u32 newsample1 = phase1;
-				if (unlikely(phase1 < (u32)phase1_diff)) {
-					// edge! polyblep it.
-					u32 fractime = mini(65535, phase1 / (phase1_diff >> 16));
-					prev_sample1 -= (fractime * fractime) >> 1;
-					fractime = 65535 - fractime;
-					newsample1 += (fractime * fractime) >> 1;
-				}
-				s32 out = (s32)(prev_sample1 >> 4);
-				prev_sample1 = newsample1;
-				phase2_diff += dd_phase2;
-				phase2 += phase2_diff;
-				u32 newsample2 = phase2;
-				if (unlikely(phase2 < (u32)phase2_diff)) {
-					// edge! polyblep it.
-					u32 fractime = mini(65535, phase2 / (phase2_diff >> 16));
-					prev_sample2 -= (fractime * fractime) >> 1;
-					fractime = 65535 - fractime;
-					newsample2 += (fractime * fractime) >> 1;
-				}
-				out += (s32)((prev_sample2 ^ flippity) >> 4) - (2 << (31 - 4));
-				prev_sample2 = newsample2;
+				s32 out = (s32)(POLYBLEPSAW(&phase1, &phase1_diff, dd_phase1, &prev_sample1) >> 4);
+				out += (s32)((POLYBLEPSAW(&phase2, &phase2_diff, dd_phase2, &prev_sample2) ^ flippity) >> 4)
+				       - (2 << (31 - 4));
 
 				s16 n = ((s16*)rndtab)[rand_table_pos++];
 				noise += noise_diff;
 
-				osc_lpg += osc_lpg_diff;
+				if (i >= ramp_start)
+					osc_lpg += osc_lpg_diff;
 				y1 += (out * drive + n * noise - (y2 - y1) * resonance - y1) * osc_lpg; // drive
 				y1 *= 0.999f;
 				y2 += (y1 - y2) * osc_lpg;
@@ -350,25 +350,24 @@ static void apply_subtractive_lpg_noise(u8 voice_id, Voice* voice, float goal_lp
 				osc_dst += 2;
 			} // samples
 		}
-		osc[0].phase = phase1;
-		osc[0].phase_diff = phase1_diff;
-		osc[0].prev_sample = prev_sample1;
+		phase[osc1] = phase1;
+		phase_diff[osc1] = phase1_diff;
+		prev_sample[osc1] = prev_sample1;
 
-		osc[2].phase = phase2;
-		osc[2].phase_diff = phase2_diff;
-		osc[2].prev_sample = prev_sample2;
+		phase[osc2] = phase2;
+		phase_diff[osc2] = phase2_diff;
+		prev_sample[osc2] = prev_sample2;
 
-		voice->lpg_smoother[osc_id].y1 = y1;
-		voice->lpg_smoother[osc_id].y2 = y2;
+		lpg_smoother[osc_id].y1 = y1;
+		lpg_smoother[osc_id].y2 = y2;
 	} // osc loop
 
-	voice->env1_lvl = goal_lpg;
-	voice->noise_lvl = noise;
+	envs.env1_lvl[voice_id] = goal_lpg;
+	envs.noise_lvl[voice_id] = noise;
 }
 
 static void run_voice(u8 voice_id, u32* dst) {
 	u8 mask = 1 << voice_id;
-	Voice* voice = &voices[voice_id];
 	Touch* s_touch = get_string_touch(voice_id);
 
 	// track max pressure
@@ -378,15 +377,18 @@ static void run_voice(u8 voice_id, u32* dst) {
 	// midi note is released but still playing
 	// and it's being suppressed by touch/latch/seq or its release phase has rung out
 	if (((midi_pitch_override & mask) && !(midi_pressure_override & mask))
-	    && ((midi_suppress & mask) || (voice->env1_lvl < 0.001f)))
+	    && ((midi_suppress & mask) || (envs.env1_lvl[voice_id] < 0.001f)))
 		// disable pitch override, this truly turns off the note
 		midi_pitch_override &= ~mask;
 
 	// generate oscillators
-	generate_oscs(voice_id, voice);
+	generate_oscs(voice_id);
 
 	// apply envelope
-	float goal_lpg = update_envelope(voice_id, voice);
+	float goal_lpg = update_envelope(voice_id);
+	// midi and sequencer notes start and stop at their sample within the tick, the envelope holds its level until then
+	u8 ramp_start = note_offset[voice_id];
+	note_offset[voice_id] = 0;
 
 	// pre-calc noise, drive, resonance
 	int drive_lvl = param_val_poly(P_DISTORTION, voice_id) * 2 - 65536;
@@ -398,16 +400,16 @@ static void run_voice(u8 voice_id, u32* dst) {
 	goal_noise *= goal_noise;
 	if (drive_lvl > 0)
 		goal_noise *= fdrive;
-	float noise_diff = (goal_noise - voice->noise_lvl) * (1.f / SAMPLES_PER_TICK);
+	float noise_diff = (goal_noise - envs.noise_lvl[voice_id]) * (1.f / SAMPLES_PER_TICK);
 	int resonancei = 65536 - param_val_poly(P_RESO, voice_id);
 	float resonance = 2.1f - (table_interp(pitches, resonancei) * (2.1f / pitches[1024]));
 	drive *= 2.f / (resonance + 2.f);
 
 	// apply low pass gate and noise
 	if (using_sampler())
-		apply_sample_lpg_noise(voice_id, voice, goal_lpg, noise_diff, drive, dst);
+		apply_sample_lpg_noise(voice_id, goal_lpg, noise_diff, drive, ramp_start, dst);
 	else
-		apply_subtractive_lpg_noise(voice_id, voice, goal_lpg, noise_diff, drive, resonance, dst);
+		apply_subtractive_lpg_noise(voice_id, goal_lpg, noise_diff, drive, resonance, ramp_start, dst);
 }
 
 // send cv values resulting from oscillator generation
@@ -449,7 +451,7 @@ void draw_voices(bool show_latch) {
 	u8 left_offset = show_latch ? 42 : 46;
 	u8 bar_spacing = show_latch ? 6 : 8;
 	for (u8 voice_id = 0; voice_id < NUM_VOICES; voice_id++) {
-		u8 bar_height = clampi(voices[voice_id].env1_norm * max_height, 0, max_height);
+		u8 bar_height = clampi(env1_norm[voice_id] * max_height, 0, max_height);
 		u8 x = voice_id * bar_spacing + left_offset;
 		// top
 		fill_rectangle(x, OLED_HEIGHT - bar_height - 1, x + bar_width, OLED_HEIGHT - bar_height + 1);
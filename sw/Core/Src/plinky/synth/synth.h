@@ -5,7 +5,8 @@
 // on the virtual touches in the eight strings, applies the envelope and basic sound parameters
 // this module also sends out pitch/pressure/gate cv signals based on the generated oscillators
 
-extern Voice voices[NUM_VOICES];
+extern OscBlock oscs;
+extern EnvBlock envs;
 
 void handle_synth_voices(u32* dst);
 
@@ -1,6 +1,8 @@
 #include "time.h"
+#include "analytics/input_trace.h"
 #include "hardware/adc_dac.h"
 #include "hardware/midi.h"
+#include "hardware/ram.h"
 #include "params.h"
 #include "sequencer.h"
 #include "ui/oled_viz.h"
@@ -10,34 +12,54 @@
 // amount of ticks for one pulse at the lowest allowable bpm
 #define MAX_CLOCK_GAP_TICKS(ppqn) ((600 * SAMPLE_RATE) / (ppqn * MIN_BPM_10X * SAMPLES_PER_TICK))
 #define CUR_PULSE_COUNT(ppqn) ((ppqn * clock_32nds_q21) >> 24)
+#define US_PER_TICK (SAMPLES_PER_TICK * 1000000 / SAMPLE_RATE)
+#define LOCK_TOLERANCE 0.1f // max pulse timing error for a locked loop, relative to the pulse period
+#define LOCK_PULSES 8       // consecutive pulses within the tolerance before the loop counts as locked
+
+// external clocks are followed by a second order delay-locked loop over the pulse timestamps (as in "Using a DLL to
+// filter time", F. Adriaensen). It filters out the jitter of the pulses and measures the tempo with sub-tick precision
+typedef struct ClockFollower {
+	u32 pulse_time; // filtered time of the latest pulse in micros()
+	float period;   // filtered pulse period in micros, 0 while unknown
+	bool started;   // pulse_time is valid
+	u8 lock_count;  // consecutive pulses within LOCK_TOLERANCE
+} ClockFollower;
+
+// loop bandwidth per ClockSmoothing, in cycles per pulse
+const static float dll_bandwidth[NUM_CLOCK_SMOOTHINGS] = {
+    [CLK_SMOOTH_NORMAL] = 0.04f,
+    [CLK_SMOOTH_FAST] = 0.1f,
+    [CLK_SMOOTH_SLOW] = 0.015f,
+};
 
 ClockType clock_type = CLK_INTERNAL;
 u32 synth_tick = 0;     // global synth_tick counter
 u16 bpm_10x = 120 * 10; // bpm with one decimal precision
 
-bool pulse_32nd = false; // true if this tick is the start of a new 32nd note
-u16 counter_32nds = 0;   // counts 32nd notes, rolls over at SYNC_DIVS_LCM
+bool pulse_32nd = false;  // true if this tick is the start of a new 32nd note
+u8 pulse_32nd_offset = 0; // sample within the tick where that 32nd note starts
+u16 counter_32nds = 0;    // counts 32nd notes, rolls over at SYNC_DIVS_LCM
 
 // global
-static u32 clock_32nds_q21 = 0;
-static ValueSmoother bpm_smoother;
+u32 clock_32nds_q21 = 0; // position in 32nd notes, 21 fractional bits
 static bool reset_clock_next_tick = false;
 
 // midi clock
-static bool midi_pulse = false;
+static u8 midi_pulses = 0; // received since the last tick
 static u8 midi_pulse_counter = 0;
 static u8 midi_ppqn = 24;
 static u32 ticks_since_midi_pulse = 0;
-static u32 last_midi_pulse_ticks = 0;
+static ClockFollower midi_follower;
 static bool start_seq_from_midi_start = false;
 static bool start_seq_from_midi_continue = false;
 
 // cv clock
 static volatile u8 cv_pulse = 0;
+static volatile u32 cv_pulse_time = 0;
 static u8 cv_pulse_counter = 0;
 static u8 cv_ppqn = 4;
 static u32 ticks_since_cv_pulse = 0;
-static u32 last_cv_pulse_ticks = 0;
+static ClockFollower cv_follower;
 static bool cv_pulse_handled = false;
 
 // swing
@@ -56,6 +78,7 @@ u32 clock_pos_q16(u16 loop_32nds) {
 }
 
 void trigger_cv_clock(void) {
+	cv_pulse_time = micros();
 	cv_pulse++;
 }
 
@@ -81,12 +104,74 @@ void trigger_tap_tempo(void) {
 	}
 }
 
-static void calc_bmp_from_ext(u32 last_pulse_duration, u32 cur_pulse_duration, u8 ppqn) {
-	smooth_value(&bpm_smoother, (75.f * SAMPLE_RATE) / ((((last_pulse_duration + cur_pulse_duration) * ppqn) << 3)),
-	             MIN_BPM_10X);
-	bpm_10x = (u16)(bpm_smoother.y2 + 0.5f);
+// == CLOCK FOLLOWER == //
+
+static bool follower_locked(ClockFollower* follower) {
+	return follower->lock_count >= LOCK_PULSES;
+}
+
+static void follower_pulse(ClockFollower* follower, u32 time, u8 ppqn) {
+	u32 interval = time - follower->pulse_time;
+	bool valid_interval = follower->started && interval <= MAX_CLOCK_GAP_TICKS(ppqn) * US_PER_TICK;
+	float error = interval - follower->period;
+	// first pulses, or the tempo jumped => start over from the raw interval
+	if (follower->period == 0.f || fabsf(error) > follower->period * 0.5f) {
+		follower->period = valid_interval ? interval : 0.f;
+		follower->pulse_time = time;
+		follower->started = true;
+		follower->lock_count = 0;
+		return;
+	}
+	// lock detection
+	if (fabsf(error) < follower->period * LOCK_TOLERANCE)
+		follower->lock_count = mini(follower->lock_count + 1, LOCK_PULSES);
+	else
+		follower->lock_count = 0;
+	// loop filter, runs at four times the bandwidth until locked to pick up the tempo quickly
+	float omega = 6.2832f * dll_bandwidth[sys_params.clock_smoothing]; // 2 pi b
+	if (!follower_locked(follower))
+		omega = minf(omega * 4.f, 0.8f);
+	follower->pulse_time += (s32)(follower->period + 1.4142f * omega * error + 0.5f);
+	follower->period += omega * omega * error;
+}
+
+// clock advance per tick at the follower's tempo, in float because pulse length times tick length overflows 32 bits
+static s32 follower_tick_q21(ClockFollower* follower, u8 ppqn) {
+	return (s32)((float)((1 << 24) / ppqn) * US_PER_TICK / follower->period);
+}
+
+// move the clock towards the position of the follower, returns false when the follower has no tempo yet
+static bool follow_clock(ClockFollower* follower, u8* pulse_counter, u8 ppqn, bool pulse) {
+	u32 pulse_q21 = (*pulse_counter << 24) / ppqn;
+	if (follower->period == 0.f) {
+		if (!pulse)
+			return false;
+		// no tempo yet => snap to the pulses
+		clock_32nds_q21 = pulse_q21;
+		*pulse_counter %= ppqn << 2;
+		return true;
+	}
+	*pulse_counter %= ppqn << 2;
+	// the clock runs one tick behind the pulses and its notes play a tick later, two ticks like midi notes do
+	s32 since_pulse = (s32)(trace_now() - US_PER_TICK - follower->pulse_time);
+	float pulse_frac = clampf(since_pulse / follower->period, -1.f, 1.f);
+	u32 target_q21 = pulse_q21 + (s32)(pulse_frac * (1 << 24)) / ppqn;
+	// distance to the target, the clock wraps at 32 32nds
+	s32 diff = (s32)((target_q21 - clock_32nds_q21) << 6) >> 6;
+	s32 pulse_len_q21 = (1 << 24) / ppqn;
+	s32 tick_step_q21 = follower_tick_q21(follower, ppqn);
+	// way off => jump, otherwise never step backwards and catch up at most at double speed
+	if (abs(diff) > pulse_len_q21)
+		clock_32nds_q21 += diff;
+	else
+		clock_32nds_q21 += clampi(diff, 0, 2 * tick_step_q21);
+	// we only calculate the bpm to show on the display and to time the synced delay
+	bpm_10x = clampi(600000000.f / (follower->period * ppqn) + 0.5f, MIN_BPM_10X, MAX_BPM_10X);
+	return true;
 }
 
+// == CLOCK == //
+
 static void set_clock_type(ClockType new_type) {
 	if (new_type == clock_type)
 		return;
@@ -112,17 +197,14 @@ static void set_clock_type(ClockType new_type) {
 			cv_pulse_counter = CUR_PULSE_COUNT(cv_ppqn);
 		break;
 	}
-	// going from internal to external => set the displayed bpm value
-	if (clock_type == CLK_INTERNAL)
-		set_smoother(&bpm_smoother, bpm_10x);
 	clock_type = new_type;
 }
 
 static void cleanup_clock_flags(void) {
-	if (cv_pulse_handled)
+	if (cv_pulse_handled && cv_pulse)
 		cv_pulse--;
 	cv_pulse_handled = false;
-	midi_pulse = false;
+	midi_pulses = 0;
 }
 
 static void calculate_swing(bool get_param) {
@@ -167,6 +249,7 @@ void clock_reset(void) {
 	counter_32nds = 0;
 	calculate_swing(true);
 	pulse_32nd = true; // this is the start of a 32nd
+	pulse_32nd_offset = 0;
 	if (seq_playing())
 		send_cv_clock(true); // this is the start of a 16th (4 ppqn)
 	midi_send_clock();       // this is the start of a 24 ppqn pulse
@@ -193,12 +276,14 @@ void clock_tick(void) {
 	ticks_since_cv_pulse++;
 	ticks_since_midi_pulse++;
 
-	if (cv_pulse) {
+	u32 pulse_time = cv_pulse_time;
+	bool new_cv_pulse = trace_cv_clock(cv_pulse != 0, &pulse_time);
+	if (new_cv_pulse) {
 		// track pulses
-		last_cv_pulse_ticks = ticks_since_cv_pulse;
 		ticks_since_cv_pulse = 0;
 		cv_pulse_counter++;
 		cv_pulse_handled = true;
+		follower_pulse(&cv_follower, pulse_time, cv_ppqn);
 		// check clock priority
 		if (clock_type != CLK_CV)
 			set_clock_type(CLK_CV);
@@ -208,11 +293,10 @@ void clock_tick(void) {
 	if (clock_type == CLK_CV && ticks_since_cv_pulse > MAX_CLOCK_GAP_TICKS(cv_ppqn))
 		set_clock_type(CLK_MIDI);
 
-	if (midi_pulse) {
-		// track pulses
-		last_midi_pulse_ticks = ticks_since_midi_pulse;
+	if (midi_pulses) {
+		// track pulses, the follower has already seen them as they came in
 		ticks_since_midi_pulse = 0;
-		midi_pulse_counter++;
+		midi_pulse_counter += midi_pulses;
 		// check clock priority
 		if (clock_type == CLK_INTERNAL)
 			set_clock_type(CLK_MIDI);
@@ -249,40 +333,20 @@ void clock_tick(void) {
 
 	// handle global accumulator clock
 	switch (clock_type) {
-	case CLK_CV: {
-		u32 max_gap = MAX_CLOCK_GAP_TICKS(cv_ppqn);
-		// cv pulse => snap the clock to the pulse position
-		if (cv_pulse) {
-			clock_32nds_q21 = (cv_pulse_counter << 24) / cv_ppqn;
-			cv_pulse_counter = cv_pulse_counter % (cv_ppqn << 2);
-			if (last_cv_pulse_ticks <= max_gap && ticks_since_cv_pulse <= max_gap)
-				// we only calculate the bmp to show on the display
-				calc_bmp_from_ext(last_cv_pulse_ticks, ticks_since_cv_pulse, cv_ppqn);
-			break;
-		}
-		// valid last pulse length => calculate clock from previous pulse
-		else if (last_cv_pulse_ticks <= max_gap) {
-			clock_32nds_q21 += (1 << 24) / (cv_ppqn * last_cv_pulse_ticks);
+	case CLK_CV:
+		if (follow_clock(&cv_follower, &cv_pulse_counter, cv_ppqn, new_cv_pulse))
 			break;
-		}
-	} // no valid pulse length => progress by midi clock
-	case CLK_MIDI: {
-		u32 max_gap = MAX_CLOCK_GAP_TICKS(midi_ppqn);
-		// midi pulse => snap the clock to the pulse position
-		if (midi_pulse && clock_type == CLK_MIDI) {
-			clock_32nds_q21 = (midi_pulse_counter << 24) / midi_ppqn;
-			midi_pulse_counter = midi_pulse_counter % (midi_ppqn << 2);
-			if (last_midi_pulse_ticks <= max_gap && ticks_since_midi_pulse <= max_gap)
-				// we only calculate the bmp to show on the display
-				calc_bmp_from_ext(last_midi_pulse_ticks, ticks_since_midi_pulse, midi_ppqn);
+		// no tempo yet => fall through to the midi clock
+	case CLK_MIDI:
+		if (clock_type == CLK_MIDI && follow_clock(&midi_follower, &midi_pulse_counter, midi_ppqn, midi_pulses))
 			break;
-		}
-		// valid last pulse length => calculate clock from previous pulse
-		else if (last_midi_pulse_ticks <= max_gap) {
-			clock_32nds_q21 += (1 << 24) / (midi_ppqn * last_midi_pulse_ticks);
+		// cv clock without a tempo => run at the tempo of a running midi clock
+		if (clock_type == CLK_CV && midi_follower.period != 0.f
+		    && ticks_since_midi_pulse <= MAX_CLOCK_GAP_TICKS(midi_ppqn)) {
+			clock_32nds_q21 += follower_tick_q21(&midi_follower, midi_ppqn);
 			break;
 		}
-	} // no valid pulse length => progress by internal clock
+		// no tempo yet => fall through to the internal clock
 	default:
 		// internal clock => calculate clock from bpm param
 		bpm_10x = maxi(((param_val(P_TEMPO) * 1200) >> 16) + 1200, MIN_BPM_10X);
@@ -301,8 +365,15 @@ void clock_tick(void) {
 	calculate_swing(true);
 
 	// check for 32nd note pulse
-	if (clock_32nds_q21 >= cur_32nd_start_q21 + length_32nd_q21) {
+	u32 next_32nd_q21 = cur_32nd_start_q21 + length_32nd_q21;
+	if (clock_32nds_q21 >= next_32nd_q21) {
 		pulse_32nd = true;
+		// this tick's block runs from prev_clock to the current clock, find the sample the pulse falls on
+		u32 tick_q21 = clock_32nds_q21 - prev_clock;
+		pulse_32nd_offset = next_32nd_q21 > prev_clock && tick_q21
+		                        ? mini((u64)(next_32nd_q21 - prev_clock) * SAMPLES_PER_TICK / tick_q21,
+		                               SAMPLES_PER_TICK - 1)
+		                        : 0;
 		counter_32nds = (counter_32nds + 1) % SYNC_DIVS_LCM;
 		calculate_swing(false);
 
@@ -320,7 +391,7 @@ void clock_tick(void) {
 	pulse_32nd = false;
 }
 
-void clock_rcv_midi(u8 midi_status) {
+void clock_rcv_midi(u8 midi_status, u32 time) {
 	switch (midi_status) {
 	case MIDI_START:
 		start_seq_from_midi_start = true;
@@ -332,7 +403,8 @@ void clock_rcv_midi(u8 midi_status) {
 		seq_stop();
 		break;
 	case MIDI_TIMING_CLOCK:
-		midi_pulse = true;
+		midi_pulses++;
+		follower_pulse(&midi_follower, time, midi_ppqn);
 		break;
 	}
 }
\ No newline at end of file
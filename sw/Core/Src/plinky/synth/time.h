@@ -4,8 +4,10 @@
 extern ClockType clock_type;
 extern u32 synth_tick;
 extern u16 bpm_10x;
+extern u32 clock_32nds_q21;
 
 extern bool pulse_32nd;
+extern u8 pulse_32nd_offset;
 extern u16 counter_32nds;
 
 u32 clock_pos_q16(u16 loop_32nds);
@@ -17,4 +19,4 @@ void clock_reset(void);
 
 void clock_tick(void);
 
-void clock_rcv_midi(u8 midi_status);
\ No newline at end of file
+void clock_rcv_midi(u8 midi_status, u32 time);
\ No newline at end of file
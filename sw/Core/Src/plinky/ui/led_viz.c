@@ -222,4 +222,5 @@ void draw_led_visuals(void) {
 
 	draw_main_leds();
 	draw_shift_leds();
+	leds_swap();
 }
\ No newline at end of file
@@ -79,18 +79,53 @@ static bool draw_message(void) {
 
 // == SCOPE == //
 
-static u32 scope[OLED_WIDTH];
+#define SCOPE_TAP_SIZE 512 // a block to trigger in, followed by the samples on screen
+#define SCOPE_SAMPLES 256   // two samples per pixel
 
-void clear_scope_pixel(u8 x) {
-	scope[x] = 0;
-}
+VIZ_TAP(scope_tap, SCOPE_TAP_SIZE);
+static u32 scope[OLED_WIDTH];
 
-void put_scope_pixel(u8 x, u8 y) {
+static void put_scope_pixel(u8 x, u8 y) {
 	if (y >= 32)
 		return;
 	scope[x] |= (1 << y);
 }
 
+// audio_post() fills the tap with a block of consecutive samples whenever it has room. Once a block is complete we
+// trigger on its biggest rising edge, leaving room for a screen of samples behind it, and draw those samples
+static void update_scope(void) {
+	if (viz_tap_available(&scope_tap) < SCOPE_TAP_SIZE)
+		return;
+
+	// trigger search
+	s16 prevprevli = viz_tap_peek(&scope_tap, 0);
+	s16 prevli = viz_tap_peek(&scope_tap, 1);
+	s16 antiturningpointli = prevli;
+	int bestedge = -1;
+	u16 trigger = 0;
+	for (u16 i = 2; i <= SCOPE_TAP_SIZE - SCOPE_SAMPLES; ++i) {
+		s16 li = viz_tap_peek(&scope_tap, i);
+		if (prevli < prevprevli && prevli < li)
+			antiturningpointli = prevli; // remember the last turning point at the bottom
+		if (prevli > prevprevli && prevli > li && prevli - antiturningpointli > bestedge) {
+			// we are at the biggest peak so far
+			bestedge = prevli - antiturningpointli;
+			trigger = i - 1;
+		}
+		prevprevli = prevli;
+		prevli = li;
+	}
+
+	// scope generation
+	memset(scope, 0, sizeof(scope));
+	for (u16 i = 0; i < SCOPE_SAMPLES; ++i) {
+		u32 scope_val = viz_tap_peek(&scope_tap, trigger + i);
+		put_scope_pixel(i / 2, scope_val >> 16);
+		put_scope_pixel(i / 2, scope_val >> 24);
+	}
+	viz_tap_skip(&scope_tap, SCOPE_TAP_SIZE);
+}
+
 static void draw_scope(void) {
 	u8* oled_buf = oled_buffer();
 	for (u8 x = 0; x < OLED_WIDTH; ++x) {
@@ -201,6 +236,9 @@ static void draw_visuals(void) {
 }
 
 void draw_oled_visuals(void) {
+	// process data collected by the audio interrupt
+	update_scope();
+	update_lfo_scope();
 	oled_clear();
 	draw_visuals();
 	oled_flip();
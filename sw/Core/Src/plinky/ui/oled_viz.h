@@ -1,11 +1,12 @@
 #pragma once
 #include "utils.h"
+#include "viz_tap.h"
 
 // this manages drawing visuals on the oled display
 
 void flash_message(Font fnt, const char* msg, const char* submsg);
 
-void clear_scope_pixel(u8 x);
-void put_scope_pixel(u8 x, u8 y);
+// filled by audio_post()
+extern VizTap scope_tap;
 
 void draw_oled_visuals(void);
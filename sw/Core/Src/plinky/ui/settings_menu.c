@@ -4,6 +4,7 @@
 #include "hardware/leds.h"
 #include "hardware/ram.h"
 #include "hardware/touchstrips.h"
+#include "scheduler.h"
 #include "synth/params.h"
 
 #define NUM_ITEMS 64
@@ -20,9 +21,12 @@ typedef enum Item {
 	// system
 	I_ACCEL_SENS = S_SYSTEM * 8,
 	I_ENC_DIR,
+	I_TOUCH_SCAN,
+	I_PRESET_GLIDE,
 	// midi
 	I_MIDI_IN_CH = S_MIDI * 8,
 	I_MIDI_OUT_CH,
+	I_CLOCK_SMOOTH,
 	// cv
 	I_CV_QUANT = S_CV * 8,
 	// actions
@@ -30,6 +34,8 @@ typedef enum Item {
 	I_TOUCH_CALIB,
 	I_CV_CALIB,
 	I_OG_PRESETS,
+	I_SCAN_BENCH,
+	I_TASK_STATS,
 
 	MAX_ITEM,
 } Item;
@@ -37,13 +43,18 @@ typedef enum Item {
 const static u8 num_options[NUM_ITEMS] = {
     [I_ACCEL_SENS] = 201,
     [I_ENC_DIR] = 2,
+    [I_TOUCH_SCAN] = NUM_SCAN_STRATEGIES,
+    [I_PRESET_GLIDE] = NUM_PRESET_GLIDES,
     [I_MIDI_IN_CH] = 16,
     [I_MIDI_OUT_CH] = 16,
+    [I_CLOCK_SMOOTH] = NUM_CLOCK_SMOOTHINGS,
     [I_CV_QUANT] = NUM_CV_QUANT_TYPES,
     [I_REBOOT] = 1,
     [I_TOUCH_CALIB] = 1,
     [I_CV_CALIB] = 1,
     [I_OG_PRESETS] = 1,
+    [I_SCAN_BENCH] = 1,
+    [I_TASK_STATS] = 1,
 };
 
 const static char* section_name[NUM_SYS_PARAM_SECTS] = {
@@ -54,9 +65,11 @@ const static char* section_name[NUM_SYS_PARAM_SECTS] = {
 };
 
 const static char* item_name[NUM_ITEMS] = {
-    [I_ACCEL_SENS] = "Acc sens",     [I_ENC_DIR] = "Enc dir",   [I_MIDI_IN_CH] = "In channel",
-    [I_MIDI_OUT_CH] = "Out channel", [I_CV_QUANT] = "Quant",    [I_REBOOT] = "Reboot",
-    [I_TOUCH_CALIB] = "Touch Calib", [I_CV_CALIB] = "CV Calib", [I_OG_PRESETS] = "OG Presets",
+    [I_ACCEL_SENS] = "Acc sens",     [I_ENC_DIR] = "Enc dir",       [I_MIDI_IN_CH] = "In channel",
+    [I_MIDI_OUT_CH] = "Out channel", [I_CV_QUANT] = "Quant",        [I_REBOOT] = "Reboot",
+    [I_TOUCH_CALIB] = "Touch Calib", [I_CV_CALIB] = "CV Calib",     [I_OG_PRESETS] = "OG Presets",
+    [I_TOUCH_SCAN] = "Touch scan",   [I_SCAN_BENCH] = "Scan Bench", [I_CLOCK_SMOOTH] = "Clk smooth",
+    [I_PRESET_GLIDE] = "Pst glide",  [I_TASK_STATS] = "Task stats",
 };
 
 static Item cur_item = 0;
@@ -78,12 +91,21 @@ static void select_item(Item item, bool force) {
 	case I_ENC_DIR:
 		cur_value = sys_params.reverse_encoder;
 		break;
+	case I_TOUCH_SCAN:
+		cur_value = sys_params.touch_scan;
+		break;
+	case I_PRESET_GLIDE:
+		cur_value = sys_params.preset_glide;
+		break;
 	case I_MIDI_IN_CH:
 		cur_value = sys_params.midi_in_chan;
 		break;
 	case I_MIDI_OUT_CH:
 		cur_value = sys_params.midi_out_chan;
 		break;
+	case I_CLOCK_SMOOTH:
+		cur_value = sys_params.clock_smoothing;
+		break;
 	case I_CV_QUANT:
 		cur_value = sys_params.cv_quant;
 		break;
@@ -102,12 +124,21 @@ static void save_value(u8 value) {
 	case I_ENC_DIR:
 		saved_value = sys_params.reverse_encoder;
 		break;
+	case I_TOUCH_SCAN:
+		saved_value = sys_params.touch_scan;
+		break;
+	case I_PRESET_GLIDE:
+		saved_value = sys_params.preset_glide;
+		break;
 	case I_MIDI_IN_CH:
 		saved_value = sys_params.midi_in_chan;
 		break;
 	case I_MIDI_OUT_CH:
 		saved_value = sys_params.midi_out_chan;
 		break;
+	case I_CLOCK_SMOOTH:
+		saved_value = sys_params.clock_smoothing;
+		break;
 	case I_CV_QUANT:
 		saved_value = sys_params.cv_quant;
 		break;
@@ -124,12 +155,21 @@ static void save_value(u8 value) {
 	case I_ENC_DIR:
 		sys_params.reverse_encoder = cur_value;
 		break;
+	case I_TOUCH_SCAN:
+		sys_params.touch_scan = cur_value;
+		break;
+	case I_PRESET_GLIDE:
+		sys_params.preset_glide = cur_value;
+		break;
 	case I_MIDI_IN_CH:
 		sys_params.midi_in_chan = cur_value;
 		break;
 	case I_MIDI_OUT_CH:
 		sys_params.midi_out_chan = cur_value;
 		break;
+	case I_CLOCK_SMOOTH:
+		sys_params.clock_smoothing = cur_value;
+		break;
 	case I_CV_QUANT:
 		sys_params.cv_quant = cur_value;
 		break;
@@ -183,6 +223,12 @@ void settings_menu_actions(void) {
 	case I_OG_PRESETS:
 		revert_presets();
 		break;
+	case I_SCAN_BENCH:
+		touch_scan_benchmark();
+		break;
+	case I_TASK_STATS:
+		sched_show_stats();
+		break;
 	default:
 		break;
 	}
@@ -237,6 +283,12 @@ static const char* get_param_str(Item item, u8 value, char* val_buf) {
 		return val_buf;
 	case I_ENC_DIR:
 		return value ? "Rvrse" : "Normal";
+	case I_TOUCH_SCAN:
+		return touch_scan_name[value];
+	case I_CLOCK_SMOOTH:
+		return clock_smoothing_name[value];
+	case I_PRESET_GLIDE:
+		return preset_glide_name[value];
 	// 1-based
 	case I_MIDI_IN_CH:
 	case I_MIDI_OUT_CH:
@@ -0,0 +1,73 @@
+#pragma once
+#include "utils.h"
+
+// single-producer/single-consumer ring buffers that carry values for visualizations from the audio interrupt to the
+// main loop. The codec tick only pushes, the main loop drains the tap and does all drawing work there
+
+typedef struct VizTap {
+	u32* buf;
+	u16 mask; // buffer size - 1, size must be a power of 2
+	volatile u16 write_pos;
+	volatile u16 read_pos;
+	volatile u16 dropped; // only written by the producer
+	u16 drops_reported;   // only written by the consumer
+} VizTap;
+
+// defines the storage and the tap itself
+#define VIZ_TAP(name, size)                                                                                            \
+	static_assert(((size) & ((size) - 1)) == 0, "viz tap size must be a power of 2");                                 \
+	static u32 name##_buf[size];                                                                                       \
+	VizTap name = {name##_buf, (size) - 1, 0, 0, 0, 0}
+
+// producer side, only call from the audio interrupt
+static inline void viz_tap_push(VizTap* tap, u32 val) {
+	u16 write_pos = tap->write_pos;
+	// full => drop the value, the consumer will catch up
+	if ((u16)(write_pos - tap->read_pos) > tap->mask) {
+		tap->dropped++;
+		return;
+	}
+	tap->buf[write_pos & tap->mask] = val;
+	// make sure the value is written before the consumer can see it
+	memory_barrier();
+	tap->write_pos = write_pos + 1;
+}
+
+// block captures push only while the tap has room, so that the main loop always gets whole blocks of consecutive
+// values instead of a stream with gaps in it
+static inline bool viz_tap_full(VizTap* tap) {
+	return (u16)(tap->write_pos - tap->read_pos) > tap->mask;
+}
+
+// consumer side, only call from the main loop
+static inline u16 viz_tap_available(VizTap* tap) {
+	return tap->write_pos - tap->read_pos;
+}
+
+// the i-th available value, without taking it
+static inline u32 viz_tap_peek(VizTap* tap, u16 i) {
+	return tap->buf[(u16)(tap->read_pos + i) & tap->mask];
+}
+
+static inline void viz_tap_skip(VizTap* tap, u16 num_values) {
+	// make sure the values are read before the producer can overwrite them
+	memory_barrier();
+	tap->read_pos += num_values;
+}
+
+static inline u32 viz_tap_pop(VizTap* tap) {
+	u16 read_pos = tap->read_pos;
+	u32 val = tap->buf[read_pos & tap->mask];
+	// make sure the value is read before the producer can overwrite it
+	memory_barrier();
+	tap->read_pos = read_pos + 1;
+	return val;
+}
+
+// returns the number of values dropped since the last call
+static inline u16 viz_tap_dropped(VizTap* tap) {
+	u16 total_dropped = tap->dropped;
+	u16 dropped = total_dropped - tap->drops_reported;
+	tap->drops_reported = total_dropped;
+	return dropped;
+}
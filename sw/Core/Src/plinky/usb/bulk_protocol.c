@@ -0,0 +1,464 @@
+#include "bulk_protocol.h"
+#include "analytics/input_trace.h"
+#include "analytics/telemetry.h"
+#include "hardware/flash.h"
+#include "hardware/ram.h"
+#include "hardware/spi.h"
+#include "synth/sampler.h"
+#include "tusb.h"
+
+/* bulk wire format, version 2. Every frame is a 12 byte header, a payload and a crc:
+u32 magic = 0xf30fabcd
+u8 cmd    // BulkCmd
+u8 item   // 0-31 presets, 32-127 pattern quarters, 128-135 sample infos, 136 sys params
+u16 seq   // frame counter of the sender
+u16 arg   // DATA: byte offset in the item, READ: number of items, AUDIO_*: page index / count, NAK: BulkError
+u16 len   // payload length, at most BULK_CHUNK_SIZE
+u8 payload[len]
+u16 crc   // crc16-ccitt over header and payload
+
+host -> device:
+- HELLO: the device answers with HELLO, its payload is a BulkInfo
+- READ: the device streams DATA frames for items [item, item + arg), then sends END
+- DATA: writes a chunk of an item. The chunks of an item are sent in order and their lengths are multiples of 8. Every
+  DATA frame gets answered with ACK or NAK, the host can have BULK_WINDOW unanswered frames in flight. After a NAK
+  the device has dropped the item, the host resends it from offset 0. An item is committed once its last chunk is in
+- SUBSCRIBE: item is the number of ticks per telemetry record, arg the TelemetrySection mask, 0 stops the stream.
+  Answered with ACK
+- TRACE: item is the TraceMode, a replay carries the TraceHeader of the trace as payload. Answered with ACK
+- TRACE_DATA: the next bytes of the trace to replay, a frame without payload ends it. Answered with ACK, or with NAK
+  BULK_ERR_FULL when the bytes don't fit yet, the host resends the same frame a little later
+- TRACE_STATUS: the device answers with TRACE_STATUS, its payload is a TraceStatus
+- AUDIO_READ: the device streams AUDIO_DATA frames for the first arg pages of the audio of sample slot item, then
+  sends END
+- AUDIO_DATA: programs one page (BULK_CHUNK_SIZE bytes) of the audio of sample slot item into the spi flash, arg is the
+  page index. Pages are sent in order from page 0, every 64KB block gets erased when its first page arrives. Answered
+  like DATA, after a NAK the host resends from the rejected page. The sample info is a DATA item, sent after the audio
+device -> host:
+- DATA (during READ), AUDIO_DATA (during AUDIO_READ), END, ACK, NAK (item and seq of the rejected frame)
+- TELEMETRY: whole telemetry records, arg is the number of records dropped since the previous TELEMETRY frame. Sent
+  whenever the host is not sending, never inside another exchange
+- TRACE_DATA: the next bytes of a recording, sent like TELEMETRY and before it */
+
+#define BULK_VERSION 2
+#define BULK_WINDOW 4
+#define BULK_CHUNK_SIZE 256
+#define BULK_SYS_ITEM NUM_FLASH_ITEMS
+#define NUM_BULK_ITEMS (NUM_FLASH_ITEMS + 1)
+#define SLOT_BYTES (2 * MAX_SAMPLE_LEN)
+#define SLOT_PAGES (SLOT_BYTES / BULK_CHUNK_SIZE)
+#define NO_SLOT 255
+
+typedef enum BulkCmd {
+	BULK_HELLO,
+	BULK_READ,
+	BULK_DATA,
+	BULK_END,
+	BULK_ACK,
+	BULK_NAK,
+	BULK_SUBSCRIBE,
+	BULK_TELEMETRY,
+	BULK_TRACE,
+	BULK_TRACE_DATA,
+	BULK_TRACE_STATUS,
+	BULK_AUDIO_READ,
+	BULK_AUDIO_DATA,
+} BulkCmd;
+
+typedef enum BulkError {
+	BULK_ERR_CRC = 1,
+	BULK_ERR_CMD,
+	BULK_ERR_ITEM,
+	BULK_ERR_LENGTH,
+	BULK_ERR_ORDER,
+	BULK_ERR_FULL,
+	BULK_ERR_TRACE,
+	BULK_ERR_FLASH,
+} BulkError;
+
+typedef struct BulkHeader {
+	u8 magic[4];
+	u8 cmd;
+	u8 item;
+	u16 seq;
+	u16 arg;
+	u16 len;
+} BulkHeader;
+static_assert(sizeof(BulkHeader) == 12, "?");
+static_assert(BULK_CHUNK_SIZE >= TELEM_MAX_RECORD_SIZE, "?");
+static_assert(BULK_CHUNK_SIZE >= sizeof(TraceHeader), "?");
+static_assert(BULK_CHUNK_SIZE >= sizeof(TraceStatus), "?");
+static_assert(BULK_CHUNK_SIZE == 256, "an audio frame is one spi flash page");
+
+typedef struct BulkInfo {
+	u8 version;
+	u8 window;
+	u16 chunk_size;
+	u8 num_items;
+	u8 num_presets;
+	u8 num_ptn_quarters;
+	u8 num_samples;
+	u16 preset_size;
+	u16 ptn_quarter_size;
+	u16 sample_info_size;
+	u16 sys_params_size;
+	u16 slot_pages;
+} BulkInfo;
+
+typedef enum BulkState {
+	BULK_RCV_HDR,
+	BULK_RCV_PAYLOAD,
+	BULK_RCV_CRC,
+	BULK_SND_HDR,
+	BULK_SND_PAYLOAD,
+	BULK_SND_CRC,
+} BulkState;
+
+const static u8 magic[4] = {0xf3, 0x0f, 0xab, BULK_MAGIC3};
+
+const static BulkInfo info = {
+    .version = BULK_VERSION,
+    .window = BULK_WINDOW,
+    .chunk_size = BULK_CHUNK_SIZE,
+    .num_items = NUM_BULK_ITEMS,
+    .num_presets = NUM_PRESETS,
+    .num_ptn_quarters = NUM_PTN_QUARTERS,
+    .num_samples = NUM_SAMPLES,
+    .preset_size = sizeof(Preset),
+    .ptn_quarter_size = sizeof(PatternQuarter),
+    .sample_info_size = sizeof(SampleInfo),
+    .sys_params_size = sizeof(SysParams),
+    .slot_pages = SLOT_PAGES,
+};
+
+static BulkState state;
+static u8* data_buf;
+static u32 remaining_bytes;
+
+static BulkHeader rx_hdr;
+static BulkHeader tx_hdr;
+static u16 rx_crc;
+static u16 tx_crc;
+static u16 tx_seq = 0;
+static u64 chunk_buf[BULK_CHUNK_SIZE / 8]; // payload of the current frame, aligned for flash writes
+
+// item being written
+static u8 write_item = 255;
+static u16 write_offset;
+static FlashStream write_stream;
+static SysParams rx_sys_params;
+
+// sample audio being written
+static u8 write_slot = NO_SLOT;
+static u16 write_page;
+
+// items or sample audio being read
+static bool reading = false;
+static bool reading_audio;
+static u8 read_item;
+static u8 read_end;
+static u16 read_offset;
+static u16 read_page;
+static u16 read_end_page;
+
+static u16 crc16(const void* data, u32 len, u16 crc) {
+	const u8* src = (const u8*)data;
+	while (len--) {
+		crc ^= *src++ << 8;
+		for (u8 i = 0; i < 8; ++i)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static u16 item_size(u8 item) {
+	if (item < PATTERNS_START)
+		return sizeof(Preset);
+	if (item < F_SAMPLES_START)
+		return sizeof(PatternQuarter);
+	if (item < NUM_FLASH_ITEMS)
+		return sizeof(SampleInfo);
+	return item == BULK_SYS_ITEM ? sizeof(SysParams) : 0;
+}
+
+static void set_state(BulkState new_state, void* data, u32 len) {
+	state = new_state;
+	data_buf = (u8*)data;
+	remaining_bytes = len;
+}
+
+static void send_frame(BulkCmd cmd, u8 item, u16 seq, u16 arg, u16 len) {
+	memcpy(tx_hdr.magic, magic, 4);
+	tx_hdr.cmd = cmd;
+	tx_hdr.item = item;
+	tx_hdr.seq = seq;
+	tx_hdr.arg = arg;
+	tx_hdr.len = len;
+	tx_crc = crc16(chunk_buf, len, crc16(&tx_hdr, sizeof(tx_hdr), 0xffff));
+	set_state(BULK_SND_HDR, &tx_hdr, sizeof(tx_hdr));
+}
+
+static void send_reply(BulkCmd cmd, u16 arg) {
+	send_frame(cmd, rx_hdr.item, rx_hdr.seq, arg, 0);
+}
+
+// audio pages come straight from the spi flash
+static void send_next_audio_frame(void) {
+	if (read_page >= read_end_page) {
+		reading = false;
+		send_frame(BULK_END, read_item, tx_seq++, read_end_page, 0);
+		return;
+	}
+	spi_claim();
+	spi_read(read_item * SLOT_BYTES + read_page * BULK_CHUNK_SIZE, chunk_buf, BULK_CHUNK_SIZE);
+	spi_release();
+	send_frame(BULK_AUDIO_DATA, read_item, tx_seq++, read_page++, BULK_CHUNK_SIZE);
+}
+
+// the payload gets copied so that edits to the ram copy can't invalidate the crc mid-frame
+static void send_next_read_frame(void) {
+	if (reading_audio) {
+		send_next_audio_frame();
+		return;
+	}
+	if (read_item >= read_end) {
+		reading = false;
+		send_frame(BULK_END, read_end, tx_seq++, 0, 0);
+		return;
+	}
+	u16 size = item_size(read_item);
+	u16 len = mini(BULK_CHUNK_SIZE, size - read_offset);
+	const void* src = read_item == BULK_SYS_ITEM ? &sys_params : latest_flash_item(read_item);
+	memcpy(chunk_buf, (const u8*)src + read_offset, len);
+	send_frame(BULK_DATA, read_item, tx_seq++, read_offset, len);
+	read_offset += len;
+	if (read_offset == size) {
+		read_item++;
+		read_offset = 0;
+	}
+}
+
+static void apply_sys_params(void) {
+	// the active preset and the format version are not part of a restore
+	rx_sys_params.preset_id = sys_params.preset_id;
+	rx_sys_params.version = sys_params.version;
+	sys_params = rx_sys_params;
+	clamp_sys_params();
+	log_ram_edit(SEG_SYS);
+}
+
+static BulkError write_chunk(void) {
+	u8 item = rx_hdr.item;
+	u16 offset = rx_hdr.arg;
+	u16 len = rx_hdr.len;
+	u16 size = item_size(item);
+	if (!size)
+		return BULK_ERR_ITEM;
+	if (!len || (len & 7) || offset + len > size)
+		return BULK_ERR_LENGTH;
+	// first chunk starts a new item, anything in progress is dropped
+	if (offset == 0) {
+		write_item = item;
+		write_offset = 0;
+		if (item != BULK_SYS_ITEM)
+			flash_stream_begin(&write_stream, item);
+	}
+	else if (item != write_item || offset != write_offset)
+		return BULK_ERR_ORDER;
+	if (item == BULK_SYS_ITEM)
+		memcpy((u8*)&rx_sys_params + offset, chunk_buf, len);
+	else
+		flash_stream_write(&write_stream, offset, chunk_buf, len);
+	write_offset += len;
+	// last chunk => commit
+	if (write_offset == size) {
+		if (item == BULK_SYS_ITEM)
+			apply_sys_params();
+		else {
+			flash_stream_commit(&write_stream);
+			reload_flash_item(item);
+		}
+		write_item = 255;
+	}
+	return 0;
+}
+
+// a page that fails leaves the write position where it is, so the host can resend it
+static BulkError write_audio_page(void) {
+	u8 slot = rx_hdr.item;
+	u16 page = rx_hdr.arg;
+	if (slot >= NUM_SAMPLES)
+		return BULK_ERR_ITEM;
+	if (rx_hdr.len != BULK_CHUNK_SIZE || page >= SLOT_PAGES)
+		return BULK_ERR_LENGTH;
+	if (page && (slot != write_slot || page != write_page))
+		return BULK_ERR_ORDER;
+	u32 addr = slot * SLOT_BYTES + page * BULK_CHUNK_SIZE;
+	int spi_rv = 0;
+	spi_claim();
+	if (addr % 65536 == 0)
+		spi_rv = spi_erase64k(addr, 0, 0);
+	memcpy(spi_bit_tx + 4, chunk_buf, BULK_CHUNK_SIZE);
+	if (spi_rv == 0)
+		spi_rv = spi_write256(addr);
+	spi_release();
+	if (spi_rv)
+		return BULK_ERR_FLASH;
+	write_slot = slot;
+	write_page = page + 1;
+	return 0;
+}
+
+static void handle_frame(void) {
+	if (rx_crc != crc16(chunk_buf, rx_hdr.len, crc16(&rx_hdr, sizeof(rx_hdr), 0xffff))) {
+		write_item = 255;
+		send_reply(BULK_NAK, BULK_ERR_CRC);
+		return;
+	}
+	switch (rx_hdr.cmd) {
+	case BULK_HELLO:
+		memcpy(chunk_buf, &info, sizeof(info));
+		send_frame(BULK_HELLO, 0, tx_seq++, 0, sizeof(info));
+		break;
+	case BULK_READ:
+		if (rx_hdr.item >= NUM_BULK_ITEMS || rx_hdr.item + rx_hdr.arg > NUM_BULK_ITEMS) {
+			send_reply(BULK_NAK, BULK_ERR_ITEM);
+			break;
+		}
+		reading = true;
+		reading_audio = false;
+		read_item = rx_hdr.item;
+		read_end = rx_hdr.item + rx_hdr.arg;
+		read_offset = 0;
+		send_next_read_frame();
+		break;
+	case BULK_DATA: {
+		BulkError error = write_chunk();
+		if (error)
+			write_item = 255;
+		send_reply(error ? BULK_NAK : BULK_ACK, error);
+		break;
+	}
+	case BULK_SUBSCRIBE:
+		telemetry_subscribe(rx_hdr.arg, rx_hdr.item);
+		send_reply(BULK_ACK, 0);
+		break;
+	case BULK_TRACE: {
+		TraceHeader header;
+		memcpy(&header, chunk_buf, sizeof(header));
+		bool valid = rx_hdr.item <= TRACE_REPLAY && (rx_hdr.item != TRACE_REPLAY || rx_hdr.len == sizeof(header));
+		if (valid && trace_start(rx_hdr.item, &header))
+			send_reply(BULK_ACK, 0);
+		else
+			send_reply(BULK_NAK, BULK_ERR_TRACE);
+		break;
+	}
+	case BULK_TRACE_DATA:
+		if (trace_mode != TRACE_REPLAY)
+			send_reply(BULK_NAK, BULK_ERR_TRACE);
+		else if (!trace_write((u8*)chunk_buf, rx_hdr.len))
+			send_reply(BULK_NAK, BULK_ERR_FULL);
+		else
+			send_reply(BULK_ACK, 0);
+		break;
+	case BULK_TRACE_STATUS: {
+		TraceStatus status;
+		trace_get_status(&status);
+		memcpy(chunk_buf, &status, sizeof(status));
+		send_frame(BULK_TRACE_STATUS, 0, rx_hdr.seq, 0, sizeof(status));
+		break;
+	}
+	case BULK_AUDIO_READ:
+		if (rx_hdr.item >= NUM_SAMPLES || rx_hdr.arg > SLOT_PAGES) {
+			send_reply(BULK_NAK, BULK_ERR_ITEM);
+			break;
+		}
+		reading = true;
+		reading_audio = true;
+		read_item = rx_hdr.item;
+		read_page = 0;
+		read_end_page = rx_hdr.arg;
+		send_next_read_frame();
+		break;
+	case BULK_AUDIO_DATA: {
+		BulkError error = write_audio_page();
+		send_reply(error ? BULK_NAK : BULK_ACK, error);
+		break;
+	}
+	default:
+		send_reply(BULK_NAK, BULK_ERR_CMD);
+		break;
+	}
+}
+
+// the magic has been received, get the rest of the header
+void bulk_begin(void) {
+	reading = false;
+	memcpy(rx_hdr.magic, magic, 4);
+	set_state(BULK_RCV_HDR, rx_hdr.magic + 4, sizeof(rx_hdr) - 4);
+}
+
+// the host is quiet, send a frame of a recording or of telemetry records if there is anything
+BulkProgress bulk_send_stream(void) {
+	u16 len = trace_read((u8*)chunk_buf, BULK_CHUNK_SIZE);
+	if (len) {
+		reading = false;
+		send_frame(BULK_TRACE_DATA, 0, tx_seq++, 0, len);
+		return BULK_BUSY;
+	}
+	u16 dropped;
+	len = telemetry_read((u8*)chunk_buf, BULK_CHUNK_SIZE, &dropped);
+	if (!len)
+		return BULK_STALLED;
+	reading = false;
+	send_frame(BULK_TELEMETRY, 0, tx_seq++, dropped, len);
+	return BULK_BUSY;
+}
+
+BulkProgress bulk_process(void) {
+	u32 handled_bytes;
+	if (state >= BULK_SND_HDR)
+		handled_bytes = tud_vendor_write(data_buf, remaining_bytes);
+	else
+		handled_bytes = tud_vendor_read(data_buf, mini(remaining_bytes, CFG_TUD_VENDOR_RX_BUFSIZE));
+	if (handled_bytes == 0)
+		return BULK_STALLED;
+	remaining_bytes -= handled_bytes;
+	data_buf += handled_bytes;
+	if (remaining_bytes)
+		return BULK_BUSY;
+
+	switch (state) {
+	case BULK_RCV_HDR:
+		// oversized frames are garbage, go back to looking for a magic
+		if (rx_hdr.len > BULK_CHUNK_SIZE)
+			return BULK_FRAME_DONE;
+		else if (rx_hdr.len)
+			set_state(BULK_RCV_PAYLOAD, chunk_buf, rx_hdr.len);
+		else
+			set_state(BULK_RCV_CRC, &rx_crc, 2);
+		break;
+	case BULK_RCV_PAYLOAD:
+		set_state(BULK_RCV_CRC, &rx_crc, 2);
+		break;
+	case BULK_RCV_CRC:
+		handle_frame();
+		break;
+	case BULK_SND_HDR:
+		if (tx_hdr.len)
+			set_state(BULK_SND_PAYLOAD, chunk_buf, tx_hdr.len);
+		else
+			set_state(BULK_SND_CRC, &tx_crc, 2);
+		break;
+	case BULK_SND_PAYLOAD:
+		set_state(BULK_SND_CRC, &tx_crc, 2);
+		break;
+	case BULK_SND_CRC:
+		if (reading)
+			send_next_read_frame();
+		else
+			return BULK_FRAME_DONE;
+		break;
+	}
+	return BULK_BUSY;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "utils.h"
+
+// versioned bulk protocol that backs up and restores presets, pattern quarters, sample infos, sys params and sample
+// audio in one pipelined session (tools/plinky_bank.py packs them into an archive), and streams telemetry and input
+// traces. It shares the vendor interface and the first three magic bytes with the web editor protocol
+
+#define BULK_MAGIC3 0xcd
+
+typedef enum BulkProgress {
+	BULK_STALLED,    // no bytes could be moved
+	BULK_BUSY,       // bytes moved, frame in progress
+	BULK_FRAME_DONE, // waiting for the next frame
+} BulkProgress;
+
+void bulk_begin(void);
+BulkProgress bulk_process(void);
+BulkProgress bulk_send_stream(void);
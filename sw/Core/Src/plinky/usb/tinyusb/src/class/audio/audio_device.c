@@ -382,7 +382,6 @@ static bool audio_rx_done_type_I_pcm_ff_cb(uint8_t rhport, audiod_interface_t *a
  */
 #if CFG_TUD_AUDIO_EPSIZE_IN
 #if !CFG_TUD_AUDIO_TX_FIFO_SIZE
-/*  This function is intended for later use once EP buffers (at least for ISO EPs) are implemented as ring buffers
 uint16_t tud_audio_n_write_ep_in_buffer(uint8_t itf, const void * data, uint16_t len)
 {
   audiod_interface_t* audio = &_audiod_itf[itf];
@@ -409,7 +408,6 @@ uint16_t tud_audio_n_write_ep_in_buffer(uint8_t itf, const void * data, uint16_t
   // Return number of bytes written
   return len;
 }
-*/
 
 #else
 
@@ -875,11 +873,13 @@ static bool audiod_set_interface(uint8_t rhport, tusb_control_request_t const *
   if (_audiod_itf[idxDriver].ep_in_as_intf_num == itf)
   {
     _audiod_itf[idxDriver].ep_in_as_intf_num = 0;
-    usbd_edpt_close(rhport, _audiod_itf[idxDriver].ep_in);
 
-    // Invoke callback - can be used to stop data sampling
+    // Invoke callback - can be used to stop data sampling. Called before the EP gets closed, so that an application
+    // that reloads the EP from tud_xfer_complete_isr_cb() stops doing so first
     if (tud_audio_set_itf_close_EP_cb) TU_VERIFY(tud_audio_set_itf_close_EP_cb(rhport, p_request));
 
+    usbd_edpt_close(rhport, _audiod_itf[idxDriver].ep_in);
+
     _audiod_itf[idxDriver].ep_in = 0;                           // Necessary?
   }
 #endif
@@ -182,11 +182,9 @@ void     tud_audio_n_read_flush (uint8_t itf);
 #endif
 #endif
 
-/*  This function is intended for later use once EP buffers (at least for ISO EPs) are implemented as ring buffers
 #if CFG_TUD_AUDIO_EPSIZE_IN && !CFG_TUD_AUDIO_TX_FIFO_SIZE
-uint16_t tud_audio_n_write_ep_in_buffer(uint8_t itf, const void * data, uint16_t len)
+uint16_t tud_audio_n_write_ep_in_buffer(uint8_t itf, const void * data, uint16_t len);
 #endif
-*/
 
 #ifndef CFG_TUD_AUDIO_TX_FIFO_COUNT
 #define CFG_TUD_AUDIO_TX_FIFO_COUNT 1
@@ -302,8 +300,8 @@ static inline bool tud_audio_mounted(void)
   return tud_audio_n_mounted(0);
 }
 
-#if CFG_TUD_AUDIO_EPSIZE_IN
-#if CFG_TUD_AUDIO_TX_FIFO_SIZE && CFG_TUD_AUDIO_TX_FIFO_COUNT > 1
+#if CFG_TUD_AUDIO_EPSIZE_IN && CFG_TUD_AUDIO_TX_FIFO_SIZE
+#if CFG_TUD_AUDIO_TX_FIFO_COUNT > 1
 static inline uint16_t tud_audio_write (uint8_t channelId, uint8_t const* buffer, uint16_t n_bytes)    // Short version if only one audio function is used
 {
   return tud_audio_n_write(0, channelId, buffer, n_bytes);
@@ -1015,6 +1015,16 @@ void dcd_event_handler(dcd_event_t const * event, bool in_isr)
       return;   // skip SOF event for now
     break;
 
+    case DCD_EVENT_XFER_COMPLETE:
+      // let the application reload streaming endpoints right here, so that they don't depend on tud_task()
+      if ( in_isr && tud_xfer_complete_isr_cb &&
+           tud_xfer_complete_isr_cb(event->rhport, event->xfer_complete.ep_addr, event->xfer_complete.len) )
+      {
+        return;
+      }
+      osal_queue_send(_usbd_q, event, in_isr);
+    break;
+
     case DCD_EVENT_SUSPEND:
       // NOTE: When plugging/unplugging device, the D+/D- state are unstable and
       // can accidentally meet the SUSPEND condition ( Bus Idle for 3ms ).
@@ -128,6 +128,10 @@ TU_ATTR_WEAK void tud_suspend_cb(bool remote_wakeup_en);
 // Invoked when usb bus is resumed
 TU_ATTR_WEAK void tud_resume_cb(void);
 
+// Invoked in the usb interrupt when an endpoint completes a transfer. Returning true consumes the completion: it never
+// reaches the class driver, and the application has to submit the next transfer with dcd_edpt_xfer() itself
+TU_ATTR_WEAK bool tud_xfer_complete_isr_cb(uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes);
+
 // Invoked when received control request with VENDOR TYPE
 TU_ATTR_WEAK bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
 
@@ -98,10 +98,11 @@
 
 //------------- CLASS -------------//
 #define CFG_TUD_CDC               0
-#define CFG_TUD_MSC               0
+#define CFG_TUD_MSC               1
 #define CFG_TUD_HID               0
 #define CFG_TUD_MIDI              1
 #define CFG_TUD_VENDOR            1
+#define CFG_TUD_AUDIO             1
 
 // MIDI FIFO size of TX and RX
 #define CFG_TUD_MIDI_RX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
@@ -112,6 +113,18 @@
  #define CFG_TUD_VENDOR_RX_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 128)
  #define CFG_TUD_VENDOR_TX_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 128)
 
+// Audio: stereo 16 bit stream to the host, packets are loaded straight from the codec ring in usb_audio.c
+#define CFG_TUD_AUDIO_N_AS_INT              1
+#define CFG_TUD_AUDIO_CTRL_BUF_SIZE         64
+#define CFG_TUD_AUDIO_FORMAT_TYPE_TX        AUDIO_FORMAT_TYPE_I
+#define CFG_TUD_AUDIO_N_CHANNELS_TX         2
+#define CFG_TUD_AUDIO_N_BYTES_PER_SAMPLE_TX 2
+#define CFG_TUD_AUDIO_EPSIZE_IN             (33 * 2 * 2) // 31.25 frames per ms, plus one for rate matching
+#define CFG_TUD_AUDIO_TX_FIFO_SIZE          0
+
+// MSC: virtual fat volume of the sample slots in usb_msc.c, every transfer moves up to 4 sectors
+#define CFG_TUD_MSC_EP_BUFSIZE    2048
+
 
 #ifdef __cplusplus
  }
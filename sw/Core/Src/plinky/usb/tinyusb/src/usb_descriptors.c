@@ -38,11 +38,11 @@ enum
  * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
  *
  * Auto ProductID layout's Bitmap:
- *   [MSB]       MIDI | HID | MSC | CDC          [LSB]
+ *   [MSB]       AUDIO | VENDOR | MIDI | HID | MSC | CDC          [LSB]
  */
 #define _PID_MAP(itf, n)  ( (CFG_TUD_##itf) << (n) )
 #define USB_PID           (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 1) | _PID_MAP(HID, 2) | \
-                           _PID_MAP(MIDI, 3) | _PID_MAP(VENDOR, 4) )
+                           _PID_MAP(MIDI, 3) | _PID_MAP(VENDOR, 4) | _PID_MAP(AUDIO, 5) )
 extern uint32_t serialno;
 //--------------------------------------------------------------------+
 // Device Descriptors
@@ -87,14 +87,55 @@ enum
 //  ITF_NUM_CDC,
 //  ITF_NUM_CDC_DATA,
   ITF_NUM_VENDOR,
+  ITF_NUM_AUDIO_CONTROL,
+  ITF_NUM_AUDIO_STREAMING,
+  ITF_NUM_MSC,
   ITF_NUM_TOTAL
 };
 
-#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_LEN + /*TUD_CDC_DESC_LEN + */TUD_VENDOR_DESC_LEN)
+// UAC2 stereo input to the host carrying the codec output
+// clock source 4 (internal, fixed) -> input terminal 1 (synthesizer) -> output terminal 3 (usb streaming)
+#define AUDIO_TERM_TYPE_SYNTHESIZER 0x0713
+
+#define TUD_AUDIO_STEREO_IN_DESC_LEN (TUD_AUDIO_DESC_IAD_LEN\
+  + TUD_AUDIO_DESC_STD_AC_LEN\
+  + TUD_AUDIO_DESC_CS_AC_LEN\
+  + TUD_AUDIO_DESC_CLK_SRC_LEN\
+  + TUD_AUDIO_DESC_INPUT_TERM_LEN\
+  + TUD_AUDIO_DESC_OUTPUT_TERM_LEN\
+  + TUD_AUDIO_DESC_STD_AS_INT_LEN\
+  + TUD_AUDIO_DESC_STD_AS_INT_LEN\
+  + TUD_AUDIO_DESC_CS_AS_INT_LEN\
+  + TUD_AUDIO_DESC_TYPE_I_FORMAT_LEN\
+  + TUD_AUDIO_DESC_STD_AS_ISO_EP_LEN\
+  + TUD_AUDIO_DESC_CS_AS_ISO_EP_LEN)
+
+#define TUD_AUDIO_STEREO_IN_DESCRIPTOR(_itfnum, _stridx, _epin, _epsize) \
+  TUD_AUDIO_DESC_IAD(_itfnum, 0x02, 0x00),\
+  TUD_AUDIO_DESC_STD_AC(_itfnum, 0x00, _stridx),\
+  TUD_AUDIO_DESC_CS_AC(0x0200, AUDIO_FUNC_MUSICAL_INSTRUMENT, TUD_AUDIO_DESC_CLK_SRC_LEN+TUD_AUDIO_DESC_INPUT_TERM_LEN+TUD_AUDIO_DESC_OUTPUT_TERM_LEN, 0x00),\
+  TUD_AUDIO_DESC_CLK_SRC(0x04, AUDIO_CLOCK_SOURCE_ATT_INT_FIX_CLK, (AUDIO_CTRL_R << AUDIO_CLOCK_SOURCE_CTRL_CLK_FRQ_POS), 0x00, 0x00),\
+  TUD_AUDIO_DESC_INPUT_TERM(0x01, AUDIO_TERM_TYPE_SYNTHESIZER, 0x00, 0x04, 0x02, AUDIO_CHANNEL_CONFIG_FRONT_LEFT | AUDIO_CHANNEL_CONFIG_FRONT_RIGHT, 0x00, 0x0000, 0x00),\
+  TUD_AUDIO_DESC_OUTPUT_TERM(0x03, AUDIO_TERM_TYPE_USB_STREAMING, 0x00, 0x01, 0x04, 0x0000, 0x00),\
+  /* alternate 0 has no bandwidth, alternate 1 streams */\
+  TUD_AUDIO_DESC_STD_AS_INT((uint8_t)((_itfnum)+1), 0x00, 0x00, 0x00),\
+  TUD_AUDIO_DESC_STD_AS_INT((uint8_t)((_itfnum)+1), 0x01, 0x01, 0x00),\
+  TUD_AUDIO_DESC_CS_AS_INT(0x03, AUDIO_CTRL_NONE, AUDIO_FORMAT_TYPE_I, AUDIO_DATA_FORMAT_TYPE_I_PCM, 0x02, AUDIO_CHANNEL_CONFIG_FRONT_LEFT | AUDIO_CHANNEL_CONFIG_FRONT_RIGHT, 0x00),\
+  TUD_AUDIO_DESC_TYPE_I_FORMAT(2, 16),\
+  /* asynchronous: the codec is the clock master, packet sizes follow it */\
+  TUD_AUDIO_DESC_STD_AS_ISO_EP(_epin, (TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_DATA), _epsize, 0x01),\
+  TUD_AUDIO_DESC_CS_AS_ISO_EP(AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, AUDIO_CTRL_NONE, AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED, 0x0000)
+
+// audio_device.c needs the length of each audio function
+const uint16_t tud_audio_desc_lengths[] = { TUD_AUDIO_STEREO_IN_DESC_LEN };
+
+#define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_MIDI_DESC_LEN + /*TUD_CDC_DESC_LEN + */TUD_VENDOR_DESC_LEN + TUD_AUDIO_STEREO_IN_DESC_LEN + TUD_MSC_DESC_LEN)
 
   #define EPNUM_MIDI   0x01
 //#define EPNUM_CDC     2
 #define EPNUM_VENDOR  2
+#define EPNUM_AUDIO   3
+#define EPNUM_MSC     4
 
 uint8_t const desc_fs_configuration[] =
 {
@@ -108,7 +149,13 @@ uint8_t const desc_fs_configuration[] =
 //TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 5, 0x81, 8, EPNUM_CDC, 0x80 | EPNUM_CDC, TUD_OPT_HIGH_SPEED ? 512 : 64),
 //
 // Interface number, string index, EP Out & IN address, EP size
-TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 4, EPNUM_VENDOR, 0x80 | EPNUM_VENDOR, TUD_OPT_HIGH_SPEED ? 512 : 64)
+TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 4, EPNUM_VENDOR, 0x80 | EPNUM_VENDOR, TUD_OPT_HIGH_SPEED ? 512 : 64),
+
+// Interface number, string index, EP In address, EP size
+TUD_AUDIO_STEREO_IN_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 5, 0x80 | EPNUM_AUDIO, CFG_TUD_AUDIO_EPSIZE_IN),
+
+// Interface number, string index, EP Out & EP In address, EP size
+TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 6, EPNUM_MSC, 0x80 | EPNUM_MSC, 64)
 };
 
 #if TUD_OPT_HIGH_SPEED
@@ -217,8 +264,9 @@ char const* string_desc_arr [] =
   "Plinky",                     // 1: Manufacturer
   "PlinkySynth MIDI",              // 2: Product
   "",                      // 3: Serials, should use chip ID
-  "TinyUSB WebUSB"               // 4: Vendor Interface
-//   "TinyUSB CDC",                 // 5: CDC Interface // unused
+  "TinyUSB WebUSB",              // 4: Vendor Interface
+  "Plinky Audio",                // 5: Audio Interface
+  "Plinky Samples",              // 6: MSC Interface
 };
 
 static uint16_t _desc_str[32];
@@ -1,19 +1,25 @@
 #include "usb.h"
+#include "analytics/telemetry.h"
+#include "hardware/midi.h"
 #include "tusb.h"
 #include "web_editor.h"
 
 extern bool web_serial_connected; // tinyusb/src/usbmidi.c
 static bool web_serial_was_connected;
 
+bool usb_audio_xfer_isr(u8 rhport, u8 ep_addr); // usb_audio.c, needs tinyusb's bool
+
 void init_usb(void) {
 	tusb_init();
 }
 
 void usb_frame(void) {
 	if (web_serial_connected != web_serial_was_connected) {
-		// web editor reconnected => reset
-		if (web_serial_connected)
+		// web editor reconnected => reset, telemetry needs a new subscription
+		if (web_serial_connected) {
 			web_editor_reset();
+			telemetry_subscribe(0, 0);
+		}
 		web_serial_was_connected = web_serial_connected;
 	}
 
@@ -23,4 +29,12 @@ void usb_frame(void) {
 	else
 		// throttle usb midi data manually
 		tud_task();
-}
\ No newline at end of file
+	// pick up usb midi that didn't fit the queue when it arrived
+	midi_usb_rx();
+}
+
+// usb interrupt: a transfer completed. Returning true keeps it from reaching tud_task()
+bool tud_xfer_complete_isr_cb(uint8_t rhport, uint8_t ep_addr, uint32_t xferred_bytes) {
+	midi_usb_xfer_isr(ep_addr);
+	return usb_audio_xfer_isr(rhport, ep_addr);
+}
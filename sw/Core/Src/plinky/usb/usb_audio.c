@@ -0,0 +1,133 @@
+#include "usb_audio.h"
+#include "device/dcd.h"
+#include "tusb.h"
+
+// streams the codec output to the host as a stereo 16 bit uac2 input. The endpoint is asynchronous: the codec clock is
+// the master and each 1ms usb frame carries the frames the codec produced in the meantime, 31.25 on average
+//
+// both ends of the stream run in interrupts. The codec interrupt appends every finished tick to a capture ring, the usb
+// interrupt loads the next iso packet out of it as soon as the previous one is sent. The main loop only loads the
+// first packet when the host opens the stream, so neither main loop stalls nor long ticks reach the host
+
+#define CLOCK_ID 4      // clock source entity in usb_descriptors.c
+#define RING_FRAMES 512 // 16ms, a multiple of SAMPLES_PER_TICK
+#define TARGET_LAG 192  // frames between the write and read positions, three ticks
+#define LAG_SLACK 16    // lag error that gets corrected by sending one frame more or less
+#define MAX_PACKET_FRAMES (CFG_TUD_AUDIO_EPSIZE_IN / sizeof(u32))
+
+static u32 ring[RING_FRAMES];
+static volatile u32 write_frame; // frames captured since the stream opened, frame n lives at n % RING_FRAMES
+static u32 read_frame;
+static s32 lag_q4;      // lag, averaged over ~16 packets: it saws by a tick as the codec writes whole ticks
+static u16 frac_frames; // thousandths of a frame owed to the host
+static bool resync;
+static volatile u8 stream_ep; // iso in endpoint while the host streams, 0 otherwise
+static u32 packet[MAX_PACKET_FRAMES];
+
+// codec interrupt
+void usb_audio_capture(const u32* frames) {
+	if (!stream_ep)
+		return;
+	memcpy(ring + write_frame % RING_FRAMES, frames, SAMPLES_PER_TICK * sizeof(u32));
+	// the frames need to be in the ring before they get published
+	__asm__ volatile("" ::: "memory");
+	write_frame += SAMPLES_PER_TICK;
+}
+
+// fills dst with the next packet, returns its number of frames
+static u16 load_packet(u32* dst) {
+	u32 written = write_frame;
+	s32 lag = written - read_frame;
+	bool restart = resync;
+	if (resync) {
+		// the stream just opened, send empty packets until the ring holds the target lag
+		if (lag < TARGET_LAG)
+			return 0;
+		resync = false;
+	}
+	// (re)start at the target lag, also when the host stopped polling for a while and the codec is about to overwrite
+	// frames we haven't sent
+	if (restart || lag > RING_FRAMES - SAMPLES_PER_TICK) {
+		read_frame = written - TARGET_LAG;
+		lag = TARGET_LAG;
+		lag_q4 = TARGET_LAG << 4;
+	}
+	lag_q4 += lag - (lag_q4 >> 4);
+
+	// nominal packet size, nudged by a frame while the lag is off so that the average rate follows the codec
+	u16 num_frames = SAMPLE_RATE / 1000;
+	frac_frames += SAMPLE_RATE % 1000;
+	if (frac_frames >= 1000) {
+		frac_frames -= 1000;
+		num_frames++;
+	}
+	if ((lag_q4 >> 4) > TARGET_LAG + LAG_SLACK)
+		num_frames++;
+	else if ((lag_q4 >> 4) < TARGET_LAG - LAG_SLACK)
+		num_frames--;
+	// only send captured frames
+	num_frames = clampi(num_frames, 0, lag);
+
+	// copy out of the ring, in two parts when the packet wraps around
+	u16 start = read_frame % RING_FRAMES;
+	u16 first = mini(num_frames, RING_FRAMES - start);
+	memcpy(dst, ring + start, first * sizeof(u32));
+	memcpy(dst + first, ring, (num_frames - first) * sizeof(u32));
+	read_frame += num_frames;
+	return num_frames;
+}
+
+// the host opened the stream, the driver loads the first packet next
+bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const* p_request) {
+	stream_ep = 0;
+	write_frame = 0;
+	read_frame = 0;
+	frac_frames = 0;
+	lag_q4 = TARGET_LAG << 4;
+	resync = true;
+	return true;
+}
+
+// the host closed the stream, called before the endpoint gets closed
+bool tud_audio_set_itf_close_EP_cb(uint8_t rhport, tusb_control_request_t const* p_request) {
+	stream_ep = 0;
+	return true;
+}
+
+// main loop: the driver wants the first packet of a stream
+bool tud_audio_tx_done_pre_load_cb(uint8_t rhport, uint8_t itf, uint8_t ep_in, uint8_t cur_alt_setting) {
+	if (!cur_alt_setting)
+		return true;
+	u16 num_frames = load_packet(packet);
+	tud_audio_n_write_ep_in_buffer(itf, packet, num_frames * sizeof(u32));
+	// from here on the usb interrupt loads the packets
+	stream_ep = ep_in;
+	return true;
+}
+
+// usb interrupt (via usb.c): a packet went out, load the next one. Returns whether it was the audio stream
+bool usb_audio_xfer_isr(u8 rhport, u8 ep_addr) {
+	if (!stream_ep || ep_addr != stream_ep)
+		return false;
+	u16 num_frames = load_packet(packet);
+	dcd_edpt_xfer(rhport, ep_addr, (u8*)packet, num_frames * sizeof(u32));
+	return true;
+}
+
+// the only control is the read-only sample rate of the clock source
+bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const* p_request) {
+	if (TU_U16_HIGH(p_request->wIndex) != CLOCK_ID || TU_U16_HIGH(p_request->wValue) != AUDIO_CS_CTRL_SAM_FREQ)
+		return false;
+	switch (p_request->bRequest) {
+	case AUDIO_CS_REQ_CUR: {
+		audio_control_cur_4_t cur = {.bCur = SAMPLE_RATE};
+		return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request, &cur, sizeof(cur));
+	}
+	case AUDIO_CS_REQ_RANGE: {
+		audio_control_range_4_n_t(1) range = {.wNumSubRanges = 1, .subrange = {{SAMPLE_RATE, SAMPLE_RATE, 0}}};
+		return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request, &range, sizeof(range));
+	}
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "utils.h"
+
+// stereo 16 bit stream of the codec output to the host, see usb_audio.c
+
+// codec interrupt: appends the SAMPLES_PER_TICK stereo frames of the tick that just finished
+void usb_audio_capture(const u32* frames);
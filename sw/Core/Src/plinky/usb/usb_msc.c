@@ -0,0 +1,778 @@
+#include "hardware/flash.h"
+#include "hardware/ram.h"
+#include "hardware/spi.h"
+#include "synth/sampler.h"
+#include "tusb.h"
+
+// shows the sample slots to the host as a usb drive with one wav file per slot. The drive is a fat16 volume that only
+// exists on the fly: boot sector, fat and root directory are generated from the sample infos on every read, the audio
+// comes straight from the spi flash
+//
+// a new wav file is recognized by its header at the start of a cluster, its audio gets converted to mono and programmed
+// into a free slot as it arrives. Which clusters belong to the file comes from the fat the host writes: until the chain
+// is known, the file is assumed to continue right after its known clusters, and an upload whose chain turns out to
+// break away from that assumption is dropped. Everything else the host writes (directories, its metadata files) is
+// ignored, apart from the size in the file's directory entry. The sample info is written once the last sample is in
+// and the chain is confirmed, the host sees the new slot contents after remounting the drive
+
+#define SECTOR_SIZE 512
+#define CLUSTER_SECTORS 8
+#define CLUSTER_SIZE (SECTOR_SIZE * CLUSTER_SECTORS)
+#define WAV_HEADER_SIZE SECTOR_SIZE // our own files pad their header to exactly one sector
+#define SLOT_BYTES (2 * MAX_SAMPLE_LEN)
+#define SLOT_CLUSTERS ((WAV_HEADER_SIZE + SLOT_BYTES + CLUSTER_SIZE - 1) / CLUSTER_SIZE)
+#define SLOT_SECTORS (SLOT_CLUSTERS * CLUSTER_SECTORS)
+#define NUM_CLUSTERS (NUM_SAMPLES * SLOT_CLUSTERS)
+
+// volume layout in sectors: boot sector, fats, root directory, one fixed range of clusters per slot
+#define NUM_FATS 2
+#define FAT_SECTORS (((NUM_CLUSTERS + 2) * 2 + SECTOR_SIZE - 1) / SECTOR_SIZE)
+#define ROOT_ENTRIES 512
+#define ROOT_SECTORS (ROOT_ENTRIES * 32 / SECTOR_SIZE)
+#define FAT_START 1
+#define ROOT_START (FAT_START + NUM_FATS * FAT_SECTORS)
+#define DATA_START (ROOT_START + ROOT_SECTORS)
+#define NUM_SECTORS (DATA_START + NUM_CLUSTERS * CLUSTER_SECTORS)
+
+static_assert(NUM_CLUSTERS >= 4085 && NUM_CLUSTERS < 65525, "volume has to be fat16");
+
+#define FAT_DATE (((2024 - 1980) << 9) | (1 << 5) | 1) // 2024-01-01
+#define NUM_WAVEFORM_WORDS (sizeof(((SampleInfo*)0)->waveform4_b) / 8)
+#define NO_UPLOAD 255
+#define MAX_EXTENTS 16   // contiguous cluster runs of an upload, more fragmented files are dropped
+#define FAT_ENTRIES (SECTOR_SIZE / 2)
+#define MAX_FAT_RUNS 64  // entries of the host's fat that don't link to the next cluster, see host_fat_entry()
+#define MAX_DIR_FILES 16 // directory entries of the host's root directory
+
+static_assert(FAT_SECTORS <= 64, "fat_written has a bit per sector");
+
+typedef struct BootSector {
+	u8 jump[3];
+	char oem[8];
+	u16 bytes_per_sector;
+	u8 sectors_per_cluster;
+	u16 reserved_sectors;
+	u8 num_fats;
+	u16 root_entries;
+	u16 total_sectors16;
+	u8 media;
+	u16 fat_sectors;
+	u16 sectors_per_track;
+	u16 num_heads;
+	u32 hidden_sectors;
+	u32 total_sectors32;
+	u8 drive_number;
+	u8 reserved;
+	u8 boot_signature;
+	u32 volume_id;
+	char volume_label[11];
+	char fs_type[8];
+} __attribute__((packed)) BootSector;
+
+typedef struct DirEntry {
+	char name[11];
+	u8 attr;
+	u8 reserved;
+	u8 create_time_fine;
+	u16 create_time;
+	u16 create_date;
+	u16 access_date;
+	u16 cluster_hi;
+	u16 write_time;
+	u16 write_date;
+	u16 cluster;
+	u32 size;
+} DirEntry;
+static_assert(sizeof(DirEntry) == 32, "?");
+
+typedef struct WavCue {
+	u32 id;
+	u32 position;
+	char chunk[4];
+	u32 chunk_start;
+	u32 block_start;
+	u32 sample_offset;
+} WavCue;
+
+// the slice points travel as cue points
+typedef struct WavHeader {
+	char riff[4];
+	u32 riff_size;
+	char wave[4];
+	char fmt[4];
+	u32 fmt_size;
+	u16 format;
+	u16 channels;
+	u32 sample_rate;
+	u32 byte_rate;
+	u16 block_align;
+	u16 bits_per_sample;
+	char cue[4];
+	u32 cue_size;
+	u32 num_cues;
+	WavCue cues[8];
+	char junk[4];
+	u32 junk_size;
+	u8 padding[256];
+	char data[4];
+	u32 data_size;
+} WavHeader;
+static_assert(sizeof(WavHeader) == WAV_HEADER_SIZE, "?");
+
+// the part of SampleInfo after the waveform, written in one go when an upload completes
+typedef struct SampleInfoTail {
+	int splitpoints[8];
+	int samplelen;
+	s8 notes[8];
+	u8 pitched;
+	u8 loop;
+	u8 paddy[2];
+} SampleInfoTail;
+static_assert(sizeof(SampleInfo) - offsetof(SampleInfo, splitpoints) == sizeof(SampleInfoTail), "?");
+
+// a run of clusters of the uploaded file, relative to DATA_START
+typedef struct Extent {
+	u16 cluster;
+	u16 len;
+} Extent;
+
+typedef struct Upload {
+	u8 slot;
+	u8 frame_size; // bytes per frame in the file
+	u8 num_cues;
+	u8 wave_word_id; // waveform is streamed to flash 8 bytes at a time
+	u64 wave_word;
+	Extent extents[MAX_EXTENTS]; // the file's cluster chain as far as the fat has told us, in file order
+	u8 num_extents;
+	bool chain_ended; // the last known cluster is marked as the end of the chain, the host may still extend it
+	bool chain_done;  // the chain ended and covers the whole file
+	u32 file_size;    // from the directory entry, 0 until the host writes it
+	u32 guessed_end;  // file clusters programmed before the fat confirmed them
+	u8 partial[4];    // start of a frame that continues in the next sector
+	u32 partial_pos;  // file position of the next sector, 0 if there is no partial frame
+	u32 data_offset;  // file position of the audio
+	u32 data_end;     // file position after the audio
+	u32 samplelen;    // samples we are going to keep
+	u32 samples_written;
+	u32 erased_end; // bytes erased from the start of the slot
+	int cues[8];
+	FlashStream info_stream;
+} Upload;
+
+const static BootSector boot_sector = {
+    .jump = {0xeb, 0x3c, 0x90},
+    .oem = "PLINKY  ",
+    .bytes_per_sector = SECTOR_SIZE,
+    .sectors_per_cluster = CLUSTER_SECTORS,
+    .reserved_sectors = FAT_START,
+    .num_fats = NUM_FATS,
+    .root_entries = ROOT_ENTRIES,
+    .total_sectors16 = NUM_SECTORS < 0x10000 ? NUM_SECTORS : 0,
+    .media = 0xf8,
+    .fat_sectors = FAT_SECTORS,
+    .sectors_per_track = 1,
+    .num_heads = 1,
+    .total_sectors32 = NUM_SECTORS < 0x10000 ? 0 : NUM_SECTORS,
+    .drive_number = 0x80,
+    .boot_signature = 0x29,
+    .volume_id = 0x504c4e4b,
+    .volume_label = "PLINKY     ",
+    .fs_type = "FAT16   ",
+};
+
+// a run of entries in the host's fat that don't link to the next cluster
+typedef struct FatRun {
+	u16 entry;
+	u16 len;  // free entries, 1 for jumps and chain ends
+	u16 next; // 0 for free entries
+} FatRun;
+
+typedef struct DirFile {
+	u16 sector; // of the root directory
+	u16 cluster;
+	u32 size;
+} DirFile;
+
+static Upload upload = {.slot = NO_UPLOAD};
+static FatRun fat_runs[MAX_FAT_RUNS];
+static u8 num_fat_runs;
+static u64 fat_written; // sectors of the fat the host wrote since the drive was mounted
+static DirFile dir_files[MAX_DIR_FILES];
+static u8 num_dir_files;
+static u8 claimed_slots; // slots that received an upload since the drive was mounted
+
+static u32 slot_addr(u8 slot) {
+	return slot * SLOT_BYTES;
+}
+
+static const SampleInfo* slot_info(u8 slot) {
+	return (const SampleInfo*)latest_flash_item(F_SAMPLES_START + slot);
+}
+
+// empty slots have no file
+static u32 slot_len(u8 slot) {
+	int len = slot_info(slot)->samplelen;
+	return (len > 0 && len <= MAX_SAMPLE_LEN) ? len : 0;
+}
+
+// == READING == //
+
+// the file of a slot owns all clusters of the slot, so that deleting it frees room for a full length sample
+static u16 fat_entry(u32 entry) {
+	if (entry < 2)
+		return entry ? 0xffff : 0xfff8;
+	u32 cluster = entry - 2;
+	if (cluster >= NUM_CLUSTERS || !slot_len(cluster / SLOT_CLUSTERS))
+		return 0;
+	return cluster % SLOT_CLUSTERS == SLOT_CLUSTERS - 1 ? 0xffff : entry + 1;
+}
+
+static void read_fat_sector(u32 sector, u16* dst) {
+	for (u16 i = 0; i < SECTOR_SIZE / 2; ++i)
+		dst[i] = fat_entry(sector * (SECTOR_SIZE / 2) + i);
+}
+
+static void read_root_sector(u32 sector, DirEntry* dst) {
+	memset(dst, 0, SECTOR_SIZE);
+	if (sector)
+		return;
+	memcpy(dst->name, boot_sector.volume_label, 11);
+	dst->attr = 0x08;
+	dst->write_date = FAT_DATE;
+	dst++;
+	for (u8 slot = 0; slot < NUM_SAMPLES; ++slot) {
+		u32 len = slot_len(slot);
+		if (!len)
+			continue;
+		memcpy(dst->name, "SAMPLE1 WAV", 11);
+		dst->name[6] += slot;
+		dst->attr = 0x20;
+		dst->create_date = dst->access_date = dst->write_date = FAT_DATE;
+		dst->cluster = 2 + slot * SLOT_CLUSTERS;
+		dst->size = WAV_HEADER_SIZE + len * 2;
+		dst++;
+	}
+}
+
+static void read_wav_header(u8 slot, WavHeader* dst) {
+	const SampleInfo* s = slot_info(slot);
+	u32 data_size = slot_len(slot) * 2;
+	memset(dst, 0, sizeof(WavHeader));
+	memcpy(dst->riff, "RIFF", 4);
+	dst->riff_size = sizeof(WavHeader) - 8 + data_size;
+	memcpy(dst->wave, "WAVE", 4);
+	memcpy(dst->fmt, "fmt ", 4);
+	dst->fmt_size = 16;
+	dst->format = 1;
+	dst->channels = 1;
+	dst->sample_rate = SAMPLE_RATE;
+	dst->byte_rate = SAMPLE_RATE * 2;
+	dst->block_align = 2;
+	dst->bits_per_sample = 16;
+	memcpy(dst->cue, "cue ", 4);
+	dst->cue_size = 4 + sizeof(dst->cues);
+	dst->num_cues = 8;
+	for (u8 i = 0; i < 8; ++i) {
+		WavCue* cue = &dst->cues[i];
+		cue->id = i + 1;
+		cue->position = cue->sample_offset = s->splitpoints[i];
+		memcpy(cue->chunk, "data", 4);
+	}
+	memcpy(dst->junk, "JUNK", 4);
+	dst->junk_size = sizeof(dst->padding);
+	memcpy(dst->data, "data", 4);
+	dst->data_size = data_size;
+}
+
+// consecutive audio sectors are read in one go, up to the size of the transfer buffer
+static u32 read_data(u32 sector, u8* dst, u32 max_bytes) {
+	u8 slot = sector / SLOT_SECTORS;
+	u32 file_pos = (sector % SLOT_SECTORS) * SECTOR_SIZE;
+	u32 audio_end = WAV_HEADER_SIZE + slot_len(slot) * 2;
+	if (file_pos == 0 && audio_end > WAV_HEADER_SIZE) {
+		read_wav_header(slot, (WavHeader*)dst);
+		return SECTOR_SIZE;
+	}
+	if (file_pos >= audio_end) {
+		memset(dst, 0, SECTOR_SIZE);
+		return SECTOR_SIZE;
+	}
+	u32 num_bytes = mini(max_bytes, audio_end - file_pos);
+	spi_claim();
+	spi_read(slot_addr(slot) + file_pos - WAV_HEADER_SIZE, dst, num_bytes);
+	spi_release();
+	// pad the last sector of the file
+	u32 padded = (num_bytes + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+	memset(dst + num_bytes, 0, padded - num_bytes);
+	return padded;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) {
+	if (lba >= NUM_SECTORS || offset)
+		return -1;
+	if (lba >= DATA_START)
+		return read_data(lba - DATA_START, buffer, bufsize);
+	if (lba >= ROOT_START)
+		read_root_sector(lba - ROOT_START, buffer);
+	else if (lba >= FAT_START)
+		read_fat_sector((lba - FAT_START) % FAT_SECTORS, buffer);
+	else {
+		memset(buffer, 0, SECTOR_SIZE);
+		memcpy(buffer, &boot_sector, sizeof(BootSector));
+		((u8*)buffer)[510] = 0x55;
+		((u8*)buffer)[511] = 0xaa;
+	}
+	return SECTOR_SIZE;
+}
+
+// == HOST WRITES == //
+
+// hosts write the fat, the directory and the file data in any order, so what they wrote to the fat and the root
+// directory since the drive was mounted is kept, in a compact form
+
+// the fat as the host sees it: sectors it didn't write still hold what read_fat_sector() generates
+static u16 host_fat_entry(u32 entry) {
+	if (!(fat_written & (1ull << (entry / FAT_ENTRIES))))
+		return fat_entry(entry);
+	for (u8 i = 0; i < num_fat_runs; ++i)
+		if (entry >= fat_runs[i].entry && entry < fat_runs[i].entry + fat_runs[i].len)
+			return fat_runs[i].next;
+	return entry + 1;
+}
+
+static void keep_fat_sector(u32 sector, const u16* src) {
+	u32 first = sector * FAT_ENTRIES;
+	u8 kept = 0;
+	for (u8 i = 0; i < num_fat_runs; ++i)
+		if (fat_runs[i].entry < first || fat_runs[i].entry >= first + FAT_ENTRIES)
+			fat_runs[kept++] = fat_runs[i];
+	num_fat_runs = kept;
+	fat_written |= 1ull << sector;
+	for (u32 i = 0; i < FAT_ENTRIES; ++i) {
+		u32 entry = first + i;
+		u16 next = src[i];
+		if (next == entry + 1)
+			continue;
+		FatRun* run = &fat_runs[num_fat_runs - 1];
+		if (!next && num_fat_runs > kept && !run->next && run->entry + run->len == entry) {
+			run->len++;
+			continue;
+		}
+		// out of room, the sector falls back to the generated fat, which marks the clusters of empty slots as free
+		if (num_fat_runs == MAX_FAT_RUNS) {
+			num_fat_runs = kept;
+			fat_written &= ~(1ull << sector);
+			return;
+		}
+		fat_runs[num_fat_runs++] = (FatRun){entry, 1, next};
+	}
+}
+
+static void keep_root_sector(u32 sector, const DirEntry* src) {
+	u8 kept = 0;
+	for (u8 i = 0; i < num_dir_files; ++i)
+		if (dir_files[i].sector != sector)
+			dir_files[kept++] = dir_files[i];
+	num_dir_files = kept;
+	for (u8 i = 0; i < SECTOR_SIZE / sizeof(DirEntry) && num_dir_files < MAX_DIR_FILES; ++i, ++src)
+		// skip the end marker, deleted entries, volume labels, long name entries and directories
+		if (src->name[0] && (u8)src->name[0] != 0xe5 && !(src->attr & 0x18))
+			dir_files[num_dir_files++] = (DirFile){sector, src->cluster, src->size};
+}
+
+static void forget_host_writes(void) {
+	num_fat_runs = 0;
+	fat_written = 0;
+	num_dir_files = 0;
+}
+
+// == UPLOADING == //
+
+static void flush_wave_word(void) {
+	flash_stream_write(&upload.info_stream, upload.wave_word_id * 8, &upload.wave_word, 8);
+	upload.wave_word = 0;
+	upload.wave_word_id++;
+}
+
+// same format as setwaveform4() in sampler.c: one nibble per 1024 samples
+static void add_waveform_peak(u32 sample_id, u16 peak) {
+	u32 x = sample_id / 1024;
+	u8 word_id = x / 16;
+	// the host went back to an earlier part of the file, that part of the waveform is already written
+	if (word_id < upload.wave_word_id)
+		return;
+	while (upload.wave_word_id < word_id)
+		flush_wave_word();
+	u8 shift = (x & 15) * 4;
+	u64 v = mini(peak / 1024, 15);
+	if (v > ((upload.wave_word >> shift) & 15))
+		upload.wave_word = (upload.wave_word & ~((u64)15 << shift)) | (v << shift);
+}
+
+static void finish_upload(void) {
+	u8 slot = upload.slot;
+	upload.slot = NO_UPLOAD;
+	// nothing has been programmed, the slot is untouched
+	if (!upload.samples_written)
+		return;
+	while (upload.wave_word_id < NUM_WAVEFORM_WORDS)
+		flush_wave_word();
+	// the cue points become the first slices, the remaining ones split the rest evenly like after a recording
+	SampleInfoTail tail = {0};
+	int len = mini(upload.samples_written, upload.samplelen);
+	u8 n = maxi(upload.num_cues, 1);
+	for (u8 i = 0; i < upload.num_cues; ++i)
+		tail.splitpoints[i] = mini(upload.cues[i], len);
+	int start = tail.splitpoints[n - 1];
+	for (u8 i = n; i < 8; ++i)
+		tail.splitpoints[i] = start + ((len - start) * (i - n + 1)) / (8 - n + 1);
+	tail.samplelen = len;
+	flash_stream_write(&upload.info_stream, offsetof(SampleInfo, splitpoints), &tail, sizeof(tail));
+	flash_stream_commit(&upload.info_stream);
+	reload_flash_item(F_SAMPLES_START + slot);
+	DebugLog("msc: %d samples uploaded to slot %d\r\n", len, slot + 1);
+}
+
+// the upload can't be completed: an erased slot gets an empty sample info, an untouched one is left alone
+static void drop_upload(const char* reason) {
+	DebugLog("msc: upload to slot %d dropped, %s\r\n", upload.slot + 1, reason);
+	if (upload.erased_end) {
+		SampleInfoTail tail = {0};
+		flash_stream_write(&upload.info_stream, offsetof(SampleInfo, splitpoints), &tail, sizeof(tail));
+		flash_stream_commit(&upload.info_stream);
+		reload_flash_item(F_SAMPLES_START + upload.slot);
+	}
+	upload.slot = NO_UPLOAD;
+}
+
+static u32 chain_clusters(void) {
+	u32 n = 0;
+	for (u8 i = 0; i < upload.num_extents; ++i)
+		n += upload.extents[i].len;
+	return n;
+}
+
+// all audio is in, and the fat confirmed the clusters it came from
+static void check_upload_done(void) {
+	if (upload.slot == NO_UPLOAD || upload.samples_written < upload.samplelen)
+		return;
+	if (upload.chain_done || upload.guessed_end <= chain_clusters())
+		finish_upload();
+}
+
+// hosts write the chain and the size as the file grows: they are final once the chain ends where the header or the
+// directory entry says the file ends
+static void update_chain_done(void) {
+	u32 chain_bytes = chain_clusters() * CLUSTER_SIZE;
+	if (!upload.chain_ended)
+		return;
+	if (upload.file_size > chain_bytes - CLUSTER_SIZE && upload.file_size <= chain_bytes) {
+		// the file is shorter than its header claims, common for streamed wav files
+		if (upload.file_size < upload.data_end) {
+			upload.data_end = maxi(upload.file_size, upload.data_offset);
+			upload.samplelen = mini(upload.samplelen, (upload.data_end - upload.data_offset) / upload.frame_size);
+		}
+		upload.chain_done = true;
+	}
+	else if (chain_bytes >= upload.data_end)
+		upload.chain_done = true;
+	check_upload_done();
+}
+
+static s16 read_s16(const u8* src) {
+	return (s16)(src[0] | (src[1] << 8));
+}
+
+static u32 read_u32(const u8* src) {
+	return src[0] | (src[1] << 8) | (src[2] << 16) | ((u32)src[3] << 24);
+}
+
+// programs the frames of the upload that lie in this file sector, returns how many. A frame that straddles the end of
+// the sector is kept until the next sector arrives. Pages are programmed with 0xff outside of the frames, which leaves
+// the flash untouched there
+static u32 program_audio(u32 file_pos, const u8* src) {
+	u32 start = maxi(file_pos, upload.data_offset);
+	u32 end = mini(file_pos + SECTOR_SIZE, upload.data_end);
+	if (start >= end)
+		return 0;
+	u8 fs = upload.frame_size;
+	u32 first = (start - upload.data_offset) / fs;
+	u32 last = mini((end - upload.data_offset + fs - 1) / fs, upload.samplelen);
+	if (first >= last)
+		return 0;
+	u32 programmed = 0;
+	u8 joined[4];
+	s16* page = (s16*)(spi_bit_tx + 4);
+	spi_claim();
+	for (u32 page_start = first & ~127; page_start < last; page_start += 128) {
+		u32 flash_pos = page_start * 2;
+		while (upload.erased_end <= flash_pos) {
+			spi_erase64k(slot_addr(upload.slot) + upload.erased_end, 0, 0);
+			upload.erased_end += 65536;
+		}
+		memset(page, 0xff, 256);
+		u32 page_programmed = 0;
+		u32 page_end = mini(page_start + 128, last);
+		for (u32 i = maxi(page_start, first); i < page_end; ++i) {
+			u32 frame_pos = upload.data_offset + i * fs;
+			const u8* frame = src + frame_pos - file_pos;
+			if (frame_pos < file_pos) {
+				// started in the previous sector
+				if (upload.partial_pos != file_pos)
+					continue;
+				u8 head = file_pos - frame_pos;
+				memcpy(joined, upload.partial, head);
+				memcpy(joined + head, src, fs - head);
+				frame = joined;
+				upload.partial_pos = 0;
+			}
+			else if (frame_pos + fs > file_pos + SECTOR_SIZE) {
+				// continues in the next sector
+				memcpy(upload.partial, frame, file_pos + SECTOR_SIZE - frame_pos);
+				upload.partial_pos = file_pos + SECTOR_SIZE;
+				continue;
+			}
+			else if (frame_pos + fs > end)
+				continue;
+			s16 smp = read_s16(frame);
+			if (fs == 4)
+				smp = (smp + read_s16(frame + 2)) >> 1;
+			page[i - page_start] = smp;
+			add_waveform_peak(i, abs(smp));
+			page_programmed++;
+		}
+		if (page_programmed && spi_write256(slot_addr(upload.slot) + flash_pos) != 0)
+			DebugLog("msc: flash write fail\r\n");
+		programmed += page_programmed;
+	}
+	spi_release();
+	upload.samples_written += programmed;
+	return programmed;
+}
+
+// follows the chain of the upload through the host's fat, from the last cluster we know
+static void follow_upload_chain(void) {
+	if (upload.slot == NO_UPLOAD || upload.chain_done)
+		return;
+	Extent* last = &upload.extents[upload.num_extents - 1];
+	// fat entries are numbered from 2
+	u32 tail = last->cluster + last->len - 1 + 2;
+	while (true) {
+		u16 next = host_fat_entry(tail);
+		// not allocated yet
+		if (next < 2)
+			return;
+		upload.chain_ended = next >= 0xfff8;
+		if (upload.chain_ended) {
+			update_chain_done();
+			return;
+		}
+		if (next - 2 >= NUM_CLUSTERS) {
+			drop_upload("broken fat chain");
+			return;
+		}
+		if (next == tail + 1)
+			last->len++;
+		else {
+			// the file continues elsewhere, audio we took from the clusters after the break belonged to something else
+			if (upload.guessed_end > chain_clusters()) {
+				drop_upload("clusters assumed contiguous are not");
+				return;
+			}
+			if (upload.num_extents == MAX_EXTENTS) {
+				drop_upload("file too fragmented");
+				return;
+			}
+			last = &upload.extents[upload.num_extents++];
+			*last = (Extent){next - 2, 1};
+		}
+		tail = next;
+	}
+}
+
+// the size of the upload from its directory entry
+static void update_upload_size(void) {
+	if (upload.slot == NO_UPLOAD || upload.chain_done)
+		return;
+	for (u8 i = 0; i < num_dir_files; ++i)
+		if (dir_files[i].cluster == upload.extents[0].cluster + 2) {
+			upload.file_size = dir_files[i].size;
+			update_chain_done();
+			return;
+		}
+}
+
+// the slot whose clusters the host picked, unless an earlier upload of this mount went there. The host only picks
+// clusters of a slot that has no file, or whose file has been deleted
+static u8 pick_upload_slot(u32 cluster) {
+	u8 slot = cluster / SLOT_CLUSTERS;
+	if (!(claimed_slots & (1 << slot)))
+		return slot;
+	for (slot = 0; slot < NUM_SAMPLES; ++slot)
+		if (!(claimed_slots & (1 << slot)) && !slot_len(slot))
+			return slot;
+	return NO_UPLOAD;
+}
+
+// only 16 bit pcm is supported, the header has to fit in the first sector of the file
+static void start_upload(u32 cluster, const u8* src) {
+	if (upload.slot != NO_UPLOAD)
+		finish_upload();
+	u8 channels = 0;
+	u8 bits = 0;
+	u8 num_cues = 0;
+	u32 pos = 12;
+	while (pos + 8 <= SECTOR_SIZE) {
+		const u8* chunk = src + pos;
+		u32 size = read_u32(chunk + 4);
+		if (!memcmp(chunk, "data", 4)) {
+			upload.data_offset = pos + 8;
+			upload.data_end = upload.data_offset + (size < 2 * SLOT_BYTES ? size : 2 * SLOT_BYTES);
+			break;
+		}
+		if (size >= SECTOR_SIZE)
+			break;
+		if (!memcmp(chunk, "fmt ", 4) && pos + 24 <= SECTOR_SIZE) {
+			u16 format = chunk[8] | (chunk[9] << 8);
+			channels = format == 1 || format == 0xfffe ? chunk[10] : 0;
+			bits = chunk[22];
+		}
+		if (!memcmp(chunk, "cue ", 4) && pos + 12 <= SECTOR_SIZE) {
+			u32 count = read_u32(chunk + 8);
+			for (u32 i = 0; i < count && num_cues < 8; ++i) {
+				const u8* cue = chunk + 12 + i * sizeof(WavCue);
+				if (cue + sizeof(WavCue) > src + SECTOR_SIZE)
+					break;
+				upload.cues[num_cues++] = read_u32(cue + offsetof(WavCue, sample_offset));
+			}
+		}
+		pos += 8 + size + (size & 1);
+	}
+	if (pos + 8 > SECTOR_SIZE || bits != 16 || channels < 1 || channels > 2) {
+		DebugLog("msc: unsupported wav file\r\n");
+		return;
+	}
+	upload.frame_size = channels * 2;
+	upload.samplelen = mini((upload.data_end - upload.data_offset) / upload.frame_size, MAX_SAMPLE_LEN);
+	upload.slot = upload.samplelen ? pick_upload_slot(cluster) : NO_UPLOAD;
+	if (upload.slot == NO_UPLOAD)
+		return;
+	claimed_slots |= 1 << upload.slot;
+	// cue points can come in any order
+	for (u8 i = 1; i < num_cues; ++i)
+		for (u8 j = i; j > 0 && upload.cues[j - 1] > upload.cues[j]; --j) {
+			int tmp = upload.cues[j];
+			upload.cues[j] = upload.cues[j - 1];
+			upload.cues[j - 1] = tmp;
+		}
+	upload.num_cues = num_cues;
+	upload.extents[0] = (Extent){cluster, 1};
+	upload.num_extents = 1;
+	upload.chain_ended = false;
+	upload.chain_done = false;
+	upload.file_size = 0;
+	upload.guessed_end = 0;
+	upload.partial_pos = 0;
+	upload.samples_written = 0;
+	upload.erased_end = 0;
+	upload.wave_word = 0;
+	upload.wave_word_id = 0;
+	flash_stream_begin(&upload.info_stream, F_SAMPLES_START + upload.slot);
+	// the host may have written the fat and the directory entry before the data
+	follow_upload_chain();
+	update_upload_size();
+	// short headers leave room for audio in the first sector
+	if (upload.slot != NO_UPLOAD)
+		program_audio(0, src);
+	check_upload_done();
+}
+
+// file position of a data cluster, -1 if it's not part of the upload. Clusters past the known chain are assumed to
+// continue it until the fat says otherwise
+static s32 upload_cluster_pos(u32 cluster) {
+	u32 file_cluster = 0;
+	for (u8 i = 0; i < upload.num_extents; ++i) {
+		const Extent* e = &upload.extents[i];
+		if (cluster >= e->cluster && cluster < e->cluster + e->len)
+			return (file_cluster + cluster - e->cluster) * CLUSTER_SIZE;
+		file_cluster += e->len;
+	}
+	const Extent* last = &upload.extents[upload.num_extents - 1];
+	if (upload.chain_done || cluster < last->cluster + last->len)
+		return -1;
+	return (file_cluster + cluster - last->cluster - last->len) * CLUSTER_SIZE;
+}
+
+static void write_data_sector(u32 sector, const u8* src) {
+	u32 cluster = sector / CLUSTER_SECTORS;
+	if (sector % CLUSTER_SECTORS == 0 && !memcmp(src, "RIFF", 4) && !memcmp(src + 8, "WAVE", 4)) {
+		start_upload(cluster, src);
+		return;
+	}
+	if (upload.slot == NO_UPLOAD)
+		return;
+	s32 cluster_pos = upload_cluster_pos(cluster);
+	if (cluster_pos < 0)
+		return;
+	u32 file_pos = cluster_pos + (sector % CLUSTER_SECTORS) * SECTOR_SIZE;
+	if (program_audio(file_pos, src) && file_pos / CLUSTER_SIZE >= chain_clusters())
+		upload.guessed_end = maxi(upload.guessed_end, file_pos / CLUSTER_SIZE + 1);
+	check_upload_done();
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize) {
+	if (lba >= NUM_SECTORS || offset)
+		return -1;
+	for (u32 pos = 0; pos + SECTOR_SIZE <= bufsize; pos += SECTOR_SIZE, ++lba) {
+		if (lba >= DATA_START)
+			write_data_sector(lba - DATA_START, buffer + pos);
+		else if (lba >= ROOT_START) {
+			keep_root_sector(lba - ROOT_START, (const DirEntry*)(buffer + pos));
+			update_upload_size();
+		}
+		// the second fat is a copy of the first
+		else if (lba >= FAT_START && lba < FAT_START + FAT_SECTORS) {
+			keep_fat_sector(lba - FAT_START, (const u16*)(buffer + pos));
+			follow_upload_chain();
+		}
+	}
+	return bufsize;
+}
+
+// == SCSI == //
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4]) {
+	memcpy(vendor_id, "Plinky", 6);
+	memcpy(product_id, "Sample slots", 12);
+	memcpy(product_rev, "1.0", 3);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+	return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size) {
+	*block_count = NUM_SECTORS;
+	*block_size = SECTOR_SIZE;
+}
+
+// the host ejected the drive
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject) {
+	if (load_eject && !start) {
+		if (upload.slot != NO_UPLOAD)
+			finish_upload();
+		claimed_slots = 0;
+		forget_host_writes();
+	}
+	return true;
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize) {
+	switch (scsi_cmd[0]) {
+	case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+		return 0;
+	default:
+		tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+		return -1;
+	}
+}
@@ -1,6 +1,8 @@
 #include "web_editor.h"
+#include "bulk_protocol.h"
 #include "hardware/flash.h"
 #include "hardware/ram.h"
+#include "scheduler.h"
 #include "tusb.h"
 
 /* webusb wire format. 10 byte header, then data.
@@ -37,6 +39,7 @@ typedef enum WuState {
 	WU_RCV_DATA,
 	WU_SND_HDR,
 	WU_SND_DATA,
+	WU_BULK, // bulk_protocol.c owns the stream until its frame is done
 } WuState;
 
 const static u8 magic[4] = {0xf3, 0x0f, 0xab, 0xca};
@@ -70,10 +73,18 @@ void web_editor_reset(void) {
 }
 
 void web_editor_frame(void) {
-	u32 start_time = micros();
-	while (micros() - start_time < 1000) {
+	// keep going while there is data to move, for at most the rest of our time slice
+	while (sched_time_left()) {
 		// process bytes
 		tud_task();
+		if (state == WU_BULK) {
+			BulkProgress progress = bulk_process();
+			if (progress == BULK_STALLED)
+				return;
+			if (progress == BULK_FRAME_DONE)
+				web_editor_reset();
+			continue;
+		}
 		u32 handled_bytes = 0;
 		switch (state) {
 		// send bytes
@@ -86,9 +97,15 @@ void web_editor_frame(void) {
 			handled_bytes = tud_vendor_read(data_buf, mini(remaining_bytes, CFG_TUD_VENDOR_RX_BUFSIZE));
 			break;
 		}
-		// nothing read or sent: buffer full or no data => try again
-		if (handled_bytes == 0)
-			continue;
+		// nothing read or sent: buffer full or no data => try again next frame
+		if (handled_bytes == 0) {
+			// the host is quiet between frames, use the time for telemetry and traces
+			if (state == WU_MAGIC0 && bulk_send_stream() == BULK_BUSY) {
+				state = WU_BULK;
+				continue;
+			}
+			return;
+		}
 
 		// progress
 		remaining_bytes = remaining_bytes - handled_bytes;
@@ -106,6 +123,12 @@ void web_editor_frame(void) {
 		case WU_MAGIC2:
 		case WU_MAGIC3: {
 			u8 m = header.magic[state];
+			// bulk protocol frame
+			if (state == WU_MAGIC3 && m == BULK_MAGIC3) {
+				state = WU_BULK;
+				bulk_begin();
+				break;
+			}
 			// received incorrect magic byte
 			if (m != magic[state] && m != magic_32[state]) {
 				// received magic 0, manually set state to magic 1
@@ -145,7 +168,9 @@ void web_editor_frame(void) {
 				break;
 			// request to save
 			case 1:
-				load_preset(header.idx, false);
+				// the data goes straight into cur_preset, the preset has to be in ram right away
+				if (header.idx != sys_params.preset_id || !preset_ram_ready())
+					load_preset(header.idx, true);
 				set_state(WU_RCV_DATA, ((u8*)&cur_preset) + wu_hdr_offset(), wu_hdr_len());
 				break;
 			}
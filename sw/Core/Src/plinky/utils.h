@@ -43,9 +43,13 @@ typedef char bool;
 static inline u32 millis(void) {
 	return HAL_GetTick();
 }
-static inline u32 micros(void) {
+#ifdef __arm__
+static inline u32 micros(void) { // 1MHz, see MX_TIM5_Init()
 	return TIM5->CNT;
 }
+#else
+u32 micros(void); // host builds bring their own clock, see tools/synth_render.c
+#endif
 // returns true every [duration] ms
 static inline bool do_every(u32 duration, u32* referenceTime) {
 	if (millis() - *referenceTime >= duration) {
@@ -107,7 +111,29 @@ static inline void DebugLog(const char* fmt, ...) {
 // plinky utils
 #define clz __builtin_clz
 #define unlikely(x) __builtin_expect((x), 0)
+#ifdef __arm__
 #define SMUAD(o, a, b) asm("smuad %0, %1, %2" : "=r"(o) : "r"(a), "r"(b))
+#else
+// host builds (dsp bench): both 16 bit halves multiplied, products added with the same wraparound
+#define SMUAD(o, a, b) ((o) = (s32)((u32)((s16)(a) * (s16)(b)) + (u32)(((s32)(a) >> 16) * ((s32)(b) >> 16))))
+#endif
+
+// orders memory accesses for the other side of an interrupt, host builds (synth render) only need the compiler barrier
+#ifdef __arm__
+#define memory_barrier() __DMB()
+#else
+#define memory_barrier() __asm__ volatile("" ::: "memory")
+#endif
+
+// audio hot path placement: with RAMFUNCS defined, tagged functions run from sram and tagged tables are copied there by
+// the startup code, next to .data. Off by default, the ram region is shared with .data, .bss and the stack
+#ifdef RAMFUNCS
+#define RAM_FUNC __attribute__((section(".ramfunc"), noinline))
+#define FAST_DATA __attribute__((section(".fastdata")))
+#else
+#define RAM_FUNC
+#define FAST_DATA
+#endif
 
 static u8 const zero[2048] = {0};
 
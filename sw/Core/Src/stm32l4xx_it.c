@@ -21,6 +21,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32l4xx_it.h"
 #include "hardware/encoder.h"
+#include "hardware/midi.h"
 #include "main.h"
 #include "synth/time.h"
 /* Private includes ----------------------------------------------------------*/
@@ -290,11 +291,25 @@ void I2C2_EV_IRQHandler(void) {
 	/* USER CODE END I2C2_EV_IRQn 1 */
 }
 
+/**
+ * @brief This function handles I2C2 error interrupt.
+ */
+void I2C2_ER_IRQHandler(void) {
+	/* USER CODE BEGIN I2C2_ER_IRQn 0 */
+
+	/* USER CODE END I2C2_ER_IRQn 0 */
+	HAL_I2C_ER_IRQHandler(&hi2c2);
+	/* USER CODE BEGIN I2C2_ER_IRQn 1 */
+
+	/* USER CODE END I2C2_ER_IRQn 1 */
+}
+
 /**
  * @brief This function handles USART3 global interrupt.
  */
 void USART3_IRQHandler(void) {
 	/* USER CODE BEGIN USART3_IRQn 0 */
+	midi_uart_irq();
 
 	/* USER CODE END USART3_IRQn 0 */
 	HAL_UART_IRQHandler(&huart3);
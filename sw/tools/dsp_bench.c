@@ -0,0 +1,307 @@
+// host benchmark of the audio dsp primitives and block kernels. Builds the firmware's own audio_tools.h, tables.c and
+// pitch_grid.c for the host, the inline asm falls back to the portable versions in audio_tools.h and utils.h
+//
+//   make dsp-bench      (from sw/nocube_makefile, HOST_CC=clang to pick another compiler)
+//
+// every kernel reports host ns per sample next to a hand counted cortex-m4 cost: the instructions the firmware build
+// issues per sample, read off its disassembly and counted at one cycle each plus one extra per load, no flash wait
+// states (see RAMFUNCS in utils.h). Nothing here measures the m4, the counts are estimates typed into the kernel table
+// and go stale when the code or the compiler changes. On the device, the telemetry's tick cycle counts (DWT, see
+// tick_counter.h) are the measurement. Where there is an independent way to compute the same thing, the kernel is also
+// checked bit for bit against it
+
+#include "synth/audio_tools.h"
+#include "synth/pitch_grid.h"
+#include "synth/pitch_tools.h"
+#include <time.h>
+
+#define BLOCK 4096                   // samples per kernel call
+#define MIN_SAMPLES (8 * 1024 * 1024) // per measurement
+#define RV_SIZE (RV_SIZE_MASK + 1)
+#define CORE_CLOCK 112000000         // hse / PLLM * PLLN / PLLR, see SystemClock_Config
+
+typedef struct Kernel {
+	const char* name;
+	float m4_est;      // hand counted estimate per sample, not measured
+	void (*run)(void); // processes BLOCK samples
+	u32 (*check)(void); // returns the number of mismatches, 0 if there is nothing to check against
+} Kernel;
+
+static u32 src_a[BLOCK];
+static u32 src_b[BLOCK];
+static u32 dst[BLOCK];
+static s16 rv_buf[RV_SIZE];
+static volatile u32 sink;
+
+static u32 lcg = 1;
+static u32 rnd(void) {
+	lcg = lcg * 1664525 + 1013904223;
+	return lcg;
+}
+
+static u64 now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// == REFERENCES == //
+
+static s16 ref_sat16(s64 a) {
+	return (s16)fmax(-32768., fmin(32767., (double)a));
+}
+
+static u32 ref_pack(s16 l, s16 r) {
+	s16 lanes[2] = {l, r};
+	u32 out;
+	memcpy(&out, lanes, 4);
+	return out;
+}
+
+static s16 lane(u32 x, u8 id) {
+	s16 lanes[2];
+	memcpy(lanes, &x, 4);
+	return lanes[id];
+}
+
+// == PRIMITIVES == //
+
+static void run_stereopack(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = STEREOPACK(src_a[i], src_b[i]);
+}
+static u32 check_stereopack(void) {
+	u32 errors = 0;
+	for (u32 i = 0; i < BLOCK; ++i)
+		errors += STEREOPACK(src_a[i], src_b[i]) != ref_pack(src_a[i], src_b[i]);
+	return errors;
+}
+
+static void run_saturate16(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = SATURATE16((s32)src_a[i] >> 14);
+}
+static u32 check_saturate16(void) {
+	u32 errors = 0;
+	for (u32 i = 0; i < BLOCK; ++i)
+		errors += SATURATE16((s32)src_a[i] >> 14) != ref_sat16((s32)src_a[i] >> 14);
+	return errors;
+}
+
+static void run_smuad(void) {
+	for (u32 i = 0; i < BLOCK; ++i) {
+		s32 out;
+		SMUAD(out, src_a[i], src_b[i]);
+		dst[i] = out;
+	}
+}
+static u32 check_smuad(void) {
+	u32 errors = 0;
+	for (u32 i = 0; i < BLOCK; ++i) {
+		s32 out;
+		SMUAD(out, src_a[i], src_b[i]);
+		s64 ref = (s64)lane(src_a[i], 0) * lane(src_b[i], 0) + (s64)lane(src_a[i], 1) * lane(src_b[i], 1);
+		errors += out != (s32)(u32)ref;
+	}
+	return errors;
+}
+
+static void run_stereoaddsat(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = STEREOADDSAT(src_a[i], src_b[i]);
+}
+static u32 check_stereoaddsat(void) {
+	u32 errors = 0;
+	for (u32 i = 0; i < BLOCK; ++i) {
+		u32 ref = ref_pack(ref_sat16(lane(src_a[i], 0) + lane(src_b[i], 0)),
+		                   ref_sat16(lane(src_a[i], 1) + lane(src_b[i], 1)));
+		errors += STEREOADDSAT(src_a[i], src_b[i]) != ref;
+	}
+	return errors;
+}
+
+static void run_stereoaddaverage(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = STEREOADDAVERAGE(src_a[i], src_b[i]);
+}
+static u32 check_stereoaddaverage(void) {
+	u32 errors = 0;
+	for (u32 i = 0; i < BLOCK; ++i) {
+		u32 ref = ref_pack(floor((lane(src_a[i], 0) + lane(src_b[i], 0)) / 2.),
+		                   floor((lane(src_a[i], 1) + lane(src_b[i], 1)) / 2.));
+		errors += STEREOADDAVERAGE(src_a[i], src_b[i]) != ref;
+	}
+	return errors;
+}
+
+static void run_midsidescale(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = MIDSIDESCALE(src_a[i], 40000, 70000);
+}
+
+static void run_stereosigmoid(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = STEREOSIGMOID(src_a[i]);
+}
+
+static void run_linearinterprv(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		dst[i] = LINEARINTERPRV(rv_buf, i, src_b[i] & 0xfffff);
+}
+static u32 check_linearinterprv(void) {
+	u32 errors = 0;
+	for (u32 i = 0; i < BLOCK; ++i) {
+		int wobpos = src_b[i] & 0xfffff;
+		int basei = i - (wobpos >> 12);
+		s64 w = wobpos & 0xfff;
+		s64 ref = (rv_buf[basei & RV_SIZE_MASK] * (0x1000 - w) + rv_buf[(basei - 1) & RV_SIZE_MASK] * w) >> 12;
+		errors += LINEARINTERPRV(rv_buf, i, wobpos) != (s16)ref;
+	}
+	return errors;
+}
+
+static void run_table_interp(void) {
+	for (u32 i = 0; i < BLOCK; ++i) {
+		float f = table_interp(pitches, src_a[i] & 0x1ffff);
+		memcpy(&dst[i], &f, 4);
+	}
+}
+
+// == KERNELS == //
+
+// the input diffusers and the first wobbling loop half of Reverb2, on the same macros
+static void run_reverb_chain(void) {
+	static int i = 0;
+	int apwobpos = 1 << 18;
+	for (u32 s = 0; s < BLOCK; ++s) {
+		s16* buf = rv_buf;
+		int acc = (s16)src_a[s] >> 2;
+		AP(142);
+		AP(379);
+		AP(107);
+		AP(277);
+		AP_WOBBLE(672, apwobpos);
+		AP(1800);
+		DELAY(4453);
+		dst[s] = acc;
+		i = (i - 1) & RV_SIZE_MASK;
+	}
+}
+
+// two oscillators of the supersaw loop in apply_subtractive_lpg_noise
+static u32 saw_phase[2];
+static s32 saw_phase_diff[2] = {1 << 24, 3 << 22};
+static u32 saw_prev[2];
+
+static void run_polyblep(void) {
+	for (u32 i = 0; i < BLOCK; ++i) {
+		s32 out = (s32)(POLYBLEPSAW(&saw_phase[0], &saw_phase_diff[0], 0, &saw_prev[0]) >> 4);
+		out += (s32)(POLYBLEPSAW(&saw_phase[1], &saw_phase_diff[1], 0, &saw_prev[1]) >> 4) - (2 << (31 - 4));
+		dst[i] = out;
+	}
+}
+
+// the loop as it was written out in synth.c before POLYBLEPSAW
+static u32 ref_polyblep(u32* phase1, s32* phase1_diff, s32 dd_phase1, u32* prev_sample1) {
+	*phase1_diff += dd_phase1;
+	*phase1 += *phase1_diff;
+	u32 newsample1 = *phase1;
+	if (*phase1 < (u32)*phase1_diff) {
+		u32 fractime = mini(65535, *phase1 / (*phase1_diff >> 16));
+		*prev_sample1 -= (fractime * fractime) >> 1;
+		fractime = 65535 - fractime;
+		newsample1 += (fractime * fractime) >> 1;
+	}
+	u32 out = *prev_sample1;
+	*prev_sample1 = newsample1;
+	return out;
+}
+
+static u32 check_polyblep(void) {
+	u32 errors = 0;
+	u32 phase[2] = {0, 0}, ref_phase[2] = {0, 0};
+	s32 diff[2] = {1 << 24, 1 << 20}, ref_diff[2] = {1 << 24, 1 << 20};
+	u32 prev[2] = {0, 0}, ref_prev[2] = {0, 0};
+	for (u32 i = 0; i < BLOCK; ++i)
+		for (u8 osc = 0; osc < 2; ++osc) {
+			s32 dd = (s32)src_b[i] >> 20; // with glide
+			errors += POLYBLEPSAW(&phase[osc], &diff[osc], dd, &prev[osc])
+			          != ref_polyblep(&ref_phase[osc], &ref_diff[osc], dd, &ref_prev[osc]);
+		}
+	return errors;
+}
+
+// one "sample" is a row rebuild: the first step changes on every call
+static void run_pitch_grid_rebuild(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		sink = pitch_grid_row(i & 7, S_MAJOR, i & 63)[0];
+}
+
+// one "sample" is a lookup of an unchanged row
+static void run_pitch_grid_cached(void) {
+	for (u32 i = 0; i < BLOCK; ++i)
+		sink = pitch_grid_row(i & 7, S_MAJOR, 12)[0];
+}
+
+static u32 check_pitch_grid(void) {
+	u32 errors = 0;
+	for (Scale scale = 0; scale < NUM_SCALES; ++scale)
+		for (u8 first_step = 1; first_step < 64; ++first_step) {
+			const s32* row = pitch_grid_row(0, scale, first_step);
+			for (s8 pad = -1; pad <= PADS_PER_STRIP; ++pad)
+				errors += row[pad] != pitch_at_step(scale, first_step + pad);
+		}
+	return errors;
+}
+
+// the m4 estimates are hand counts of the firmware's inner loop, loads and stores of the operands included
+static const Kernel kernels[] = {
+    {"STEREOPACK", 4, run_stereopack, check_stereopack},
+    {"SATURATE16", 4, run_saturate16, check_saturate16},
+    {"SMUAD", 5, run_smuad, check_smuad},
+    {"STEREOADDSAT", 5, run_stereoaddsat, check_stereoaddsat},
+    {"STEREOADDAVERAGE", 5, run_stereoaddaverage, check_stereoaddaverage},
+    {"MIDSIDESCALE", 14, run_midsidescale, 0},
+    {"STEREOSIGMOID", 10, run_stereosigmoid, 0},
+    {"LINEARINTERPRV", 16, run_linearinterprv, check_linearinterprv},
+    {"table_interp", 14, run_table_interp, 0},
+    {"reverb AP chain", 82, run_reverb_chain, 0},
+    {"polyblep saw x2", 16, run_polyblep, check_polyblep},
+    {"pitch grid rebuild", 150, run_pitch_grid_rebuild, check_pitch_grid},
+    {"pitch grid cached", 12, run_pitch_grid_cached, 0},
+};
+
+int main(void) {
+	for (u32 i = 0; i < BLOCK; ++i) {
+		src_a[i] = rnd();
+		src_b[i] = rnd();
+	}
+	for (u32 i = 0; i < RV_SIZE; ++i)
+		rv_buf[i] = rnd() >> 16;
+
+	printf("%-20s%12s%16s%10s\n", "kernel", "host ns", "m4 est*", "check");
+	u32 failures = 0;
+	for (u8 k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+		const Kernel* kernel = &kernels[k];
+		kernel->run(); // warm up
+		u64 start = now_ns();
+		u32 samples = 0;
+		while (samples < MIN_SAMPLES) {
+			kernel->run();
+			samples += BLOCK;
+		}
+		double ns = (double)(now_ns() - start) / samples;
+		sink = dst[rnd() % BLOCK];
+		char check[16] = "-";
+		if (kernel->check) {
+			u32 errors = kernel->check();
+			failures += errors != 0;
+			snprintf(check, sizeof(check), errors ? "%u bad" : "ok", errors);
+		}
+		printf("%-20s%12.2f%16.0f%10s\n", kernel->name, ns, kernel->m4_est, check);
+	}
+	printf("* hand counted cycles per sample, not measured\n");
+	printf("m4 budget: %d cycles per sample, %d per tick\n", CORE_CLOCK / SAMPLE_RATE,
+	       CORE_CLOCK / SAMPLE_RATE * SAMPLES_PER_TICK);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+// host benchmark and crash test of the flash page store (hardware/flash.c) and the spi sample flash (hardware/spi.c).
+// Builds the firmware's own flash.c and spi.c on top of the file backed flash model in flash_sim.c
+//
+//   make flash-bench      (from sw/nocube_makefile, FLASH_BENCH_ARGS="100000 5000" for more saves and crashes)
+//   flash_bench internal.bin spi.bin [saves] [crashes]
+//
+// - wear: erases per page after a mix of preset, pattern and sample info saves
+// - boot scan: init_flash() on the page store that wear left behind
+// - crash consistency: cuts the power at a random program or erase of a save, boots again and checks that the saved
+//   item reads back as its old or its new version, that sys_params is one of the two, and that nothing else changed.
+//   ECC isn't modelled: on the chip, reading a half programmed double word raises an ecc error instead
+// - spi: records a sample slot the way the sampler does and reads it back through spi_read() and the grain dma chain
+
+#include "flash_sim.h"
+#include "gfx/gfx.h"
+#include "hardware/adc_dac.h"
+#include "hardware/expander.h"
+#include "hardware/flash.h"
+#include "hardware/ram.h"
+#include "hardware/spi.h"
+#include "hardware/touchstrips.h"
+#include "synth/audio.h"
+#include "synth/params.h"
+#include "synth/sampler.h"
+#include <time.h>
+
+#define INT_BASE 0x08080000
+#define STORE_PAGES 255   // page 255 holds the calibration
+#define RATED_ERASES 10000 // stm32l476 page endurance
+#define HASH_CYCLES 6      // m4 cycles per byte of compute_hash() in flash.c, estimated
+#define CORE_CLOCK 112000000
+#define BOOTS 200
+#define SLOT_BYTES (2 * MAX_SAMPLE_LEN)
+#define GRAIN_SAMPLES 64
+
+// == FIRMWARE STUBS == //
+
+SPI_HandleTypeDef hspi2;
+SysParams sys_params;
+short* reverb_ram_buf;
+short* delay_ram_buf;
+int grain_pos[NUM_GRAINS];
+s16 grain_buf_end[NUM_GRAINS];
+
+static Preset init_preset;
+static TouchCalibData touch_calib_data[NUM_TOUCH_READINGS];
+static ADC_DAC_Calib adc_dac_calib[NUM_ADC_DAC_ITEMS];
+static s16 grain_buf[NUM_GRAINS * (GRAIN_SAMPLES + 2)];
+
+const Preset* init_params_ptr() {
+	return &init_preset;
+}
+TouchCalibData* touch_calib_ptr(void) {
+	return touch_calib_data;
+}
+void update_touch_calib_lut(void) {
+}
+ADC_DAC_Calib* adc_dac_calib_ptr(void) {
+	return adc_dac_calib;
+}
+void oled_clear(void) {
+}
+void oled_flip(void) {
+}
+int draw_str(int x, int y, Font f, const char* buf) {
+	return 0;
+}
+s16* grain_buf_ptr(void) {
+	return grain_buf;
+}
+int using_sampler(void) {
+	return 1;
+}
+u16 get_expander_lfo_data(u8 lfo_id) {
+	return 0;
+}
+
+// == PAGE STORE MODEL == //
+
+static u8 expected[NUM_FLASH_ITEMS][FLASH_PAGE_SIZE];
+static SysParams expected_sys;
+static u8 new_item[FLASH_PAGE_SIZE];
+static SysParams new_sys;
+
+static u32 lcg = 1;
+static u32 rnd(void) {
+	lcg = lcg * 1664525 + 1013904223;
+	return lcg;
+}
+
+static void fill_random(void* dst, u32 size) {
+	for (u32 i = 0; i < size; ++i)
+		((u8*)dst)[i] = rnd() >> 24;
+}
+
+static u64 now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const void* item_ptr(u8 item) {
+	if (item < PATTERNS_START)
+		return preset_flash_ptr(item);
+	if (item < F_SAMPLES_START)
+		return ptn_quarter_flash_ptr(item - PATTERNS_START);
+	return sample_info_flash_ptr(item - F_SAMPLES_START);
+}
+
+// flash_write_block() writes whole double words, the rest of the item stays erased
+static u32 item_size(u8 item) {
+	if (item < PATTERNS_START)
+		return sizeof(Preset) & ~7;
+	if (item < F_SAMPLES_START)
+		return sizeof(PatternQuarter) & ~7;
+	return sizeof(SampleInfo) & ~7;
+}
+
+// mostly presets, then pattern quarters, now and then a sample info
+static u8 random_item(void) {
+	u32 r = rnd() >> 16;
+	if (r % 10 < 6)
+		return r % NUM_PRESETS;
+	if (r % 10 < 9)
+		return PATTERNS_START + r % NUM_PTN_QUARTERS;
+	return F_SAMPLES_START + r % NUM_SAMPLES;
+}
+
+static void save_random(u8 item) {
+	fill_random(new_item, item_size(item));
+	fill_random(&new_sys, sizeof(SysParams));
+	sys_params = new_sys;
+	flash_write_page(new_item, item_size(item), item);
+}
+
+static void boot(void) {
+	flash_busy = false;
+	init_flash();
+}
+
+static void snapshot(void) {
+	for (u16 item = 0; item < NUM_FLASH_ITEMS; ++item)
+		memcpy(expected[item], item_ptr(item), item_size(item));
+	expected_sys = sys_params;
+}
+
+static u32 count_store_pages(void) {
+	u32 pages = 0;
+	for (u16 page = 0; page < STORE_PAGES; ++page) {
+		const u8* footer = (const u8*)(size_t)(INT_BASE + page * FLASH_PAGE_SIZE + FLASH_PAGE_SIZE - 8);
+		pages += footer[0] < NUM_FLASH_ITEMS && footer[1] >= 2;
+	}
+	return pages;
+}
+
+// == BENCHMARKS == //
+
+static void bench_wear(u32 saves) {
+	flash_sim_erase_all();
+	flash_sim_reset_stats();
+	boot();
+	u64 start_us = flash_sim_time_us();
+	for (u32 i = 0; i < saves; ++i)
+		save_random(random_item());
+	u64 busy_ms = (flash_sim_time_us() - start_us) / 1000;
+
+	const u32* counts = flash_sim_erase_counts(FSIM_INTERNAL);
+	u32 min_erases = ~0, max_erases = 0, total = 0;
+	for (u16 page = 0; page < STORE_PAGES; ++page) {
+		if (counts[page] < min_erases)
+			min_erases = counts[page];
+		if (counts[page] > max_erases)
+			max_erases = counts[page];
+		total += counts[page];
+	}
+	FlashSimStats stats;
+	flash_sim_stats(FSIM_INTERNAL, &stats);
+	printf("wear: %u saves, %.1f ms each, page erases min %u mean %.1f max %u, %u rejected programs\n", saves,
+	       (float)busy_ms / saves, min_erases, (float)total / STORE_PAGES, max_erases, stats.errors);
+	printf("      the most erased page reaches %u cycles after %.0f saves\n", RATED_ERASES,
+	       (double)saves * RATED_ERASES / maxi(max_erases, 1));
+}
+
+static void bench_boot(void) {
+	u32 pages = count_store_pages();
+	u64 start = now_ns();
+	for (u32 i = 0; i < BOOTS; ++i)
+		boot();
+	double host_us = (now_ns() - start) / 1000. / BOOTS;
+	double m4_ms = (double)pages * (FLASH_PAGE_SIZE - 8) * HASH_CYCLES / (CORE_CLOCK / 1000);
+	printf("boot scan: %u valid pages, host %.1f us, m4 est %.1f ms\n", pages, host_us, m4_ms);
+}
+
+static u32 check_items(u8 saved_item, bool* saved_is_new) {
+	u32 bad = 0;
+	for (u16 item = 0; item < NUM_FLASH_ITEMS; ++item) {
+		const void* now = item_ptr(item);
+		if (item == saved_item && !memcmp(now, new_item, item_size(item))) {
+			*saved_is_new = true;
+			continue;
+		}
+		bad += memcmp(now, expected[item], item_size(item)) != 0;
+	}
+	return bad;
+}
+
+static u32 bench_crashes(u32 crashes) {
+	static u32 lost, torn_sys, reverted, kept, cut;
+	static u8 item;
+	static bool powered_off;
+	flash_sim_erase_all();
+	boot();
+	// age the store a little first, so that saves reuse pages
+	for (u32 i = 0; i < 2 * STORE_PAGES; ++i)
+		save_random(random_item());
+	boot();
+	snapshot();
+	for (u32 trial = 0; trial < crashes; ++trial) {
+		item = random_item();
+		// one page erase, the item, sys_params and the footer, in double words. Some saves get to finish
+		u32 ops = 1 + item_size(item) / 8 + sizeof(SysParams) / 8 + 1;
+		powered_off = false;
+		if (setjmp(flash_sim_power_cut) == 0) {
+			flash_sim_cut_power_after(1 + rnd() % (ops + ops / 8), rnd());
+			save_random(item);
+			flash_sim_cut_power_after(0, 0);
+		}
+		else
+			powered_off = true;
+		cut += powered_off;
+		boot();
+		bool saved_is_new = false;
+		lost += check_items(item, &saved_is_new);
+		bool sys_ok = !memcmp(&sys_params, &new_sys, sizeof(SysParams));
+		sys_ok |= !memcmp(&sys_params, &expected_sys, sizeof(SysParams));
+		torn_sys += !sys_ok;
+		kept += powered_off && saved_is_new;
+		reverted += powered_off && !saved_is_new;
+		// a save that completed has to be there
+		lost += !powered_off && !saved_is_new;
+		snapshot();
+	}
+	printf("crashes: %u saves, %u lost power: %u kept the new version, %u the old one; %u bad items, %u bad sys_params\n",
+	       crashes, cut, kept, reverted, lost, torn_sys);
+	return lost + torn_sys;
+}
+
+static u32 bench_spi(void) {
+	static u8 page[256];
+	static u8 check[4096];
+	u32 slot = 1;
+	u32 base = slot * SLOT_BYTES;
+	flash_sim_reset_stats();
+	init_spi();
+	u64 start_us = flash_sim_time_us();
+	// the same erase and write pattern as recording a sample
+	for (u32 addr = 0; addr < SLOT_BYTES; addr += 65536)
+		spi_erase64k(base + addr, 0, 0);
+	u64 erase_us = flash_sim_time_us();
+	lcg = 12345;
+	for (u32 addr = 0; addr < SLOT_BYTES; addr += 256) {
+		fill_random(spi_bit_tx + 4, 256);
+		spi_write256(base + addr);
+	}
+	u64 write_us = flash_sim_time_us();
+
+	// read back in chunks, and through the grain dma chain
+	u32 bad = 0;
+	lcg = 12345;
+	for (u32 addr = 0; addr < SLOT_BYTES; addr += sizeof(check)) {
+		spi_read(base + addr, check, sizeof(check));
+		for (u32 i = 0; i < sizeof(check); i += 256) {
+			fill_random(page, 256);
+			bad += memcmp(check + i, page, 256) != 0;
+		}
+	}
+	u32 grain_bad = 0;
+	for (u8 g = 0; g < NUM_GRAINS; ++g) {
+		grain_pos[g] = base / 2 + rnd() % (SLOT_BYTES / 2 - GRAIN_SAMPLES);
+		grain_buf_end[g] = (g + 1) * (GRAIN_SAMPLES + 2);
+	}
+	spi_tick();
+	while (spi_state)
+		alex_dma_done();
+	for (u8 g = 0; g < NUM_GRAINS; ++g) {
+		spi_read(grain_pos[g] * 2, check, GRAIN_SAMPLES * 2);
+		// every grain starts with the two words clocked in during the read command
+		grain_bad += memcmp(grain_buf + g * (GRAIN_SAMPLES + 2) + 2, check, GRAIN_SAMPLES * 2) != 0;
+	}
+
+	FlashSimStats stats;
+	flash_sim_stats(FSIM_SPI, &stats);
+	printf("spi: %u KB slot erased in %.2f s, written in %.2f s, %u bad pages, %u bad grains, %u rejected commands\n",
+	       SLOT_BYTES / 1024, (erase_us - start_us) / 1e6, (write_us - erase_us) / 1e6, bad, grain_bad, stats.errors);
+	return bad + grain_bad + stats.errors;
+}
+
+int main(int argc, char** argv) {
+	const char* internal_path = argc > 1 ? argv[1] : "flash_internal.bin";
+	const char* spi_path = argc > 2 ? argv[2] : "flash_spi.bin";
+	u32 saves = argc > 3 ? atoi(argv[3]) : 20000;
+	u32 crashes = argc > 4 ? atoi(argv[4]) : 2000;
+	if (!flash_sim_open(internal_path, spi_path))
+		return 1;
+	fill_random(&init_preset, sizeof(init_preset));
+	bench_wear(saves);
+	bench_boot();
+	u32 failures = bench_crashes(crashes);
+	failures += bench_spi();
+	flash_sim_close();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,376 @@
+// host model of the internal flash page store and the spi sample flash, behind the hal calls that hardware/flash.c
+// and hardware/spi.c make. See flash_sim.h
+
+#include "flash_sim.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// internal flash, bank 2 (see FLASH_ADDR_256 in flash.c). Typical times from the stm32l476 datasheet
+#define INT_BASE 0x08080000
+#define INT_PAGES 256
+#define INT_PROGRAM_NS 82000     // 64 bit double word
+#define INT_ERASE_NS 22000000    // 2KB page
+
+// spi flash, two 16MB chips on the spi2 bus. Typical times of a W25Q128
+#define SPI_CHIP_SIZE (16 << 20)
+#define SPI_PAGE 256
+#define SPI_BLOCK 65536
+#define SPI_PROGRAM_NS 400000    // 256 byte page
+#define SPI_ERASE_NS 150000000   // 64KB block
+#define SPI_BYTE_NS 286          // 28MHz clock: apb1 / 2
+#define SPI_POLL_NS 100000       // status polls while busy skip ahead this far, instead of spinning byte by byte
+#define SPI_STATUS_BUSY 1
+#define SPI_STATUS_WEL 2
+
+typedef struct SimMem {
+	int fd;
+	u8* data;
+	u32 size;
+	u32 block_size;
+	u32* erase_counts;
+	FlashSimStats stats;
+} SimMem;
+
+typedef struct SpiChip {
+	bool selected;
+	bool wel; // write enable latch, set by command 6, cleared by every program or erase
+	u8 cmd;
+	u32 pos;  // bytes clocked in since the chip got selected
+	u32 addr; // 24 bit address of the command
+	u64 busy_until;
+	u8 page[SPI_PAGE]; // page program buffer
+} SpiChip;
+
+jmp_buf flash_sim_power_cut;
+
+static SimMem mems[FSIM_NUM_MEMS] = {{.fd = -1}, {.fd = -1}};
+static SpiChip chips[2];
+static u64 now_ns;
+static u32 ops;
+static u32 cut_at; // 0 when disarmed
+static u32 rng = 1;
+
+static u32 next_rand(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+// == FILES == //
+
+static bool map_file(SimMem* m, const char* path, u32 size, u32 block_size, void* addr) {
+	m->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (m->fd < 0) {
+		perror(path);
+		return false;
+	}
+	struct stat st;
+	fstat(m->fd, &st);
+	bool blank = st.st_size == 0;
+	if (ftruncate(m->fd, size) != 0) {
+		perror(path);
+		return false;
+	}
+	int flags = MAP_SHARED | (addr ? MAP_FIXED_NOREPLACE : 0);
+	m->data = mmap(addr, size, PROT_READ | PROT_WRITE, flags, m->fd, 0);
+	if (m->data == MAP_FAILED || (addr && m->data != addr)) {
+		fprintf(stderr, "%s: can't map at %p\n", path, addr);
+		m->data = 0;
+		return false;
+	}
+	m->size = size;
+	m->block_size = block_size;
+	m->erase_counts = calloc(size / block_size, sizeof(u32));
+	if (blank)
+		memset(m->data, 0xff, size);
+	return true;
+}
+
+bool flash_sim_open(const char* internal_path, const char* spi_path) {
+	memset(chips, 0, sizeof(chips));
+	return map_file(&mems[FSIM_INTERNAL], internal_path, INT_PAGES * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE,
+	                (void*)INT_BASE)
+	       && map_file(&mems[FSIM_SPI], spi_path, 2 * SPI_CHIP_SIZE, SPI_BLOCK, 0);
+}
+
+void flash_sim_close(void) {
+	for (u8 i = 0; i < FSIM_NUM_MEMS; ++i) {
+		SimMem* m = &mems[i];
+		if (m->data)
+			munmap(m->data, m->size);
+		if (m->fd >= 0)
+			close(m->fd);
+		free(m->erase_counts);
+		*m = (SimMem){.fd = -1};
+	}
+}
+
+void flash_sim_erase_all(void) {
+	for (u8 i = 0; i < FSIM_NUM_MEMS; ++i)
+		memset(mems[i].data, 0xff, mems[i].size);
+}
+
+// == TIME, STATS == //
+
+u64 flash_sim_time_us(void) {
+	return now_ns / 1000;
+}
+
+void flash_sim_advance_us(u64 us) {
+	now_ns += us * 1000;
+}
+
+void flash_sim_cut_power_after(u32 num_ops, u32 seed) {
+	cut_at = num_ops ? ops + num_ops : 0;
+	rng = seed ? seed : 1;
+}
+
+u32 flash_sim_ops(void) {
+	return ops;
+}
+
+void flash_sim_stats(FlashSimMem mem, FlashSimStats* stats) {
+	SimMem* m = &mems[mem];
+	*stats = m->stats;
+	stats->blocks = m->size / m->block_size;
+	stats->min_erases = ~0;
+	stats->max_erases = 0;
+	u64 total = 0;
+	for (u32 i = 0; i < stats->blocks; ++i) {
+		u32 count = m->erase_counts[i];
+		if (count < stats->min_erases)
+			stats->min_erases = count;
+		if (count > stats->max_erases)
+			stats->max_erases = count;
+		total += count;
+	}
+	stats->mean_erases = (float)total / stats->blocks;
+}
+
+const u32* flash_sim_erase_counts(FlashSimMem mem) {
+	return mems[mem].erase_counts;
+}
+
+void flash_sim_reset_stats(void) {
+	for (u8 i = 0; i < FSIM_NUM_MEMS; ++i) {
+		memset(&mems[i].stats, 0, sizeof(FlashSimStats));
+		memset(mems[i].erase_counts, 0, mems[i].size / mems[i].block_size * sizeof(u32));
+	}
+}
+
+// == OPERATIONS == //
+
+// every program and erase counts as one op, the armed one loses power halfway through
+static bool power_fails(void) {
+	return ++ops == cut_at;
+}
+
+static void power_cut(void) {
+	cut_at = 0;
+	memset(chips, 0, sizeof(chips));
+	longjmp(flash_sim_power_cut, 1);
+}
+
+static void erase_block(FlashSimMem mem, u32 block, u64 duration_ns) {
+	SimMem* m = &mems[mem];
+	u8* dst = m->data + block * m->block_size;
+	m->erase_counts[block]++;
+	m->stats.erases++;
+	m->stats.busy_us += duration_ns / 1000;
+	if (power_fails()) {
+		// half erased: every double word is either erased or still holds its old value
+		for (u32 i = 0; i < m->block_size; i += 8)
+			if (next_rand() & 1)
+				memset(dst + i, 0xff, 8);
+		power_cut();
+	}
+	memset(dst, 0xff, m->block_size);
+}
+
+// programming can only clear bits
+static void program(FlashSimMem mem, u32 offset, const u8* src, u32 len, u64 duration_ns) {
+	SimMem* m = &mems[mem];
+	u8* dst = m->data + offset;
+	m->stats.programs++;
+	m->stats.busy_us += duration_ns / 1000;
+	if (power_fails()) {
+		// half programmed: some of the bits that should have been cleared still read as 1
+		for (u32 i = 0; i < len; ++i)
+			dst[i] &= src[i] | (u8)next_rand();
+		power_cut();
+	}
+	for (u32 i = 0; i < len; ++i)
+		dst[i] &= src[i];
+}
+
+// == INTERNAL FLASH HAL == //
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+	return HAL_OK;
+}
+
+// every operation completes before its call returns, its busy time is already on the clock
+HAL_StatusTypeDef FLASH_WaitForLastOperation(uint32_t Timeout) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+	SimMem* m = &mems[FSIM_INTERNAL];
+	if (TypeProgram != FLASH_TYPEPROGRAM_DOUBLEWORD || Address < INT_BASE || Address >= INT_BASE + m->size
+	    || (Address & 7)) {
+		m->stats.errors++;
+		return HAL_ERROR;
+	}
+	u32 offset = Address - INT_BASE;
+	u64 old;
+	memcpy(&old, m->data + offset, 8);
+	// PROGERR: a double word has to be erased before it gets programmed, unless it gets programmed to all zeros
+	if (old != ~(u64)0 && Data != 0) {
+		m->stats.errors++;
+		return HAL_ERROR;
+	}
+	now_ns += INT_PROGRAM_NS;
+	program(FSIM_INTERNAL, offset, (const u8*)&Data, 8, INT_PROGRAM_NS);
+	return HAL_OK;
+}
+
+// only bank 2 is modelled, that is where the page store lives
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError) {
+	*PageError = 0xffffffff;
+	if (pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES || pEraseInit->Banks != FLASH_BANK_2) {
+		mems[FSIM_INTERNAL].stats.errors++;
+		return HAL_ERROR;
+	}
+	for (u32 page = pEraseInit->Page; page < pEraseInit->Page + pEraseInit->NbPages; ++page) {
+		if (page >= INT_PAGES) {
+			*PageError = page;
+			return HAL_ERROR;
+		}
+		now_ns += INT_ERASE_NS;
+		erase_block(FSIM_INTERNAL, page, INT_ERASE_NS);
+	}
+	return HAL_OK;
+}
+
+// == SPI FLASH HAL == //
+
+static u32 chip_base(SpiChip* c) {
+	return (c - chips) * SPI_CHIP_SIZE;
+}
+
+static u8 spi_clock_byte(SpiChip* c, u8 tx) {
+	u32 pos = c->pos++;
+	bool busy = now_ns < c->busy_until;
+	if (pos == 0) {
+		c->cmd = tx;
+		c->addr = 0;
+		memset(c->page, 0xff, SPI_PAGE);
+		// a busy chip only answers status reads
+		if (busy && tx != 5) {
+			mems[FSIM_SPI].stats.errors++;
+			c->cmd = 0;
+		}
+		return 0xff;
+	}
+	if (c->cmd == 5) {
+		// status reads are how the firmware waits, skip ahead instead of spinning
+		if (busy)
+			now_ns = c->busy_until - now_ns > SPI_POLL_NS ? now_ns + SPI_POLL_NS : c->busy_until;
+		return (busy ? SPI_STATUS_BUSY : 0) | (c->wel ? SPI_STATUS_WEL : 0);
+	}
+	if (pos < 4) {
+		c->addr = (c->addr << 8) | tx;
+		return 0xff;
+	}
+	switch (c->cmd) {
+	case 0x90: // manufacturer and device id
+		return (pos & 1) ? 0x17 : 0xef;
+	case 0x03: // read, wraps around at the end of the chip
+		return mems[FSIM_SPI].data[chip_base(c) + (c->addr++ & (SPI_CHIP_SIZE - 1))];
+	case 0x02: // page program, wraps around within the page
+		c->page[(c->addr + pos - 4) & (SPI_PAGE - 1)] = tx;
+		return 0xff;
+	}
+	return 0xff;
+}
+
+// programs and erases start when the chip select goes high
+static void spi_end_command(SpiChip* c) {
+	u8 cmd = c->cmd;
+	bool complete = c->pos >= ((cmd == 0x02) ? 5 : 4);
+	c->pos = 0;
+	c->cmd = 0;
+	if (cmd == 0x06) {
+		c->wel = true;
+		return;
+	}
+	if ((cmd != 0x02 && cmd != 0xd8) || !complete)
+		return;
+	if (!c->wel) {
+		mems[FSIM_SPI].stats.errors++;
+		return;
+	}
+	c->wel = false;
+	u32 addr = chip_base(c) + (c->addr & (SPI_CHIP_SIZE - 1));
+	if (cmd == 0xd8) {
+		c->busy_until = now_ns + SPI_ERASE_NS;
+		erase_block(FSIM_SPI, addr / SPI_BLOCK, SPI_ERASE_NS);
+	}
+	else {
+		c->busy_until = now_ns + SPI_PROGRAM_NS;
+		program(FSIM_SPI, addr & ~(SPI_PAGE - 1), c->page, SPI_PAGE, SPI_PROGRAM_NS);
+	}
+}
+
+// the flash chip selects are active low on port e: pin 1 for chip 0, pin 0 for chip 1. The expander dac isn't modelled
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+	if (GPIOx != GPIOE)
+		return;
+	for (u8 chip = 0; chip < 2; ++chip) {
+		SpiChip* c = &chips[chip];
+		if (!(GPIO_Pin & (chip ? GPIO_PIN_0 : GPIO_PIN_1)))
+			continue;
+		bool select = PinState == GPIO_PIN_RESET;
+		if (select && !c->selected)
+			c->pos = 0;
+		if (!select && c->selected) {
+			c->selected = false;
+			spi_end_command(c);
+		}
+		c->selected = select;
+	}
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size,
+                                          uint32_t Timeout) {
+	for (u16 i = 0; i < Size; ++i) {
+		now_ns += SPI_BYTE_NS;
+		u8 rx = 0xff;
+		for (u8 chip = 0; chip < 2; ++chip)
+			if (chips[chip].selected)
+				rx &= spi_clock_byte(&chips[chip], pTxData[i]);
+		pRxData[i] = rx;
+	}
+	return HAL_OK;
+}
+
+// == TICKS == //
+
+uint32_t HAL_GetTick(void) {
+	return now_ns / 1000000;
+}
+
+void HAL_Delay(uint32_t Delay) {
+	now_ns += (u64)Delay * 1000000;
+}
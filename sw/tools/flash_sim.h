@@ -0,0 +1,49 @@
+#pragma once
+#include "utils.h"
+#include <setjmp.h>
+
+// file backed model of plinky's two flash memories, for host builds of hardware/flash.c and hardware/spi.c. The model
+// sits behind the hal calls those files make (flash programming, spi transfers, chip selects, ticks), so the firmware
+// code runs unchanged apart from a few register accesses that have host branches
+//
+// - internal: bank 2 of the stm32l476, 256 pages of 2KB, mapped at its real address so the page store's pointers work
+//   as they are. Programs 64 bit double words, a double word has to be erased before it can be programmed again
+// - spi: 2 x 16MB nor flash, 256 byte page programs that can only clear bits, 64KB block erases, busy status polling
+//
+// both advance a virtual clock by the typical busy time of every operation, count the erases of every block, and can
+// cut the power at any program or erase: that operation is left half done and the sim longjmps to flash_sim_power_cut
+
+typedef enum FlashSimMem {
+	FSIM_INTERNAL,
+	FSIM_SPI,
+	FSIM_NUM_MEMS,
+} FlashSimMem;
+
+typedef struct FlashSimStats {
+	u32 programs; // double words (internal) or pages (spi)
+	u32 erases;
+	u32 errors; // rejected: programs of memory that isn't erased, spi writes without write enable or while busy
+	u32 blocks;
+	u32 min_erases; // per erase block
+	u32 max_erases;
+	float mean_erases;
+	u64 busy_us; // virtual time spent programming and erasing
+} FlashSimStats;
+
+extern jmp_buf flash_sim_power_cut;
+
+// maps both files, creating erased ones where they are missing
+bool flash_sim_open(const char* internal_path, const char* spi_path);
+void flash_sim_close(void);
+void flash_sim_erase_all(void);
+
+u64 flash_sim_time_us(void);
+void flash_sim_advance_us(u64 us);
+
+// the power drops during the ops-th program or erase from now, 0 disarms. Returns through flash_sim_power_cut
+void flash_sim_cut_power_after(u32 ops, u32 seed);
+u32 flash_sim_ops(void); // programs and erases so far, of both memories
+
+void flash_sim_stats(FlashSimMem mem, FlashSimStats* stats);
+const u32* flash_sim_erase_counts(FlashSimMem mem);
+void flash_sim_reset_stats(void);
@@ -0,0 +1,404 @@
+#!/usr/bin/env python3
+# backs up a whole plinky (presets, pattern quarters, sample infos, sys params and sample audio) into one archive,
+# restores it, and packs, unpacks, verifies and diffs archives. See bulk_protocol.c for the usb side
+#
+#   python3 plinky_bank.py backup studio.plkb
+#   python3 plinky_bank.py restore studio.plkb --only presets,samples
+#   python3 plinky_bank.py unpack studio.plkb studio/     one file per item, sample audio as mono wav
+#   python3 plinky_bank.py pack studio/ studio.plkb
+#   python3 plinky_bank.py verify studio.plkb
+#   python3 plinky_bank.py diff old.plkb new.plkb
+#
+# archive format, version 1, little endian:
+#   header   '4sHH4H': magic 'PLKB', format version, number of sections, then the sizes of Preset, PatternQuarter,
+#            SampleInfo and SysParams of the firmware it was made on. A restore needs the same sizes
+#   section  'BBBxIII': kind (0 item, 1 sample audio), id (bulk item 0-136 or sample slot 0-7), codec, raw length,
+#            stored length, crc32 of the raw bytes. Then the stored bytes
+#   trailer  u32 crc32 of everything before it
+# codecs: 0 stored, 1 zlib, 2 audio: first differences of the 16 bit samples, low bytes then high bytes, zlib.
+# Audio only covers the used length of a slot, so a backup moves what is there rather than 4MB per slot.
+# Needs numpy, and pyusb for backup and restore
+
+import argparse
+import json
+import os
+import struct
+import sys
+import time
+import wave
+import zlib
+
+import numpy as np
+
+MAGIC = b'PLKB'
+VERSION = 1
+ARCHIVE_HEADER = struct.Struct('<4sHH4H')
+SECTION = struct.Struct('<BBBxIII')
+KIND_ITEM, KIND_AUDIO = range(2)
+CODEC_STORED, CODEC_ZLIB, CODEC_AUDIO = range(3)
+
+NUM_PRESETS = 32
+NUM_PTN_QUARTERS = 96
+NUM_SAMPLES = 8
+PATTERNS_START = NUM_PRESETS
+SAMPLES_START = PATTERNS_START + NUM_PTN_QUARTERS
+SYS_ITEM = SAMPLES_START + NUM_SAMPLES
+NUM_ITEMS = SYS_ITEM + 1
+SAMPLELEN_OFFSET = 1024 + 8 * 4  # SampleInfo: waveform4_b[1024], splitpoints[8], samplelen
+MAX_SAMPLE_LEN = 1024 * 1024 * 2
+SAMPLE_RATE = 31250
+
+BULK_HELLO = 0
+BULK_READ = 1
+BULK_DATA = 2
+BULK_END = 3
+BULK_ACK = 4
+BULK_NAK = 5
+BULK_AUDIO_READ = 11
+BULK_AUDIO_DATA = 12
+BULK_INFO = struct.Struct('<BBHBBBBHHHHH')
+ERRORS = ['ok', 'crc', 'unknown command', 'bad item', 'bad length', 'out of order', 'full', 'trace', 'flash']
+MAX_RETRIES = 8
+
+
+def item_name(item):
+    if item < PATTERNS_START:
+        return f'preset_{item:02d}'
+    if item < SAMPLES_START:
+        return f'pattern_quarter_{item - PATTERNS_START:02d}'
+    if item < SYS_ITEM:
+        return f'sample_info_{item - SAMPLES_START}'
+    return 'sys_params'
+
+
+def item_category(item):
+    if item < PATTERNS_START:
+        return 'presets'
+    if item < SAMPLES_START:
+        return 'patterns'
+    return 'samples' if item < SYS_ITEM else 'sys'
+
+
+def sample_len(info):
+    (length,) = struct.unpack_from('<i', info, SAMPLELEN_OFFSET)
+    return length if 0 < length <= MAX_SAMPLE_LEN else 0
+
+
+# == ARCHIVE == #
+
+def encode(kind, raw):
+    if kind == KIND_AUDIO:
+        samples = np.frombuffer(raw, dtype='<i2')
+        deltas = np.diff(samples, prepend=np.int16(0)).astype('<i2').view(np.uint8)
+        return CODEC_AUDIO, zlib.compress(np.concatenate((deltas[0::2], deltas[1::2])).tobytes(), 9)
+    packed = zlib.compress(raw, 9)
+    return (CODEC_ZLIB, packed) if len(packed) < len(raw) else (CODEC_STORED, raw)
+
+
+def decode(codec, stored):
+    if codec == CODEC_STORED:
+        return stored
+    raw = zlib.decompress(stored)
+    if codec == CODEC_AUDIO:
+        planes = np.frombuffer(raw, dtype=np.uint8)
+        half = len(planes) // 2
+        deltas = np.empty(len(planes), dtype=np.uint8)
+        deltas[0::2] = planes[:half]
+        deltas[1::2] = planes[half:]
+        raw = np.cumsum(deltas.view('<i2'), dtype=np.int16).astype('<i2').tobytes()
+    return raw
+
+
+def write_archive(path, sizes, items, audio):
+    """items: {bulk item: bytes}, audio: {slot: bytes}"""
+    sections = [(KIND_ITEM, i, items[i]) for i in sorted(items)] + [(KIND_AUDIO, s, audio[s]) for s in sorted(audio)]
+    body = bytearray(ARCHIVE_HEADER.pack(MAGIC, VERSION, len(sections), *sizes))
+    for kind, section_id, raw in sections:
+        codec, stored = encode(kind, raw)
+        body += SECTION.pack(kind, section_id, codec, len(raw), len(stored), zlib.crc32(raw)) + stored
+    body += struct.pack('<I', zlib.crc32(body))
+    with open(path, 'wb') as f:
+        f.write(body)
+    return len(body)
+
+
+def read_archive(path):
+    """returns sizes, items, audio and a list of problems, exits if the file isn't a readable archive"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < ARCHIVE_HEADER.size + 4:
+        sys.exit(f'{path}: too short')
+    magic, version, num_sections, *sizes = ARCHIVE_HEADER.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit(f'{path}: not a plinky bank archive')
+    if version > VERSION:
+        sys.exit(f'{path}: format version {version}, this tool reads up to {VERSION}')
+    problems = []
+    (crc,) = struct.unpack_from('<I', data, len(data) - 4)
+    if crc != zlib.crc32(data[:-4]):
+        problems.append('archive crc mismatch')
+    items, audio = {}, {}
+    pos = ARCHIVE_HEADER.size
+    for _ in range(num_sections):
+        if pos + SECTION.size > len(data) - 4:
+            problems.append('archive ends inside a section')
+            break
+        kind, section_id, codec, raw_len, stored_len, raw_crc = SECTION.unpack_from(data, pos)
+        pos += SECTION.size
+        name = item_name(section_id) if kind == KIND_ITEM else f'sample_{section_id} audio'
+        try:
+            raw = decode(codec, data[pos:pos + stored_len])
+        except zlib.error:
+            raw = b''
+        pos += stored_len
+        if len(raw) != raw_len or zlib.crc32(raw) != raw_crc:
+            problems.append(f'{name}: crc mismatch')
+            continue
+        (items if kind == KIND_ITEM else audio)[section_id] = raw
+    return sizes, items, audio, problems
+
+
+def load_valid(path):
+    sizes, items, audio, problems = read_archive(path)
+    if problems:
+        sys.exit(f'{path}: ' + ', '.join(problems))
+    return sizes, items, audio
+
+
+# == DEVICE == #
+
+class Session:
+    """bulk protocol exchanges on top of plinky_trace.Device"""
+
+    def __init__(self):
+        from plinky_trace import Device
+        self.dev = Device()
+        self.queue = []
+        self.send(BULK_HELLO)
+        payload = self.receive((BULK_HELLO,))[3]
+        if len(payload) < BULK_INFO.size or payload[0] < 2:
+            sys.exit('the firmware is too old, it can\'t move sample audio')
+        (_, self.window, self.chunk_size, _, _, _, _, *sizes, self.slot_pages) = BULK_INFO.unpack_from(payload)
+        self.sizes = tuple(sizes)
+
+    def close(self):
+        self.dev.close()
+
+    def send(self, cmd, item=0, arg=0, payload=b''):
+        from plinky_telemetry import EP_OUT, frame
+        self.dev.dev.write(EP_OUT, frame(cmd, item, arg, payload))
+
+    def receive(self, cmds):
+        deadline = time.time() + 5
+        while time.time() < deadline:
+            while self.queue:
+                answer = self.queue.pop(0)
+                if answer[0] in cmds:
+                    return answer
+            self.queue += self.dev.poll()
+        sys.exit('no answer from the plinky')
+
+    def read(self, request, data_cmd, item, count):
+        """streams DATA or AUDIO_DATA frames until END, returns {item: {arg: payload}}"""
+        self.send(request, item, count)
+        chunks = {}
+        while True:
+            cmd, item, arg, payload = self.receive((data_cmd, BULK_END, BULK_NAK))
+            if cmd == BULK_NAK:
+                sys.exit(f'read refused: {ERRORS[arg]}')
+            if cmd == BULK_END:
+                return chunks
+            chunks.setdefault(item, {})[arg] = payload
+
+    def write(self, frames, restart):
+        """sends (cmd, item, arg, payload) frames, at most window of them unanswered. After a nak every frame behind
+        it gets rejected as well, sending starts over at restart(index of the rejected frame)"""
+        acked = sent = retries = 0
+        while acked < len(frames):
+            while sent < len(frames) and sent - acked < self.window:
+                self.send(*frames[sent])
+                sent += 1
+            cmd, _, arg, _ = self.receive((BULK_ACK, BULK_NAK))
+            if cmd == BULK_ACK:
+                acked += 1
+                continue
+            retries += 1
+            if retries > MAX_RETRIES:
+                sys.exit(f'write failed: {ERRORS[arg] if arg < len(ERRORS) else arg}')
+            for _ in range(sent - acked - 1):
+                self.receive((BULK_ACK, BULK_NAK))
+            acked = sent = restart(acked)
+
+    def write_item(self, item, data):
+        size = self.chunk_size
+        frames = [(BULK_DATA, item, pos, data[pos:pos + size]) for pos in range(0, len(data), size)]
+        self.write(frames, lambda rejected: 0)
+
+    def write_audio(self, slot, data):
+        data += b'\xff' * (-len(data) % self.chunk_size)  # erased flash stays untouched
+        frames = [(BULK_AUDIO_DATA, slot, page, data[page * self.chunk_size:(page + 1) * self.chunk_size])
+                  for page in range(len(data) // self.chunk_size)]
+        self.write(frames, lambda rejected: rejected)
+
+
+def backup(args):
+    start = time.time()
+    session = Session()
+    try:
+        chunks = session.read(BULK_READ, BULK_DATA, 0, NUM_ITEMS)
+        items = {item: b''.join(parts[k] for k in sorted(parts)) for item, parts in chunks.items()}
+        audio = {}
+        for slot in range(NUM_SAMPLES):
+            length = sample_len(items.get(SAMPLES_START + slot, b''))
+            if not length:
+                continue
+            pages = -(-length * 2 // session.chunk_size)
+            parts = session.read(BULK_AUDIO_READ, BULK_AUDIO_DATA, slot, pages).get(slot, {})
+            audio[slot] = b''.join(parts[k] for k in sorted(parts))[:length * 2]
+            print(f'sample {slot}: {length / SAMPLE_RATE:.1f} s')
+    finally:
+        session.close()
+    size = write_archive(args.archive, session.sizes, items, audio)
+    print(f'{len(items)} items, {len(audio)} samples, {size / 1024:.0f} KB in {time.time() - start:.1f} s')
+
+
+def restore(args):
+    sizes, items, audio = load_valid(args.archive)
+    only = set(args.only.split(','))
+    start = time.time()
+    session = Session()
+    try:
+        if session.sizes != tuple(sizes):
+            sys.exit('the archive was made on a firmware with different item sizes')
+        order = [i for i in sorted(items) if item_category(i) in only and i != SYS_ITEM]
+        # the audio of a slot goes first, its sample info makes it visible
+        for slot in sorted(audio) if 'samples' in only else []:
+            print(f'sample {slot}: {len(audio[slot]) / 2 / SAMPLE_RATE:.1f} s')
+            session.write_audio(slot, audio[slot])
+            if SAMPLES_START + slot in items:
+                session.write_item(SAMPLES_START + slot, items[SAMPLES_START + slot])
+                order.remove(SAMPLES_START + slot)
+        for item in order:
+            session.write_item(item, items[item])
+        if 'sys' in only and SYS_ITEM in items:
+            session.write_item(SYS_ITEM, items[SYS_ITEM])
+    finally:
+        session.close()
+    print(f'restored in {time.time() - start:.1f} s')
+
+
+# == FILES == #
+
+def unpack(args):
+    sizes, items, audio = load_valid(args.archive)
+    os.makedirs(args.dir, exist_ok=True)
+    with open(os.path.join(args.dir, 'manifest.json'), 'w') as f:
+        json.dump({'version': VERSION, 'sizes': dict(zip(('preset', 'pattern_quarter', 'sample_info', 'sys_params'),
+                                                          sizes))}, f, indent=2)
+    for item, data in items.items():
+        with open(os.path.join(args.dir, item_name(item) + '.bin'), 'wb') as f:
+            f.write(data)
+    for slot, data in audio.items():
+        with wave.open(os.path.join(args.dir, f'sample_{slot}.wav'), 'wb') as f:
+            f.setnchannels(1)
+            f.setsampwidth(2)
+            f.setframerate(SAMPLE_RATE)
+            f.writeframes(data)
+    print(f'{len(items)} items, {len(audio)} samples')
+
+
+def pack(args):
+    with open(os.path.join(args.dir, 'manifest.json')) as f:
+        manifest = json.load(f)
+    sizes = [manifest['sizes'][k] for k in ('preset', 'pattern_quarter', 'sample_info', 'sys_params')]
+    items, audio = {}, {}
+    for item in range(NUM_ITEMS):
+        path = os.path.join(args.dir, item_name(item) + '.bin')
+        if not os.path.exists(path):
+            continue
+        with open(path, 'rb') as f:
+            items[item] = f.read()
+        size = sizes[['presets', 'patterns', 'samples', 'sys'].index(item_category(item))]
+        if len(items[item]) != size:
+            sys.exit(f'{path}: {len(items[item])} bytes, expected {size}')
+    for slot in range(NUM_SAMPLES):
+        path = os.path.join(args.dir, f'sample_{slot}.wav')
+        if not os.path.exists(path):
+            continue
+        with wave.open(path, 'rb') as f:
+            if f.getnchannels() != 1 or f.getsampwidth() != 2:
+                sys.exit(f'{path}: needs to be mono 16 bit')
+            audio[slot] = f.readframes(f.getnframes())[:MAX_SAMPLE_LEN * 2]
+        info = items.get(SAMPLES_START + slot)
+        if info and sample_len(info) != len(audio[slot]) // 2:
+            print(f'{path}: {len(audio[slot]) // 2} samples, its sample info says {sample_len(info)}')
+    size = write_archive(args.archive, sizes, items, audio)
+    print(f'{len(items)} items, {len(audio)} samples, {size / 1024:.0f} KB')
+
+
+def verify(args):
+    sizes, items, audio, problems = read_archive(args.archive)
+    for problem in problems:
+        print(problem)
+    counts = {c: sum(item_category(i) == c for i in items) for c in ('presets', 'patterns', 'samples', 'sys')}
+    seconds = sum(len(a) for a in audio.values()) / 2 / SAMPLE_RATE
+    print(f'{counts["presets"]} presets, {counts["patterns"]} pattern quarters, {counts["samples"]} sample infos, '
+          f'{"sys params, " if counts["sys"] else ""}{len(audio)} samples ({seconds:.1f} s of audio)')
+    print(f'item sizes {sizes}')
+    print('ok' if not problems else f'{len(problems)} problems')
+    sys.exit(1 if problems else 0)
+
+
+def diff(args):
+    sizes_a, items_a, audio_a = load_valid(args.archive)
+    sizes_b, items_b, audio_b = load_valid(args.other)
+    if sizes_a != sizes_b:
+        print(f'item sizes differ: {sizes_a} vs {sizes_b}')
+    changes = 0
+    for item in sorted(set(items_a) | set(items_b)):
+        a, b = items_a.get(item), items_b.get(item)
+        if a == b:
+            continue
+        changes += 1
+        if a is None or b is None:
+            print(f'{item_name(item)}: only in {args.other if a is None else args.archive}')
+            continue
+        differing = sum(x != y for x, y in zip(a, b)) + abs(len(a) - len(b))
+        print(f'{item_name(item)}: {differing} bytes differ')
+    for slot in sorted(set(audio_a) | set(audio_b)):
+        a, b = audio_a.get(slot), audio_b.get(slot)
+        if a == b:
+            continue
+        changes += 1
+        if a is None or b is None:
+            print(f'sample_{slot} audio: only in {args.other if a is None else args.archive}')
+            continue
+        sa, sb = np.frombuffer(a, dtype='<i2'), np.frombuffer(b, dtype='<i2')
+        n = min(len(sa), len(sb))
+        delta = np.abs(sa[:n].astype(np.int32) - sb[:n])
+        print(f'sample_{slot} audio: {len(sa)} vs {len(sb)} samples, {np.count_nonzero(delta)} differ, '
+              f'max difference {delta.max() if n else 0}')
+    print(f'{changes} differences')
+    sys.exit(1 if changes else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='back up, restore and inspect whole plinky banks')
+    parser.add_argument('mode', choices=('backup', 'restore', 'unpack', 'pack', 'verify', 'diff'))
+    parser.add_argument('paths', nargs='+', help='archive, then the directory (unpack), or the directory, then the '
+                                                 'archive (pack), or two archives (diff)')
+    parser.add_argument('--only', default='presets,patterns,samples,sys',
+                        help='restore: comma separated list of presets, patterns, samples, sys')
+    args = parser.parse_args()
+    if args.mode == 'pack':
+        args.paths.reverse()
+    args.archive = args.paths[0]
+    args.dir = args.other = args.paths[1] if len(args.paths) > 1 else None
+    if args.mode in ('unpack', 'pack', 'diff') and len(args.paths) != 2:
+        parser.error(f'{args.mode} needs two paths')
+    {'backup': backup, 'restore': restore, 'unpack': unpack, 'pack': pack, 'verify': verify, 'diff': diff}[
+        args.mode](args)
+
+
+if __name__ == '__main__':
+    main()
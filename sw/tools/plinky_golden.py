@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+# renders a corpus of cases with the host build of the synth engine and compares them bit for bit against stored
+# reference renders. A case is a preset, a rand seed and a midi script, see synth_render.c for how it gets played
+#
+#   make synth-render                                          (from sw/nocube_makefile, once)
+#   python3 plinky_golden.py record cases.json refs/          (re)writes the references
+#   python3 plinky_golden.py check cases.json refs/           renders every case and compares it
+#
+# the corpus in golden/ starts from erased flash and runs from sw/nocube_makefile with make golden, or
+# make golden GOLDEN_MODE=record to rewrite its references after an intended change in the sound
+#
+# cases.json holds a list of cases, event times are in seconds from the start of the render:
+#   [{"name": "pad_chord", "preset": 3, "seed": 1, "seconds": 4,
+#     "events": [[0.0, "note_on", 60, 100], [0.5, "cc", 64, 127], [2.0, "note_off", 60]]}]
+#
+# the render runs offline in virtual time, so the same case gives the same bits every time and any difference is a
+# change in the engine. check also records an input trace of every case and replays it (see input_trace.h), which has
+# to match the hashes and the audio of the recording. The cases render and compare in parallel on all host cores.
+# Needs numpy
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import wave
+from multiprocessing import Pool
+
+import numpy as np
+
+SAMPLE_RATE = 31250
+CHANNELS = 2
+RENDER_BIN = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'nocube_makefile', 'RELEASE',
+                          'synth_render')
+
+
+def read_wav(path):
+    with wave.open(path, 'rb') as f:
+        data = np.frombuffer(f.readframes(f.getnframes()), dtype='<i2')
+        return data.reshape(-1, f.getnchannels())
+
+
+def write_wav(path, frames):
+    with wave.open(path, 'wb') as f:
+        f.setnchannels(CHANNELS)
+        f.setsampwidth(2)
+        f.setframerate(SAMPLE_RATE)
+        f.writeframes(frames.astype('<i2').tobytes())
+
+
+# == RENDERING == #
+
+def midi_bytes(event, channel):
+    kind, args = event[1], event[2:]
+    if kind == 'note_on':
+        return 0x90 | channel, args[0], args[1]
+    if kind == 'note_off':
+        return 0x80 | channel, args[0], 0
+    if kind == 'cc':
+        return 0xB0 | channel, args[0], args[1]
+    if kind == 'pitchbend':
+        bend = args[0] + 8192
+        return 0xE0 | channel, bend & 0x7F, bend >> 7
+    if kind == 'pressure':
+        return 0xD0 | channel, args[0], 0
+    if kind == 'program':
+        return 0xC0 | channel, args[0], 0
+    raise ValueError(f'unknown event {kind}')
+
+
+def copy_flash(tmp, args):
+    """every run gets its own copy of the flash, the firmware may write to it"""
+    internal, spi = os.path.join(tmp, 'internal.bin'), os.path.join(tmp, 'spi.bin')
+    for path in internal, spi:
+        if os.path.exists(path):
+            os.remove(path)
+    if args.flash:
+        shutil.copy(args.flash[0], internal)
+        shutil.copy(args.flash[1], spi)
+    return internal, spi
+
+
+def render_cmd(case, internal, spi, raw, args):
+    events = ''.join('%d %d %d %d\n' % ((round(e[0] * 1e6),) + midi_bytes(e, args.channel))
+                     for e in case['events'])
+    frames = round(case['seconds'] * SAMPLE_RATE)
+    return [args.render_bin, internal, spi, str(case['preset']), str(case.get('seed', 1)), str(frames), raw], events
+
+
+def render_case(job):
+    """renders one case into out_path, returns an error message or None"""
+    case, out_path, args = job
+    with tempfile.TemporaryDirectory() as tmp:
+        internal, spi = copy_flash(tmp, args)
+        raw = os.path.join(tmp, 'out.raw')
+        cmd, events = render_cmd(case, internal, spi, raw, args)
+        result = subprocess.run(cmd, input=events, capture_output=True, text=True)
+        if result.returncode:
+            return f'render failed: {result.stderr.strip()}'
+        write_wav(out_path, np.fromfile(raw, dtype='<i2').reshape(-1, CHANNELS))
+    return None
+
+
+def replay_case(job):
+    """records a trace of one case and replays it, returns an error message or None"""
+    case, args = job
+    with tempfile.TemporaryDirectory() as tmp:
+        internal, spi = copy_flash(tmp, args)
+        raw, trace, replayed = (os.path.join(tmp, name) for name in ('out.raw', 'out.trace', 'replay.raw'))
+        cmd, events = render_cmd(case, internal, spi, raw, args)
+        result = subprocess.run(cmd + [trace], input=events, capture_output=True, text=True)
+        if result.returncode:
+            return f'render failed: {result.stderr.strip()}'
+        internal, spi = copy_flash(tmp, args)
+        result = subprocess.run([args.render_bin, internal, spi, '--replay', trace, replayed], capture_output=True,
+                                text=True)
+        if result.returncode:
+            return f'replay {result.stdout.strip() or result.stderr.strip()}'
+        # the replay plays whole ticks
+        recorded = np.fromfile(raw, dtype='<i2')
+        if not np.array_equal(recorded, np.fromfile(replayed, dtype='<i2')[:len(recorded)]):
+            return 'replay matches its hashes, but not the audio of the recording'
+    return None
+
+
+def render_all(cases, out_dir, pool, args):
+    os.makedirs(out_dir, exist_ok=True)
+    jobs = [(case, os.path.join(out_dir, case['name'] + '.wav'), args) for case in cases]
+    return dict(zip((case['name'] for case in cases), pool.map(render_case, jobs)))
+
+
+# == COMPARING == #
+
+def compare_case(job):
+    name, ref_path, out_path = job
+    if not os.path.exists(ref_path):
+        return {'name': name, 'error': 'no reference'}
+    ref = read_wav(ref_path)
+    out = read_wav(out_path)
+    if len(ref) != len(out):
+        return {'name': name, 'error': f'{len(out)} frames, the reference has {len(ref)}'}
+    diff = out.astype(np.int32) - ref
+    differing = np.flatnonzero(np.any(diff, axis=1))
+    return {
+        'name': name,
+        'frames': len(ref),
+        'differing': len(differing),
+        'first': int(differing[0]) if len(differing) else -1,
+        'max_abs': int(np.max(np.abs(diff))) if len(ref) else 0,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='golden audio renders of the plinky synth engine')
+    parser.add_argument('mode', choices=('record', 'check'))
+    parser.add_argument('cases', help='json list of cases')
+    parser.add_argument('refs', help='directory with the reference renders')
+    parser.add_argument('--renders', default='renders', help='where check writes its renders')
+    parser.add_argument('--flash', nargs=2, metavar=('INTERNAL', 'SPI'),
+                        help='flash images to start from (presets, patterns, samples), erased flash otherwise')
+    parser.add_argument('--channel', type=int, default=0, help='midi in channel of the flash image, 0-15')
+    parser.add_argument('--render-bin', default=RENDER_BIN, help='synth_render binary')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count())
+    args = parser.parse_args()
+
+    if not os.path.exists(args.render_bin):
+        sys.exit(f'{args.render_bin} not found, run make synth-render in sw/nocube_makefile')
+    with open(args.cases) as f:
+        cases = json.load(f)
+
+    with Pool(args.jobs) as pool:
+        out_dir = args.refs if args.mode == 'record' else args.renders
+        errors = render_all(cases, out_dir, pool, args)
+        if args.mode == 'record':
+            for name, error in errors.items():
+                print(f'{"FAIL" if error else "ok  "} {name:<30}{error or ""}'.rstrip())
+            sys.exit(1 if any(errors.values()) else 0)
+        jobs = [(c['name'], os.path.join(args.refs, c['name'] + '.wav'), os.path.join(args.renders, c['name'] + '.wav'))
+                for c in cases if not errors[c['name']]]
+        results = pool.map(compare_case, jobs)
+        replay_errors = pool.map(replay_case, [(case, args) for case in cases])
+    results += [{'name': name, 'error': error} for name, error in errors.items() if error]
+    results += [{'name': case['name'], 'error': error} for case, error in zip(cases, replay_errors) if error]
+
+    failures = 0
+    for result in results:
+        if 'error' in result:
+            failures += 1
+            print(f'FAIL {result["name"]:<30}{result["error"]}')
+            continue
+        if not result['differing']:
+            print(f'ok   {result["name"]:<30}{result["frames"]} frames identical')
+            continue
+        failures += 1
+        print(f'FAIL {result["name"]:<30}{result["differing"]} of {result["frames"]} frames differ, first at '
+              f'{result["first"] / SAMPLE_RATE:.4f} s, max {result["max_abs"]}')
+    print(f'{len(results) - failures}/{len(results)} passed')
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
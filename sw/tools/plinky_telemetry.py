@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+# subscribes to the telemetry stream of a plinky connected over usb and writes it out as columns, one row per record.
+# see bulk_protocol.c for the framing and analytics/telemetry.h for the record layout
+#
+#   python3 plinky_telemetry.py out.csv --sections voices,lfos,clock --interval 4 --seconds 10
+#
+# needs pyusb. Writes parquet instead of csv when the output ends in .parquet and pandas + pyarrow are installed
+
+import argparse
+import csv
+import struct
+import sys
+import time
+
+import usb.core
+import usb.util
+
+VID = 0xCAFE
+VENDOR_ITF = 2
+EP_OUT = 0x02
+EP_IN = 0x82
+
+MAGIC = bytes([0xF3, 0x0F, 0xAB, 0xCD])
+HEADER = struct.Struct('<4sBBHHH')
+BULK_ACK = 4
+BULK_SUBSCRIBE = 6
+BULK_TELEMETRY = 7
+
+NUM_VOICES = 8
+NUM_LFOS = 4
+NUM_GRAINS = 32
+PARAMS_PER_TICK = 8
+
+# bit, name, size, decoder(payload) -> list of (column, value)
+SECTIONS = [
+    (1 << 0, 'voices', NUM_VOICES * 10, lambda b: [
+        (f'voice{v}_{name}', val) for v in range(NUM_VOICES)
+        for name, val in zip(('env1_lvl', 'env2_lvl16', 'pitch'), struct.unpack_from('<fHi', b, v * 10))]),
+    (1 << 1, 'lfos', NUM_LFOS * 4, lambda b: [
+        (f'lfo{i}', val) for i, val in enumerate(struct.unpack(f'<{NUM_LFOS}i', b))]),
+    (1 << 2, 'params', 1 + PARAMS_PER_TICK * 4, lambda b: [
+        (f'param{b[0] + i}', val) for i, val in enumerate(struct.unpack_from(f'<{PARAMS_PER_TICK}i', b, 1))]),
+    (1 << 3, 'clock', 5, lambda b: list(zip(('clock_32nds_q21', 'seq_step'), struct.unpack('<IB', b)))),
+    (1 << 4, 'grains', NUM_GRAINS * 2, lambda b: [
+        (f'grain{i}_end', val) for i, val in enumerate(struct.unpack(f'<{NUM_GRAINS}h', b))]),
+    (1 << 5, 'ticks', 8, lambda b: list(zip(('tick_cycles_avg', 'tick_cycles_max'), struct.unpack('<II', b)))),
+    (1 << 6, 'preset', 5, lambda b: list(zip(('preset_id', 'preset_switch_ticks', 'preset_switch_max_ticks'),
+                                               struct.unpack('<BHH', b)))),
+]
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def frame(cmd, item, arg, payload=b''):
+    header = HEADER.pack(MAGIC, cmd, item, 0, arg, len(payload))
+    return header + payload + struct.pack('<H', crc16(header + payload))
+
+
+def parse_frames(buf):
+    """yields (cmd, item, arg, payload) for every complete frame in buf, removes them from buf"""
+    while True:
+        start = buf.find(MAGIC)
+        if start < 0:
+            del buf[:max(len(buf) - 3, 0)]
+            return
+        del buf[:start]
+        if len(buf) < HEADER.size:
+            return
+        _, cmd, item, _, arg, length = HEADER.unpack_from(buf)
+        end = HEADER.size + length + 2
+        if len(buf) < end:
+            return
+        (crc,) = struct.unpack_from('<H', buf, end - 2)
+        if crc != crc16(buf[:end - 2]):
+            del buf[:1]
+            continue
+        yield cmd, item, arg, bytes(buf[HEADER.size:end - 2])
+        del buf[:end]
+
+
+def parse_records(payload, state):
+    """decodes the records of a telemetry frame. state carries the tick unwrapping and the last param values"""
+    pos = 0
+    while pos + 3 <= len(payload):
+        tick16, mask = struct.unpack_from('<HB', payload, pos)
+        pos += 3
+        state['tick'] += (tick16 - state['tick']) & 0xFFFF
+        row = {'tick': state['tick']}
+        for bit, _, size, decode in SECTIONS:
+            if mask & bit:
+                row.update(decode(payload[pos:pos + size]))
+                pos += size
+        # params arrive a few at a time, keep the latest value of every param in each row
+        state['params'].update((k, v) for k, v in row.items() if k.startswith('param'))
+        row.update(state['params'])
+        yield row
+
+
+def main():
+    parser = argparse.ArgumentParser(description='record plinky telemetry')
+    parser.add_argument('output', help='.csv or .parquet file')
+    parser.add_argument('--sections', default='voices,lfos,clock,ticks',
+                        help='comma separated: ' + ','.join(s[1] for s in SECTIONS) + ' or all')
+    parser.add_argument('--interval', type=int, default=1, help='audio ticks per record (1-255)')
+    parser.add_argument('--seconds', type=float, default=10)
+    args = parser.parse_args()
+
+    names = args.sections.split(',')
+    mask = sum(bit for bit, name, _, _ in SECTIONS if name in names or 'all' in names)
+
+    dev = usb.core.find(idVendor=VID)
+    if dev is None:
+        sys.exit('plinky not found')
+    usb.util.claim_interface(dev, VENDOR_ITF)
+    dev.write(EP_OUT, frame(BULK_SUBSCRIBE, args.interval, mask))
+
+    rows = []
+    dropped = 0
+    state = {'tick': 0, 'params': {}}
+    buf = bytearray()
+    end_time = time.time() + args.seconds
+    try:
+        while time.time() < end_time:
+            try:
+                buf += dev.read(EP_IN, 4096, timeout=100)
+            except usb.core.USBTimeoutError:
+                continue
+            for cmd, _, arg, payload in parse_frames(buf):
+                if cmd == BULK_TELEMETRY:
+                    dropped += arg
+                    rows.extend(parse_records(payload, state))
+    finally:
+        dev.write(EP_OUT, frame(BULK_SUBSCRIBE, 0, 0))
+        usb.util.release_interface(dev, VENDOR_ITF)
+
+    columns = []
+    for row in rows:
+        columns.extend(k for k in row if k not in columns)
+    if args.output.endswith('.parquet'):
+        import pandas
+        pandas.DataFrame(rows, columns=columns).to_parquet(args.output)
+    else:
+        with open(args.output, 'w', newline='') as f:
+            writer = csv.DictWriter(f, columns)
+            writer.writeheader()
+            writer.writerows(rows)
+    print(f'{len(rows)} records, {dropped} dropped on the device')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+# records the inputs of a plinky connected over usb into a trace file, plays a trace back in place of the live inputs,
+# or prints what is in a trace. See analytics/input_trace.h for the format and bulk_protocol.c for the framing
+#
+#   python3 plinky_trace.py record glitch.trace --seconds 20
+#   python3 plinky_trace.py replay glitch.trace      plays the trace on the plinky and checks the hashes it recorded
+#   python3 plinky_trace.py dump glitch.trace --ticks
+#   synth_render internal.bin spi.bin --replay glitch.trace out.raw     the same check on the host, see synth_render.c
+#
+# a replay starts from the same reset as the recording: the recorded preset, rand seed, stopped sequencer and cleared
+# effects. Start recordings from silence, then the replay matches on the unit that recorded it. Needs pyusb
+
+import argparse
+import struct
+import sys
+import time
+
+import usb.core
+import usb.util
+
+from plinky_telemetry import VID, VENDOR_ITF, EP_OUT, EP_IN, frame, parse_frames
+
+BULK_ACK = 4
+BULK_NAK = 5
+BULK_TRACE = 8
+BULK_TRACE_DATA = 9
+BULK_TRACE_STATUS = 10
+BULK_ERR_FULL = 6
+CHUNK_SIZE = 256
+
+TRACE_OFF, TRACE_RECORD, TRACE_REPLAY = range(3)
+ERRORS = ['ok', 'overflow: the host did not keep up', 'underrun: the host did not keep up',
+          'corrupt: the trace ends inside a record', 'broken: a tick did not run to the end', 'diverged']
+
+HEADER = struct.Struct('<IBBHI36H')
+STATUS = struct.Struct('<BBHIIII')
+MAGIC = 0x52544c50
+US_PER_TICK = 2048
+
+TR_TIME, TR_TOUCH, TR_ADC, TR_MIDI, TR_ENCODER, TR_ACCEL, TR_CV_CLOCK, TR_HASH = (1 << i for i in range(8))
+ADC_NAMES = ['pitch', 'gate', 'x', 'y', 'a', 'b', 'knob_b', 'knob_a']
+
+
+# == DEVICE == #
+
+class Device:
+    def __init__(self):
+        self.dev = usb.core.find(idVendor=VID)
+        if self.dev is None:
+            sys.exit('plinky not found')
+        usb.util.claim_interface(self.dev, VENDOR_ITF)
+        self.buf = bytearray()
+        self.trace = bytearray()  # recorded bytes, they can arrive at any time
+
+    def close(self):
+        usb.util.release_interface(self.dev, VENDOR_ITF)
+
+    def poll(self, timeout=100):
+        """reads what the device has sent, returns the frames other than recorded trace data"""
+        try:
+            self.buf += self.dev.read(EP_IN, 4096, timeout=timeout)
+        except usb.core.USBTimeoutError:
+            return []
+        frames = []
+        for cmd, item, arg, payload in parse_frames(self.buf):
+            if cmd == BULK_TRACE_DATA:
+                self.trace += payload
+            else:
+                frames.append((cmd, item, arg, payload))
+        return frames
+
+    def request(self, cmd, item=0, payload=b'', answers=(BULK_ACK, BULK_NAK)):
+        self.dev.write(EP_OUT, frame(cmd, item, 0, payload))
+        deadline = time.time() + 2
+        while time.time() < deadline:
+            for answer in self.poll():
+                if answer[0] in answers:
+                    return answer
+        sys.exit('no answer from the plinky')
+
+    def status(self):
+        payload = self.request(BULK_TRACE_STATUS, answers=(BULK_TRACE_STATUS,))[3]
+        mode, error, hashes, ticks, size, diverged, state_hash = STATUS.unpack_from(payload)
+        return {'mode': mode, 'error': error, 'hashes_checked': hashes, 'ticks': ticks, 'bytes': size,
+                'first_diverged_tick': diverged, 'hash': state_hash}
+
+
+def print_status(status):
+    print(f'{status["ticks"]} ticks, {status["hashes_checked"]} hashes checked, {ERRORS[status["error"]]}', end='')
+    if status['error'] == ERRORS.index('diverged'):
+        print(f' at tick {status["first_diverged_tick"]}', end='')
+    print()
+
+
+def record(args):
+    dev = Device()
+    try:
+        if dev.request(BULK_TRACE, TRACE_RECORD)[0] != BULK_ACK:
+            sys.exit('could not start the recording')
+        print(f'recording for {args.seconds} seconds')
+        end_time = time.time() + args.seconds
+        while time.time() < end_time:
+            dev.poll()
+        dev.request(BULK_TRACE, TRACE_OFF)
+        # the device keeps sending until its ring is empty
+        size = -1
+        while size != len(dev.trace):
+            size = len(dev.trace)
+            dev.poll(timeout=200)
+        status = dev.status()
+        if status['bytes'] != len(dev.trace):
+            print(f'lost {status["bytes"] - len(dev.trace)} bytes on the way')
+    finally:
+        dev.close()
+    with open(args.trace, 'wb') as f:
+        f.write(dev.trace)
+    print(f'{len(dev.trace)} bytes')
+    print_status(status)
+    sys.exit(1 if status['error'] else 0)
+
+
+def replay(args):
+    with open(args.trace, 'rb') as f:
+        data = f.read()
+    header, records = data[:HEADER.size], data[HEADER.size:]
+    dev = Device()
+    try:
+        if dev.request(BULK_TRACE, TRACE_REPLAY, header)[0] != BULK_ACK:
+            sys.exit('the plinky did not accept the trace')
+        pos = 0
+        while True:
+            chunk = records[pos:pos + CHUNK_SIZE]
+            cmd, _, arg, _ = dev.request(BULK_TRACE_DATA, payload=chunk)
+            if cmd == BULK_NAK and arg == BULK_ERR_FULL:
+                time.sleep(0.005)
+                continue
+            # the replay stopped early
+            if cmd == BULK_NAK or not chunk:
+                break
+            pos += len(chunk)
+        status = dev.status()
+        while status['mode'] == TRACE_REPLAY:
+            time.sleep(0.05)
+            status = dev.status()
+    finally:
+        dev.close()
+    print_status(status)
+    sys.exit(1 if status['error'] else 0)
+
+
+# == DUMP == #
+
+def parse_trace(data):
+    """returns the header fields and a list of per tick dicts"""
+    magic, version, preset_id, hash_ticks, seed, *floor = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit('not a plinky trace')
+    header = {'version': version, 'preset': preset_id, 'hash_ticks': hash_ticks, 'seed': seed}
+    ticks = []
+    pos = HEADER.size
+
+    def take(fmt):
+        nonlocal pos
+        values = struct.unpack_from('<' + fmt, data, pos)
+        pos += struct.calcsize('<' + fmt)
+        return values
+
+    while pos < len(data):
+        try:
+            (flags,) = take('B')
+            tick = {'flags': flags}
+            if flags & TR_TIME:
+                (tick['time_dev'],) = take('h')
+            if flags & TR_TOUCH:
+                (n,) = take('B')
+                tick['touch'] = take(f'{n}H')
+            if flags & TR_ADC:
+                (mask,) = take('B')
+                tick['adc'] = {ADC_NAMES[c]: take('H')[0] for c in range(8) if mask & (1 << c)}
+            if flags & TR_MIDI:
+                (n,) = take('B')
+                tick['midi'] = [take('BBBH') for _ in range(n)]
+            if flags & TR_ENCODER:
+                tick['encoder'] = take('bBf')
+            if flags & TR_ACCEL:
+                tick['accel'] = take('3h')
+            if flags & TR_CV_CLOCK:
+                (tick['cv_age'],) = take('H')
+            if flags & TR_HASH:
+                (tick['hash'],) = take('I')
+        except struct.error:
+            print(f'trace ends inside a record at byte {pos}')
+            break
+        ticks.append(tick)
+    return header, ticks
+
+
+def dump(args):
+    with open(args.trace, 'rb') as f:
+        data = f.read()
+    header, ticks = parse_trace(data)
+    print(f'version {header["version"]}, preset {header["preset"]}, seed {header["seed"]:#010x}, '
+          f'hash every {header["hash_ticks"]} ticks')
+    for i, tick in enumerate(ticks if args.ticks else []):
+        parts = [f'{k}={v}' for k, v in tick.items() if k != 'flags']
+        print(f'{i:8d}  ' + '  '.join(parts))
+    seconds = len(ticks) * US_PER_TICK / 1e6
+    print(f'{len(ticks)} ticks, {seconds:.1f} s, {len(data)} bytes, {len(data) / max(len(ticks), 1):.1f} bytes/tick')
+    for name, key in (('touch', 'touch'), ('adc', 'adc'), ('midi', 'midi'), ('encoder', 'encoder'),
+                      ('accel', 'accel'), ('cv clock', 'cv_age'), ('hash', 'hash')):
+        print(f'  {name:<10}{sum(key in t for t in ticks):>8} ticks')
+    late = [t['time_dev'] for t in ticks if abs(t.get('time_dev', 0)) > US_PER_TICK // 4]
+    if late:
+        print(f'  {len(late)} ticks started more than a quarter tick off, worst {max(late, key=abs):+d} us')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='record, replay and inspect plinky input traces')
+    parser.add_argument('mode', choices=('record', 'replay', 'dump'))
+    parser.add_argument('trace')
+    parser.add_argument('--seconds', type=float, default=10, help='length of a recording')
+    parser.add_argument('--ticks', action='store_true', help='dump: print every tick')
+    args = parser.parse_args()
+    {'record': record, 'replay': replay, 'dump': dump}[args.mode](args)
+
+
+if __name__ == '__main__':
+    main()
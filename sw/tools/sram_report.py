@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# prints how the two srams of a plinky build are used: the linker's RAM region (.ramfunc, .fastdata, .data, .bss,
+# heap and stack) next to the delay and reverb buffers the firmware places by hand, see STM32L476VGTX_FLASH.ld
+#
+#   python3 sram_report.py RELEASE/plinkyblack.elf --nm arm-none-eabi-nm
+#
+# run by the nocube makefile after every link
+
+import argparse
+import subprocess
+
+SRAM1 = (0x20000000, 96 * 1024)
+SRAM2 = (0x10000000, 32 * 1024)
+
+
+def read_symbols(nm, elf):
+    """returns {name: (address, size)} for every symbol in the elf"""
+    out = subprocess.run([nm, '-S', elf], capture_output=True, text=True, check=True).stdout
+    symbols = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            symbols[fields[3]] = (int(fields[0], 16), int(fields[1], 16))
+        elif len(fields) == 3:
+            symbols[fields[2]] = (int(fields[0], 16), 0)
+    return symbols
+
+
+def in_sram(addr):
+    return any(start <= addr < start + size for start, size in (SRAM1, SRAM2))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='sram usage of a plinky build')
+    parser.add_argument('elf')
+    parser.add_argument('--nm', default='arm-none-eabi-nm')
+    parser.add_argument('--top', type=int, default=10, help='number of largest sram symbols to list')
+    args = parser.parse_args()
+
+    symbols = read_symbols(args.nm, args.elf)
+
+    def addr(name):
+        return symbols[name][0]
+
+    def span(start, end):
+        return addr(end) - addr(start)
+
+    ramfunc = span('_sramfunc', '_eramfunc')
+    fastdata = span('_sfastdata', '_efastdata')
+    heap_stack = addr('_Min_Heap_Size') + addr('_Min_Stack_Size')
+    ram_used = addr('_ebss') - SRAM1[0] + heap_stack
+    ram_size = addr('_sdelay_ram') - SRAM1[0]
+    delay = span('_sdelay_ram', '_edelay_ram')
+    reverb = span('_sreverb_ram', '_ereverb_ram')
+
+    rows = [
+        ('SRAM1', SRAM1[1], ''),
+        ('  .ramfunc', ramfunc, 'hot path code'),
+        ('  .fastdata', fastdata, 'hot path tables'),
+        ('  .data', span('_sdata', '_edata') - ramfunc - fastdata, ''),
+        ('  .bss', span('_sbss', '_ebss'), ''),
+        ('  heap + stack', heap_stack, 'minimum'),
+        ('  free', ram_size - ram_used, f'of {ram_size} in the RAM region'),
+        ('  delay line', delay, f'fixed at 0x{addr("_sdelay_ram"):08x}'),
+        ('SRAM2', SRAM2[1], ''),
+        ('  reverb', reverb, f'fixed at 0x{addr("_sreverb_ram"):08x}'),
+        ('  free', SRAM2[1] - reverb, ''),
+    ]
+    for name, size, note in rows:
+        print(f'{name:<16}{size:>8}  {note}'.rstrip())
+
+    largest = sorted(((size, name) for name, (a, size) in symbols.items() if size and in_sram(a)), reverse=True)
+    print('largest sram symbols:')
+    for size, name in largest[:args.top]:
+        print(f'  {name:<30}{size:>8}')
+
+
+if __name__ == '__main__':
+    main()
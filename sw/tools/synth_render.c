@@ -0,0 +1,452 @@
+// offline render of the synth engine, for golden tests (see plinky_golden.py) and input traces (see input_trace.h).
+// Builds the firmware's synth, parameter, sequencer, ram, midi, touch scan, adc, accelerometer and input trace code for
+// the host on top of the flash model in flash_sim.c, and runs plinky_codec_tick() without the ui in virtual time
+//
+//   make synth-render      (from sw/nocube_makefile)
+//   synth_render internal.bin spi.bin preset seed frames out.raw [out.trace] < events
+//   synth_render internal.bin spi.bin --replay in.trace out.raw
+//
+// events are midi messages, one per line as "micros status d1 d2", micros counted from the start of the render. They
+// arrive through the usb midi path at their time, the same way a host would send them. The render starts from the
+// flash images (erased ones when the files don't exist) with the preset loaded and rand() seeded, nothing touched,
+// no cv plugged in and the knobs centred. out.raw gets the stereo s16 output frames, little endian. With out.trace the
+// render records its inputs, from the reset a trace starts with
+//
+// --replay plays a trace recorded on a plinky (plinky_trace.py record) or by a render, and checks it against the hashes
+// it recorded: exit status 0 when they all match. The flash images have to hold what the unit had, its presets,
+// patterns, samples, settings and calibration. The pad actions, shift states and encoder belong to the ui, which the
+// host build leaves out, as well as the cv sense pins: a trace that uses them diverges, the same as audio input does
+//
+// the same inputs give the same bits on every run, on every host that builds it with the same compiler and libc
+
+#include "flash_sim.h"
+#include "gfx/gfx.h"
+#include "hardware/accelerometer.h"
+#include "hardware/adc_dac.h"
+#include "hardware/codec.h"
+#include "hardware/encoder.h"
+#include "hardware/expander.h"
+#include "hardware/flash.h"
+#include "hardware/i2c_bus.h"
+#include "hardware/leds.h"
+#include "hardware/midi.h"
+#include "hardware/ram.h"
+#include "hardware/spi.h"
+#include "hardware/touchstrips.h"
+#include "analytics/input_trace.h"
+#include "plinky.h"
+#include "synth/audio.h"
+#include "synth/audio_tools.h"
+#include "synth/params.h"
+#include "synth/sequencer.h"
+#include "synth/strings.h"
+#include "synth/synth.h"
+#include "synth/time.h"
+#include "ui/oled_viz.h"
+#include "ui/pad_actions.h"
+#include "ui/shift_states.h"
+
+#define US_PER_TICK (SAMPLES_PER_TICK * 1000000 / SAMPLE_RATE)
+#define UNTOUCHED_RAW 1000 // tsc count of a strip nobody touches, it only has to stay the same
+#define ADC_CHANS 8        // see adc_dac.c
+#define ADC_SAMPLES 8
+#define USB_MIDI_EP_OUT 0x01 // EPNUM_MIDI in usb_descriptors.c
+#define MAX_EVENTS 65536
+
+typedef struct Event {
+	u32 time;
+	u8 msg[3];
+} Event;
+
+static Event events[MAX_EVENTS];
+static u32 num_events;
+static u32 next_event;
+static u32 now_us; // virtual micros()
+static u32 tick_start_us;
+
+// == HARDWARE STAND-INS == //
+
+SPI_HandleTypeDef hspi2;
+UART_HandleTypeDef huart3;
+I2C_HandleTypeDef hi2c2;
+TSC_HandleTypeDef htsc;
+ADC_HandleTypeDef hadc1;
+DAC_HandleTypeDef hdac1;
+TIM_HandleTypeDef htim6;
+static TIM_TypeDef cv_timer; // the cv outputs write its compare registers
+TIM_HandleTypeDef htim3 = {.Instance = &cv_timer};
+u8 leds[NUM_TOUCHSTRIPS][PADS_PER_STRIP];
+UIMode ui_mode = UI_DEFAULT;
+ShiftState shift_state = SS_NONE;
+CalibMode calib_mode = CALIB_NONE;
+volatile bool encoder_pressed;
+VIZ_TAP(scope_tap, 256);
+
+extern u16 adc_buffer[ADC_CHANS * ADC_SAMPLES];
+
+// the firmware puts the effect buffers at fixed sram addresses
+static s16 reverb_buf[RV_SIZE_MASK + 1];
+static s16 delay_buf[DL_SIZE_MASK + 1];
+
+u32 micros(void) {
+	return now_us;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+	return GPIO_PIN_SET; // the cv sense pins: nothing plugged in
+}
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_DAC_Start(DAC_HandleTypeDef* hdac, uint32_t Channel) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_DAC_SetValue(DAC_HandleTypeDef* hdac, uint32_t Channel, uint32_t Alignment, uint32_t Data) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t Channel) {
+	return HAL_OK;
+}
+
+// touchstrips: every group completes its acquisition within a tick, at the count of an untouched strip
+HAL_StatusTypeDef HAL_TSC_Start(TSC_HandleTypeDef* htsc) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_TSC_Stop(TSC_HandleTypeDef* htsc) {
+	return HAL_OK;
+}
+TSC_GroupStatusTypeDef HAL_TSC_GroupGetStatus(TSC_HandleTypeDef* htsc, uint32_t gx_index) {
+	return TSC_GROUP_COMPLETED;
+}
+uint32_t HAL_TSC_GroupGetValue(TSC_HandleTypeDef* htsc, uint32_t gx_index) {
+	return UNTOUCHED_RAW;
+}
+HAL_StatusTypeDef HAL_TSC_IOConfig(TSC_HandleTypeDef* htsc, TSC_IOConfigTypeDef* config) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_TSC_IODischarge(TSC_HandleTypeDef* htsc, FunctionalState choice) {
+	return HAL_OK;
+}
+
+// accelerometer: lying still, accel_read() never runs
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t* pData, uint16_t Size, uint32_t Timeout) {
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t* pData, uint16_t Size, uint32_t Timeout) {
+	return HAL_OK;
+}
+bool i2c_bus_try_acquire(I2cClient client) {
+	return true;
+}
+void i2c_bus_acquire(I2cClient client) {
+}
+void i2c_bus_release(void) {
+}
+
+u16 get_expander_lfo_data(u8 lfo_id) {
+	return 0;
+}
+void set_expander_lfo_data(u8 lfo_id, s32 lfo_val) {
+}
+void codec_update_volume(void) {
+}
+bool enc_recently_used(void) {
+	return false;
+}
+void clear_last_encoder_use(void) {
+}
+bool mod_action_pressed(void) {
+	return false;
+}
+
+// ui
+void handle_pad_actions(u8 strip_id, Touch* strip_cur) {
+}
+void shift_set_state(ShiftState new_state) {
+}
+void shift_release_state(void) {
+}
+void shift_hold_state(void) {
+}
+void leds_swap(void) {
+}
+u8 gfx_text_color;
+static u8 oled[OLED_WIDTH * OLED_HEIGHT / 8];
+u8* oled_buffer(void) {
+	return oled;
+}
+void oled_clear(void) {
+}
+void oled_flip(void) {
+}
+void flash_message(Font fnt, const char* msg, const char* submsg) {
+}
+void draw_logo(void) {
+}
+void put_pixel(int x, int y, int c) {
+}
+void vline(int x1, int y1, int y2, int c) {
+}
+void hline(int x1, int y1, int x2, int c) {
+}
+void fill_rectangle(int x1, int y1, int x2, int y2) {
+}
+void half_rectangle(int x1, int y1, int x2, int y2) {
+}
+void inverted_rectangle(int x1, int y1, int x2, int y2) {
+}
+int draw_icon(int x, int y, unsigned char c, int textcol) {
+	return x;
+}
+int str_width(Font f, const char* buf) {
+	return 0;
+}
+int draw_str(int x, int y, Font f, const char* buf) {
+	return x;
+}
+int draw_str_ctr(int y, Font f, const char* buf) {
+	return 0;
+}
+int fdraw_str(int x, int y, Font f, const char* fmt, ...) {
+	return x;
+}
+int drawstr_noright(int x, int y, Font f, const char* buf) {
+	return x;
+}
+
+// == RENDER == //
+
+static bool read_events(FILE* f) {
+	u32 time, status, d1, d2;
+	int n;
+	while ((n = fscanf(f, "%u %u %u %u", &time, &status, &d1, &d2)) == 4) {
+		if (num_events == MAX_EVENTS) {
+			fprintf(stderr, "more than %u events\n", MAX_EVENTS);
+			return false;
+		}
+		events[num_events++] = (Event){time, {status, d1, d2}};
+	}
+	if (n != EOF) {
+		fprintf(stderr, "bad event on line %u\n", num_events + 1);
+		return false;
+	}
+	// arrival order
+	for (u32 i = 1; i < num_events; ++i)
+		for (u32 j = i; j > 0 && events[j - 1].time > events[j].time; --j) {
+			Event tmp = events[j];
+			events[j] = events[j - 1];
+			events[j - 1] = tmp;
+		}
+	return true;
+}
+
+// every event that arrived before the tick starts comes in through a usb transfer at its time
+static void deliver_events(void) {
+	while (next_event < num_events && events[next_event].time <= tick_start_us) {
+		now_us = events[next_event].time;
+		midi_usb_xfer_isr(USB_MIDI_EP_OUT);
+		midi_usb_rx();
+	}
+	now_us = tick_start_us;
+}
+
+// a unit has been on for a while when it plays: the smoothed inputs start out settled on the values of the first tick
+static void settle_inputs(void) {
+	for (u16 i = 0; i < 2000; ++i) {
+		adc_update_inputs();
+		accel_tick();
+	}
+}
+
+// plinky_codec_tick() without the ui, the pad actions and the encoder that run when a touch frame completes
+static void codec_tick(u32 tick, u32* audio_out, u32* audio_in) {
+	trace_tick_start();
+	read_touchstrips();
+	if (!tick)
+		settle_inputs();
+	audio_pre(audio_out, audio_in);
+	update_preset_ram();
+	process_midi();
+	clock_tick();
+	seq_tick();
+	generate_string_touches();
+	params_tick();
+	update_sample_ram(false);
+	update_pattern_ram();
+	handle_synth_voices(audio_out);
+	spi_tick();
+	// the grain reads for the next tick, on the chip they finish well within this one
+	while (spi_state)
+		alex_dma_done();
+	audio_post(audio_out, audio_in);
+	trace_tick_end(audio_out);
+}
+
+static bool init_render(const char* internal_path, const char* spi_path, u8 preset_id) {
+	if (preset_id >= NUM_PRESETS || !flash_sim_open(internal_path, spi_path))
+		return false;
+	reverb_ram_buf = reverb_buf;
+	delay_ram_buf = delay_buf;
+	init_spi();
+	init_touchstrips();
+	init_adc_dac();
+	init_flash();
+	init_ram();
+	init_presets();
+	init_audio();
+	flash_read_calib();
+	// knobs centred and no cv plugged in: every adc channel reads its calibrated zero
+	for (u8 i = 0; i < ADC_CHANS * ADC_SAMPLES; ++i)
+		adc_buffer[i] = adc_dac_calib_ptr()[i % ADC_CHANS].bias;
+	load_preset(preset_id, true);
+	// the touch pointers get set at the first touch frame swap, on the chip the ticks before read address 0 (flash)
+	params_update_touch_pointers();
+	return true;
+}
+
+static void save_trace(FILE* f) {
+	u8 chunk[256];
+	u16 len;
+	while ((len = trace_read(chunk, sizeof(chunk))))
+		fwrite(chunk, 1, len, f);
+}
+
+static int render(int argc, char** argv) {
+	u8 preset_id = atoi(argv[3]);
+	u32 seed = strtoul(argv[4], 0, 0);
+	u32 frames = strtoul(argv[5], 0, 0);
+	FILE* out = fopen(argv[6], "wb");
+	FILE* trace = argc > 7 ? fopen(argv[7], "wb") : 0;
+	if (!out || (argc > 7 && !trace)) {
+		perror(out ? argv[7] : argv[6]);
+		return 1;
+	}
+	if (!read_events(stdin) || !init_render(argv[1], argv[2], preset_id))
+		return 1;
+	srand(seed);
+	if (trace)
+		trace_start(TRACE_RECORD, 0);
+
+	static u32 audio_out[SAMPLES_PER_TICK];
+	static u32 audio_in[SAMPLES_PER_TICK];
+	for (u32 tick = 0; tick * SAMPLES_PER_TICK < frames; ++tick) {
+		tick_start_us = tick * US_PER_TICK;
+		deliver_events();
+		memset(audio_in, 0, sizeof(audio_in));
+		codec_tick(tick, audio_out, audio_in);
+		fwrite(audio_out, sizeof(u32), mini(SAMPLES_PER_TICK, frames - tick * SAMPLES_PER_TICK), out);
+		if (trace)
+			save_trace(trace);
+	}
+	fclose(out);
+	if (trace) {
+		trace_start(TRACE_OFF, 0);
+		save_trace(trace);
+		fclose(trace);
+	}
+	flash_sim_close();
+	return 0;
+}
+
+static int replay(char** argv) {
+	static const char* errors[] = {"ok", "overflow", "underrun", "corrupt", "broken", "diverged"};
+	FILE* trace = fopen(argv[4], "rb");
+	FILE* out = fopen(argv[5], "wb");
+	if (!trace || !out) {
+		perror(trace ? argv[5] : argv[4]);
+		return 1;
+	}
+	TraceHeader header;
+	if (fread(&header, sizeof(header), 1, trace) != 1 || header.magic != TRACE_MAGIC) {
+		fprintf(stderr, "%s is not a trace\n", argv[4]);
+		return 1;
+	}
+	if (!init_render(argv[1], argv[2], header.preset_id))
+		return 1;
+	if (!trace_start(TRACE_REPLAY, &header)) {
+		fprintf(stderr, "%s: trace version %d, this build plays %d\n", argv[4], header.version, TRACE_VERSION);
+		return 1;
+	}
+
+	static u32 audio_out[SAMPLES_PER_TICK];
+	static u32 audio_in[SAMPLES_PER_TICK];
+	u8 chunk[256];
+	u16 len = 0;
+	bool eof = false;
+	for (u32 tick = 0;; ++tick) {
+		// the host side of the bulk transfers: keep the ring topped up, then mark the end
+		while (!eof) {
+			if (!len && !(len = fread(chunk, 1, sizeof(chunk), trace)))
+				eof = trace_write(chunk, 0);
+			else if (trace_write(chunk, len))
+				len = 0;
+			else
+				break;
+		}
+		tick_start_us = now_us = tick * US_PER_TICK;
+		memset(audio_in, 0, sizeof(audio_in));
+		codec_tick(tick, audio_out, audio_in);
+		// the tick that finds the trace at its end plays live
+		if (trace_mode != TRACE_REPLAY)
+			break;
+		fwrite(audio_out, sizeof(u32), SAMPLES_PER_TICK, out);
+	}
+	fclose(out);
+	fclose(trace);
+	flash_sim_close();
+
+	TraceStatus status;
+	trace_get_status(&status);
+	if (status.error == TRACE_ERR_DIVERGED)
+		printf("%u ticks, %u hashes checked, diverged at tick %u\n", status.ticks, status.hashes_checked,
+		       status.first_diverged_tick);
+	else
+		printf("%u ticks, %u hashes checked, %s\n", status.ticks, status.hashes_checked, errors[status.error]);
+	return status.error ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc == 6 && !strcmp(argv[3], "--replay"))
+		return replay(argv);
+	if (argc == 7 || argc == 8)
+		return render(argc, argv);
+	fprintf(stderr, "usage: synth_render internal.bin spi.bin preset seed frames out.raw [out.trace] < events\n"
+	                "       synth_render internal.bin spi.bin --replay in.trace out.raw\n");
+	return 2;
+}
+
+// == USB MIDI STAND-IN == //
+
+// last: these need tinyusb's bool, the plinky headers above declare their own
+#include "tusb.h"
+
+// the events that are due, read out by midi_usb_rx()
+bool tud_midi_n_mounted(uint8_t itf) {
+	return false;
+}
+uint32_t tud_midi_n_available(uint8_t itf, uint8_t cable_num) {
+	return next_event < num_events && events[next_event].time <= now_us;
+}
+bool tud_midi_n_packet_read(uint8_t itf, uint8_t packet[4]) {
+	if (!tud_midi_n_available(itf, 0))
+		return false;
+	Event* e = &events[next_event++];
+	packet[0] = e->msg[0] >> 4;
+	memcpy(packet + 1, e->msg, 3);
+	return true;
+}
+bool tud_midi_n_packet_write(uint8_t itf, uint8_t const packet[4]) {
+	return false;
+}
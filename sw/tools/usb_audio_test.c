@@ -0,0 +1,181 @@
+// host test of the usb audio stream (usb/usb_audio.c) against a software stand-in for the usb host and the codec
+//
+//   make usb-audio-test      (from sw/nocube_makefile)
+//
+// the firmware's usb_audio.c is built as it is. Around it runs a simulation in virtual time:
+// - codec: the dma interrupt fires every 64 frames of the codec clock, which drifts from the usb clock by a few hundred
+//   ppm. Every tick takes a random time to compute and then hands its frames to usb_audio_capture(). The frames carry
+//   their own index, so the host can tell a torn or skipped frame from a good one
+// - usb host: polls the iso in endpoint once per 1ms frame. A packet the firmware submitted before the frame goes out
+//   in it, then the completion interrupt reloads the endpoint. The usb interrupt keeps its reset priority 0, above the
+//   sai dma interrupt (1) that runs the tick, so it preempts a running tick and sees only the ticks that finished
+// - main loop: opens the stream, with random stalls in between
+//
+// every scenario checks that the host receives every frame exactly once, in order, with no empty packets once the
+// stream runs, and reports the range of the lag between the codec and the host
+
+#include "usb/usb_audio.c"
+
+#define NS_PER_USB_FRAME 1000000ull
+#define NS_PER_TICK (1000000000ull * SAMPLES_PER_TICK / SAMPLE_RATE)
+#define TEST_SECONDS 60
+
+typedef struct Scenario {
+	const char* name;
+	s32 codec_ppm; // codec clock error against the usb clock
+	u32 min_tick_us, max_tick_us;
+	u32 max_stall_us; // main loop
+	u32 host_gap_ms;  // the host stops polling once for this long
+	u32 max_restarts; // discontinuities allowed
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"nominal", 0, 200, 800, 2000, 0, 0},
+    {"long ticks", 0, 1500, 1950, 2000, 0, 0},
+    {"fast codec", 1000, 200, 1950, 2000, 0, 0},
+    {"slow codec", -1000, 200, 1950, 2000, 0, 0},
+    {"main loop stalls", 300, 200, 1950, 50000, 0, 0},
+    {"host gap", -300, 200, 1950, 2000, 30, 1},
+};
+
+// == USB STAND-IN == //
+
+static u8 sent[CFG_TUD_AUDIO_EPSIZE_IN];
+static u16 sent_len;
+static bool sent_pending;
+
+uint16_t tud_audio_n_write_ep_in_buffer(uint8_t itf, const void* data, uint16_t len) {
+	memcpy(sent, data, len);
+	sent_len = len;
+	sent_pending = true;
+	return len;
+}
+
+bool dcd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t* buffer, uint16_t total_bytes) {
+	memcpy(sent, buffer, total_bytes);
+	sent_len = total_bytes;
+	sent_pending = true;
+	return true;
+}
+
+bool tud_audio_buffer_and_schedule_control_xfer(uint8_t rhport, tusb_control_request_t const* p_request, void* data,
+                                                uint16_t len) {
+	return true;
+}
+
+// == SIMULATION == //
+
+static u32 lcg = 1;
+static u32 rnd(u32 lo, u32 hi) {
+	lcg = lcg * 1664525 + 1013904223;
+	return lo + (lcg >> 8) % (hi - lo + 1);
+}
+
+typedef struct Result {
+	u32 frames;
+	u32 restarts;  // received frames that don't follow the one before
+	u32 empty;     // empty packets after the first frame
+	u32 missed;    // usb frames without a packet
+	s32 min_lag, max_lag;
+	u32 max_packet;
+} Result;
+
+// codec: the next tick to finish and when it does
+static u32 tick;
+static u64 tick_ns, tick_end;
+static const Scenario* sc;
+
+static void codec_until(u64 t) {
+	static u32 frames[SAMPLES_PER_TICK];
+	while (tick_end <= t) {
+		for (u32 i = 0; i < SAMPLES_PER_TICK; ++i)
+			frames[i] = tick * SAMPLES_PER_TICK + i;
+		usb_audio_capture(frames);
+		tick++;
+		tick_end = tick * tick_ns + rnd(sc->min_tick_us, sc->max_tick_us) * 1000ull;
+	}
+}
+
+static bool run_scenario(const Scenario* scenario, Result* res) {
+	sc = scenario;
+	memset(res, 0, sizeof(Result));
+	res->min_lag = RING_FRAMES;
+	stream_ep = 0;
+	lcg = 1;
+	tick = 0;
+	tick_ns = NS_PER_TICK * (1000000 + sc->codec_ppm) / 1000000;
+	tick_end = rnd(sc->min_tick_us, sc->max_tick_us) * 1000ull;
+
+	u64 end_ns = TEST_SECONDS * 1000000000ull;
+	u64 open_ns = 100000000ull + rnd(0, 1000000);
+	u64 gap_ns = 20000000000ull;
+	u64 main_ns = 0;
+	u64 ready_ns = 0; // when the submitted packet is in the endpoint
+	bool opened = false;
+	bool started = false;
+	u32 expect = 0;
+	sent_pending = false;
+
+	for (u64 usb_ns = NS_PER_USB_FRAME; usb_ns < end_ns; usb_ns += NS_PER_USB_FRAME) {
+		// main loop: opens the stream once it gets to it
+		while (main_ns < usb_ns) {
+			codec_until(main_ns);
+			if (!opened && main_ns >= open_ns) {
+				tud_audio_set_itf_cb(0, 0);
+				tud_audio_tx_done_pre_load_cb(0, 0, 0x83, 1);
+				ready_ns = main_ns;
+				opened = true;
+			}
+			main_ns += rnd(10, sc->max_stall_us) * 1000ull;
+		}
+		codec_until(usb_ns);
+		bool polling = usb_ns < gap_ns || usb_ns >= gap_ns + sc->host_gap_ms * NS_PER_USB_FRAME;
+		if (!opened || !polling)
+			continue;
+
+		// host: takes the packet of this frame, if the firmware loaded one in time
+		if (!sent_pending || ready_ns > usb_ns) {
+			res->missed += started;
+			continue;
+		}
+		sent_pending = false;
+		u32 num_frames = sent_len / sizeof(u32);
+		res->max_packet = maxi(res->max_packet, num_frames);
+		res->empty += started && !num_frames;
+		for (u32 i = 0; i < num_frames; ++i) {
+			u32 frame;
+			memcpy(&frame, sent + i * sizeof(u32), sizeof(u32));
+			res->restarts += started && frame != expect;
+			expect = frame + 1;
+			started = true;
+			res->frames++;
+		}
+
+		// completion interrupt at the end of the transaction
+		u64 irq_ns = usb_ns + 100000;
+		codec_until(irq_ns);
+		usb_audio_xfer_isr(0, 0x83);
+		ready_ns = irq_ns;
+		if (started) {
+			s32 lag = write_frame - read_frame;
+			res->min_lag = mini(res->min_lag, lag);
+			res->max_lag = maxi(res->max_lag, lag);
+		}
+	}
+	return res->frames && res->restarts <= sc->max_restarts && !res->empty && res->min_lag >= 0 &&
+	       res->max_lag <= RING_FRAMES - SAMPLES_PER_TICK;
+}
+
+int main(void) {
+	u32 failed = 0;
+	printf("%-18s %9s %8s %6s %7s %9s %6s  result\n", "scenario", "frames", "restarts", "empty", "missed", "lag",
+	       "packet");
+	for (u32 i = 0; i < sizeof(scenarios) / sizeof(Scenario); ++i) {
+		Result res;
+		bool ok = run_scenario(&scenarios[i], &res);
+		printf("%-18s %9u %8u %6u %7u %4d..%-4d %6u  %s\n", scenarios[i].name, res.frames, res.restarts, res.empty,
+		       res.missed, res.min_lag, res.max_lag, res.max_packet, ok ? "ok" : "FAIL");
+		failed += !ok;
+	}
+	return failed ? 1 : 0;
+}